@@ -22,6 +22,11 @@ You should have received a copy of the GNU Lesser General Public License
 along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 */
 
+/* for memmem() when built as C */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -32,15 +37,21 @@ along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 #include <errno.h>
 #include <signal.h>
 #include <sys/time.h>
+#include <poll.h>
 
 #include "hokuyo.h"
 #include "serial_device.h"
+#include "serial_reactor.h"
+#include "scip.h"
 #include "message_utils.h"
 
 #define MAXSTR 		       100
 #define MAX_DATA_LENGTH    10000
 #define MAX_PACKET_LENGTH  15000
 #define MAX_LINE_LENGTH    100
+#define STREAM_BUFFER_SIZE (2*MAX_PACKET_LENGTH)
+#define MAX_PATH_LENGTH    1024
+#define MAX_CACHE_LINE_LENGTH 2048
 
 static const int NUM_TEST_BAUD_RETRIES = 2;
 static const int MAX_NUM_POINTS        = 3000;
@@ -78,7 +89,6 @@ static const int SERIAL = 0;
 static const int NUM_STOP_LASER_RETRIES     = 5;
 static const int LASER_STOP_DELAY_US        = 50000;
 static const int IDLE_USEC                  = 100000;
-static const int TIMED_WAIT_USEC            = 1000;
 
 static const int URG_04LX_GET_SCAN_TIMEOUT_US = 500000;
 static const int UTM_30LX_GET_SCAN_TIMEOUT_US = 500000;
@@ -100,7 +110,37 @@ static const char * SCAN_STR = "SCAN";
 
 static const int READER_MAX_NUM_ERRORS_BEFORE_RESTART = 3;
 static const int READER_GET_SCAN_TIMEOUT_MSEC         = 400;
-static const int READER_SET_SCAN_PARAMS_TIMEOUT_MSEC  = 500;
+static const int READER_FIRST_SCAN_TIMEOUT_MSEC        = 2000;
+
+/* file in $HOME caching each sensor's baud rate and VV/PP responses, keyed by serial number */
+static const char * CACHE_FILE_NAME = ".breezylidar_hokuyo";
+
+/* maximum number of lines in a VV or PP response */
+static const int MAX_RESPONSE_LINES = 32;
+
+/* the fields of a line of the cache, separated by ';', which SCIP 2.0 values cannot contain */
+enum
+{
+	CACHE_SERIAL,
+	CACHE_DEVICE,
+	CACHE_BAUD,
+	CACHE_VENDOR,
+	CACHE_PRODUCT,
+	CACHE_FIRMWARE,
+	CACHE_PROTOCOL,
+	CACHE_MODEL,
+	CACHE_DMIN,
+	CACHE_DMAX,
+	CACHE_ARES,
+	CACHE_AMIN,
+	CACHE_AMAX,
+	CACHE_AFRT,
+	CACHE_SCAN,
+	CACHE_NUM_FIELDS
+};
+
+/* serializes rewriting the cache among sensors connecting at once */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
 /* XXX for now, support only URG04LX */
@@ -116,19 +156,15 @@ typedef struct hokuyo_t
 	/* device type (URG-04LX or UTM-30LX) */
 	int type;
 	
-	/* scan-ready flag */
-	bool scan_ready;
-	
 	/* serial-device object that's used for communication */
 	void * sd;
 	
-	/* thread support */
-	pthread_mutex_t data_mutex;
-	pthread_cond_t data_cond;
-	
 	/* a path to the device at which the sick can be accessed.*/
 	char device[MAXSTR];
 	
+	/* file caching the configuration of the sensors seen, or empty for none */
+	char cache_file[MAX_PATH_LENGTH];
+	
 	/* sensor information */
 	char vendor[MAXSTR];
 	char product[MAXSTR];
@@ -150,7 +186,8 @@ typedef struct hokuyo_t
 	/* hokuyo mode (scip1 or scip2.0) */
 	int mode;
 	
-	/* is the scanner streaming data? */
+	/* is the scanner streaming data?  shared by the reader or reactor thread and the API, so read 
+	   and written with __atomic builtins */
 	bool streaming;
 	
 	/* scan start count */
@@ -166,6 +203,21 @@ typedef struct hokuyo_t
 	/* 2 or 3 char encoding*/
 	int encoding;
 	
+	/* where in the full scan the requested values go, and its size; the rest are zero */
+	int scan_offset;
+	int scan_size;
+	
+	/* the part of the full scan to request, set by hokuyo_set_scan_window and taken up 
+	   under settings_mutex when the stream is next requested; window_changed is also polled without 
+	   the mutex, so it is read and written with __atomic builtins */
+	int window_start;
+	int window_end;
+	int window_skip;
+	int window_offset;
+	int window_size;
+	bool window_changed;
+	pthread_mutex_t settings_mutex;
+	
 	/*regular or special me intensity scan for utm-30_lx */
 	int scan_type;
 	
@@ -185,16 +237,28 @@ typedef struct hokuyo_t
 	bool active;
 	bool need_to_stop_laser;
 	
-	/* scan data */
-	unsigned int data[MAX_DATA_LENGTH];
-	int num_data;
+	/* scans passed from the reader thread to hokuyo_get_scan() */
+	scan_queue_t * queue;
 	
-	/* threading support */
-	pthread_cond_t settings_cond;
-	pthread_mutex_t settings_mutex;
+	/* bytes streamed from the sensor and not yet parsed, and the number of scans parsed so far */
+	char stream_buffer[STREAM_BUFFER_SIZE];
+	int stream_length;
+	unsigned int stream_scans;
+	
+	/* threading support; stopping is set by hokuyo_destroy() and read and written with __atomic builtins */
 	pthread_t thread;
 	bool thread_is_running;
+	bool stopping;
+	
+	/* reactor parsing the scan stream in place of the reader thread, if connected through one */
+	void * reactor;
+	int reactor_id;
+	char stream_request[32];
 	
+	/* called after each scan is published, under callback_mutex */
+	void (*scan_callback)(void * user);
+	void * scan_callback_user;
+	pthread_mutex_t callback_mutex;
 	
 } hokuyo_t;
 
@@ -361,6 +425,7 @@ static int _laser_on_off(hokuyo_t * h, const char * caller, bool turn_on)
 	if (line_len < 0)
 	{
 		message_on_debug(h->debug, caller2, "could not read line 1");
+		return -1;
 	}
 	
 	if (strncmp(cmd,line,line_len))
@@ -375,9 +440,10 @@ static int _laser_on_off(hokuyo_t * h, const char * caller, bool turn_on)
 		message_on_debug(h->debug, caller2, ": could not read line 2");
 	}
 	
-	if ( (strncmp(resp1, line, line_len)!=0) && (strncmp(resp2,line,line_len)!=0))
+	if ( (line_len < 2) || ((strncmp(resp1, line, 2)!=0) && (strncmp(resp2,line,2)!=0)))
 	{
 		message_on_debug(h->debug, caller2, ": response does not match (line 2):");
+		return -1;
 	}
 	
 	/* read off the LF */
@@ -389,7 +455,7 @@ static int _laser_on_off(hokuyo_t * h, const char * caller, bool turn_on)
 	
 	if (!turn_on)
 	{
-		h->streaming = false;
+		__atomic_store_n(&h->streaming, false, __ATOMIC_RELEASE);
 	}
 	
 	
@@ -450,41 +516,28 @@ static int _test_baud_rate(hokuyo_t * h, const char * caller, const int baud_rat
 	{
 		return error_return(caller2, "not connected to the sensor!");
 	}
-		
+	
+	message_on_debug(h->debug, caller2, " testing baud rate %d", baud_rate);
+	
+	/*  Set the host terminal baud rate to the test speed  */
+	if (serial_device_set_baud_rate(h->sd, caller2, baud_rate))
+	{
+		return error_return(caller2, "setting baud rate failed!");
+	}
+	
+	/* a sensor that was streaming may answer the first QT after some scan data, so it gets 
+	   another try once it has stopped; a clean answer shows SCIP2.0 mode at this baud rate */
 	int i;
 	for (i=0;i<NUM_TEST_BAUD_RETRIES;i++)
 	{
-		/*  Attempt to get status information at the current baud  */
-		message_on_debug(h->debug, caller2, " testing baud rate %d", baud_rate);
-		
-		/*  Set the host terminal baud rate to the test speed  */
-		if (!serial_device_set_baud_rate(h->sd, caller2, baud_rate))
-		{       
-			
-			/* stop the laser in case it was streaming */
-			_laser_off(h, caller);
-			
-			/* verify that the mode is set to SCIP2.0 by sending the laser off command */
-			if (!_laser_off(h, caller))
-			{
-				message_on_debug(h->debug, caller2, "SCIP2.0 Mode set.");
-				h->baud = baud_rate;
-				return 0;
-			}
-			
-			else
-			{
-				return error_return(caller2, "setting SCIP2.0 failed!" );
-			}
-			
-		}
-		
-		else
+		if (!_laser_on_off(h, caller, false))
 		{
-			return error_return(caller2, "setting baud rate failed!");
+			message_on_debug(h->debug, caller2, "SCIP2.0 Mode set.");
+			h->baud = baud_rate;
+			return 0;
 		}
 		
-		usleep(IDLE_USEC);
+		usleep(LASER_STOP_DELAY_US);
 	}
 	
 	return -1;
@@ -620,6 +673,25 @@ static int _create_scan_request(hokuyo_t * h, const char * caller,
 }
 
 
+/* read off the rest of a response, through the empty line that ends it */
+static int _read_rest_of_response(hokuyo_t * h, const char * caller, int timeout_us)
+{
+	char line[MAX_LINE_LENGTH];
+	
+	int k;
+	for (k=0; k<MAX_RESPONSE_LINES; ++k)
+	{
+		int line_len = _read_line(h, caller, line, MAX_LINE_LENGTH, timeout_us, false);
+		
+		if (line_len <= 0)
+		{
+			return line_len;
+		}
+	}
+	
+	return -1;
+}
+
 static int _parse_string(char * buf, const char * name, char * value)
 {
 	char tmp[MAXSTR];
@@ -643,143 +715,6 @@ static int _parse_string(char * buf, const char * name, char * value)
 	return 0;
 }
 
-/* read the packet either as a one blocked read or look for the terminating sequence */
-static int _read_packet(hokuyo_t * h, const char * caller, char * data, int * packet_length, int timeout_us)
-{
-	char tmp[1000];
-	sprintf(tmp, "%s:%s", caller, "_read_packet");
-	const char * caller2 = (const char *)tmp;
-
-	if (!_is_connected(h, caller2))
-	{
-		return error_return(caller2, "not connected to the sensor");
-	}
-	
-	/* if packet length is greater than zero, it means that we already know */
-	/* the expected length, therefore just use that - dont need to explicitly */
-	/* search for the end of packet - just need to check for it at the end. */
-	if (*packet_length > 0)
-	{
-		serial_device_set_io_block_w_timeout(h->sd, caller2);  
-		if (serial_device_read_chars(h->sd, caller2, data, *packet_length, timeout_us) != *packet_length)
-		{
-			return error_return(caller2, "could not read the number of expected characters");
-		}
-	}
-	
-	/* packet length is unknown, therefore we need to find it */
-	else 
-	{
-		char term_sequence[2] = {0x0a, 0x0a};
-		
-		/* set the io mode to return when the termination sequence is read */
-		/* then we know that we've reached the end of some packet */
-		serial_device_set_io_block_w_timeout_w_term_sequence(h->sd, caller2, term_sequence, 2, true);
-		
-		/* read until the end sequence is found or until read too much */
-		int chars_read=serial_device_read_chars(h->sd, caller2, data,MAX_PACKET_LENGTH,timeout_us);
-		
-		if (chars_read < 0)
-		{
-			return error_return(caller2, "could not read the terminating character while trying to determine the packet length");
-		}
-		
-		*packet_length = chars_read;
-	}
-	
-	return 0;
-}
-
-
-/* extract the data by verifying the checksum and removing it along with l_fs */
-static int _extract_packet(hokuyo_t * h, const char * caller, char * full_packet, char * extracted_packet, int packet_length)
-{
-	int len_nlfc=0;     /* length of data without l_fs and checksum */
-	int line_length;
-	int line_count=0;
-	
-	
-	if (packet_length < 1)
-	{
-		return error_return(caller, "_extract_packet: bad length");
-	}
-	
-	line_length = _check_line_checksum(h, caller, full_packet, MAX_LINE_LENGTH);
-	
-	/* line length will be zero at the end of packet, when the last lf is read */
-	while (line_length > 0)
-	{
-		line_count++;
-		
-		/* copy the data */
-		memcpy(extracted_packet,full_packet,line_length);
-		
-		extracted_packet+=line_length;
-		full_packet+=(line_length+2);     /* advance the pointer 2 chars ahead to skip the checksum and endline char */
-		len_nlfc+=line_length;
-		
-		/* check the next line */
-		line_length=_check_line_checksum(h, caller, full_packet, MAX_LINE_LENGTH);
-	}
-	if (line_length < 0)
-	{
-		return error_return(caller, "_extract_packet: error extracting a line!!!");
-	}
-	
-	return len_nlfc;
-}
-
-/* decode the packet using 2- or 3-character enconding */
-static int _decode_packet( hokuyo_t * h, const char * caller, char * extracted_packet, unsigned int * extracted_data, int extracted_length, int encoding)
-{
-	int data_length = 0;
-	int i;
-	
-	if (extracted_length < 1)
-	{
-		return error_return(caller, "_decode_packet: bad length!!!");
-	}
-	
-	switch (encoding)
-	{
-		
-	case TWO_DIGITS:
-		data_length = 0;
-		for(i=0;i<extracted_length-1;i++)   /* fixme: do we really need -1 here? */
-		{        
-			*extracted_data=((extracted_packet[i] - 0x30)<<6) + extracted_packet[i+1] - 0x30;
-			i++;
-			data_length++;
-			if (data_length > MAX_NUM_POINTS)
-			{
-				return error_return(caller, "_decode_packet: returned too many data points");
-			}
-		}
-		break;
-		
-	case THREE_DIGITS:
-		data_length = 0;
-		for(i=0;i<extracted_length-1;i++)   /* fixme: do we really need -1 here? */
-		{        
-			*extracted_data=((extracted_packet[i] - 0x30)<<12) + ((extracted_packet[i+1] - 0x30)<<6) + extracted_packet[i+2] - 0x30;
-			i+=2;
-			extracted_data++;
-			data_length++;
-			if (data_length > MAX_NUM_POINTS)
-			{
-				return error_return(caller, "_decode_packet: returned too many data points");
-			}
-		}
-		break;
-	default:
-		return error_return(caller, "_decode_packet: bad encoding");
-	}
-	
-	return data_length;
-}
-
-
-
 static int _set_baud_rate(hokuyo_t * h, const char * caller, const int baud_rate)
 {
 	char request[16];
@@ -853,7 +788,7 @@ static int _set_baud_rate(hokuyo_t * h, const char * caller, const int baud_rate
 }
 
 
-static int _get_sensor_info(hokuyo_t * h, const char * caller, int mode)
+static int _get_sensor_info(hokuyo_t * h, const char * caller)
 {
 	char line[MAX_LINE_LENGTH];
 	
@@ -986,12 +921,63 @@ static int _get_sensor_info(hokuyo_t * h, const char * caller, int mode)
 	}
 	
 	/*  read off the rest of the info from the buffer */
-	usleep(IDLE_USEC); 
-	serial_device_flush_input_buffer(h->sd, caller2);
+	if (_read_rest_of_response(h, caller2, timeout_us))
+	{
+		serial_device_flush_input_buffer(h->sd, caller2);
+	}
+	
+	return 0;    
+}
+
+/* compute the sensor's parameters from its PP response (or the cached copy of it) */
+static int _set_sensor_params(hokuyo_t * h, const char * caller2)
+{
+	h->dist_min = (int)strtol(h->dmin,NULL,10) / 1000.0;  /* convert to meters */
+	h->dist_max = (int)strtol(h->dmax,NULL,10) / 1000.0;  
+	h->angle_res = 2 * M_PI / (int)strtol(h->ares,NULL,10);  /* convert from total counts to actual resolution */
+	
+	/* error checking */
+	if (h->dist_min <= 0)
+	{
+		return error_return(caller2, "bad dmin");
+	}
+	
+	if (h->dist_max < h->dist_min)
+	{
+		return error_return(caller2, "bad dmax");
+	}
+	
+	if (h->angle_res <= 0)
+	{
+		return error_return(caller2, "bad ares");
+	}
+	
+	h->count_min = (int)strtol(h->amin,NULL,10);
+	h->count_max = (int)strtol(h->amax,NULL,10);
+	h->count_zero = (int)strtol(h->afrt,NULL,10);
+	
+	if (h->count_min > h->count_zero)
+	{
+		return error_return(caller2, "bad amin");
+	}
+	
+	if (h->count_max < h->count_zero)
+	{
+		return error_return(caller2, "bad amax");
+	}
+	h->angle_min = ( h->count_min - h->count_zero) * h->angle_res;
+	h->angle_max = ( h->count_max - h->count_zero) * h->angle_res;
+	h->scan_rate = strtol(h->scan,NULL,10) / 60.0;   /* Hz */
+	
+	if (h->scan_rate < 0)
+	{
+		return error_return(caller2, "bad scan rate");
+	}
 	
 	return 0;    
 }
 
+
 static int _get_sensor_params(hokuyo_t * h, const char * caller)
 {
 	char line[MAX_LINE_LENGTH];
@@ -1139,127 +1125,228 @@ static int _get_sensor_params(hokuyo_t * h, const char * caller)
 	}
 	
 	
-	h->dist_min = (int)strtol(h->dmin,NULL,10) / 1000.0;  /* convert to meters */
-	h->dist_max = (int)strtol(h->dmax,NULL,10) / 1000.0;  
-	h->angle_res = 2 * M_PI / (int)strtol(h->ares,NULL,10);  /* convert from total counts to actual resolution */
-	
-	/* error checking */
-	if (h->dist_min <= 0)
-	{
-		return error_return(caller2, "bad dmin");
-	}
-	
-	if (h->dist_max < h->dist_min)
+	/*  read off the rest of the info from the buffer */
+	if (_read_rest_of_response(h, caller2, timeout_us))
 	{
-		return error_return(caller2, "bad dmax");
+		serial_device_flush_input_buffer(h->sd, caller2);
 	}
 	
-	if (h->angle_res <= 0)
+	return _set_sensor_params(h, caller2);
+}
+
+/* point strings[CACHE_VENDOR] through strings[CACHE_SCAN] at the VV and PP values they cache */
+static void _cache_strings(hokuyo_t * h, char ** strings)
+{
+	strings[CACHE_VENDOR]   = h->vendor;
+	strings[CACHE_PRODUCT]  = h->product;
+	strings[CACHE_FIRMWARE] = h->firmware;
+	strings[CACHE_PROTOCOL] = h->protocol;
+	strings[CACHE_MODEL]    = h->model;
+	strings[CACHE_DMIN]     = h->dmin;
+	strings[CACHE_DMAX]     = h->dmax;
+	strings[CACHE_ARES]     = h->ares;
+	strings[CACHE_AMIN]     = h->amin;
+	strings[CACHE_AMAX]     = h->amax;
+	strings[CACHE_AFRT]     = h->afrt;
+	strings[CACHE_SCAN]     = h->scan;
+}
+
+/* split a line of the cache into its fields, in place */
+static int _split_cache_line(char * line, char ** fields)
+{
+	char * eol = strchr(line, '\n');
+	if (eol)
 	{
-		return error_return(caller2, "bad ares");
+		*eol = 0;
 	}
 	
-	h->count_min = (int)strtol(h->amin,NULL,10);
-	h->count_max = (int)strtol(h->amax,NULL,10);
-	h->count_zero = (int)strtol(h->afrt,NULL,10);
-	
-	if (h->count_min > h->count_zero)
+	int k;
+	for (k=0; k<CACHE_NUM_FIELDS; ++k)
 	{
-		return error_return(caller2, "bad amin");
+		fields[k] = line;
+		
+		char * sep = strchr(line, ';');
+		
+		if (!sep)
+		{
+			break;
+		}
+		
+		*sep = 0;
+		line = sep + 1;
 	}
 	
-	if (h->count_max < h->count_zero)
+	if (k != CACHE_NUM_FIELDS-1)
 	{
-		return error_return(caller2, "bad amax");
+		return -1;
 	}
-	h->angle_min = ( h->count_min - h->count_zero) * h->angle_res;
-	h->angle_max = ( h->count_max - h->count_zero) * h->angle_res;
-	h->scan_rate = strtol(h->scan,NULL,10) / 60.0;   /* Hz */
 	
-	if (h->scan_rate < 0)
+	/* values longer than we keep would overflow the sensor strings */
+	for (k=0; k<CACHE_NUM_FIELDS; ++k)
 	{
-		return error_return(caller2, "bad scan rate");
+		if (strlen(fields[k]) >= MAXSTR)
+		{
+			return -1;
+		}
 	}
 	
-	/*  read off the rest of the info from the buffer */
-	usleep(IDLE_USEC);
-	serial_device_flush_input_buffer(h->sd, caller2);
-	
-	return 0;    
+	return 0;
 }
 
-
-static int _get_sensor_info_and_params(hokuyo_t * h, const char * caller)
+/* find the last line of the cache whose field matches key, returning 0 and its fields if there is one */
+static int _find_cached_config(hokuyo_t * h, int field, const char * key, char * line, char ** fields)
 {
-	char tmp[1000];
-	sprintf(tmp, "%s:%s", caller, "_get_sensor_info_and_params");
-	const char * caller2 = (const char *)tmp;
-
-	if (!_is_connected(h, caller2))
-	{
-		return error_return(caller2, "not connected to the sensor!");
-	}
+	FILE * fp = *h->cache_file ? fopen(h->cache_file, "r") : NULL;
 	
-	if  (_get_sensor_info(h, caller, h->mode)) 
+	if (!fp)
 	{
-		return error_return(caller2, "unable to get status!");
+		return -1;
 	}
 	
-	if  (_get_sensor_params(h, caller)) 
+	int found = -1;
+	char tmp[MAX_CACHE_LINE_LENGTH];
+	char * tmp_fields[CACHE_NUM_FIELDS];
+	
+	while (fgets(tmp, MAX_CACHE_LINE_LENGTH, fp))
 	{
-		return error_return(caller2, "unable to get sensor params!");
+		char copy[MAX_CACHE_LINE_LENGTH];
+		strcpy(copy, tmp);
+		
+		if (!_split_cache_line(tmp, tmp_fields) && !strcmp(tmp_fields[field], key))
+		{
+			strcpy(line, copy);
+			found = _split_cache_line(line, fields);
+		}
 	}
 	
-	return 0;
-}
-
-
-
-static void _lock_data_mutex(void * v)
-{
-	hokuyo_t * h = (hokuyo_t *)v;
+	fclose(fp);
 	
-	pthread_mutex_lock(&h->data_mutex);
+	return found;
 }
 
-static void _unlock_data_mutex(void * v)
+/* record the sensor's configuration in the cache, replacing what was there for its serial number or 
+   its device; failure only costs the next connection its head start */
+static int _save_cached_config(hokuyo_t * h, const char * caller)
 {
-	hokuyo_t * h = (hokuyo_t *)v;
+	if (!*h->cache_file)
+	{
+		return 0;
+	}
 	
-	pthread_mutex_unlock(&h->data_mutex);
-}
-static void _data_cond_signal(void * v)
-{
-	hokuyo_t * h = (hokuyo_t *)v;
+	char tmp_file[MAX_PATH_LENGTH+16];
+	sprintf(tmp_file, "%s.%d", h->cache_file, (int)getpid());
 	
-	pthread_cond_signal(&h->data_cond);
-}
-
-static int data__cond_wait(void * v, int timeout_ms)
-{
-	hokuyo_t * h = (hokuyo_t *)v;
+	pthread_mutex_lock(&cache_mutex);
 	
-	struct timeval time_start;
-	struct timespec max_wait_time;
-	gettimeofday(&time_start,NULL);
+	FILE * out = fopen(tmp_file, "w");
 	
-	max_wait_time.tv_sec=time_start.tv_sec + ((time_start.tv_usec < 1000000-timeout_ms*1000) ? 0:1);
-	max_wait_time.tv_nsec=(time_start.tv_usec*1000 + timeout_ms*1000000)%1000000000;
-	return pthread_cond_timedwait(&h->data_cond,&(h->data_mutex),&max_wait_time);
+	if (!out)
+	{
+		pthread_mutex_unlock(&cache_mutex);
+		message_on_debug(h->debug, caller, "could not write %s", tmp_file);
+		return -1;
+	}
+	
+	FILE * in = fopen(h->cache_file, "r");
+	
+	if (in)
+	{
+		char line[MAX_CACHE_LINE_LENGTH];
+		char copy[MAX_CACHE_LINE_LENGTH];
+		char * fields[CACHE_NUM_FIELDS];
+		
+		while (fgets(line, MAX_CACHE_LINE_LENGTH, in))
+		{
+			strcpy(copy, line);
+			
+			if (!_split_cache_line(copy, fields) && 
+				strcmp(fields[CACHE_SERIAL], h->serial) && strcmp(fields[CACHE_DEVICE], h->device))
+			{
+				fputs(line, out);
+			}
+		}
+		
+		fclose(in);
+	}
+	
+	char * strings[CACHE_NUM_FIELDS];
+	_cache_strings(h, strings);
+	
+	fprintf(out, "%s;%s;%d", h->serial, h->device, h->baud);
+	
+	int k;
+	for (k=CACHE_VENDOR; k<CACHE_NUM_FIELDS; ++k)
+	{
+		fprintf(out, ";%s", strings[k]);
+	}
+	
+	fprintf(out, "\n");
+	
+	int status = fclose(out) || rename(tmp_file, h->cache_file);
+	
+	pthread_mutex_unlock(&cache_mutex);
+	
+	if (status)
+	{
+		remove(tmp_file);
+		message_on_debug(h->debug, caller, "could not update %s", h->cache_file);
+		return -1;
+	}
+	
+	return 0;
 }
 
-
-/* do we have a fresh scan? this is used by hokuyo_reader class */
-bool _is_scan_ready(void * v)
+static int _get_sensor_info_and_params(hokuyo_t * h, const char * caller)
 {
-	hokuyo_t * h = (hokuyo_t *)v;
+	char tmp[1000];
+	sprintf(tmp, "%s:%s", caller, "_get_sensor_info_and_params");
+	const char * caller2 = (const char *)tmp;
+
+	if (!_is_connected(h, caller2))
+	{
+		return error_return(caller2, "not connected to the sensor!");
+	}
+	
+	if  (_get_sensor_info(h, caller)) 
+	{
+		return error_return(caller2, "unable to get status!");
+	}
+	
+	/* a sensor seen before, with the same firmware, has the PP parameters it had then */
+	char line[MAX_CACHE_LINE_LENGTH];
+	char * fields[CACHE_NUM_FIELDS];
+	
+	if (!_find_cached_config(h, CACHE_SERIAL, h->serial, line, fields) && 
+		!strcmp(fields[CACHE_PRODUCT], h->product) && !strcmp(fields[CACHE_FIRMWARE], h->firmware))
+	{
+		char * strings[CACHE_NUM_FIELDS];
+		_cache_strings(h, strings);
+		
+		int k;
+		for (k=CACHE_MODEL; k<CACHE_NUM_FIELDS; ++k)
+		{
+			strcpy(strings[k], fields[k]);
+		}
+		
+		if (!_set_sensor_params(h, caller2))
+		{
+			message_on_debug(h->debug, caller2, "using cached parameters for sensor %s", h->serial);
+			return 0;
+		}
+	}
 	
-	return h->scan_ready;
+	if  (_get_sensor_params(h, caller)) 
+	{
+		return error_return(caller2, "unable to get sensor params!");
+	}
+	
+	return 0;
 }
 
 
+
 /* initializes the hokuyo */
-static int _connect(void * v, const char * caller,  char * device, const int baud_rate, const int mode)
+static int _connect(void * v, const char * caller,  char * device, const int baud_rate)
 {	
 	char tmp[1000];
 	sprintf(tmp, "%s:%s", caller, "_connect");
@@ -1279,21 +1366,27 @@ static int _connect(void * v, const char * caller,  char * device, const int bau
 	
 	message_on_debug(h->debug, caller2, "connected");
 	
-	/* find out what rate the sensor is currently running at. _baud will be set to the current baud rate. */	
+	/* find out what rate the sensor is currently running at. _baud will be set to the current baud rate. 
+	   The rate the sensor on this device was left at, if cached, is tried first. */	
 	
-	if (!_test_baud_rate(h, caller2,  115200)) 
-	{
-		message_on_debug(h->debug, caller2, "Hokuyo baud rate is 115200bps...");
-	}
-	else if (!_test_baud_rate(h, caller2,  19200))
-	{
-		message_on_debug(h->debug, caller2, "Hokuyo baud rate is 19200bps...");
-	}
-	else if (!_test_baud_rate(h, caller2,  38400))
+	char line[MAX_CACHE_LINE_LENGTH];
+	char * fields[CACHE_NUM_FIELDS];
+	int cached_baud = _find_cached_config(h, CACHE_DEVICE, device, line, fields) ? 0 : atoi(fields[CACHE_BAUD]);
+	
+	const int bauds[] = {cached_baud, 115200, 19200, 38400};
+	const int num_bauds = sizeof(bauds) / sizeof(bauds[0]);
+	
+	int k;
+	for (k=0; k<num_bauds; ++k)
 	{
-		message_on_debug(h->debug, caller2, "Hokuyo baud rate is 38400bps...");
+		if (bauds[k] && (k == 0 || bauds[k] != cached_baud) && !_test_baud_rate(h, caller2, bauds[k]))
+		{
+			message_on_debug(h->debug, caller2, "Hokuyo baud rate is %dbps...", bauds[k]);
+			break;
+		}
 	}
-	else 
+	
+	if (k == num_bauds)
 	{
 		serial_device_disconnect(h->sd, caller2);
 		
@@ -1336,6 +1429,8 @@ static int _connect(void * v, const char * caller,  char * device, const int bau
 		return error_return(caller2, "could not get status data from sensor");
 	}
 	
+	_save_cached_config(h, caller2);
+	
 	message_on_debug(h->debug, caller2, "turning the laser on");
 	
 	if (_laser_on(h, caller))
@@ -1381,368 +1476,340 @@ static int _disconnect(void * v, const char * caller)
 }
 
 
-/*confirm that the scan request was accepted */
-static int _confirm_scan(void * v, const char * caller,  char * req, int timeout_us)
+/* decode the four-character SCIP2.0 timestamp: milliseconds on the sensor's clock, modulo 2^24 */
+static unsigned int _decode_timestamp(const char * line)
 {
-	hokuyo_t * h = (hokuyo_t *)v;
+	unsigned int timestamp = 0;
 	
-	char line[MAX_LINE_LENGTH];
-	int line_len;    
-	
-	/* read back the echo of the command */
-	line_len= _read_line(h, caller, line, MAX_LINE_LENGTH, timeout_us, false);
-	if (line_len < 0)
+	int k;
+	for (k=0; k<4; ++k)
 	{
-		error_return(caller, "_confirm_scan: could not read echo of the command (line 1)");
+		timestamp = (timestamp << 6) | ((line[k] - 0x30) & 0x3f);
 	}
 	
-	if (strncmp(req,line,line_len))
-	{
-		return error_return(caller, "_confirm_scan: response does not match the echo of the command (line 1)");
-	}
+	return timestamp;
+}
+
+/* tell the scan callback, if any, that a scan has been published */
+static void _notify_scan(hokuyo_t * h)
+{
+	pthread_mutex_lock(&h->callback_mutex);
 	
-	/* read back the status response */
-	line_len = _read_line(h, caller, line,MAX_LINE_LENGTH,timeout_us,true);
-	if (line_len < 0)
+	if (h->scan_callback)
 	{
-		return error_return(caller, "_confirm_scan: could not read status response(line 2)");
+		h->scan_callback(h->scan_callback_user);
 	}
 	
-	if (_check_result("00", line))
+	pthread_mutex_unlock(&h->callback_mutex);
+}
+
+/* find the start of the next packet, just past the LF LF that ends every response, so that a 
+   stream that has lost synchronization picks up again there; returns its offset, or -1 if the 
+   data holds no complete response */
+static int _find_packet_start(const char * data, int length)
+{
+	const char * end = data + length;
+	const char * p = data;
+	
+	while ((p = (const char *)memchr(p, 0x0a, end - p)) && (p+1 < end))
 	{
-		message_on_debug(h->debug, caller, "_confirm_scan: status response does not match (line 2):");
-		
-		if (!_check_result("10",line))
-		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner)it looks like we need to turn the laser back on");
-			_laser_on(h, caller);
-		}
-		
-		else if (!_check_result("01", line))
-		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner) Starting step has non-numeric value");
-		}
-		
-		else if (_check_result("02",line))
-		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner) End step has non-numeric value");
-		}
-		
-		else if (!_check_result("03",line))
-		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner) Cluster count (skip) has non-numeric value");
-		}
-		
-		else if (!_check_result("04",line))
+		if (p[1] == 0x0a)
 		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner) End step is out of range");
+			return p + 2 - data;
 		}
 		
-		else if (!_check_result("05",line))
-		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner) End step is smaller than starting step");
-		}
-		
-		else 
-		{
-			message_on_debug(h->debug, caller, "_confirm_scan: (response from scanner) Looks like hardware trouble");
-		}
-		
-		return -1;
+		p++;
 	}
 	
-	return 0;
+	return -1;
 }
 
+/* whether the last character of a line (not counting its LF) is the checksum of the rest */
+static bool _is_checksum_valid(const char * line, int length)
+{
+	if (length < 2)
+	{
+		return false;
+	}
+	
+	char sum = 0;
+	
+	int j;
+	for (j=0; j<length-1; j++)
+	{
+		sum += line[j];
+	}
+	
+	return ((sum & 0x3f) + 0x30) == line[length-1];
+}
 
-/* get a scan from hokuyo:proide a pointer to allocated buffer, reference 
-var with number of points (void * v, const char * caller,  ranges) and scan parameters */
-int _get_scan(void * v, const char * caller,  unsigned int * range, int * n_range, int scan_start, 
-	int scan_end, int scan_skip, int encoding, int scan_type,  int num_scans)
+/* create the streaming request for the current scan settings, so that the stream parser can 
+   recognize its echo */
+static int _create_stream_request(hokuyo_t * h, const char * caller)
 {
-	char tmp[1000];
-	sprintf(tmp, "%s:%s", caller, "_get_scan");
-	const char * caller2 = (const char *)tmp;
+	bool need_to_read_off_cmd_and_status = false;
 	
-	hokuyo_t * h = (hokuyo_t *)v;
+	pthread_mutex_lock(&h->settings_mutex);
 	
-	char req[128];
-	char good_status[2];
-	char line[MAX_LINE_LENGTH];
-	char full_packet[MAX_PACKET_LENGTH];
-	char extracted_packet[MAX_PACKET_LENGTH];
-	int line_len;
-	bool need_to_request_scan = false;
+	h->scan_start  = h->window_start;
+	h->scan_end    = h->window_end;
+	h->scan_skip   = h->window_skip;
+	h->scan_offset = h->window_offset;
+	h->scan_size   = h->window_size;
+	__atomic_store_n(&h->window_changed, false, __ATOMIC_RELEASE);
 	
-	if (!_is_connected(h, caller2))
+	pthread_mutex_unlock(&h->settings_mutex);
+	
+	if (_create_scan_request(h, caller, h->scan_start, h->scan_end, h->scan_skip, ENCODING, SCAN_TYPE, 0, 
+		h->stream_request, &need_to_read_off_cmd_and_status))
 	{
-		return error_return(caller2, " not connected to the sensor!");
+		return error_return(caller, "could not create scan request string");
 	}
 	
+	h->encoding   = ENCODING;
+	h->scan_type  = SCAN_TYPE;
 	
-	/* settings have changed, therefore we need to figure out the packet length */
-	if (
-		(h->scan_start != scan_start) || 
-		(h->scan_end != scan_end) || 
-		(h->scan_skip != scan_skip) || 
-		(h->encoding != encoding) || 
-		(h->scan_type!=scan_type))
-	{
-		h->packet_length = -1;
-		h->scan_ready = false;
-		
-		if (h->streaming)
-		{
-			if (!_laser_off(h, caller))
-			{
-				message_on_debug(h->debug, caller2, " laser has been shut off");
-				usleep(IDLE_USEC);
-			}
-			
-			else
-			{
-				message_on_debug(h->debug, caller2, " could not shut off the laser");
-			}
-		}
+	h->stream_length = 0;
+	
+	return 0;
+}
 
-    		
-		message_on_debug(h->debug, caller2, "need to check packet size");
+/* handle one complete response to the streaming request; returns 1 if it was a scan, which is 
+   published, 0 if it was the confirmation, or -1 if it was not a valid response */
+static int _handle_stream_response(hokuyo_t * h, const char * caller, const char * response, int length)
+{
+	const char * end = response + length;
+	int request_length = strlen(h->stream_request);
+	
+	/* skip whatever precedes the echo, such as the rest of a response that we joined partway */
+	const char * echo = (const char *)memmem(response, length, h->stream_request, request_length-2);
+	
+	if (echo && (echo != response))
+	{
+		message_on_debug(h->debug, caller, "skipping %d bytes before the echo", (int)(echo - response));
+		response = echo;
 	}
 	
-	else
+	if (end - response > MAX_PACKET_LENGTH)
 	{
-		message_on_debug(h->debug, caller2, "reusing old packet size");
+		message_on_debug(h->debug, caller, "response is too long");
+		return -1;
 	}
 	
-	memcpy(good_status,"99",2*sizeof(char));
-	bool need_to_read_off_cmd_and_status = false;
-	if (_create_scan_request(h, caller,
-		scan_start, scan_end, scan_skip, 
-		encoding, scan_type, num_scans, 
-		req, &need_to_read_off_cmd_and_status))
+	/* echo of the request, with the number of remaining scans in its last two characters */
+	const char * line = response;
+	const char * lf = (const char *)memchr(line, 0x0a, end - line);
+	
+	if ((lf - line != request_length) || strncmp(h->stream_request, line, request_length-2))
 	{
-		return error_return(caller2, " could not create scan request string!");
+		message_on_debug(h->debug, caller, "ignoring a response that is not to the streaming request");
+		return -1;
 	}
 	
-	if (num_scans == 1)
+	/* status: "00" confirms the request, "99" precedes each scan */
+	line = lf + 1;
+	lf = (const char *)memchr(line, 0x0a, end - line);
+	
+	if (!lf || !_is_checksum_valid(line, lf - line))
 	{
-		need_to_request_scan = true;
+		message_on_debug(h->debug, caller, "could not read status (line @2)");
+		return -1;
 	}
-	else if (num_scans == 0)
+	
+	if (!_check_result("00", (char *)line))
 	{
-		if (!h->streaming)
-		{
-			need_to_request_scan=true;
-		}
-		
-		else 
-		{
-			need_to_request_scan=false;
-		}
+		message_on_debug(h->debug, caller, "streaming confirmed");
+		return 0;
 	}
 	
-	else 
+	if (_check_result("99", (char *)line))
 	{
-		return error_return(caller2, " invalid number of scans");
+		/* the sensor has stopped streaming (e.g. "10" for the laser turned off), so ask again */
+		message_on_debug(h->debug, caller, "sensor reported status %c%c", line[0], line[1]);
+		__atomic_store_n(&h->streaming, false, __ATOMIC_RELEASE);
+		return -1;
 	}
 	
+	/* timestamp */
+	line = lf + 1;
+	lf = (const char *)memchr(line, 0x0a, end - line);
 	
-	int timeout_us = 0;
-	switch (h->type)
+	/* from here on the response is a scan, so one that fails to parse counts as skipped */
+	if (!lf || (lf - line != 5) || !_is_checksum_valid(line, 5))
 	{
-	case TYPE_URG_04LX:
-		timeout_us = URG_04LX_GET_SCAN_TIMEOUT_US;
-		break;
-		
-	case TYPE_UTM_30LX:
-		timeout_us = UTM_30LX_GET_SCAN_TIMEOUT_US;
-		break;
+		message_on_debug(h->debug, caller, "could not read timestamp (line @3)");
+		scan_queue_drop(h->queue);
+		return -1;
 	}
 	
-	/* only send the request command if we need to */
-	/* this means only when we request a single scan or to start streaming */
-	if (need_to_request_scan)
-	{
-	    
-	    serial_device_flush_input_buffer(h->sd, caller);
-	    
-	    /* write the data request command */
-	    if (_send_command2(h, caller, req))
-	    {
-	        return error_return(caller2, "could not write command");
-	    }
-	    		
-		if (_confirm_scan(v, caller, req, timeout_us))
-		{
-			return error_return(caller2, " could not confirm scan!" );
-		}
-		
-		/* the read was successful, so it means that if we requested streaming, we got it */
-		if (num_scans == 0)
-		{
-			h->streaming = true;
-		}
-		
-		if ((num_scans==0) || (scan_type==SCAN_SPECIAL_ME))
-		{
-			/* read off the LF character */
-			line_len = _read_line(h, caller, line, MAX_LINE_LENGTH, timeout_us, false);
-			if (line_len < 0)
-			{
-				return error_return(caller2, " could not read LF (line 3) ");
-			}
-			
-			if (line_len > 0)
-			{
-				return error_return(caller2, " response does not match LF" );
-			}
-		}
+	unsigned int timestamp = _decode_timestamp(line);
+	
+	/* verify the checksums, and remove LF and checksum chars from the data lines that follow, up 
+	   to the empty line that ends the response */
+	char extracted_packet[MAX_PACKET_LENGTH+SCIP_PADDING];
+	int extracted_length = scip_strip_lines(lf + 1, end - (lf + 1), extracted_packet);
+	
+	if (extracted_length < 0)
+	{
+		message_on_debug(h->debug, caller, "checksum error in data");
+		scan_queue_drop(h->queue);
+		return -1;
 	}
 	
-	if (need_to_read_off_cmd_and_status)
+	/* a response that lost characters can still have good checksums on every line */
+	int n_expected = (h->scan_end - h->scan_start + h->scan_skip) / h->scan_skip;
+	
+	if (extracted_length != n_expected * h->encoding)
 	{
-		/* read back the echo of the command */
-		line_len=_read_line(h, caller, line,MAX_LINE_LENGTH, timeout_us, false);
-		if (line_len < 0)
-		{
-			return error_return(caller2, " could not read echo of the command (line @1)" );
-		}
-		
-		if (strncmp(req,line,line_len-2))     /* XXX: not checking the number of remaining scans */
-		{
-			return error_return(caller2, " echo of the command does not match (line @1):");
-		}
-		
-		/* read back the status response */
-		line_len=_read_line(h, caller, line,MAX_LINE_LENGTH,timeout_us,true);
-		if (line_len < 0)
-		{
-			return error_return(caller2, " could not read line @2" );
-		}
-		
-		if (strncmp(good_status,line,2))
-		{
-			return error_return(caller2, " response does not match (line @2):");
-		}
+		message_on_debug(h->debug, caller, "got %d data characters instead of %d", extracted_length, n_expected * h->encoding);
+		scan_queue_drop(h->queue);
+		return -1;
 	}
 	
+	/* decode straight into the next queue slot, unless the queue is full */
+	unsigned int * range = (unsigned int *)scan_queue_acquire(h->queue);
 	
-	/* read the timestamp */
-	line_len=_read_line(h, caller, line,MAX_LINE_LENGTH,timeout_us,true);
-	if (line_len < 0)
+	if (!range)
 	{
-		return error_return(caller2, " could not read timestamp (line @3)" );
+		scan_queue_drop(h->queue);
+		return 1;
 	}
 	
-	/* read the whole packet */
-	if (_read_packet(h, caller, full_packet, &h->packet_length, timeout_us))
+	/* a partial scan goes in its place in the full one, which is zero (no detection) elsewhere */
+	int n_range = scip_decode(extracted_packet, extracted_length, h->encoding, range + h->scan_offset);
+	
+	memset(range, 0, h->scan_offset * sizeof(unsigned int));
+	memset(range + h->scan_offset + n_range, 0, (h->scan_size - h->scan_offset - n_range) * sizeof(unsigned int));
+	
+	scan_queue_publish(h->queue, h->scan_size, scan_queue_now_usec(), timestamp);
+	
+	_notify_scan(h);
+	
+	return 1;
+}
+
+/* handle every complete response received so far, returning the number of bytes consumed; also 
+   the reactor callback */
+static int _consume_stream(void * v, const char * data, int length)
+{
+	hokuyo_t * h = (hokuyo_t *)v;
+	
+	int consumed = 0;
+	int next;
+	
+	/* each response ends with LF LF, so a garbled one is skipped by starting over after it */
+	while ((next = _find_packet_start(data + consumed, length - consumed)) > 0)
 	{
-		return error_return(caller2, " could not read data packet" );
+		if (_handle_stream_response(h, "hokuyo_stream", data + consumed, next) > 0)
+		{
+			h->stream_scans++;
+		}
+		
+		consumed += next;
 	}
 	
-	/* verify the checksum, and remove LF and checksum chars from data */
-	int extracted_length = _extract_packet(h, caller, full_packet, extracted_packet, h->packet_length);
-	if (extracted_length < 0)
+	/* no response is longer than a packet, so we have lost track of the stream; keep the last 
+	   byte, in case it is the first LF of the next LF LF */
+	if (length - consumed > MAX_PACKET_LENGTH)
 	{
-		return error_return(caller2, " could not extract data from packet" );
+		message_on_debug(h->debug, "hokuyo_stream", "discarding unterminated response");
+		consumed = length - 1;
 	}
 	
-	/* decode the packet into the provided buffer */
-	_lock_data_mutex(h);
-	*n_range = _decode_packet(h, caller, extracted_packet, range, extracted_length, encoding);
-	if ( (*n_range < 0) || (*n_range>MAX_NUM_POINTS))
+	/* on a reactor, request a new scan window after stopping the stream, which the old scans' 
+	   echoes then no longer match */
+	if (h->reactor && __atomic_load_n(&h->window_changed, __ATOMIC_ACQUIRE) && 
+	    !_create_stream_request(h, "hokuyo_stream"))
 	{
-		h->scan_ready=false;    
-		_unlock_data_mutex(h);        
-		return error_return(caller2, " returned too many data points" );
-		/* if (scan_ready != NULL) *scan_ready=false; */
+		const char * stop = "QT\n";
+		
+		if (!serial_reactor_write(h->reactor, "hokuyo_stream", h->reactor_id, stop, strlen(stop)))
+		{
+			__atomic_store_n(&h->streaming, false, __ATOMIC_RELEASE);
+		}
 	}
 	
-	/* if (scan_ready != NULL) *scan_ready=true; */
-	h->scan_ready = true;
+	/* on a reactor, restart a stream that the sensor reported stopped by asking again */
+	if (h->reactor && !__atomic_load_n(&h->streaming, __ATOMIC_ACQUIRE))
+	{
+		char request[MAXSTR];
+		sprintf(request, "%s\n", h->stream_request);
+		
+		if (!serial_reactor_write(h->reactor, "hokuyo_stream", h->reactor_id, request, strlen(request)))
+		{
+			__atomic_store_n(&h->streaming, true, __ATOMIC_RELEASE);
+		}
+	}
 	
-	/* signal that the newest data is available */
-	_data_cond_signal(h);
-	_unlock_data_mutex(h);
+	return consumed;
+}
+
+/* issue the streaming request; the confirmation and the scans are then parsed as they arrive */
+static int _start_stream(hokuyo_t * h, const char * caller)
+{
+	if (_create_stream_request(h, caller))
+	{
+		return -1;
+	}
 	
-	/* update the scan params because the scan was successful */
-	h->scan_start = scan_start;
-	h->scan_end = scan_end;
-	h->scan_skip = scan_skip;
-	h->encoding = encoding;
-	h->scan_type = scan_type;
+	serial_device_flush_input_buffer(h->sd, caller);
 	
-	/* the read was successful, so it means that if we requested streaming, we got it */
-	if (num_scans==0)
+	if (_send_command2(h, caller, h->stream_request))
 	{
-		h->streaming = true;
+		return error_return(caller, "_start_stream: could not write command");
 	}
 	
+	__atomic_store_n(&h->streaming, true, __ATOMIC_RELEASE);
+	
 	return 0;
 }
 
-
-
-/* find the start of packet in case of loss of synchronization */
-static int _find_packet_start(void * v, const char * caller) 
+/* wait for what the sensor sends next and publish the scans it completes; returns the number 
+   of scans published, or -1 if nothing arrived in time */
+static int _read_stream(hokuyo_t * h, const char * caller)
 {
-	char tmp[1000];
-	sprintf(tmp, "%s:%s", caller, "_find_packet_start");
-	const char * caller2 = (const char *)tmp;
+	int timeout_us = (h->type == TYPE_UTM_30LX) ? UTM_30LX_GET_SCAN_TIMEOUT_US : URG_04LX_GET_SCAN_TIMEOUT_US;
 	
-	hokuyo_t * h = (hokuyo_t *)v;
+	serial_device_set_io_nonblock_wo_timeout(h->sd, caller);
 	
-	static char data[MAX_PACKET_LENGTH];
-	char seq[2]={0x0A,0x0A};   /* two LFs */
+	/* returns bytes the serial device already buffered first, then whatever the port has */
+	int n = serial_device_read_chars(h->sd, caller, h->stream_buffer + h->stream_length, 
+		STREAM_BUFFER_SIZE - h->stream_length, 0);
 	
-	if (_is_connected(h, caller2))
+	if (n == 0)
 	{
-		return error_return(caller2, "not connected to the sensor!");
+		struct pollfd pfd;
+		pfd.fd = serial_device_get_fd(h->sd);
+		pfd.events = POLLIN;
+		
+		if (poll(&pfd, 1, timeout_us / 1000) < 1)
+		{
+			return -1;
+		}
+		
+		n = serial_device_read_chars(h->sd, caller, h->stream_buffer + h->stream_length, 
+			STREAM_BUFFER_SIZE - h->stream_length, 0);
 	}
 	
-	/* set the io mode to return when the termination sequence is read
-	then we know that we've reached the end of some packet */ 
-	serial_device_set_io_block_w_timeout_w_term_sequence(h->sd, caller2, seq, 2, true);
-	
-	/* read until the end sequence is found or until read too much */
-	int num_chars = serial_device_read_chars(h->sd, caller2, data, MAX_PACKET_LENGTH, 0);
-	
-	if (num_chars < 1 )
+	if (n <= 0)
 	{
-		return error_return(caller2, "terminating character was not read");
+		return -1;
 	}
 	
-	return 0;
-}
-
-
-static void _set_scan_unready(void * v)
-{
-	hokuyo_t * h = (hokuyo_t *)v;
+	h->stream_length += n;
 	
-	h->scan_ready = false;
-}
-
-
-static int _cond_wait(hokuyo_t * hokuyo, int timeout_ms)
-{ 
-	struct timeval time_start;
-	struct timespec max_wait_time;
-	gettimeofday(&time_start,NULL);
+	unsigned int scans = h->stream_scans;
+	
+	int consumed = _consume_stream(h, h->stream_buffer, h->stream_length);
+	
+	/* keep the partial response for the next read */
+	memmove(h->stream_buffer, h->stream_buffer + consumed, h->stream_length - consumed);
+	h->stream_length -= consumed;
 	
-	max_wait_time.tv_sec = time_start.tv_sec + ((time_start.tv_usec < 1000000-timeout_ms*1000) ? 0:1);
-	max_wait_time.tv_nsec =(time_start.tv_usec*1000 + timeout_ms*1000000)%1000000000;
-	return pthread_cond_timedwait(&hokuyo->settings_cond,&(hokuyo->settings_mutex),&max_wait_time);
+	return h->stream_scans - scans;
 }
 
 
-static double _get_current_time_sec(void)
-{
-	struct timeval time;
-	gettimeofday(&time, NULL);
-	return  (time.tv_sec + time.tv_usec*0.000001); 
-}
-
 static void * _run(void * v)
 {
 	hokuyo_t * h = (hokuyo_t *)v;
@@ -1750,35 +1817,23 @@ static void * _run(void * v)
 	sigset_t sigs;
 	sigfillset(&sigs);
 	pthread_sigmask(SIG_BLOCK,&sigs,NULL);
-	struct timeval timeStart;
-	struct timeval timeStop;
-	struct timeval totalTimeStart;
-	struct timeval totalTimeStop;
-	unsigned int cntr=0;
 	
 	bool connected, active;
 	
 	int numErrors=0;
 	
-	gettimeofday(&totalTimeStart,NULL);
-	gettimeofday(&totalTimeStop,NULL);
-	
-	while(1)
+	while (!__atomic_load_n(&h->stopping, __ATOMIC_ACQUIRE))
 	{
-		cntr++;
-		gettimeofday(&timeStart,NULL);
-		pthread_testcancel();
-		
-		/*  create a local copy of the scan params to be used later */
-		int scan_start   = SCAN_START;
-		int scan_end     = SCAN_END;
-		int scan_skip    = SCAN_SKIP;
-		int encoding     = ENCODING;
-		int scan_type    = SCAN_TYPE;
-		
 		connected        = _is_connected(h, "_run");
 		active           = h->active;
 		
+		/* a new scan window is requested after stopping the stream */
+		if (__atomic_load_n(&h->window_changed, __ATOMIC_ACQUIRE) && 
+		    __atomic_load_n(&h->streaming, __ATOMIC_ACQUIRE))
+		{
+			h->need_to_stop_laser = true;
+		}
+		
 		if (h->need_to_stop_laser)
 		{
 			if (!_laser_off(h, (char *)"_run"))
@@ -1796,42 +1851,35 @@ static void * _run(void * v)
 		}
 		
 		
-		pthread_cond_signal(&h->settings_cond);
-		
 		if (connected && active)
 		{
-			int error = _get_scan(
-                                h, 
-				(char *)"_run", 
-				h->data, &h->num_data, 
-				scan_start, scan_end, 
-				scan_skip, 
-				encoding, 
-				scan_type, 
-				0);
-			
-			if (!error)
+			/* one request streams scans for as long as the laser stays on */
+			if (!__atomic_load_n(&h->streaming, __ATOMIC_ACQUIRE) && _start_stream(h, "_run"))
 			{
-				numErrors=0;
-			} 
+				numErrors++;
+			}
 			
-			else 
+			else
 			{
-				numErrors++;
-				message_on_debug(h->debug, "_run", "Could not read a scan from the sensor"); 
-				if (!_find_packet_start(h, (char *)"_run"))
-				{
-					message_on_debug(h->debug, "_run", "Resynchronized with the stream"); 
-				}
+				int nscans = _read_stream(h, "_run");
 				
-				if (numErrors>=READER_MAX_NUM_ERRORS_BEFORE_RESTART)
+				if (nscans > 0)
 				{
-					h->need_to_stop_laser=true;
 					numErrors=0;
 				}
 				
-				/*  XXX: need to do some error handling here */
-				/* pthread_exit(NULL); */
+				else if (nscans < 0)
+				{
+					numErrors++;
+					message_on_debug(h->debug, "_run", "Could not read a scan from the sensor"); 
+				}
+			}
+			
+			/* garbled responses are skipped within the stream, so only silence restarts it */
+			if (numErrors>=READER_MAX_NUM_ERRORS_BEFORE_RESTART)
+			{
+				h->need_to_stop_laser=true;
+				numErrors=0;
 			}
 		}
 		
@@ -1840,9 +1888,6 @@ static void * _run(void * v)
 			/* just idle */
 			usleep(IDLE_USEC);
 		}
-		
-		gettimeofday(&timeStop,NULL);
-		
 	}
 	
 	return NULL;
@@ -1875,6 +1920,8 @@ void * hokuyo_create(const char * caller, bool debug)
 	h->scan_end        = -1;
 	h->scan_skip       = -1;
 	h->encoding        = -1;
+	h->scan_offset     = -1;
+	h->scan_size       = -1;
 	h->scan_type       = -1;
 	h->packet_length   = -1;
 	h->dist_min        = -1;
@@ -1888,24 +1935,50 @@ void * hokuyo_create(const char * caller, bool debug)
 	h->count_max       = -1;
 	h->count_zero      = -1;
 	
-	/* initialize mutexes */
-	pthread_mutex_init(&h->data_mutex, NULL);
-	pthread_cond_init(&h->data_cond, NULL);    
-	
 	/* create serial device interface */
 	h->sd = serial_device_create(caller2);
 	
-	_set_scan_unready(h);
+	/* create the scan queue; the extra point leaves room for an oversized packet to be detected */
+	h->queue = scan_queue_create(DEFAULT_SCAN_QUEUE_CAPACITY, MAX_NUM_POINTS+1, SCAN_QUEUE_OVERWRITE_OLDEST);
 	
 	h->active = false;
 	h->need_to_stop_laser = false;
 	
 	h->thread_is_running = false;
+	h->stopping = false;
+	
+	h->stream_length = 0;
+	h->stream_scans = 0;
+	
+	h->reactor = NULL;
+	h->reactor_id = -1;
+	h->scan_callback = NULL;
+	h->scan_callback_user = NULL;
+	
+	/* the full scan, until hokuyo_set_scan_window says otherwise */
+	h->window_start   = SCAN_START;
+	h->window_end     = SCAN_END;
+	h->window_skip    = SCAN_SKIP;
+	h->window_offset  = 0;
+	h->window_size    = (SCAN_END - SCAN_START) / SCAN_SKIP + 1;
+	h->window_changed = false;
 	
 	pthread_mutex_init(&h->settings_mutex,NULL);
-	pthread_cond_init(&h->settings_cond,NULL);
 	
-	h->num_data =0;	
+	/* recursive, so that a scan callback can replace itself */
+	pthread_mutexattr_t mutexattr;
+	pthread_mutexattr_init(&mutexattr);
+	pthread_mutexattr_settype(&mutexattr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&h->callback_mutex, &mutexattr);
+	pthread_mutexattr_destroy(&mutexattr);
+	
+	/* cache the configuration in the user's home directory, if there is one */
+	const char * home = getenv("HOME");
+	*h->cache_file = 0;
+	if (home && (strlen(home) + strlen(CACHE_FILE_NAME) + 2 <= MAX_PATH_LENGTH))
+	{
+		sprintf(h->cache_file, "%s/%s", home, CACHE_FILE_NAME);
+	}
 	
 	return h;
 }
@@ -1919,46 +1992,121 @@ int hokuyo_connect(void * v, const char * caller, char * device, int baud_rate)
 	hokuyo_t * h = (hokuyo_t *)v;
 	
 
-	if (_connect(h, caller2, device, baud_rate, SCIP20))
+	if (_connect(h, caller2, device, baud_rate))
 	{
 		return -1;
 	}
 	
 	
+	/* _connect has just left the laser on and idle, so the thread can request the stream right away */
+	h->active = true;
+	
 	/*  start the thread */
 	if (pthread_create(&h->thread, NULL, _run, (void *)h)) 
 	{
+		h->active = false;
 		return -1;
 	}
 	
 	h->thread_is_running = true;
 	
-	/*  copy the new values */
-	h->need_to_stop_laser=true;
+	/* return as soon as the first scan is published */
+	if (scan_queue_wait(h->queue, READER_FIRST_SCAN_TIMEOUT_MSEC*1000))
+	{
+		message_on_debug(h->debug, caller2, "timed out waiting for the first scan");
+	}
 	
-	h->active = true;
+	return 0;
+}
+
+int hokuyo_connect_reactor(void * v, const char * caller, char * device, int baud_rate, void * reactor)
+{
+	char tmp[1000];
+	sprintf(tmp, "%s:%s", caller, "hokuyo_connect_reactor");
+	const char * caller2 = (const char *)tmp;
+
+	hokuyo_t * h = (hokuyo_t *)v;
 	
-	double timeStartSec = _get_current_time_sec();
+	if (h->thread_is_running || h->reactor)
+	{
+		return error_return(caller2, "already connected");
+	}
 	
-	/* this loop makes sure that timedwait does not return before the time expires - recommended in manual for this function.. */
-	while (true)
-	{        
-		if ((_get_current_time_sec() - timeStartSec)*1000 >= READER_SET_SCAN_PARAMS_TIMEOUT_MSEC)
-		{
-			break;
-		}
-		
-		if (_cond_wait(h, READER_SET_SCAN_PARAMS_TIMEOUT_MSEC) == ETIMEDOUT)
-		{
-			message_on_debug(h->debug, caller2, "timed out");
-		}
-		
-		usleep(TIMED_WAIT_USEC);
+	if (_connect(h, caller2, device, baud_rate))
+	{
+		return -1;
+	}
+	
+	if (_create_stream_request(h, caller2))
+	{
+		_disconnect(h, caller2);
+		return -1;
+	}
+	
+	serial_device_flush_input_buffer(h->sd, caller2);
+	
+	/* the request is sent below, so the reactor thread must not send it too */
+	__atomic_store_n(&h->streaming, true, __ATOMIC_RELEASE);
+	
+	/* watch the device before requesting the stream, so that the confirmation is parsed with the scans */
+	h->reactor_id = serial_reactor_add(reactor, caller2, h->sd, _consume_stream, h, h->debug);
+	if (h->reactor_id < 0)
+	{
+		__atomic_store_n(&h->streaming, false, __ATOMIC_RELEASE);
+		_disconnect(h, caller2);
+		return -1;
+	}
+	
+	h->reactor = reactor;
+	
+	h->active     = true;
+	
+	char request[MAXSTR];
+	sprintf(request, "%s\n", h->stream_request);
+	
+	if (serial_reactor_write(reactor, caller2, h->reactor_id, request, strlen(request)))
+	{
+		serial_reactor_remove(reactor, caller2, h->reactor_id);
+		h->reactor = NULL;
+		h->active = false;
+		__atomic_store_n(&h->streaming, false, __ATOMIC_RELEASE);
+		_disconnect(h, caller2);
+		return error_return(caller2, "could not write scan request");
 	}
 	
 	return 0;
 }
 
+void hokuyo_set_cache_file(void * v, const char * path)
+{
+	hokuyo_t * h = (hokuyo_t *)v;
+	
+	*h->cache_file = 0;
+	
+	if (path && (strlen(path) < MAX_PATH_LENGTH))
+	{
+		strcpy(h->cache_file, path);
+	}
+}
+
+void hokuyo_set_scan_callback(void * v, void (*callback)(void * user), void * user)
+{
+	hokuyo_t * h = (hokuyo_t *)v;
+	
+	pthread_mutex_lock(&h->callback_mutex);
+	
+	h->scan_callback = callback;
+	h->scan_callback_user = user;
+	
+	/* a scan published before the callback was set would otherwise go unannounced until the next one */
+	if (callback && !scan_queue_wait(h->queue, 0))
+	{
+		callback(user);
+	}
+	
+	pthread_mutex_unlock(&h->callback_mutex);
+}
+
 void hokuyo_destroy(void * v, const char * caller)
 {    
 	hokuyo_t * h = (hokuyo_t *)v;
@@ -1966,11 +2114,19 @@ void hokuyo_destroy(void * v, const char * caller)
 	if (h->thread_is_running)
 	{
 		message_on_debug(h->debug, caller, "hokuyo_destroy: stopping thread...");
-		pthread_cancel(h->thread);
+		/* the thread checks between reads, which time out, so it never stops inside a scan callback */
+		__atomic_store_n(&h->stopping, true, __ATOMIC_RELEASE);
 		pthread_join(h->thread,NULL);
 		h->thread_is_running=false;
 	}
 	
+	if (h->reactor)
+	{
+		message_on_debug(h->debug, caller, "hokuyo_destroy: removing device from reactor...");
+		serial_reactor_remove(h->reactor, caller, h->reactor_id);
+		h->reactor = NULL;
+	}
+	
 	if (_is_connected(h, caller))
 	{
 		message_on_debug(h->debug, caller, "hokuyo_destroy: disconnecting from device..."); 
@@ -1978,12 +2134,90 @@ void hokuyo_destroy(void * v, const char * caller)
 	}
 	
 	pthread_mutex_destroy(&h->settings_mutex);
-	pthread_cond_destroy(&h->settings_cond);
+	pthread_mutex_destroy(&h->callback_mutex);
+	
+	scan_queue_free(h->queue);
+	h->queue = NULL;
+}
+
+int hokuyo_set_scan_queue(void * v, const char * caller, int capacity, int policy)
+{
+	hokuyo_t * h = (hokuyo_t *)v;
+	
+	if (h->thread_is_running || h->reactor)
+	{
+		return error_return(caller, "hokuyo_set_scan_queue: cannot replace the queue while connected");
+	}
+	
+	scan_queue_t * queue = scan_queue_create(capacity, MAX_NUM_POINTS+1, policy);
+	
+	if (!queue)
+	{
+		return error_return(caller, "hokuyo_set_scan_queue: could not create queue");
+	}
+	
+	scan_queue_free(h->queue);
+	h->queue = queue;
+	
+	return 0;
+}
+
+int hokuyo_set_scan_window(void * v, const char * caller, int scan_size, int detection_margin)
+{
+	hokuyo_t * h = (hokuyo_t *)v;
+	
+	int full_size = (SCAN_END - SCAN_START) / SCAN_SKIP + 1;
+	
+	/* a consumer with fewer rays over the same angle gets each as the nearest return in a cluster */
+	int cluster = (scan_size > 0) ? full_size / scan_size : 0;
+	
+	if ((cluster < 1) || (cluster > 99) || ((full_size + cluster - 1) / cluster != scan_size))
+	{
+		return error_return(caller, "hokuyo_set_scan_window: scan size %d does not divide the %d-point scan", 
+			scan_size, full_size);
+	}
+	
+	/* the rays that scan_update() uses; see coreslam.c */
+	int first = detection_margin + 1;
+	int last = scan_size - detection_margin - 1;
+	
+	if ((detection_margin < 0) || (first > last))
+	{
+		return error_return(caller, "hokuyo_set_scan_window: detection margin %d leaves no rays", detection_margin);
+	}
+	
+	int skip = SCAN_SKIP * cluster;
+	int end = SCAN_START + (last + 1) * skip - 1;
+	
+	pthread_mutex_lock(&h->settings_mutex);
+	
+	h->window_start   = SCAN_START + first * skip;
+	h->window_end     = (end < SCAN_END) ? end : SCAN_END;
+	h->window_skip    = skip;
+	h->window_offset  = first;
+	h->window_size    = scan_size;
+	__atomic_store_n(&h->window_changed, true, __ATOMIC_RELEASE);
+	
+	pthread_mutex_unlock(&h->settings_mutex);
+	
+	return 0;
+}
+
+scan_queue_t * hokuyo_get_scan_queue(void * v)
+{
+	hokuyo_t * h = (hokuyo_t *)v;
+	
+	return h->queue;
 }
 
 
 
 int hokuyo_get_scan(void * v, const char * caller, unsigned int * range)
+{
+	return hokuyo_get_scan_info(v, caller, range, false, NULL);
+}
+
+int hokuyo_get_scan_info(void * v, const char * caller, unsigned int * range, bool next_unseen, scan_queue_info_t * info)
 {
 	hokuyo_t * h = (hokuyo_t *)v;
 	
@@ -1992,48 +2226,28 @@ int hokuyo_get_scan(void * v, const char * caller, unsigned int * range)
 	    return 0;
 	}
 	
-	int n_range = 0;
-	
-	double timeStartSec = _get_current_time_sec();
+	uint64_t deadline_usec = scan_queue_now_usec() + READER_GET_SCAN_TIMEOUT_MSEC*1000;
 	
-	_lock_data_mutex(h);
-	
-	while (!_is_scan_ready(h))
-	{         		    
-		if ((_get_current_time_sec() - timeStartSec)*1000 >= READER_GET_SCAN_TIMEOUT_MSEC)
-		{
-			break;
-		}
+	/* take the newest or oldest unread scan, sleeping until the reader thread publishes if none is unread */
+	while (true)
+	{
+		int n_range = next_unseen ?
+			scan_queue_pop(h->queue, (int *)range, info) :
+			scan_queue_pop_latest(h->queue, (int *)range, info);
 		
-		else if (!_is_scan_ready(h))
+		if (n_range >= 0)
 		{
-			usleep(TIMED_WAIT_USEC);
+			return n_range;
 		}
 		
-		int ret = data__cond_wait(h, READER_GET_SCAN_TIMEOUT_MSEC);
+		uint64_t now_usec = scan_queue_now_usec();
 		
-		if (ret==ETIMEDOUT)
+		if (now_usec >= deadline_usec || scan_queue_wait(h->queue, deadline_usec - now_usec))
 		{
-			message_on_debug(h->debug, caller, "hokuyo_get_scan: timed out");
+			message_on_debug(h->debug, caller, "hokuyo_get_scan: could not get a scan from the sensor");
+			return 0;
 		}
-	}	
-	
-	/* need to verify that the scan is actually ready */
-	if (_is_scan_ready(h))
-	{
-		/* new scan is ready! */
-		memcpy(range, h->data, h->num_data*sizeof(unsigned int));
-		n_range = h->num_data;
-		_set_scan_unready(h);	    
-	} 
-	else 
-	{	    
-		message_on_debug(h->debug, caller, "hokuyo_get_scan: could not get a scan from the sensor");
 	}
-	
-	_unlock_data_mutex(h);
-	
-	return n_range;
 }
 
 void hokuyo_get_str(void * v, const char * caller, char * s)
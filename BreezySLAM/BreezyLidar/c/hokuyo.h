@@ -31,15 +31,51 @@ static const int MAX_NUM_POINTS_UTM_30LX    = 1081*2;
 /* Unused for USB */
 static const int DEFAULT_BAUD_RATE          = 115200;
 
+/* Scans buffered between the reader thread and hokuyo_get_scan() */
+static const int DEFAULT_SCAN_QUEUE_CAPACITY = 4;
+
 #include <stdbool.h>
 
+#include "scan_queue.h"
+
 /* These functions are used by BreezyLidar */
 void * hokuyo_create(const char * caller, bool debug);
 int    hokuyo_connect(void * v, const char * caller, char * device, int baud_rate);
+
+/* As hokuyo_connect, but streams scans into the queue from a serial reactor's thread (see 
+   serial_reactor.h) instead of starting a reader thread of its own */
+int    hokuyo_connect_reactor(void * v, const char * caller, char * device, int baud_rate, void * reactor);
+
+/* Sets the file caching each sensor's baud rate and VV/PP responses by serial number, so that 
+   reconnecting skips probing and PP; NULL or "" for none.  Defaults to ~/.breezylidar_hokuyo.  
+   Call before connecting. */
+void   hokuyo_set_cache_file(void * v, const char * path);
+
+/* Sets a function called, on the thread that reads the sensor, after each scan is published; 
+   NULL for none.  If an unread scan is already waiting, the callback is also called right away. */
+void   hokuyo_set_scan_callback(void * v, void (*callback)(void * user), void * user);
 void   hokuyo_destroy(void * v, const char * caller);
 int    hokuyo_get_scan(void * v, const char * caller, unsigned int * range);
+
+/* As hokuyo_get_scan, but can take the oldest unseen scan instead of the newest, and reports the 
+   scan's sequence number, host CLOCK_MONOTONIC and sensor timestamps, and scans skipped, if info 
+   is not NULL */
+int    hokuyo_get_scan_info(void * v, const char * caller, unsigned int * range, bool next_unseen, 
+                            scan_queue_info_t * info);
 void   hokuyo_get_str(void * v, const char * caller, char * s);
 
+/* Replaces the scan queue (e.g. to use SCAN_QUEUE_BACKPRESSURE); call before hokuyo_connect */
+int    hokuyo_set_scan_queue(void * v, const char * caller, int capacity, int policy);
+
+/* Requests only the rays that a consumer with scan_size rays over the sensor's field of view uses, 
+   ignoring detection_margin of them at each edge as BreezySLAM's scan_update() does.  A smaller 
+   scan_size that divides the full scan has the sensor cluster its points.  Scans are still of 
+   scan_size values, those outside the window being zero.  Can be called while streaming. */
+int    hokuyo_set_scan_window(void * v, const char * caller, int scan_size, int detection_margin);
+
+/* The queue the reader thread publishes into, for consumers that pop scans directly */
+scan_queue_t * hokuyo_get_scan_queue(void * v);
+
 /* These functions are available but unused */
 double hokuyo_get_angle_max(void * v);
 double hokuyo_get_angle_min(void * v);
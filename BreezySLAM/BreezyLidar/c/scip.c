@@ -0,0 +1,264 @@
+/*
+
+scip.c Decoding of SCIP 2.0 measurement data for Hokuyo sensors
+
+Each character of the SCIP 2.0 encodings carries six bits, offset by 0x30, and
+a value is two or three of them, most significant first.  Data lines hold 64
+characters followed by a checksum: the low six bits of their sum, offset by
+0x30.
+
+On x86 processors with SSSE3, detected at run time, whole 64-character lines
+are checked and copied sixteen bytes at a time, their checksums summed with
+psadbw, and values are unpacked four or eight at a time with pshufb and
+pmaddubsw; anything shorter, or any other processor, uses the scalar code.
+Only the SSSE3 routines are compiled for SSSE3, so the library still runs on
+x86 processors without it.
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCIP_SSSE3
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#include <tmmintrin.h>
+#endif
+
+#include "scip.h"
+
+#define LINE_LENGTH 64
+
+enum
+{
+    TWO_DIGITS =   2,
+    THREE_DIGITS = 3
+};
+
+
+/* Local helpers ============================================================ */
+
+/* check and copy one line of n characters, returning their sum, or -1 if a character is not a valid digit */
+static int _strip_line(const char * line, int n, char * data)
+{
+    int sum = 0;
+    int bad = 0;
+
+    int k;
+    for (k=0; k<n; ++k)
+    {
+        unsigned char c = (unsigned char)line[k];
+
+        bad |= (unsigned char)(c - 0x30) > 0x3f;
+        sum += c;
+        data[k] = c;
+    }
+
+    return bad ? -1 : sum;
+}
+
+#ifdef SCIP_SSSE3
+
+/* as _strip_line, for a full line */
+SSSE3_TARGET static int _strip_full_line_ssse3(const char * line, char * data)
+{
+    const __m128i offset = _mm_set1_epi8(0x30);
+    const __m128i digit_max = _mm_set1_epi8(0x3f);
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i sums = zero;
+    __m128i bad = zero;
+
+    int k;
+    for (k=0; k<LINE_LENGTH; k+=16)
+    {
+        __m128i c = _mm_loadu_si128((const __m128i *)(line + k));
+
+        _mm_storeu_si128((__m128i *)(data + k), c);
+
+        /* a digit less 0x30 must be at most 0x3f, unsigned */
+        __m128i d = _mm_sub_epi8(c, offset);
+        bad = _mm_or_si128(bad, _mm_xor_si128(_mm_max_epu8(d, digit_max), digit_max));
+
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(c, zero));
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, zero)) != 0xffff)
+    {
+        return -1;
+    }
+
+    return _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+}
+
+/* decodes whole groups of four or eight values, returning how many */
+SSSE3_TARGET static int _decode_ssse3(const char * data, int length, int encoding, unsigned int * values)
+{
+    int n = 0;
+
+    const __m128i offset = _mm_set1_epi8(0x30);
+    const __m128i zero = _mm_setzero_si128();
+
+    if (encoding == THREE_DIGITS)
+    {
+        /* each 32-bit lane gets its value's characters, least significant first: c, b, a, 0 */
+        const __m128i spread = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+
+        /* then c + 64b and a, then (c + 64b) + 4096a */
+        const __m128i low = _mm_setr_epi8(1, 64, 1, 0, 1, 64, 1, 0, 1, 64, 1, 0, 1, 64, 1, 0);
+        const __m128i high = _mm_setr_epi16(1, 4096, 1, 4096, 1, 4096, 1, 4096);
+
+        /* four values from the first twelve bytes of each load */
+        for (; n+4 <= length/3; n+=4)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(data + 3*n));
+            c = _mm_shuffle_epi8(_mm_sub_epi8(c, offset), spread);
+
+            __m128i v = _mm_madd_epi16(_mm_maddubs_epi16(c, low), high);
+
+            _mm_storeu_si128((__m128i *)(values + n), v);
+        }
+    }
+
+    else
+    {
+        /* 64a + b for each pair of characters */
+        const __m128i weights = _mm_setr_epi8(64, 1, 64, 1, 64, 1, 64, 1, 64, 1, 64, 1, 64, 1, 64, 1);
+
+        for (; n+8 <= length/2; n+=8)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(data + 2*n));
+
+            __m128i v = _mm_maddubs_epi16(_mm_sub_epi8(c, offset), weights);
+
+            _mm_storeu_si128((__m128i *)(values + n),   _mm_unpacklo_epi16(v, zero));
+            _mm_storeu_si128((__m128i *)(values + n+4), _mm_unpackhi_epi16(v, zero));
+        }
+    }
+
+    return n;
+}
+
+#endif
+
+static int _strip_full_line(const char * line, char * data, int ssse3)
+{
+#ifdef SCIP_SSSE3
+    if (ssse3)
+    {
+        return _strip_full_line_ssse3(line, data);
+    }
+#else
+    (void)ssse3;
+#endif
+
+    return _strip_line(line, LINE_LENGTH, data);
+}
+
+static int _decode_scalar(const char * data, int length, int encoding, unsigned int * values)
+{
+    int n = length / encoding;
+
+    int k;
+    for (k=0; k<n; ++k)
+    {
+        const char * p = data + k * encoding;
+
+        values[k] = (encoding == THREE_DIGITS) ?
+            ((p[0] - 0x30) << 12) | ((p[1] - 0x30) << 6) | (p[2] - 0x30) :
+            ((p[0] - 0x30) << 6)  |  (p[1] - 0x30);
+    }
+
+    return n;
+}
+
+
+/* Exported functions ======================================================= */
+
+int scip_strip_lines(const char * lines, int length, char * data)
+{
+    const char * end = lines + length;
+    int count = 0;
+
+#ifdef SCIP_SSSE3
+    const int ssse3 = __builtin_cpu_supports("ssse3");
+#else
+    const int ssse3 = 0;
+#endif
+
+    while (lines < end)
+    {
+        const char * lf;
+
+        /* a full line is 64 characters, the checksum and the LF, rather than 63 and the empty line */
+        if ((end - lines >= LINE_LENGTH + 2) && (lines[LINE_LENGTH+1] == 0x0a) && (lines[LINE_LENGTH] != 0x0a))
+        {
+            lf = lines + LINE_LENGTH + 1;
+        }
+
+        else if (!(lf = (const char *)memchr(lines, 0x0a, end - lines)))
+        {
+            return -1;
+        }
+
+        int n = lf - lines - 1;
+
+        /* the empty line ends the data */
+        if (n < 0)
+        {
+            return count;
+        }
+
+        if (n == 0)
+        {
+            return -1;
+        }
+
+        int sum = (n == LINE_LENGTH) ?
+            _strip_full_line(lines, data + count, ssse3) :
+            _strip_line(lines, n, data + count);
+
+        if ((sum < 0) || (((sum & 0x3f) + 0x30) != lines[n]))
+        {
+            return -1;
+        }
+
+        count += n;
+        lines = lf + 1;
+    }
+
+    /* no empty line */
+    return -1;
+}
+
+int scip_decode(const char * data, int length, int encoding, unsigned int * values)
+{
+    if ((encoding != TWO_DIGITS) && (encoding != THREE_DIGITS))
+    {
+        return -1;
+    }
+
+    int n = 0;
+
+#ifdef SCIP_SSSE3
+
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        n = _decode_ssse3(data, length, encoding, values);
+    }
+
+#endif
+
+    return n + _decode_scalar(data + n*encoding, length - n*encoding, encoding, values + n);
+}
@@ -0,0 +1,33 @@
+/*
+
+scip.h Decoding of SCIP 2.0 measurement data for Hokuyo sensors
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+/* Extra bytes that the buffers passed to these functions must have beyond their data,
+   so that vector loads and stores can run off the end */
+#define SCIP_PADDING 16
+
+/* Strips the data lines of a SCIP 2.0 response -- lines of up to 64 encoded characters, each
+   followed by its checksum and LF, ending with an empty line -- down to the encoded characters,
+   verifying each line's checksum and that every character is a valid encoded digit.  Returns
+   the number of characters copied to data, or -1 if the lines are malformed.  data must hold
+   length + SCIP_PADDING bytes. */
+int scip_strip_lines(const char * lines, int length, char * data);
+
+/* Decodes length characters of stripped data in the 2- or 3-character encoding into values,
+   returning the number of values decoded.  data must have SCIP_PADDING readable bytes beyond
+   its length. */
+int scip_decode(const char * data, int length, int encoding, unsigned int * values);
@@ -38,6 +38,7 @@ along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 
 #define MAX_DEVICE_NAME_LENGTH 128
 #define MAX_NUM_TERM_CHARS     128
+#define RX_BUFFER_SIZE         4096
 
 /*  io modes */ 
 enum 
@@ -65,6 +66,10 @@ typedef struct serial_device_t
     
     struct termios oldterm, newterm;       	/* terminal structs */
     
+    /* bytes read from the device but not yet returned, in rx_buffer[rx_start..rx_end) */
+    char rx_buffer[RX_BUFFER_SIZE];
+    int rx_start, rx_end;
+    
 } serial_device_t;
 
 
@@ -131,6 +136,128 @@ static int set_nonblocking_io(serial_device_t * s, const char * caller)
 }
 
 
+/* move up to byte_count bytes left over from earlier reads into data */
+static int take_buffered(serial_device_t * s, char * data, int byte_count)
+{
+    int buffered = s->rx_end - s->rx_start;
+    int n = buffered < byte_count ? buffered : byte_count;
+    
+    memcpy(data, s->rx_buffer + s->rx_start, n);
+    s->rx_start += n;
+    
+    if (s->rx_start == s->rx_end)
+    {
+        s->rx_start = s->rx_end = 0;
+    }
+    
+    return n;
+}
+
+/* find the first occurrence of sequence seq of length n in buf */
+static const char * find_sequence(const char * buf, int length, const char * seq, int n)
+{
+    const char * end = buf + length;
+    
+    while (end - buf >= n)
+    {
+        const char * p = (const char *)memchr(buf, seq[0], end - buf - n + 1);
+        
+        if (!p)
+        {
+            return NULL;
+        }
+        
+        if (!memcmp(p, seq, n))
+        {
+            return p;
+        }
+        
+        buf = p + 1;
+    }
+    
+    return NULL;
+}
+
+/* read up to and including the terminating sequence, pulling whatever the device has into 
+   rx_buffer and keeping any bytes after the sequence for the next call */
+static int read_to_term_sequence(serial_device_t * s, const char * caller, char * data, int byte_count, int timeout_us)
+{
+    fd_set watched_fds;
+    struct timeval timeout;
+    int retval;
+    int bytes_read_total = 0;   /* bytes already moved to data, none of them ending the sequence */
+    int searched = 0;           /* buffered bytes that cannot start the sequence */
+    int n = s->numTermChars;
+    
+    /* set up for the "select" call */
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_usec = timeout_us % 1000000;
+    
+    while (true)
+    {
+        char * buf = s->rx_buffer + s->rx_start;
+        int buffered = s->rx_end - s->rx_start;
+        
+        const char * match = find_sequence(buf + searched, buffered - searched, s->termSequence, n);
+        
+        if (match && bytes_read_total + (match + n - buf) <= byte_count)
+        {
+            bytes_read_total += take_buffered(s, data + bytes_read_total, match + n - buf);
+            
+            return s->retTermSequence ? bytes_read_total : bytes_read_total - n;
+        }
+        
+        if (bytes_read_total + buffered >= byte_count)
+        {
+            /* discard what the byte-at-a-time reader would have consumed */
+            take_buffered(s, data + bytes_read_total, byte_count - bytes_read_total);
+            
+            return error_return(caller, "serial_device_read_chars: Read too much data. The terminating sequence has not been read");
+        }
+        
+        searched = buffered > n-1 ? buffered - (n-1) : 0;
+        
+        /* make room at the end of the buffer, handing over bytes that cannot be part of the sequence if need be */
+        if (s->rx_end == RX_BUFFER_SIZE)
+        {
+            if (s->rx_start == 0)
+            {
+                bytes_read_total += take_buffered(s, data + bytes_read_total, searched);
+                searched = 0;
+            }
+            
+            memmove(s->rx_buffer, s->rx_buffer + s->rx_start, s->rx_end - s->rx_start);
+            s->rx_end -= s->rx_start;
+            s->rx_start = 0;
+        }
+        
+        FD_ZERO(&watched_fds);
+        FD_SET(s->fd, &watched_fds);
+        
+        if ((retval = select(s->fd + 1, &watched_fds, NULL, NULL, &timeout)) < 1)   /* block until at least 1 char is available or timeout */
+        {                                                                         /* error reading chars */
+            if (retval < 0) 
+            {
+                perror("ReadChars");
+            }
+            else                                                                    /* timeout */
+            {
+                message_on_debug(true, caller, "ReadChars: timeout. The terminating sequence has not been read");
+            }
+            return -1;
+        }
+        
+        /* take everything the device has, up to the room left */
+        int bytes_read = read(s->fd, s->rx_buffer + s->rx_end, RX_BUFFER_SIZE - s->rx_end);
+        
+        if (bytes_read > 0)
+        {
+            s->rx_end += bytes_read;
+        }
+    }
+}
+
+
 /* convert integer speed to baud rate setting */
 static int speed_to_baud(const char * caller, int speed, speed_t * baud)
 {
@@ -171,6 +298,7 @@ void * serial_device_create(const char * caller)
     serial_device_t * s = (serial_device_t *)malloc(sizeof(serial_device_t));
     
     s->connected = false;
+    s->rx_start = s->rx_end = 0;
     
     return (void *)s;
 }
@@ -204,6 +332,7 @@ int serial_device_connect(void * v, const char * caller, const char * device, in
     
     /* Update the connected flag */
     s->connected=true;
+    s->rx_start = s->rx_end = 0;
     
     /* Save current attributes so they can be restored after use */
     if( tcgetattr( s->fd, &s->oldterm ) < 0 )
@@ -268,6 +397,13 @@ bool serial_device_is_connected(void * v, const char * caller)
     return s->connected;    
 }
 
+int serial_device_get_fd(void * v)
+{
+    serial_device_t * s = (serial_device_t *)v;
+
+    return s->connected ? s->fd : -1;    
+}
+
 
 int serial_device_set_baud_rate(void * v, const char * caller, int speed)
 {
@@ -316,6 +452,7 @@ int serial_device_set_baud_rate(void * v, const char * caller, int speed)
     
     /* make sure queue is empty */
     tcflush(s->fd, TCIOFLUSH);
+    s->rx_start = s->rx_end = 0;
     
     /* save the baud rate value */
     s->baud = tempBaud;
@@ -341,8 +478,9 @@ int serial_device_flush_input_buffer(void * v, const char * caller)
     int block=s->block;
     set_nonblocking_io(s, caller);
     
-    /* read off all the chars */
+    /* read off all the chars, including any we were holding */
     while (read(s->fd,c,1000) > 0){}
+    s->rx_start = s->rx_end = 0;
     
     if (block==1)
     {
@@ -367,7 +505,18 @@ int serial_device_read_chars(void * v, const char * caller, char * data, int byt
     int bytes_left = byte_count;
     int retval;
     int bytes_read;
-    int charsMatched=0;
+    
+    /* bytes left over from reading up to a terminating sequence come first */
+    if (s->ioMode != IO_BLOCK_W_TIMEOUT_W_TERM_SEQUENCE)
+    {
+        bytes_read_total = take_buffered(s, data, byte_count);
+        bytes_left      -= bytes_read_total;
+        
+        if (s->ioMode == IO_NONBLOCK_WO_TIMEOUT && bytes_read_total)
+        {
+            return bytes_read_total;
+        }
+    }
     
     switch (s->ioMode)
     {
@@ -453,58 +602,7 @@ int serial_device_read_chars(void * v, const char * caller, char * data, int byt
         
     case IO_BLOCK_W_TIMEOUT_W_TERM_SEQUENCE:
         
-        /* set up for the "select" call */
-        FD_ZERO(&watched_fds);
-        FD_SET(s->fd, &watched_fds);
-        timeout.tv_sec = timeout_us / 1000000;
-        timeout.tv_usec = timeout_us % 1000000;
-        
-        while (bytes_left) 
-        {
-            if ((retval = select(s->fd + 1, &watched_fds, NULL, NULL, &timeout)) < 1)   /* block until at least 1 char is available or timeout */
-            {                                                                         /* error reading chars */
-                if (retval < 0) 
-                {
-                    perror("ReadChars");
-                }
-                else                                                                    /* timeout */
-                {
-                    message_on_debug(true, caller, "ReadChars: timeout. The terminating sequence has not been read");
-                }
-                return -1;
-            }
-            bytes_read = read(s->fd, &(data[bytes_read_total]), 1);
-            
-            if (bytes_read==1)
-            {
-                if (data[bytes_read_total]==s->termSequence[charsMatched])
-                {
-                    charsMatched++;
-                }
-                else 
-                {
-                    charsMatched=0;
-                }
-                
-                bytes_read_total += bytes_read;
-                bytes_left       -= bytes_read;
-                
-                if (charsMatched==s->numTermChars)
-                {
-                    if (s->retTermSequence)
-                    {
-                        return bytes_read_total;
-                    }
-                    
-                    else 
-                    {
-                        return bytes_read_total-s->numTermChars;
-                    }
-                }
-            }
-        }
-        
-        return error_return(caller, "serial_device_read_chars: Read too much data. The terminating sequence has not been read");
+        return read_to_term_sequence(s, caller, data, byte_count, timeout_us);
         
     default:
         
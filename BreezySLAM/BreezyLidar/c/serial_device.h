@@ -32,6 +32,9 @@ int    serial_device_disconnect(void * v, const char * caller);
 
 bool   serial_device_is_connected(void * v, const char * caller);
 
+/* The file descriptor of a connected device, for event loops that poll it; -1 if not connected */
+int    serial_device_get_fd(void * v);
+
 int    serial_device_set_baud_rate(void * v, const char * caller, int baud); 
 
 int    serial_device_flush_input_buffer(void * v, const char * caller);                        
@@ -0,0 +1,632 @@
+/*
+
+serial_reactor.c Event loop multiplexing serial devices on one thread
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "serial_reactor.h"
+#include "serial_device.h"
+#include "message_utils.h"
+
+/* large enough for the longest Hokuyo measurement packet */
+#define RX_BUFFER_SIZE 16384
+#define TX_BUFFER_SIZE 4096
+#define MAX_DEVICES    32
+
+static const int MAX_EVENTS = 16;
+
+/* epoll data for the eventfd that wakes the loop up; devices use their slot index */
+static const uint32_t WAKEUP_ID = 0xffffffff;
+
+typedef struct serial_reactor_device_t
+{
+    bool used;
+
+    /* bumped each time the slot is reused, so stale events for a removed device are ignored */
+    uint32_t generation;
+
+    void * sd;
+    int fd;
+    bool owns_sd;
+
+    /* flag for debugging output about the device */
+    bool debug;
+
+    serial_reactor_callback_t callback;
+    void * user;
+
+    /* bytes received but not yet consumed by the callback, in rx_buffer[rx_start..rx_end) */
+    char * rx_buffer;
+    int rx_start, rx_end;
+
+    /* bytes queued by serial_reactor_write() that the device has not yet accepted */
+    char * tx_buffer;
+    int tx_start, tx_end;
+
+} serial_reactor_device_t;
+
+typedef struct serial_reactor_t
+{
+    int epoll_fd;
+    int wakeup_fd;
+
+    serial_reactor_device_t devices[MAX_DEVICES];
+
+    /* held while dispatching and while devices are added, removed or written from other threads;
+       recursive so that callbacks can call back into the reactor */
+    pthread_mutex_t mutex;
+
+    /* set by serial_reactor_stop() from any thread; read and written with __atomic builtins */
+    bool stopping;
+
+    /* guarded by mutex: the thread started by serial_reactor_start() until it is joined, and whether
+       it was stopped from one of its own callbacks, which cannot join it */
+    pthread_t thread;
+    bool thread_is_running;
+    bool thread_needs_join;
+
+} serial_reactor_t;
+
+
+
+/* Local helpers ============================================================ */
+
+static uint64_t _event_data(int id, uint32_t generation)
+{
+    return ((uint64_t)generation << 32) | (uint32_t)id;
+}
+
+static int _watch(serial_reactor_t * r, const char * caller, int op, int id)
+{
+    serial_reactor_device_t * d = &r->devices[id];
+
+    struct epoll_event event;
+    event.events = EPOLLIN | (d->tx_end > d->tx_start ? EPOLLOUT : 0);
+    event.data.u64 = _event_data(id, d->generation);
+
+    if (epoll_ctl(r->epoll_fd, op, d->fd, &event))
+    {
+        return error_return(caller, "serial_reactor: could not watch device: %s", strerror(errno));
+    }
+
+    return 0;
+}
+
+static void _remove(serial_reactor_t * r, const char * caller, int id)
+{
+    serial_reactor_device_t * d = &r->devices[id];
+
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_DEL, d->fd, NULL);
+
+    if (d->owns_sd)
+    {
+        serial_device_disconnect(d->sd, caller);
+        serial_device_destroy(d->sd, caller);
+    }
+
+    free(d->rx_buffer);
+    free(d->tx_buffer);
+
+    d->used = false;
+    d->generation++;
+}
+
+/* write as much of the queued output as the device accepts, watching for room if some is left */
+static int _flush(serial_reactor_t * r, const char * caller, int id)
+{
+    serial_reactor_device_t * d = &r->devices[id];
+
+    bool was_waiting = d->tx_end > d->tx_start;
+
+    while (d->tx_end > d->tx_start)
+    {
+        int n = write(d->fd, d->tx_buffer + d->tx_start, d->tx_end - d->tx_start);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+
+            return error_return(caller, "serial_reactor: could not write to device: %s", strerror(errno));
+        }
+
+        d->tx_start += n;
+    }
+
+    if (d->tx_start == d->tx_end)
+    {
+        d->tx_start = d->tx_end = 0;
+    }
+
+    /* only touch the epoll set when the need for EPOLLOUT changes */
+    bool is_waiting = d->tx_end > d->tx_start;
+
+    return is_waiting != was_waiting ? _watch(r, caller, EPOLL_CTL_MOD, id) : 0;
+}
+
+/* read everything available from a device, handing it to its callback as it comes */
+static int _receive(serial_reactor_t * r, const char * caller, int id)
+{
+    serial_reactor_device_t * d = &r->devices[id];
+
+    while (true)
+    {
+        /* move an unconsumed partial message to the front to make room behind it */
+        if (d->rx_start > 0)
+        {
+            memmove(d->rx_buffer, d->rx_buffer + d->rx_start, d->rx_end - d->rx_start);
+            d->rx_end -= d->rx_start;
+            d->rx_start = 0;
+        }
+
+        if (d->rx_end == RX_BUFFER_SIZE)
+        {
+            message_on_debug(d->debug, caller, "serial_reactor: discarding %d bytes that the parser never consumed", d->rx_end);
+            d->rx_end = 0;
+        }
+
+        /* in non-blocking mode this returns 0 when nothing is waiting */
+        int n = serial_device_read_chars(d->sd, caller, d->rx_buffer + d->rx_end, RX_BUFFER_SIZE - d->rx_end, 0);
+
+        if (n <= 0)
+        {
+            return n;
+        }
+
+        d->rx_end += n;
+
+        uint32_t generation = d->generation;
+
+        int consumed = d->callback(d->user, d->rx_buffer + d->rx_start, d->rx_end - d->rx_start);
+
+        /* the callback may have removed its own device */
+        if (!d->used || d->generation != generation)
+        {
+            return 0;
+        }
+
+        if (consumed < 0)
+        {
+            return -1;
+        }
+
+        d->rx_start += consumed < d->rx_end - d->rx_start ? consumed : d->rx_end - d->rx_start;
+    }
+}
+
+static void * _run(void * v)
+{
+    serial_reactor_loop(v, "serial_reactor");
+
+    return NULL;
+}
+
+
+
+/* Exported functions ======================================================= */
+
+void * serial_reactor_create(const char * caller)
+{
+    serial_reactor_t * r = (serial_reactor_t *)calloc(1, sizeof(serial_reactor_t));
+
+    r->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    r->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (r->epoll_fd < 0 || r->wakeup_fd < 0)
+    {
+        error_return(caller, "serial_reactor_create: %s", strerror(errno));
+
+        if (r->epoll_fd >= 0) close(r->epoll_fd);
+        if (r->wakeup_fd >= 0) close(r->wakeup_fd);
+        free(r);
+        return NULL;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = WAKEUP_ID;
+    epoll_ctl(r->epoll_fd, EPOLL_CTL_ADD, r->wakeup_fd, &event);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&r->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return r;
+}
+
+void serial_reactor_destroy(void * v, const char * caller)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    serial_reactor_stop(r, caller);
+
+    int id;
+    for (id=0; id<MAX_DEVICES; ++id)
+    {
+        if (r->devices[id].used)
+        {
+            _remove(r, caller, id);
+        }
+    }
+
+    close(r->wakeup_fd);
+    close(r->epoll_fd);
+
+    pthread_mutex_destroy(&r->mutex);
+
+    free(r);
+}
+
+int serial_reactor_add(void * v, const char * caller, void * sd, serial_reactor_callback_t callback, void * user,
+                       bool debug)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    if (!serial_device_is_connected(sd, caller))
+    {
+        return error_return(caller, "serial_reactor_add: device is not connected");
+    }
+
+    if (serial_device_set_io_nonblock_wo_timeout(sd, caller))
+    {
+        return error_return(caller, "serial_reactor_add: could not set non-blocking io");
+    }
+
+    pthread_mutex_lock(&r->mutex);
+
+    int id;
+    for (id=0; id<MAX_DEVICES && r->devices[id].used; ++id)
+        ;
+
+    if (id == MAX_DEVICES)
+    {
+        pthread_mutex_unlock(&r->mutex);
+        return error_return(caller, "serial_reactor_add: too many devices");
+    }
+
+    serial_reactor_device_t * d = &r->devices[id];
+
+    d->sd        = sd;
+    d->fd        = serial_device_get_fd(sd);
+    d->owns_sd   = false;
+    d->callback  = callback;
+    d->user      = user;
+    d->debug     = debug;
+    d->rx_buffer = (char *)malloc(RX_BUFFER_SIZE);
+    d->tx_buffer = (char *)malloc(TX_BUFFER_SIZE);
+    d->rx_start  = d->rx_end = 0;
+    d->tx_start  = d->tx_end = 0;
+
+    if (!d->rx_buffer || !d->tx_buffer)
+    {
+        free(d->rx_buffer);
+        free(d->tx_buffer);
+        pthread_mutex_unlock(&r->mutex);
+        return error_return(caller, "serial_reactor_add: could not allocate buffers");
+    }
+
+    if (_watch(r, caller, EPOLL_CTL_ADD, id))
+    {
+        free(d->rx_buffer);
+        free(d->tx_buffer);
+        pthread_mutex_unlock(&r->mutex);
+        return -1;
+    }
+
+    d->used = true;
+
+    pthread_mutex_unlock(&r->mutex);
+
+    /* bytes the device already buffered while connecting are not announced by epoll */
+    eventfd_write(r->wakeup_fd, 1);
+
+    return id;
+}
+
+int serial_reactor_open(void * v, const char * caller, const char * device, int baud_rate,
+                        serial_reactor_callback_t callback, void * user, bool debug)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    void * sd = serial_device_create(caller);
+
+    if (serial_device_connect(sd, caller, device, baud_rate))
+    {
+        serial_device_destroy(sd, caller);
+        return error_return(caller, "serial_reactor_open: could not connect to %s", device);
+    }
+
+    int id = serial_reactor_add(r, caller, sd, callback, user, debug);
+
+    if (id < 0)
+    {
+        serial_device_disconnect(sd, caller);
+        serial_device_destroy(sd, caller);
+        return -1;
+    }
+
+    r->devices[id].owns_sd = true;
+
+    return id;
+}
+
+int serial_reactor_remove(void * v, const char * caller, int id)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    if (id < 0 || id >= MAX_DEVICES)
+    {
+        return error_return(caller, "serial_reactor_remove: bad device id");
+    }
+
+    pthread_mutex_lock(&r->mutex);
+
+    if (!r->devices[id].used)
+    {
+        pthread_mutex_unlock(&r->mutex);
+        return error_return(caller, "serial_reactor_remove: no such device");
+    }
+
+    _remove(r, caller, id);
+
+    pthread_mutex_unlock(&r->mutex);
+
+    return 0;
+}
+
+int serial_reactor_write(void * v, const char * caller, int id, const char * data, int length)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    if (id < 0 || id >= MAX_DEVICES)
+    {
+        return error_return(caller, "serial_reactor_write: bad device id");
+    }
+
+    pthread_mutex_lock(&r->mutex);
+
+    serial_reactor_device_t * d = &r->devices[id];
+
+    if (!d->used)
+    {
+        pthread_mutex_unlock(&r->mutex);
+        return error_return(caller, "serial_reactor_write: no such device");
+    }
+
+    if (d->tx_start > 0)
+    {
+        memmove(d->tx_buffer, d->tx_buffer + d->tx_start, d->tx_end - d->tx_start);
+        d->tx_end -= d->tx_start;
+        d->tx_start = 0;
+    }
+
+    if (length > TX_BUFFER_SIZE - d->tx_end)
+    {
+        pthread_mutex_unlock(&r->mutex);
+        return error_return(caller, "serial_reactor_write: output buffer is full");
+    }
+
+    memcpy(d->tx_buffer + d->tx_end, data, length);
+    d->tx_end += length;
+
+    int retval = _flush(r, caller, id);
+
+    pthread_mutex_unlock(&r->mutex);
+
+    return retval;
+}
+
+int serial_reactor_run(void * v, const char * caller, int timeout_ms)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    struct epoll_event events[MAX_EVENTS];
+
+    int nevents = epoll_wait(r->epoll_fd, events, MAX_EVENTS, timeout_ms);
+
+    if (nevents < 0)
+    {
+        return errno == EINTR ? 0 : error_return(caller, "serial_reactor_run: %s", strerror(errno));
+    }
+
+    pthread_mutex_lock(&r->mutex);
+
+    int nserviced = 0;
+
+    int k;
+    for (k=0; k<nevents; ++k)
+    {
+        if (events[k].data.u64 == WAKEUP_ID)
+        {
+            eventfd_t count;
+            eventfd_read(r->wakeup_fd, &count);
+
+            /* pick up bytes that arrived before a device was added */
+            int id;
+            for (id=0; id<MAX_DEVICES; ++id)
+            {
+                if (r->devices[id].used && _receive(r, caller, id) < 0 && r->devices[id].used)
+                {
+                    _remove(r, caller, id);
+                }
+            }
+
+            continue;
+        }
+
+        int id = (int)(events[k].data.u64 & 0xffffffff);
+        uint32_t generation = (uint32_t)(events[k].data.u64 >> 32);
+        serial_reactor_device_t * d = &r->devices[id];
+
+        /* removed (and perhaps replaced) since epoll_wait() returned */
+        if (!d->used || d->generation != generation)
+        {
+            continue;
+        }
+
+        nserviced++;
+
+        if ((events[k].events & EPOLLOUT) && _flush(r, caller, id))
+        {
+            _remove(r, caller, id);
+            continue;
+        }
+
+        if ((events[k].events & EPOLLIN) && _receive(r, caller, id) < 0)
+        {
+            if (d->used)
+            {
+                _remove(r, caller, id);
+            }
+            continue;
+        }
+
+        if (events[k].events & (EPOLLHUP | EPOLLERR))
+        {
+            message_on_debug(r->devices[id].debug, caller, "serial_reactor_run: device hung up");
+            _remove(r, caller, id);
+        }
+    }
+
+    pthread_mutex_unlock(&r->mutex);
+
+    return nserviced;
+}
+
+int serial_reactor_loop(void * v, const char * caller)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    while (!__atomic_load_n(&r->stopping, __ATOMIC_ACQUIRE))
+    {
+        if (serial_reactor_run(r, caller, -1) < 0)
+        {
+            return -1;
+        }
+    }
+
+    __atomic_store_n(&r->stopping, false, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int serial_reactor_start(void * v, const char * caller)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    pthread_mutex_lock(&r->mutex);
+
+    bool is_running = r->thread_is_running;
+    bool needs_join = r->thread_needs_join;
+    bool is_self = is_running && pthread_equal(r->thread, pthread_self());
+
+    pthread_mutex_unlock(&r->mutex);
+
+    if (is_running && (!needs_join || is_self))
+    {
+        return error_return(caller, is_self ?
+            "serial_reactor_start: cannot restart from the reactor's own thread" :
+            "serial_reactor_start: already running");
+    }
+
+    /* a thread stopped from its own callback is on its way out, and needs joining first */
+    if (is_running)
+    {
+        serial_reactor_stop(r, caller);
+    }
+
+    __atomic_store_n(&r->stopping, false, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&r->mutex);
+
+    if (pthread_create(&r->thread, NULL, _run, r))
+    {
+        pthread_mutex_unlock(&r->mutex);
+
+        return error_return(caller, "serial_reactor_start: could not create thread");
+    }
+
+    r->thread_is_running = true;
+    r->thread_needs_join = false;
+
+    pthread_mutex_unlock(&r->mutex);
+
+    return 0;
+}
+
+int serial_reactor_stop(void * v, const char * caller)
+{
+    serial_reactor_t * r = (serial_reactor_t *)v;
+
+    pthread_mutex_lock(&r->mutex);
+
+    __atomic_store_n(&r->stopping, true, __ATOMIC_RELEASE);
+    eventfd_write(r->wakeup_fd, 1);
+
+    bool join = false;
+    pthread_t thread = r->thread;
+
+    if (r->thread_is_running)
+    {
+        /* a callback cannot join its own thread: leave that to serial_reactor_start() or _destroy() */
+        if (pthread_equal(thread, pthread_self()))
+        {
+            r->thread_needs_join = true;
+        }
+        else
+        {
+            join = true;
+        }
+    }
+
+    pthread_mutex_unlock(&r->mutex);
+
+    if (join)
+    {
+        int err = pthread_join(thread, NULL);
+
+        pthread_mutex_lock(&r->mutex);
+        r->thread_is_running = false;
+        r->thread_needs_join = false;
+        pthread_mutex_unlock(&r->mutex);
+
+        if (err)
+        {
+            return error_return(caller, "serial_reactor_stop: could not join the reactor thread: %s", strerror(err));
+        }
+    }
+
+    return 0;
+}
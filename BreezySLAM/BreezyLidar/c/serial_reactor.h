@@ -0,0 +1,65 @@
+/*
+
+serial_reactor.h Event loop multiplexing serial devices on one thread
+
+A reactor watches any number of connected serial devices with epoll and
+calls a protocol parser for each as bytes arrive, so that several lidars and
+Arduinos can share one thread instead of each blocking a reader thread of
+its own.
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <stdbool.h>
+
+/* Parser called on the reactor thread with the bytes received from a device and not yet consumed.
+   Returns how many bytes it consumed; the rest are passed again, with anything newer appended,
+   when more arrive.  A negative return removes the device from the reactor. */
+typedef int (*serial_reactor_callback_t)(void * user, const char * data, int length);
+
+void * serial_reactor_create(const char * caller);
+
+/* Stops the reactor and removes all its devices; devices it opened are closed */
+void   serial_reactor_destroy(void * v, const char * caller);
+
+/* Watches a device connected with serial_device_connect(), switching it to non-blocking IO, and
+   reporting on it to stderr if debug is set.
+   Returns an id for the device, or -1 on failure; a reactor watches at most 32 devices. */
+int    serial_reactor_add(void * v, const char * caller, void * sd, serial_reactor_callback_t callback, void * user,
+                          bool debug);
+
+/* Connects to a device and watches it, closing it again when it is removed */
+int    serial_reactor_open(void * v, const char * caller, const char * device, int baud_rate,
+                           serial_reactor_callback_t callback, void * user, bool debug);
+
+/* Stops watching a device.  Once this returns, the callback for the device will not be called again. */
+int    serial_reactor_remove(void * v, const char * caller, int id);
+
+/* Queues bytes for a device, writing them as the device accepts them without blocking */
+int    serial_reactor_write(void * v, const char * caller, int id, const char * data, int length);
+
+/* Waits up to timeout_ms (-1 for no limit) for the devices and dispatches what arrived.
+   Returns the number of devices serviced, or -1 on error. */
+int    serial_reactor_run(void * v, const char * caller, int timeout_ms);
+
+/* Runs the reactor on the calling thread until serial_reactor_stop() */
+int    serial_reactor_loop(void * v, const char * caller);
+
+/* Runs the reactor on a thread of its own until serial_reactor_stop() */
+int    serial_reactor_start(void * v, const char * caller);
+
+/* Makes serial_reactor_loop() return, and joins the thread started by serial_reactor_start();
+   safe to call from any thread, including callbacks, which leave the join to the next
+   serial_reactor_start() or serial_reactor_destroy() */
+int    serial_reactor_stop(void * v, const char * caller);
@@ -0,0 +1,128 @@
+/**
+*
+* NextScan.hpp - C++20 coroutine interface for waiting on BreezyLidar scans
+*
+* Copyright (C) 2014 Simon D. Levy
+
+* This code is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This code is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEXTSCAN_HPP
+#define NEXTSCAN_HPP
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+
+#include "URG04LX.hpp"
+#include "scan_queue.h"
+
+/**
+* Awaitable for the oldest scan not yet gotten from a URG04LX.  Unless a scan is
+* already waiting, the awaiting coroutine is suspended and resumed on the thread
+* that reads the sensor (e.g. the SerialReactor's), so one thread can serve many
+* lidars.  The coroutine must be the only consumer of the lidar's scans.
+*/
+class NextScan
+{
+
+public:
+
+/**
+* Builds a NextScan awaitable; see next_scan().
+*/
+NextScan(URG04LX & lidar, unsigned int * range, struct scan_queue_info_t * info) :
+    lidar(lidar), range(range), info(info), npoints(0)
+{
+}
+
+bool await_ready(void)
+{
+    return this->take();
+}
+
+void await_suspend(std::coroutine_handle<> handle)
+{
+    this->handle = handle;
+
+    // Called right away if a scan arrived since await_ready(), which may resume us
+    // before this returns, so this object must not be touched afterwards
+    this->lidar.onScan(NextScan::published, this);
+}
+
+int await_resume(void)
+{
+    return this->npoints;
+}
+
+private:
+
+    URG04LX & lidar;
+    unsigned int * range;
+    struct scan_queue_info_t * info;
+    int npoints;
+    std::coroutine_handle<> handle;
+
+    bool take(void)
+    {
+        this->npoints = scan_queue_pop(this->lidar.getScanQueue(), (int *)this->range, this->info);
+
+        return this->npoints >= 0;
+    }
+
+    static void published(void * user)
+    {
+        NextScan * self = (NextScan *)user;
+
+        if (self->take())
+        {
+            self->lidar.onScan(NULL, NULL);
+            self->handle.resume();
+        }
+    }
+};
+
+/**
+* Waits, in a coroutine, for the oldest scan not yet gotten from a URG04LX:
+* <tt>int n = co_await next_scan(lidar, range);</tt>
+* @param lidar the lidar
+* @param range gets scan range values in mm, as for URG04LX::getScan()
+* @param info if not NULL, gets the scan's sequence number and timestamps
+* @return an awaitable giving the number of range values obtained
+*/
+inline NextScan next_scan(URG04LX & lidar, unsigned int * range, struct scan_queue_info_t * info = NULL)
+{
+    return NextScan(lidar, range, info);
+}
+
+/**
+* Return type for a coroutine that consumes scans: it starts running when called
+* and its frame is freed when it returns.
+*/
+struct ScanTask
+{
+    struct promise_type
+    {
+        ScanTask get_return_object(void) { return ScanTask(); }
+        std::suspend_never initial_suspend(void) { return std::suspend_never(); }
+        std::suspend_never final_suspend(void) noexcept { return std::suspend_never(); }
+        void return_void(void) { }
+        void unhandled_exception(void) { std::terminate(); }
+    };
+};
+
+#endif // C++20 coroutines
+
+#endif // NEXTSCAN_HPP
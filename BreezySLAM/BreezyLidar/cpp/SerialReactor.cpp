@@ -0,0 +1,65 @@
+/**
+*
+* SerialReactor.cpp - C++ code for BreezyLidar SerialReactor class
+*
+* Copyright (C) 2014 Simon D. Levy
+
+* This code is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as 
+* published by the Free Software Foundation, either version 3 of the 
+* License, or (at your option) any later version.
+* 
+* This code is distributed in the hope that it will be useful,     
+* but WITHOUT ANY WARRANTY without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public License 
+* along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SerialReactor.hpp"
+
+#include "serial_reactor.h"
+
+
+SerialReactor::SerialReactor(void)
+{
+    this->reactor = serial_reactor_create("SerialReactor::SerialReactor");
+}
+
+SerialReactor::~SerialReactor()
+{
+    serial_reactor_destroy(this->reactor, "SerialReactor::~SerialReactor");
+}
+
+int SerialReactor::open(const std::string device, int baud_rate, 
+                        int (*callback)(void * user, const char * data, int length), void * user, bool debug)
+{
+    return serial_reactor_open(this->reactor, "SerialReactor::open", device.c_str(), baud_rate, callback, user, debug);
+}
+
+int SerialReactor::write(int id, const char * data, int length)
+{
+    return serial_reactor_write(this->reactor, "SerialReactor::write", id, data, length);
+}
+
+int SerialReactor::remove(int id)
+{
+    return serial_reactor_remove(this->reactor, "SerialReactor::remove", id);
+}
+
+int SerialReactor::run(int timeout_ms)
+{
+    return serial_reactor_run(this->reactor, "SerialReactor::run", timeout_ms);
+}
+
+int SerialReactor::start(void)
+{
+    return serial_reactor_start(this->reactor, "SerialReactor::start");
+}
+
+int SerialReactor::stop(void)
+{
+    return serial_reactor_stop(this->reactor, "SerialReactor::stop");
+}
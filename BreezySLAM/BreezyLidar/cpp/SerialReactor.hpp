@@ -0,0 +1,105 @@
+/**
+*
+* SerialReactor.hpp - C++ header for BreezyLidar SerialReactor class
+*
+* Copyright (C) 2014 Simon D. Levy
+
+* This code is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as 
+* published by the Free Software Foundation, either version 3 of the 
+* License, or (at your option) any later version.
+* 
+* This code is distributed in the hope that it will be useful,     
+* but WITHOUT ANY WARRANTY without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public License 
+* along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SERIALREACTOR_HPP
+#define SERIALREACTOR_HPP
+
+#include <string>
+using namespace std; 
+
+/**
+* An event loop that reads any number of serial devices on one thread, handing
+* their bytes to protocol parsers as they arrive.  Lidars join a reactor through
+* URG04LX::connect(SerialReactor &, ...); other devices through open().
+*/
+class SerialReactor
+{
+    
+public:
+    
+/**
+* Builds a SerialReactor object with no devices.
+* 
+*/    
+SerialReactor(void);
+
+/**
+* Stops this SerialReactor and closes the devices it opened.
+* 
+*/
+~SerialReactor();
+
+/**
+* Connects to a device and watches it.
+* @param device  device name
+* @param baud_rate baud rate
+* @param callback called on the reactor thread with the bytes received and not yet 
+*        consumed; returns the number of bytes it consumed, or -1 to close the device
+* @param user passed to callback
+* @param debug if true, reports on the device to stderr
+* @return an id for the device, or -1 on failure
+*/
+int open(const std::string device, int baud_rate, 
+         int (*callback)(void * user, const char * data, int length), void * user, bool debug = false);
+
+/**
+* Queues bytes for a device, writing them as it accepts them without blocking.
+* @param id the device's id
+* @param data the bytes
+* @param length how many bytes
+* @return 0 on success, -1 on failure
+*/
+int write(int id, const char * data, int length);
+
+/**
+* Stops watching a device, closing it if it was opened by open().
+* @param id the device's id
+* @return 0 on success, -1 on failure
+*/
+int remove(int id);
+
+/**
+* Waits for the devices and dispatches what arrived, on the calling thread.
+* @param timeout_ms longest time to wait, or -1 for no limit
+* @return number of devices serviced, or -1 on error
+*/
+int run(int timeout_ms = -1);
+
+/**
+* Runs this SerialReactor on a thread of its own until stop().
+* @return 0 on success, -1 on failure
+*/
+int start(void);
+
+/**
+* Stops the thread started by start().
+* @return 0 on success, -1 on failure
+*/
+int stop(void);
+
+
+private:    
+
+    friend class URG04LX;
+    
+    void * reactor;
+};
+
+#endif // SERIALREACTOR_HPP
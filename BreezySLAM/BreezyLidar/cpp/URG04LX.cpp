@@ -20,6 +20,7 @@
 
 
 #include "URG04LX.hpp"
+#include "SerialReactor.hpp"
 
 #include "hokuyo.h"
 
@@ -36,16 +37,46 @@ URG04LX::~URG04LX()
     
 }
 
+void URG04LX::setCacheFile(const std::string path)
+{
+    hokuyo_set_cache_file(this->hokuyo, path.c_str());
+}
+
 int URG04LX::connect(const std::string device, int baud_rate)
 {
     return hokuyo_connect(this->hokuyo, "URG04LX::connect", (char *)device.c_str(), baud_rate);    
 }
+
+int URG04LX::connect(SerialReactor & reactor, const std::string device, int baud_rate)
+{
+    return hokuyo_connect_reactor(this->hokuyo, "URG04LX::connect", (char *)device.c_str(), baud_rate, reactor.reactor);    
+}
   
 int URG04LX::getScan(unsigned int * range)
 {        
     return hokuyo_get_scan(this->hokuyo, "URG04LX::getScan", range);
 }
 
+int URG04LX::getScan(unsigned int * range, bool next_unseen, scan_queue_info_t * info)
+{        
+    return hokuyo_get_scan_info(this->hokuyo, "URG04LX::getScan", range, next_unseen, info);
+}
+
+int URG04LX::setScanWindow(int scan_size, int detection_margin)
+{
+    return hokuyo_set_scan_window(this->hokuyo, "URG04LX::setScanWindow", scan_size, detection_margin);
+}
+
+scan_queue_t * URG04LX::getScanQueue(void)
+{
+    return hokuyo_get_scan_queue(this->hokuyo);
+}
+
+void URG04LX::onScan(void (*callback)(void * user), void * user)
+{
+    hokuyo_set_scan_callback(this->hokuyo, callback, user);
+}
+
 
 ostream& operator<< (ostream & out, URG04LX & urg)
 {
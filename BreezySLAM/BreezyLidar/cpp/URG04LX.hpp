@@ -18,10 +18,18 @@
 * along with this code.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef URG04LX_HPP
+#define URG04LX_HPP
+
 #include <string>
 #include <iostream>
 using namespace std; 
 
+struct scan_queue_t;
+struct scan_queue_info_t;
+
+class SerialReactor;
+
 /**
 * A class for the Hokuyo URG-04LX Lidar unit.
 */
@@ -37,6 +45,14 @@ public:
 */    
 URG04LX(const bool debug = false);
 
+/**
+* Sets the file caching each sensor's baud rate and parameters by serial number,
+* so that reconnecting is faster; call before connect().
+* @param path the file, or "" for no cache (default ~/.breezylidar_hokuyo)
+* 
+*/    
+void setCacheFile(const std::string path);
+
 /**
 * Connects to a URG04-LX device.
 * @param device  device name
@@ -45,6 +61,16 @@ URG04LX(const bool debug = false);
 */    
 int connect(const std::string device, int baud_rate = 115200);
 
+/**
+* Connects to a URG04-LX device, streaming its scans from a SerialReactor's
+* thread instead of a reader thread of this object's own.
+* @param reactor the reactor to read the device
+* @param device  device name
+* @param baud_rate baud rate (irrelevant for USB)
+* 
+*/    
+int connect(SerialReactor & reactor, const std::string device, int baud_rate = 115200);
+
 /**
 * Deallocates this URG04LX object.
 * 
@@ -59,6 +85,43 @@ int connect(const std::string device, int baud_rate = 115200);
 */
 int getScan(unsigned int * range);
 
+/**
+* Gets a scan from the URG-04LX, waiting on the reader thread if none is unread.
+* @param range gets scan range values in mm, as above
+* @param next_unseen true for the oldest scan not yet gotten, false for the newest
+* @param info if not NULL, gets the scan's sequence number, CLOCK_MONOTONIC and 
+*        sensor timestamps, and the number of scans skipped before it
+* @return number of range values obtained       
+*/
+int getScan(unsigned int * range, bool next_unseen, struct scan_queue_info_t * info = NULL);
+
+/**
+* Asks the sensor for only the rays a consumer uses, such as a BreezySLAM Laser
+* with the same field of view, which ignores detection_margin rays at each edge;
+* fewer bytes then cross the serial link and fewer values are decoded.  A
+* scan_size that divides 682 has the sensor cluster its points.  Scans still
+* have scan_size values, those outside the window being zero.
+* @param scan_size number of rays the consumer expects
+* @param detection_margin rays ignored at each edge
+* @return 0 on success, -1 if the sensor cannot provide that window
+*/
+int setScanWindow(int scan_size, int detection_margin = 0);
+
+/**
+* Gets the queue into which scans are published as they arrive, for consumers
+* (such as CoreSLAM::update()) that want every scan rather than the newest.
+* @return the scan queue
+*/
+struct scan_queue_t * getScanQueue(void);
+
+/**
+* Sets a function to call, on the thread that reads the sensor, after each scan
+* is published; also called right away if an unread scan is already waiting.
+* @param callback the function, or NULL for none
+* @param user passed to callback
+*/
+void onScan(void (*callback)(void * user), void * user);
+
 
 friend ostream& operator<< (ostream & out, URG04LX & urg);
 
@@ -67,3 +130,5 @@ private:
     
     void * hokuyo;
 };
+
+#endif // URG04LX_HPP
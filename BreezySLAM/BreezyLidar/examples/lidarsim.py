@@ -0,0 +1,542 @@
+#!/usr/bin/env python3
+
+'''
+lidarsim.py : Simulates Hokuyo (SCIP 2.0) and RPLidar sensors on pseudo-terminals,
+              so that drivers can be tested and benchmarked without hardware.
+
+Usage:  lidarsim.py [options] [LOGFILE]
+
+Each simulated sensor is the slave side of a pty, whose name is printed (or
+linked to with --link) for the driver to open.  Scans are replayed in a loop
+from a Paris Mines Tech log such as ../../examples/exp1.dat, or are of a
+round room if no log is given.
+
+Hokuyo sensors answer VV, PP, II, BM, QT, RS, SS, TM and SCIP2.0, and send
+scans for GD/GS and MD/MS in either encoding.  RPLidar sensors answer
+GET_INFO and GET_HEALTH, and stream SCAN / FORCE_SCAN nodes or EXPRESS_SCAN
+capsules until STOP or RESET, following rplidar_cmd.h.
+
+Options:
+
+    --protocol scip|rplidar   protocol to speak (default scip)
+    --model urg04lx|utm30lx   Hokuyo model to report (default urg04lx)
+    --rate HZ                 scans per second (default: the model's own rate)
+    --jitter MS               spread each scan's timing by up to +/- MS milliseconds
+    --corrupt P               corrupt each scan with probability P: flip a bit,
+                              drop a byte, or prefix garbage
+    --devices N               number of sensors to simulate (default 1)
+    --link PATH               symlink PATH (PATH0, PATH1, ... for several devices)
+                              to the pty
+    --seed N                  random seed for jitter and corruption
+
+Example:
+
+    lidarsim.py --link /tmp/urg --rate 40 --corrupt 0.01 ../../examples/exp2.dat
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+'''
+
+import argparse
+import os
+import random
+import select
+import signal
+import struct
+import sys
+import time
+import tty
+
+from math import degrees, pi
+
+# Hokuyo models: PP parameters and product string
+MODELS = {
+    'urg04lx' : {
+        'PROD' : 'SOKUIKI Sensor URG-04LX',
+        'MODL' : 'URG-04LX(Hokuyo Automatic Co.,Ltd.)',
+        'DMIN' : 20, 'DMAX' : 5600, 'ARES' : 1024, 'AMIN' : 44, 'AMAX' : 725, 'AFRT' : 384, 'SCAN' : 600,
+        'STEPS' : 769 },
+    'utm30lx' : {
+        'PROD' : 'SOKUIKI Sensor TOP-URG UTM-30LX',
+        'MODL' : 'UTM-30LX',
+        'DMIN' : 23, 'DMAX' : 60000, 'ARES' : 1440, 'AMIN' : 0, 'AMAX' : 1080, 'AFRT' : 540, 'SCAN' : 2400,
+        'STEPS' : 1081 }
+}
+
+# Angle and step of the logged URG-04LX scans: step 44 onward, 1024 steps per revolution
+LOG_FIRST_STEP   = 44
+LOG_FRONT_STEP   = 384
+LOG_STEPS_PER_REV = 1024
+
+# RPLidar protocol (rplidar_protocol.h, rplidar_cmd.h)
+RPLIDAR_CMD_SYNC_BYTE         = 0xA5
+RPLIDAR_CMDFLAG_HAS_PAYLOAD   = 0x80
+RPLIDAR_ANS_SYNC_BYTES        = b'\xa5\x5a'
+RPLIDAR_ANS_PKTFLAG_LOOP      = 0x1
+RPLIDAR_CMD_STOP              = 0x25
+RPLIDAR_CMD_SCAN              = 0x20
+RPLIDAR_CMD_FORCE_SCAN        = 0x21
+RPLIDAR_CMD_RESET             = 0x40
+RPLIDAR_CMD_GET_DEVICE_INFO   = 0x50
+RPLIDAR_CMD_GET_DEVICE_HEALTH = 0x52
+RPLIDAR_CMD_EXPRESS_SCAN      = 0x82
+RPLIDAR_ANS_TYPE_MEASUREMENT  = 0x81
+RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED = 0x82
+RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1 = 0xA
+RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2 = 0x5
+RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT = 0x8000
+RPLIDAR_ANS_TYPE_DEVINFO      = 0x4
+RPLIDAR_ANS_TYPE_DEVHEALTH    = 0x6
+RPLIDAR_RPM                   = 330
+RPLIDAR_NODES_PER_REV         = 360
+RPLIDAR_CHUNKS_PER_REV        = 36
+RPLIDAR_CAPSULE_SAMPLES       = 32
+RPLIDAR_CAPSULES_PER_REV      = 24
+
+def load_scans(filename):
+    '''
+    Returns the lidar scans from a Paris Mines Tech log, or one scan of a round room.
+    '''
+    if not filename:
+        return [[3000] * 682]
+
+    scans = []
+    for line in open(filename):
+        toks = line.split()
+        if len(toks) > 24:
+            scans.append([int(tok) for tok in toks[24:]])
+    return scans
+
+def range_at(scan, angle_deg):
+    '''
+    Range (mm) of a logged scan nearest to an angle, with 0 forward and positive counterclockwise,
+    or 0 where the logging sensor did not look.
+    '''
+    index = int(round(angle_deg * LOG_STEPS_PER_REV / 360.)) + LOG_FRONT_STEP - LOG_FIRST_STEP
+    return scan[index] if 0 <= index < len(scan) else 0
+
+# SCIP 2.0 ---------------------------------------------------------------------
+
+def scip_sum(s):
+    return chr((sum(s.encode()) & 0x3f) + 0x30)
+
+def scip_line(s):
+    '''A line followed by its checksum'''
+    return s + scip_sum(s) + '\n'
+
+def scip_info_line(name, value):
+    '''An information line, whose checksum does not cover the closing semicolon'''
+    s = '%s:%s' % (name, value)
+    return s + ';' + scip_sum(s) + '\n'
+
+def scip_encode(value, digits):
+    return ''.join(chr(((value >> (6*k)) & 0x3f) + 0x30) for k in reversed(range(digits)))
+
+def scip_data_lines(data):
+    '''Data split into lines of 64 characters, each with its checksum'''
+    return ''.join(scip_line(data[k:k+64]) for k in range(0, len(data), 64))
+
+class Hokuyo(object):
+
+    def __init__(self, model, scans, rate, serial):
+
+        self.model = MODELS[model]
+        self.serial = serial
+        self.scans = scans
+        self.period = 1. / (rate if rate else self.model['SCAN'] / 60.)
+        self.start = time.time()
+        self.scan_index = 0
+        self.laser_on = False
+        self.streaming = None
+        self.cache = {}
+
+    def timestamp(self):
+        return scip_line(scip_encode(int((time.time() - self.start) * 1000) & 0xffffff, 4))
+
+    def ranges(self, scan_index):
+        '''The scan's range for each step of the model'''
+        if not (scan_index, 'steps') in self.cache:
+            scan = self.scans[scan_index]
+            ares, afrt = self.model['ARES'], self.model['AFRT']
+            self.cache[(scan_index, 'steps')] = \
+                [range_at(scan, (step - afrt) * 360. / ares) for step in range(self.model['STEPS'])]
+        return self.cache[(scan_index, 'steps')]
+
+    def data(self, scan_index, start, end, cluster, digits):
+        '''The encoded data lines of a scan, taking the smallest range in each cluster'''
+        key = (scan_index, start, end, cluster, digits)
+        if not key in self.cache:
+            ranges = self.ranges(scan_index)
+            limit = (1 << (6 * digits)) - 1
+            values = [min(ranges[k:min(k+cluster, end+1)]) for k in range(start, end+1, cluster)]
+            self.cache[key] = scip_data_lines(''.join(scip_encode(min(v, limit), digits) for v in values))
+        return self.cache[key]
+
+    def next_scan(self):
+        scan_index = self.scan_index
+        self.scan_index = (self.scan_index + 1) % len(self.scans)
+        return scan_index
+
+    def command(self, cmd):
+        '''Returns the response to a command'''
+
+        echo = cmd + '\n'
+        ok = scip_line('00') + '\n'
+
+        if cmd in ('VV',):
+            return echo + scip_line('00') + \
+                scip_info_line('VEND', 'Hokuyo Automatic Co.,Ltd.') + \
+                scip_info_line('PROD', self.model['PROD']) + \
+                scip_info_line('FIRM', '3.4.03(17/Dec./2012)') + \
+                scip_info_line('PROT', 'SCIP 2.0') + \
+                scip_info_line('SERI', self.serial) + '\n'
+
+        if cmd in ('PP',):
+            return echo + scip_line('00') + \
+                scip_info_line('MODL', self.model['MODL']) + \
+                ''.join(scip_info_line(name, self.model[name]) for name in
+                    ('DMIN', 'DMAX', 'ARES', 'AMIN', 'AMAX', 'AFRT', 'SCAN')) + '\n'
+
+        if cmd in ('II',):
+            return echo + scip_line('00') + \
+                scip_info_line('MODL', self.model['MODL']) + \
+                scip_info_line('LASR', 'ON' if self.laser_on else 'OFF') + \
+                scip_info_line('SCSP', 'Initial(%d[rpm])' % self.model['SCAN']) + \
+                scip_info_line('MESM', 'Measuring by Normal Mode' if self.streaming else 'Idle') + \
+                scip_info_line('SBPS', 'USB only') + \
+                scip_info_line('TIME', self.timestamp()[:4]) + \
+                scip_info_line('STAT', 'Stable 000 no error.') + '\n'
+
+        if cmd == 'BM':
+            status = '02' if self.laser_on else '00'
+            self.laser_on = True
+            return echo + scip_line(status) + '\n'
+
+        if cmd in ('QT', 'RS'):
+            self.laser_on = False
+            self.streaming = None
+            return echo + ok
+
+        if cmd.startswith('SS') or cmd.startswith('TM') or cmd == 'SCIP2.0':
+            return echo + ok
+
+        if cmd[:2] in ('GD', 'GS', 'MD', 'MS'):
+            return self.scan_command(cmd)
+
+        return echo + scip_line('0E') + '\n'
+
+    def scan_command(self, cmd):
+
+        digits = 3 if cmd[1] == 'D' else 2
+        streaming = cmd[0] == 'M'
+        echo = cmd + '\n'
+
+        try:
+            start, end, cluster = int(cmd[2:6]), int(cmd[6:10]), int(cmd[10:12], 16)
+            if streaming:
+                interval, nscans = int(cmd[12]), int(cmd[13:15])
+        except ValueError:
+            return echo + scip_line('01') + '\n'
+
+        if start > end or end >= self.model['STEPS'] or len(cmd) != (15 if streaming else 12):
+            return echo + scip_line('04') + '\n'
+
+        cluster = max(cluster, 1)
+
+        if not streaming:
+            if not self.laser_on:
+                return echo + scip_line('10') + '\n'
+            return echo + scip_line('00') + self.timestamp() + \
+                self.data(self.next_scan(), start, end, cluster, digits) + '\n'
+
+        # MD/MS turns the laser on, and is confirmed before its scans follow
+        self.laser_on = True
+        self.streaming = {'cmd' : cmd[:13], 'args' : (start, end, cluster, digits),
+                          'interval' : interval, 'remaining' : nscans, 'skipped' : 0}
+        return echo + scip_line('00') + '\n'
+
+    def frame(self):
+        '''The next streamed scan, or None if not streaming'''
+
+        s = self.streaming
+
+        if not s:
+            return None
+
+        # skip the requested number of scans between those sent
+        if s['skipped'] < s['interval']:
+            s['skipped'] += 1
+            self.next_scan()
+            return None
+
+        s['skipped'] = 0
+
+        if s['remaining'] > 0:
+            s['remaining'] -= 1
+            if s['remaining'] == 0:
+                self.streaming = None
+
+        return s['cmd'] + '%02d\n' % s['remaining'] + scip_line('99') + self.timestamp() + \
+            self.data(self.next_scan(), *s['args']) + '\n'
+
+    def receive(self, buf):
+        '''Returns the responses to the complete commands in buf, and what is left of buf'''
+        out = ''
+        while b'\n' in buf:
+            line, buf = buf.split(b'\n', 1)
+            cmd = line.strip(b'\r').decode('ascii', 'replace')
+            if cmd:
+                out += self.command(cmd)
+        return out.encode('ascii'), buf
+
+# RPLidar ----------------------------------------------------------------------
+
+def rplidar_descriptor(size, subtype, anstype):
+    return RPLIDAR_ANS_SYNC_BYTES + struct.pack('<IB', (size & 0x3fffffff) | (subtype << 30), anstype)
+
+class RPLidar(object):
+
+    def __init__(self, scans, rate):
+
+        self.scans = scans
+        self.period = 1. / (rate if rate else RPLIDAR_RPM / 60.)
+        self.scan_index = 0
+        self.scanning = False
+        self.express = False
+        self.first_capsule = False
+        self.pending = []
+
+    def nodes(self):
+        '''One revolution of measurement nodes, clockwise from the front'''
+        scan = self.scans[self.scan_index]
+        self.scan_index = (self.scan_index + 1) % len(self.scans)
+        out = b''
+        for k in range(RPLIDAR_NODES_PER_REV):
+            angle = k * 360. / RPLIDAR_NODES_PER_REV
+            distance = range_at(scan, -angle if angle <= 180 else 360 - angle)
+            quality = 47 if distance else 0
+            sync = 1 if k == 0 else 2
+            out += struct.pack('<BHH', (quality << 2) | sync, (int(angle * 64) << 1) | 1, distance * 4)
+        return out
+
+    def capsules(self):
+        '''One revolution of express scan capsules, clockwise from the front, with no angle compensation'''
+        scan = self.scans[self.scan_index]
+        self.scan_index = (self.scan_index + 1) % len(self.scans)
+        nsamples = RPLIDAR_CAPSULES_PER_REV * RPLIDAR_CAPSULE_SAMPLES
+        distances = []
+        for k in range(nsamples):
+            angle = k * 360. / nsamples
+            distances.append(range_at(scan, -angle if angle <= 180 else 360 - angle))
+        out = []
+        for c in range(RPLIDAR_CAPSULES_PER_REV):
+            start = int(c * RPLIDAR_CAPSULE_SAMPLES * 360. / nsamples * 64)
+            if self.first_capsule:
+                start |= RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT
+                self.first_capsule = False
+            body = struct.pack('<H', start)
+            for k in range(c * RPLIDAR_CAPSULE_SAMPLES, (c+1) * RPLIDAR_CAPSULE_SAMPLES, 2):
+                body += struct.pack('<HHB', distances[k] * 4, distances[k+1] * 4, 0)
+            checksum = 0
+            for b in body:
+                checksum ^= b
+            out.append(bytes([(RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1 << 4) | (checksum & 0xf),
+                              (RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2 << 4) | (checksum >> 4)]) + body)
+        return out
+
+    def frame(self):
+        '''The next revolution, split into chunks sent over the scan period, or None if not scanning'''
+        if not self.scanning:
+            return None
+        if self.express:
+            return self.capsules()
+        nodes = self.nodes()
+        step = len(nodes) // RPLIDAR_CHUNKS_PER_REV
+        return [nodes[k:k+step] for k in range(0, len(nodes), step)]
+
+    def receive(self, buf):
+        '''Returns the responses to the complete requests in buf, and what is left of buf'''
+        out = b''
+        while buf:
+            if buf[0] != RPLIDAR_CMD_SYNC_BYTE:
+                buf = buf[1:]
+                continue
+            if len(buf) < 2:
+                break
+            cmd = buf[1]
+            if cmd & RPLIDAR_CMDFLAG_HAS_PAYLOAD:
+                if len(buf) < 3 or len(buf) < 4 + buf[2]:
+                    break
+                buf = buf[4 + buf[2]:]
+            else:
+                buf = buf[2:]
+            out += self.command(cmd)
+        return out, buf
+
+    def command(self, cmd):
+
+        if cmd in (RPLIDAR_CMD_STOP, RPLIDAR_CMD_RESET):
+            self.scanning = False
+            return b''
+
+        if cmd in (RPLIDAR_CMD_SCAN, RPLIDAR_CMD_FORCE_SCAN):
+            self.scanning = True
+            self.express = False
+            return rplidar_descriptor(5, RPLIDAR_ANS_PKTFLAG_LOOP, RPLIDAR_ANS_TYPE_MEASUREMENT)
+
+        if cmd == RPLIDAR_CMD_EXPRESS_SCAN:
+            self.scanning = True
+            self.express = True
+            self.first_capsule = True
+            return rplidar_descriptor(84, RPLIDAR_ANS_PKTFLAG_LOOP, RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED)
+
+        if cmd == RPLIDAR_CMD_GET_DEVICE_INFO:
+            return rplidar_descriptor(20, 0, RPLIDAR_ANS_TYPE_DEVINFO) + \
+                struct.pack('<BHB16s', 0, 0x0105, 0, bytes(range(16)))
+
+        if cmd == RPLIDAR_CMD_GET_DEVICE_HEALTH:
+            return rplidar_descriptor(3, 0, RPLIDAR_ANS_TYPE_DEVHEALTH) + struct.pack('<BH', 0, 0)
+
+        return b''
+
+# Simulation -------------------------------------------------------------------
+
+def corrupt(data, rng):
+    '''Flips a bit, drops a byte, or prefixes garbage'''
+    k = rng.randrange(len(data))
+    how = rng.randrange(3)
+    if how == 0:
+        return data[:k] + bytes([data[k] ^ (1 << rng.randrange(6))]) + data[k+1:]
+    if how == 1:
+        return data[:k] + data[k+1:]
+    return bytes(rng.randrange(256) for _ in range(rng.randrange(1, 16))) + data
+
+class Device(object):
+
+    def __init__(self, sensor, link):
+
+        self.sensor = sensor
+        self.master, self.slave = os.openpty()
+        tty.setraw(self.slave)
+        os.set_blocking(self.master, False)
+        self.name = os.ttyname(self.slave)
+        self.buf = b''
+        self.next_time = time.time() + sensor.period
+        self.chunks = []
+        self.chunk_period = sensor.period
+        self.corrupt_chunk = -1  # chunks to send before the one to corrupt, or -1 for none
+        self.sent = 0
+        self.dropped = 0
+
+        if link:
+            if os.path.islink(link):
+                os.unlink(link)
+            os.symlink(self.name, link)
+
+    def write(self, data):
+        '''Writes what the pty will take; like a serial line, the rest is lost'''
+        try:
+            n = os.write(self.master, data)
+        except BlockingIOError:
+            n = 0
+        if n < len(data):
+            self.dropped += 1
+
+def main():
+
+    parser = argparse.ArgumentParser(description='Simulates lidars on pseudo-terminals')
+    parser.add_argument('logfile', nargs='?')
+    parser.add_argument('--protocol', choices=('scip', 'rplidar'), default='scip')
+    parser.add_argument('--model', choices=sorted(MODELS), default='urg04lx')
+    parser.add_argument('--rate', type=float, default=0)
+    parser.add_argument('--jitter', type=float, default=0)
+    parser.add_argument('--corrupt', type=float, default=0)
+    parser.add_argument('--devices', type=int, default=1)
+    parser.add_argument('--link')
+    parser.add_argument('--seed', type=int)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    scans = load_scans(args.logfile)
+
+    devices = []
+    for k in range(args.devices):
+        sensor = Hokuyo(args.model, scans, args.rate, 'H%07d' % (k+1)) if args.protocol == 'scip' else RPLidar(scans, args.rate)
+        link = (args.link + (str(k) if args.devices > 1 else '')) if args.link else None
+        devices.append(Device(sensor, link))
+
+    print(' '.join(device.name for device in devices))
+    sys.stdout.flush()
+
+    # report on being killed, as from the Makefile, as well as on Ctrl-C
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+    signal.signal(signal.SIGINT, signal.default_int_handler)
+
+    start = time.time()
+
+    try:
+        while True:
+
+            now = time.time()
+            timeout = max(0, min(device.next_time for device in devices) - now)
+            ready, _, _ = select.select([device.master for device in devices], [], [], timeout)
+
+            for device in devices:
+
+                if device.master in ready:
+                    try:
+                        device.buf += os.read(device.master, 4096)
+                    except (BlockingIOError, OSError):
+                        pass
+                    response, device.buf = device.sensor.receive(device.buf)
+                    if response:
+                        device.write(response)
+
+                now = time.time()
+                if now < device.next_time:
+                    continue
+
+                jitter = rng.uniform(-args.jitter, args.jitter) / 1000. if args.jitter else 0
+
+                # an RPLidar revolution goes out in chunks spread over the scan period
+                if not device.chunks:
+                    frame = device.sensor.frame()
+                    if frame is not None:
+                        device.chunks = frame if isinstance(frame, list) else [frame.encode('ascii')]
+                        device.chunk_period = device.sensor.period / len(device.chunks)
+                        device.sent += 1
+
+                        # each scan is corrupted with probability P, in one of its chunks
+                        corrupt_scan = args.corrupt and rng.random() < args.corrupt
+                        device.corrupt_chunk = rng.randrange(len(device.chunks)) if corrupt_scan else -1
+
+                period = device.chunk_period if device.chunks else device.sensor.period
+
+                if device.chunks:
+                    data = device.chunks.pop(0)
+                    if device.corrupt_chunk == 0:
+                        data = corrupt(data, rng)
+                    device.corrupt_chunk -= 1
+                    device.write(data)
+
+                device.next_time = max(device.next_time + period, now - period) + jitter
+
+    except KeyboardInterrupt:
+        elapsed = time.time() - start
+        for device in devices:
+            sys.stderr.write('%s: %d scans in %.1f sec = %.1f scans/sec, %d writes dropped\n' %
+                (device.name, device.sent, elapsed, device.sent / elapsed, device.dropped))
+
+main()
@@ -26,12 +26,13 @@ static const char * DEVICE = "/dev/ttyACM0";
 
 static const int    NITER  = 20;
 
-int main()
+int main(int argc, char ** argv)
 {
 	
 	URG04LX laser;
 	
-	laser.connect(DEVICE);
+	// The device can be given on the command line, e.g. a pty from lidarsim.py
+	laser.connect(argc > 1 ? argv[1] : DEVICE);
 	
 	cout << "===============================================================" << endl;
 	cout << laser << endl;
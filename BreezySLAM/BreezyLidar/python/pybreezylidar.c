@@ -35,6 +35,8 @@ typedef struct
     
     unsigned int * range;
     
+    scan_queue_info_t info;
+    
 } URG04LX;
 
 static void URG04LX_dealloc(URG04LX* self)
@@ -60,17 +62,24 @@ static int URG04LX_init(URG04LX *self, PyObject *args, PyObject *kw)
     char * devname;
     int baudrate = DEFAULT_BAUD_RATE;
     int debug = 0;
+    char * cache = NULL;
 	
     
-    const char * keywords[] = {"device", "baudrate", "debug", NULL};
+    const char * keywords[] = {"device", "baudrate", "debug", "cache", NULL};
     
-    if (!PyArg_ParseTupleAndKeywords(args, kw, "s|ii", (char **)keywords, &devname, &baudrate, &debug))
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "s|iis", (char **)keywords, &devname, &baudrate, &debug, &cache))
     {
         return error_on_raise_argument_exception("URG04LX.__init__");
     }
     
     self->hokuyo = hokuyo_create("breezylidar.URG04LX", debug);
     
+    // Keep the default cache file unless one (or "", for no cache) was passed
+    if (cache)
+    {
+        hokuyo_set_cache_file(self->hokuyo, cache);
+    }
+    
     if (hokuyo_connect(self->hokuyo, "breezylidar.URG04LX", devname, baudrate))
     {
         return error_on_raise_argument_exception("URG04LX");
@@ -91,9 +100,23 @@ static PyObject * URG04LX_str(URG04LX *self)
     return  PyUnicode_FromString(str);
 }
 
-static PyObject * URG04LX_getScan(URG04LX *self)
+static PyObject * URG04LX_getScan(URG04LX *self, PyObject *args, PyObject *kw)
 {                
-    int nrange = hokuyo_get_scan(self->hokuyo, "URG04LX.getScan", self->range);
+    int next_unseen = 0;
+    
+    const char * keywords[] = {"next_unseen", NULL};
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "|i", (char **)keywords, &next_unseen))
+    {
+        return null_on_raise_argument_exception("URG04LX", "getScan");
+    }
+    
+    int nrange = 0;
+    
+    // Wait for the reader thread without holding up other Python threads
+    Py_BEGIN_ALLOW_THREADS
+    nrange = hokuyo_get_scan_info(self->hokuyo, "URG04LX.getScan", self->range, next_unseen, &self->info);
+    Py_END_ALLOW_THREADS
     
     PyObject * rangelist = PyList_New(nrange);
         
@@ -106,13 +129,52 @@ static PyObject * URG04LX_getScan(URG04LX *self)
     return rangelist;
 }
 
+static PyObject * URG04LX_setScanWindow(URG04LX *self, PyObject *args, PyObject *kw)
+{                
+    int scan_size = 0;
+    int detection_margin = 0;
+    
+    const char * keywords[] = {"scan_size", "detection_margin", NULL};
+    
+    if (!PyArg_ParseTupleAndKeywords(args, kw, "i|i", (char **)keywords, &scan_size, &detection_margin))
+    {
+        return null_on_raise_argument_exception("URG04LX", "setScanWindow");
+    }
+    
+    if (hokuyo_set_scan_window(self->hokuyo, "URG04LX.setScanWindow", scan_size, detection_margin))
+    {
+        return null_on_raise_argument_exception("URG04LX", "setScanWindow");
+    }
+    
+    Py_RETURN_NONE;
+}
+
+static PyObject * URG04LX_getScanInfo(URG04LX *self)
+{                
+    return Py_BuildValue("KKKk", 
+        (unsigned long long)self->info.sequence, 
+        (unsigned long long)self->info.timestamp_usec, 
+        (unsigned long long)self->info.skipped, 
+        (unsigned long)self->info.sensor_timestamp);
+}
+
 
 
 static PyMethodDef URG04LX_methods[] = 
 {
     
-    {"getScan", (PyCFunction)URG04LX_getScan, METH_VARARGS, 
-        "URG04LX.getScan() returns scan values"
+    {"getScan", (PyCFunction)URG04LX_getScan, METH_VARARGS | METH_KEYWORDS, 
+        "URG04LX.getScan(next_unseen=False) returns the newest scan's values, or the oldest not yet gotten"
+    },
+   
+    {"setScanWindow", (PyCFunction)URG04LX_setScanWindow, METH_VARARGS | METH_KEYWORDS, 
+        "URG04LX.setScanWindow(scan_size, detection_margin=0) requests only the rays a SLAM Laser with that scan size\n"
+        "and detection margin uses (e.g. setScanWindow(laser.scan_size, laser.detection_margin)); the others are zero"
+    },
+   
+    {"getScanInfo", (PyCFunction)URG04LX_getScanInfo, METH_NOARGS, 
+        "URG04LX.getScanInfo() returns (sequence, timestamp_usec, skipped, sensor_timestamp_msec) for the last scan gotten;\n"
+        "timestamp_usec is on CLOCK_MONOTONIC, and sensor_timestamp_msec wraps at 2^24"
     },
    
     {NULL}  // Sentinel 
@@ -128,7 +190,8 @@ static PyMemberDef URG04LX_members[] = {
 
 #define TP_DOC_URG04LX \
 "A class for reading from Hokuyo URG-04LX Lidar units.\n" \
-"URG04LX.__init__(device, baud_rate=115200, debug=false)"
+"URG04LX.__init__(device, baud_rate=115200, debug=false, cache=None)\n" \
+"cache is the file caching sensor parameters by serial number (\"\" for none)"
 
 static PyTypeObject pybreezylidar_URG04LXType = 
 {
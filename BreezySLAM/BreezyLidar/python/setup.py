@@ -21,13 +21,18 @@ along with this code.  If not, see <http://www.gnu.org/licenses/>.
 
 from distutils.core import setup, Extension
 
-
 module = Extension('pybreezylidar', 
     sources = [ 
         'pybreezylidar.c', 
         'pyextension_utils.c', 
         '../c/hokuyo.c', 
-        '../c/serial_device.c']
+        '../c/serial_device.c',
+        '../c/serial_reactor.c',
+        '../c/scip.c',
+        '../../c/scan_queue.c'],
+    include_dirs = ['../../c'],
+    # keep the module's own scan queue from interposing on libbreezyslam's
+    extra_compile_args = ['-fvisibility=hidden']
     )
 
 
@@ -224,11 +224,64 @@ static void
                     error += horiz;
                 }
             }
+
+            SLAM_STATS_ADD(pixels_written, dxc + 1);
         }
     }
 }
 
 
+static void
+        scan_add_point(
+        scan_t * scan,
+        double k,
+        int distance,
+        int scanval,
+        double horz_mm,
+        double rotation)
+{
+    double angle = radians(-scan->detection_angle_degrees/2 + k * rotation);
+
+    scan->value[scan->npoints] = scanval;
+
+    scan->x_mm[scan->npoints] = distance * cos(angle) - k * horz_mm;
+    scan->y_mm[scan->npoints] = distance * sin(angle);
+    scan->npoints++;
+
+    /* Store obstacles separately for SSE */
+    if (scanval == OBSTACLE)
+    {
+        scan->obst_x_mm[scan->obst_npoints] = (float)scan->x_mm[scan->npoints-1];
+        scan->obst_y_mm[scan->obst_npoints] = (float)scan->y_mm[scan->npoints-1];
+        scan->obst_npoints++;
+    }
+}
+
+static void
+        scan_reserve(
+        scan_t * scan,
+        int npoints)
+{
+    if (npoints > scan->capacity)
+    {
+        free(scan->x_mm);
+        free(scan->y_mm);
+        free(scan->value);
+        free(scan->obst_x_mm);
+        free(scan->obst_y_mm);
+
+        scan->x_mm = double_alloc(npoints);
+        scan->y_mm = double_alloc(npoints);
+        scan->value = int_alloc(npoints);
+
+        /* assure size multiple of 4 for SSE */
+        scan->obst_x_mm = float_alloc(npoints+4);
+        scan->obst_y_mm = float_alloc(npoints+4);
+
+        scan->capacity = npoints;
+    }
+}
+
 static void
         scan_update_xy(
         scan_t * scan,
@@ -264,6 +317,31 @@ int *
     return (int *)safe_malloc(size * sizeof(int));
 }
 
+#ifdef BREEZYSLAM_STATS
+SLAM_THREAD_LOCAL slam_stats_t * slam_stats_current;
+#endif
+
+void
+        slam_stats_collect(
+        slam_stats_t * stats)
+{
+#ifdef BREEZYSLAM_STATS
+    slam_stats_current = stats;
+#else
+    (void)stats;
+#endif
+}
+
+int
+        slam_stats_enabled(void)
+{
+#ifdef BREEZYSLAM_STATS
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 void
         map_init(
         map_t * map,
@@ -392,6 +470,7 @@ void scan_init(
     scan->y_mm = double_alloc(size*span);
     scan->value = int_alloc(size*span);
     scan->span = span;
+    scan->capacity = size*span;
 
     scan->size = size;
     scan->rate_hz = scan_rate_hz;
@@ -480,6 +559,74 @@ scan_update(
     }
 }
 
+void
+scan_update_angles(
+        scan_t * scan,
+        const double * angles_degrees,
+        const int * lidar_mm,
+        int npoints,
+        double hole_width_mm,
+        double velocities_dxy_mm,
+        double velocities_dtheta_degrees)
+{
+    /* Take velocity into account */
+    int degrees_per_second = (int)(scan->rate_hz * 360);
+    double horz_mm = velocities_dxy_mm / degrees_per_second;
+    double rotation = 1 + velocities_dtheta_degrees / degrees_per_second;
+    
+    /* The rays scan_update() would use, half a ray either way */
+    double half_angle = scan->detection_angle_degrees / 2;
+    double ray_degrees = scan->detection_angle_degrees / (scan->size - 1);
+    double first_k = (scan->detection_margin + 0.5) * ray_degrees;
+    double last_k = (scan->size - scan->detection_margin - 0.5) * ray_degrees;
+    
+    /* Span each sample as scan_update() spans a ray at the same angle */
+    double span_scale = (double)(scan->size - 1) * scan->span / (scan->size * scan->span - 1);
+    double span_degrees = scan->detection_angle_degrees / (scan->size * scan->span - 1);
+    
+    int i = 0;
+    
+    scan_reserve(scan, npoints * scan->span);
+    
+    scan->npoints = 0;
+    scan->obst_npoints = 0;
+    
+    for (i=0; i<npoints; ++i)
+    {
+        int lidar_value_mm = lidar_mm[i];
+        
+        /* Degrees from the start of the scan */
+        double k = angles_degrees[i] + half_angle;
+        
+        int j = 0;
+        
+        k -= 360 * floor(k / 360);
+        
+        if (k < first_k || k > last_k)
+        {
+            continue;
+        }
+        
+        /* No obstacle */
+        if (lidar_value_mm == 0)
+        {
+            for (j=0; j<scan->span; ++j)
+            {
+                scan_add_point(scan, k * span_scale + j * span_degrees, (int)scan->distance_no_detection_mm, NO_OBSTACLE, horz_mm, rotation);
+            }
+        }
+        
+        /* Obstacle */
+        else if (lidar_value_mm > hole_width_mm / 2)
+        {
+            for (j=0; j<scan->span; ++j)
+            {
+                scan_add_point(scan, k * span_scale + j * span_degrees, lidar_value_mm, OBSTACLE, horz_mm, rotation);
+            }
+        }
+    }
+}
+
 position_t
         rmhc_position_search(
         position_t start_pos,
@@ -496,6 +643,8 @@ position_t
     
     int current_distance = distance_scan_to_map(map, scan, currentpos);
     
+    SLAM_STATS_ADD(candidates_evaluated, 1);
+
     int lowest_distance =  current_distance;
     int last_lowest_distance = current_distance;
     
@@ -511,11 +660,14 @@ position_t
         
         current_distance = distance_scan_to_map(map, scan, currentpos);
         
+        SLAM_STATS_ADD(candidates_evaluated, 1);
+
         /* -1 indicates infinity */
         if ((current_distance > -1) && (current_distance < lowest_distance))
         {
             lowest_distance = current_distance;
             bestpos = currentpos;
+            SLAM_STATS_ADD(accepted_moves, 1);
         }
         else
         {
@@ -531,6 +683,7 @@ position_t
                 counter = 0;
                 sigma_xy_mm *= 0.5;
                 sigma_theta_degrees *= 0.5;
+                SLAM_STATS_ADD(sigma_halvings, 1);
             }
         }
         
@@ -19,6 +19,9 @@ You should have received a copy of the GNU Lesser General Public License
 along with this code.  If not, see <http:#www.gnu.org/licenses/>.
 */
 
+#ifndef COREBREEZYSLAM_H
+#define COREBREEZYSLAM_H
+
 /* Default parameters --------------------------------------------------------*/
 
 static const int    DEFAULT_MAP_QUALITY         = 50; /* out of 255 */
@@ -60,6 +63,7 @@ typedef struct scan_t
     int * value;
     int npoints;
     int span;
+    int capacity;                       /* points allocated; scan_update_angles() may grow it */
 
     int size;                           /* number of rays per scan */
     double rate_hz;                     /* scans per second */
@@ -75,6 +79,23 @@ typedef struct scan_t
         
 } scan_t;
 
+/* Counters for one SLAM update, collected only when built with BREEZYSLAM_STATS */
+typedef struct slam_stats_t
+{
+    unsigned long long candidates_evaluated;    /* poses scored by rmhc_position_search() */
+    unsigned long long accepted_moves;          /* candidates that improved on the best pose */
+    unsigned long long sigma_halvings;          /* search refinements */
+    unsigned long long points_scored;           /* obstacle points found inside the map */
+    unsigned long long points_out_of_map;       /* obstacle points falling outside it */
+    unsigned long long pixels_written;          /* map pixels updated by map_update() */
+
+    /* time spent per stage, measured by the caller */
+    unsigned long long scan_update_nsec;
+    unsigned long long search_nsec;
+    unsigned long long map_update_nsec;
+    
+} slam_stats_t;
+
 /* Exported functions ------------------------------------------------------- */
 
 #ifdef __cplusplus 
@@ -86,6 +107,19 @@ int *
 int_alloc(
     int size);
 
+/* 
+ * Directs the counters of the functions below, when called on this thread, to stats 
+ * (which they add to), or nowhere if stats is NULL.  Does nothing unless built with 
+ * BREEZYSLAM_STATS.
+ */
+void
+slam_stats_collect(
+    slam_stats_t * stats);
+
+/* Returns 1 if built with BREEZYSLAM_STATS, 0 otherwise */
+int
+slam_stats_enabled(void);
+
 void 
 map_init(
     map_t * map, 
@@ -134,6 +168,24 @@ scan_update(
     double velocities_dxy_mm,
     double velocities_dtheta_degrees);
 
+/*
+ * Like scan_update(), but for npoints distances at arbitrary angles, such as the
+ * samples of a spinning Lidar as they arrive, rather than for scan_size evenly
+ * spaced rays.  angles_degrees are counterclockwise from straight ahead, as the
+ * rays of scan_update() are, in any order and any multiple of 360 from that;
+ * samples outside the window of angles that scan_update() uses are ignored.
+ * Grows the scan's point arrays as needed.
+ */
+void 
+scan_update_angles(
+    scan_t * scan, 
+    const double * angles_degrees,
+    const int * lidar_mm, 
+    int npoints,
+    double hole_width_mm,
+    double velocities_dxy_mm,
+    double velocities_dtheta_degrees);
+
 void
 map_get(
     map_t * map, 
@@ -167,3 +219,4 @@ rmhc_position_search(
 }
 #endif
 
+#endif /* COREBREEZYSLAM_H */
@@ -113,5 +113,8 @@ distance_scan_to_map(
 	}
     }
 
+    SLAM_STATS_ADD(points_scored, npoints);
+    SLAM_STATS_ADD(points_out_of_map, scan->obst_npoints - npoints);
+
     return npoints ? (int)(sum * 1024 / npoints) : -1;  
 }
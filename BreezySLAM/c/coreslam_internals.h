@@ -27,6 +27,19 @@ typedef __int64 int64_t;       /* Define it from MSVC's internal type */
 #endif
 
 
+/* Instrumentation: compiles to nothing unless BREEZYSLAM_STATS is defined */
+#ifdef BREEZYSLAM_STATS
+#ifdef _MSC_VER
+#define SLAM_THREAD_LOCAL __declspec(thread)
+#else
+#define SLAM_THREAD_LOCAL __thread
+#endif
+extern SLAM_THREAD_LOCAL slam_stats_t * slam_stats_current;
+#define SLAM_STATS_ADD(field, n) do { if (slam_stats_current) slam_stats_current->field += (n); } while (0)
+#else
+#define SLAM_STATS_ADD(field, n) do { } while (0)
+#endif
+
 static const int NO_OBSTACLE            = 65500;
 static const int OBSTACLE               = 0;
 
@@ -62,9 +62,15 @@ distance_scan_to_map(
                 sum += map->pixels[y * map->size_pixels + x];
                 npoints++;
             } 
+            else
+            {
+                SLAM_STATS_ADD(points_out_of_map, 1);
+            }
         }
     } 
 
+    SLAM_STATS_ADD(points_scored, npoints);
+
     /* Return sum scaled by number of points, or -1 if none */
     return npoints ? (int)(sum * 1024 / npoints) : -1;  
 }
@@ -0,0 +1,793 @@
+/*
+
+mapexport.c - Fast export of maps to image files
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mapexport.h"
+
+static const int FILE_BUFFER_BYTES  = 1 << 20;
+static const int IDAT_BYTES         = 1 << 16;
+static const int STORED_BLOCK_BYTES = 65535;
+static const int MAX_MATCH          = 258;
+
+/* Trajectory points bucketed by row, so each row can be drawn as it is written */
+typedef struct trajectory_t
+{
+    int * row_start;    /* points of row y are xs[row_start[y]] .. xs[row_start[y+1]-1] */
+    int * xs;
+
+} trajectory_t;
+
+/* A rectangle of the image being written */
+typedef struct view_t
+{
+    const mapexport_image_t * image;
+    const trajectory_t * trajectory;
+    int x0;
+    int y0;
+    int width;
+    int height;
+
+} view_t;
+
+static int _trajectory_init(trajectory_t * trajectory, const mapexport_image_t * image)
+{
+    int k;
+
+    trajectory->row_start = (int *)calloc(image->height+1, sizeof(int));
+    trajectory->xs = (int *)malloc((image->trajectory_npoints+1) * sizeof(int));
+
+    if (!trajectory->row_start || !trajectory->xs)
+    {
+        return -1;
+    }
+
+    /* counting sort on y, ignoring points off the map */
+    for (k=0; k<image->trajectory_npoints; ++k)
+    {
+        int x = image->trajectory_xy[2*k];
+        int y = image->trajectory_xy[2*k+1];
+
+        if (x >= 0 && x < image->width && y >= 0 && y < image->height)
+        {
+            trajectory->row_start[y+1]++;
+        }
+    }
+
+    for (k=0; k<image->height; ++k)
+    {
+        trajectory->row_start[k+1] += trajectory->row_start[k];
+    }
+
+    int * next = (int *)malloc((image->height+1) * sizeof(int));
+
+    if (!next)
+    {
+        return -1;
+    }
+
+    memcpy(next, trajectory->row_start, (image->height+1) * sizeof(int));
+
+    for (k=0; k<image->trajectory_npoints; ++k)
+    {
+        int x = image->trajectory_xy[2*k];
+        int y = image->trajectory_xy[2*k+1];
+
+        if (x >= 0 && x < image->width && y >= 0 && y < image->height)
+        {
+            trajectory->xs[next[y]++] = x;
+        }
+    }
+
+    free(next);
+
+    return 0;
+}
+
+static void _trajectory_free(trajectory_t * trajectory)
+{
+    free(trajectory->row_start);
+    free(trajectory->xs);
+}
+
+/* Returns row y of the view, either in place or built in buffer */
+static const unsigned char * _view_row(const view_t * view, int y, unsigned char * buffer)
+{
+    const mapexport_image_t * image = view->image;
+    const trajectory_t * trajectory = view->trajectory;
+
+    int row = view->y0 + y;
+    int offset = row * image->width + view->x0;
+    int first = trajectory->row_start[row];
+    int last = trajectory->row_start[row+1];
+    int k;
+
+    if (image->bytes && first == last)
+    {
+        return image->bytes + offset;
+    }
+
+    if (image->bytes)
+    {
+        memcpy(buffer, image->bytes + offset, view->width);
+    }
+    else
+    {
+        for (k=0; k<view->width; ++k)
+        {
+            buffer[k] = image->pixels[offset+k] >> 8;
+        }
+    }
+
+    for (k=first; k<last; ++k)
+    {
+        int x = trajectory->xs[k] - view->x0;
+
+        if (x >= 0 && x < view->width)
+        {
+            buffer[x] = 0;
+        }
+    }
+
+    return buffer;
+}
+
+static FILE * _open(const char * filename, char ** file_buffer)
+{
+    FILE * fp = fopen(filename, "wb");
+
+    if (fp)
+    {
+        *file_buffer = (char *)malloc(FILE_BUFFER_BYTES);
+
+        if (*file_buffer)
+        {
+            setvbuf(fp, *file_buffer, _IOFBF, FILE_BUFFER_BYTES);
+        }
+    }
+
+    return fp;
+}
+
+static int _close(FILE * fp, char * file_buffer, int result)
+{
+    if (ferror(fp))
+    {
+        result = -1;
+    }
+
+    if (fclose(fp))
+    {
+        result = -1;
+    }
+
+    free(file_buffer);
+
+    return result;
+}
+
+/* PGM ---------------------------------------------------------------------- */
+
+static int _save_pgm(const char * filename, const view_t * view)
+{
+    char * file_buffer = NULL;
+    FILE * fp = _open(filename, &file_buffer);
+
+    if (!fp)
+    {
+        return -1;
+    }
+
+    unsigned char * buffer = (unsigned char *)malloc(view->width);
+    int y;
+
+    fprintf(fp, "P5\n%d %d\n255\n", view->width, view->height);
+
+    for (y=0; y<view->height; ++y)
+    {
+        fwrite(_view_row(view, y, buffer), 1, view->width, fp);
+    }
+
+    free(buffer);
+
+    return _close(fp, file_buffer, 0);
+}
+
+/* PNG ---------------------------------------------------------------------- */
+
+typedef struct png_t
+{
+    FILE * fp;
+    int compress;
+
+    /* slice-by-four CRC-32 tables */
+    uint32_t crc_table[4][256];
+
+    /* pending IDAT chunk */
+    uint8_t * idat;
+    int nidat;
+
+    /* Adler-32 of the uncompressed stream */
+    uint32_t adler_a;
+    uint32_t adler_b;
+
+    /* uncompressed data awaiting a stored block */
+    uint8_t * stored;
+    int nstored;
+
+    /* fixed-Huffman bit buffer and run state */
+    uint64_t bits;
+    int nbits;
+    uint16_t lit_code[288];
+    uint8_t lit_len[288];
+    int has_prev;
+    uint8_t prev;
+    int run;
+
+} png_t;
+
+static void _crc_init(png_t * png)
+{
+    int n, k;
+
+    for (n=0; n<256; ++n)
+    {
+        uint32_t c = n;
+
+        for (k=0; k<8; ++k)
+        {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+
+        png->crc_table[0][n] = c;
+    }
+
+    for (n=0; n<256; ++n)
+    {
+        for (k=1; k<4; ++k)
+        {
+            uint32_t c = png->crc_table[k-1][n];
+            png->crc_table[k][n] = png->crc_table[0][c & 0xFF] ^ (c >> 8);
+        }
+    }
+}
+
+static uint32_t _crc_update(png_t * png, uint32_t crc, const uint8_t * data, int n)
+{
+    crc = ~crc;
+
+    while (n >= 4)
+    {
+        crc ^= data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+
+        crc = png->crc_table[3][crc & 0xFF] ^ png->crc_table[2][(crc >> 8) & 0xFF] ^
+              png->crc_table[1][(crc >> 16) & 0xFF] ^ png->crc_table[0][crc >> 24];
+
+        data += 4;
+        n -= 4;
+    }
+
+    while (n--)
+    {
+        crc = png->crc_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static void _adler_update(png_t * png, const uint8_t * data, int n)
+{
+    uint32_t a = png->adler_a;
+    uint32_t b = png->adler_b;
+
+    while (n > 0)
+    {
+        /* largest count for which b cannot overflow */
+        int count = n < 5552 ? n : 5552;
+        n -= count;
+
+        while (count--)
+        {
+            a += *data++;
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+    }
+
+    png->adler_a = a;
+    png->adler_b = b;
+}
+
+static void _put_u32(uint8_t * p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static void _write_chunk(png_t * png, const char * type, const uint8_t * data, int n)
+{
+    uint8_t header[8];
+
+    _put_u32(header, n);
+    memcpy(header+4, type, 4);
+
+    uint32_t crc = _crc_update(png, 0, header+4, 4);
+    crc = _crc_update(png, crc, data, n);
+
+    uint8_t trailer[4];
+    _put_u32(trailer, crc);
+
+    fwrite(header, 1, 8, png->fp);
+    fwrite(data, 1, n, png->fp);
+    fwrite(trailer, 1, 4, png->fp);
+}
+
+static void _flush_idat(png_t * png)
+{
+    if (png->nidat)
+    {
+        _write_chunk(png, "IDAT", png->idat, png->nidat);
+        png->nidat = 0;
+    }
+}
+
+static void _idat_bytes(png_t * png, const uint8_t * data, int n)
+{
+    while (n > 0)
+    {
+        int count = IDAT_BYTES - png->nidat;
+
+        if (count > n)
+        {
+            count = n;
+        }
+
+        memcpy(png->idat + png->nidat, data, count);
+        png->nidat += count;
+        data += count;
+        n -= count;
+
+        if (png->nidat == IDAT_BYTES)
+        {
+            _flush_idat(png);
+        }
+    }
+}
+
+/* Stored blocks */
+
+static void _stored_block(png_t * png, int final)
+{
+    uint8_t header[5];
+
+    header[0] = final;
+    header[1] = png->nstored & 0xFF;
+    header[2] = png->nstored >> 8;
+    header[3] = ~png->nstored & 0xFF;
+    header[4] = (~png->nstored >> 8) & 0xFF;
+
+    _idat_bytes(png, header, 5);
+    _idat_bytes(png, png->stored, png->nstored);
+
+    png->nstored = 0;
+}
+
+static void _stored_bytes(png_t * png, const uint8_t * data, int n)
+{
+    while (n > 0)
+    {
+        int count = STORED_BLOCK_BYTES - png->nstored;
+
+        if (count > n)
+        {
+            count = n;
+        }
+
+        memcpy(png->stored + png->nstored, data, count);
+        png->nstored += count;
+        data += count;
+        n -= count;
+
+        if (png->nstored == STORED_BLOCK_BYTES)
+        {
+            _stored_block(png, 0);
+        }
+    }
+}
+
+/* Fixed-Huffman blocks, coding runs as matches at distance one */
+
+static void _huffman_init(png_t * png)
+{
+    int sym, k;
+
+    for (sym=0; sym<288; ++sym)
+    {
+        int code, len;
+
+        if (sym < 144)
+        {
+            code = 0x30 + sym;
+            len = 8;
+        }
+        else if (sym < 256)
+        {
+            code = 0x190 + sym - 144;
+            len = 9;
+        }
+        else if (sym < 280)
+        {
+            code = sym - 256;
+            len = 7;
+        }
+        else
+        {
+            code = 0xC0 + sym - 280;
+            len = 8;
+        }
+
+        /* Huffman codes are packed most-significant bit first */
+        int reversed = 0;
+        for (k=0; k<len; ++k)
+        {
+            reversed |= ((code >> k) & 1) << (len-1-k);
+        }
+
+        png->lit_code[sym] = reversed;
+        png->lit_len[sym] = len;
+    }
+}
+
+static void _put_bits(png_t * png, uint32_t value, int n)
+{
+    png->bits |= (uint64_t)value << png->nbits;
+    png->nbits += n;
+
+    if (png->nbits >= 32)
+    {
+        uint8_t bytes[4] = {png->bits, png->bits >> 8, png->bits >> 16, png->bits >> 24};
+
+        _idat_bytes(png, bytes, 4);
+
+        png->bits >>= 32;
+        png->nbits -= 32;
+    }
+}
+
+static void _put_symbol(png_t * png, int sym)
+{
+    _put_bits(png, png->lit_code[sym], png->lit_len[sym]);
+}
+
+static void _put_match(png_t * png, int length)
+{
+    static const int base[29] =
+    {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+     35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int extra[29] =
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+     3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+    int code = 28;
+    while (base[code] > length)
+    {
+        code--;
+    }
+
+    _put_symbol(png, 257 + code);
+    _put_bits(png, length - base[code], extra[code]);
+
+    /* distance code 0 (distance one), five bits */
+    _put_bits(png, 0, 5);
+}
+
+static void _flush_run(png_t * png)
+{
+    if (png->run >= 3)
+    {
+        _put_match(png, png->run);
+    }
+    else
+    {
+        while (png->run--)
+        {
+            _put_symbol(png, png->prev);
+        }
+    }
+
+    png->run = 0;
+}
+
+static void _huffman_bytes(png_t * png, const uint8_t * data, int n)
+{
+    int k = 0;
+
+    while (k < n)
+    {
+        uint8_t c = data[k];
+
+        if (png->has_prev && c == png->prev)
+        {
+            /* extend the run as far as it goes */
+            int end = k + MAX_MATCH - png->run;
+
+            if (end > n)
+            {
+                end = n;
+            }
+
+            int j = k + 1;
+            while (j < end && data[j] == c)
+            {
+                j++;
+            }
+
+            png->run += j - k;
+            k = j;
+
+            if (png->run == MAX_MATCH)
+            {
+                _flush_run(png);
+            }
+        }
+        else
+        {
+            _flush_run(png);
+            _put_symbol(png, c);
+            png->prev = c;
+            png->has_prev = 1;
+            k++;
+        }
+    }
+}
+
+static void _deflate_bytes(png_t * png, const uint8_t * data, int n)
+{
+    _adler_update(png, data, n);
+
+    if (png->compress)
+    {
+        _huffman_bytes(png, data, n);
+    }
+    else
+    {
+        _stored_bytes(png, data, n);
+    }
+}
+
+static int _save_png(const char * filename, const view_t * view, int compress)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    static const uint8_t zlib_header[2] = {0x78, 0x01};
+    static const uint8_t filter_none = 0;
+
+    png_t * png = (png_t *)calloc(1, sizeof(png_t));
+    unsigned char * buffer = (unsigned char *)malloc(view->width);
+
+    if (!png || !buffer)
+    {
+        free(png);
+        free(buffer);
+        return -1;
+    }
+
+    char * file_buffer = NULL;
+    png->fp = _open(filename, &file_buffer);
+
+    if (!png->fp)
+    {
+        free(png);
+        free(buffer);
+        return -1;
+    }
+
+    png->compress = compress;
+    png->idat = (uint8_t *)malloc(IDAT_BYTES);
+    png->stored = compress ? NULL : (uint8_t *)malloc(STORED_BLOCK_BYTES);
+    png->adler_a = 1;
+
+    _crc_init(png);
+    _huffman_init(png);
+
+    fwrite(signature, 1, 8, png->fp);
+
+    /* 8-bit grayscale, no interlacing */
+    uint8_t ihdr[13] = {0};
+    _put_u32(ihdr, view->width);
+    _put_u32(ihdr+4, view->height);
+    ihdr[8] = 8;
+    _write_chunk(png, "IHDR", ihdr, 13);
+
+    _idat_bytes(png, zlib_header, 2);
+
+    if (compress)
+    {
+        /* final block, fixed Huffman codes */
+        _put_bits(png, 1, 1);
+        _put_bits(png, 1, 2);
+    }
+
+    int y;
+    for (y=0; y<view->height; ++y)
+    {
+        _deflate_bytes(png, &filter_none, 1);
+        _deflate_bytes(png, _view_row(view, y, buffer), view->width);
+    }
+
+    if (compress)
+    {
+        _flush_run(png);
+        _put_symbol(png, 256);
+
+        /* pad to a byte boundary */
+        _put_bits(png, 0, (32 - png->nbits) % 8);
+        while (png->nbits)
+        {
+            uint8_t byte = png->bits;
+            _idat_bytes(png, &byte, 1);
+            png->bits >>= 8;
+            png->nbits -= 8;
+        }
+    }
+    else
+    {
+        _stored_block(png, 1);
+    }
+
+    uint8_t adler[4];
+    _put_u32(adler, (png->adler_b << 16) | png->adler_a);
+    _idat_bytes(png, adler, 4);
+
+    _flush_idat(png);
+    _write_chunk(png, "IEND", NULL, 0);
+
+    int result = _close(png->fp, file_buffer, 0);
+
+    free(png->idat);
+    free(png->stored);
+    free(png);
+    free(buffer);
+
+    return result;
+}
+
+/* Exported functions ------------------------------------------------------- */
+
+static int _save_view(const char * filename, const view_t * view, int format)
+{
+    if (format == MAPEXPORT_PGM)
+    {
+        return _save_pgm(filename, view);
+    }
+
+    if (format == MAPEXPORT_PNG || format == MAPEXPORT_PNG_STORED)
+    {
+        return _save_png(filename, view, format == MAPEXPORT_PNG);
+    }
+
+    return -1;
+}
+
+int
+mapexport_save(
+    const char * filename,
+    const mapexport_image_t * image,
+    int format)
+{
+    trajectory_t trajectory;
+    int result = -1;
+
+    if (!_trajectory_init(&trajectory, image))
+    {
+        view_t view = {image, &trajectory, 0, 0, image->width, image->height};
+
+        result = _save_view(filename, &view, format);
+    }
+
+    _trajectory_free(&trajectory);
+
+    return result;
+}
+
+int
+mapexport_save_tiles(
+    const char * filename,
+    const mapexport_image_t * image,
+    int format,
+    int tile_size)
+{
+    if (tile_size < 1)
+    {
+        return -1;
+    }
+
+    /* split filename into prefix and extension */
+    const char * slash = strrchr(filename, '/');
+    const char * dot = strrchr(filename, '.');
+
+    if (!dot || (slash && dot < slash))
+    {
+        dot = filename + strlen(filename);
+    }
+
+    int prefix_length = dot - filename;
+    char * name = (char *)malloc(strlen(filename) + 32);
+
+    sprintf(name, "%.*s.tiles", prefix_length, filename);
+
+    FILE * index = fopen(name, "w");
+
+    if (!index)
+    {
+        free(name);
+        return -1;
+    }
+
+    int columns = (image->width + tile_size - 1) / tile_size;
+    int rows = (image->height + tile_size - 1) / tile_size;
+
+    fprintf(index, "%d %d\n%d\n%d %d\n", image->width, image->height, tile_size, rows, columns);
+
+    trajectory_t trajectory;
+    int result = _trajectory_init(&trajectory, image);
+    int row, column;
+
+    for (row=0; row<rows && !result; ++row)
+    {
+        for (column=0; column<columns && !result; ++column)
+        {
+            view_t view = {image, &trajectory, column*tile_size, row*tile_size, tile_size, tile_size};
+
+            if (view.x0 + view.width > image->width)
+            {
+                view.width = image->width - view.x0;
+            }
+
+            if (view.y0 + view.height > image->height)
+            {
+                view.height = image->height - view.y0;
+            }
+
+            sprintf(name, "%.*s-%d-%d%s", prefix_length, filename, row, column, dot);
+
+            result = _save_view(name, &view, format);
+
+            /* index lists names relative to its own directory */
+            fprintf(index, "%s\n", slash ? name + (slash - filename) + 1 : name);
+        }
+    }
+
+    _trajectory_free(&trajectory);
+    free(name);
+
+    if (fclose(index))
+    {
+        result = -1;
+    }
+
+    return result;
+}
@@ -0,0 +1,77 @@
+/*
+
+mapexport.h - Fast export of maps to image files
+
+Maps are written a row at a time straight from their pixels, with the robot
+trajectory drawn in black as each row goes out, so an export makes a single
+pass over the map and never modifies it.  PNG files are written with a built-in
+deflate encoder and need no external library.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPEXPORT_H
+#define MAPEXPORT_H
+
+/* Binary (P5) PGM */
+static const int MAPEXPORT_PGM          = 0;
+
+/* Grayscale PNG, run-length encoded with fixed-Huffman deflate blocks */
+static const int MAPEXPORT_PNG          = 1;
+
+/* Grayscale PNG with uncompressed (stored) deflate blocks */
+static const int MAPEXPORT_PNG_STORED   = 2;
+
+typedef struct mapexport_image_t
+{
+    const unsigned char * bytes;    /* 8-bit pixels, row by row, as from map_get() */
+    const unsigned short * pixels;  /* or the 16-bit pixels of a map_t, exported as by map_get() */
+    int width;
+    int height;
+
+    const int * trajectory_xy;      /* pixel coordinates x0, y0, x1, y1, ... to draw in black; may be NULL */
+    int trajectory_npoints;
+
+} mapexport_image_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Writes an image in one of the formats above; returns 0 on success, -1 on failure */
+int
+mapexport_save(
+    const char * filename,
+    const mapexport_image_t * image,
+    int format);
+
+/* Splits an image into tiles of at most tile_size x tile_size pixels.  For
+   filename map.png, writes tiles map-ROW-COL.png and a text index map.tiles
+   holding the lines "WIDTH HEIGHT", "TILE_SIZE", "ROWS COLUMNS", and then the
+   tile file names row by row.  Returns 0 on success, -1 on failure. */
+int
+mapexport_save_tiles(
+    const char * filename,
+    const mapexport_image_t * image,
+    int format,
+    int tile_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MAPEXPORT_H */
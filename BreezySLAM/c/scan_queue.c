@@ -0,0 +1,354 @@
+/*
+
+scan_queue.c - Lock-free single-producer/single-consumer queue of Lidar scans
+
+Each slot carries a version number that doubles as a sequence lock: the
+producer sets it to 2*index+1 while filling slot index and to 2*index+2 once
+the slot is published.  The consumer copies a slot out and then rechecks the
+version, so under SCAN_QUEUE_OVERWRITE_OLDEST a copy torn by the producer
+lapping the consumer is detected and retried from the oldest intact slot.
+
+A consumer with nothing to read can block in scan_queue_wait(): it raises the
+waiting flag under the queue's mutex and sleeps on a CLOCK_MONOTONIC condition
+variable, which the producer signals after publishing only if the flag is up.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "scan_queue.h"
+
+#define CACHE_LINE_BYTES 64
+
+typedef struct slot_t
+{
+    uint64_t version;
+    uint64_t sequence;
+    uint64_t timestamp_usec;
+    uint32_t sensor_timestamp;
+    int npoints;
+
+} slot_t;
+
+struct scan_queue_t
+{
+    int capacity;
+    int max_points;
+    int policy;
+
+    slot_t * slots;
+    int * values;
+
+    /* written by the producer only */
+    uint64_t head __attribute__((aligned(CACHE_LINE_BYTES)));   /* slots published */
+    uint64_t offered;                                           /* scans published or dropped */
+
+    /* written by the consumer only */
+    uint64_t tail __attribute__((aligned(CACHE_LINE_BYTES)));   /* next slot to read */
+    uint64_t next_sequence;                                     /* sequence expected next */
+
+    /* for blocking consumers */
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t wait_cond;
+    int waiting;
+};
+
+static slot_t * _slot(scan_queue_t * queue, uint64_t index)
+{
+    return &queue->slots[index % queue->capacity];
+}
+
+static int * _values(scan_queue_t * queue, uint64_t index)
+{
+    return queue->values + (index % queue->capacity) * queue->max_points;
+}
+
+/* Exported functions ------------------------------------------------------- */
+
+scan_queue_t *
+scan_queue_create(
+    int capacity,
+    int max_points,
+    int policy)
+{
+    void * v = NULL;
+
+    if (capacity < 1 || max_points < 1)
+    {
+        return NULL;
+    }
+
+    if (posix_memalign(&v, CACHE_LINE_BYTES, sizeof(scan_queue_t)))
+    {
+        return NULL;
+    }
+
+    scan_queue_t * queue = (scan_queue_t *)v;
+
+    memset(queue, 0, sizeof(scan_queue_t));
+
+    queue->capacity = capacity;
+    queue->max_points = max_points;
+    queue->policy = policy;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->wait_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&queue->wait_mutex, NULL);
+
+    queue->slots = (slot_t *)calloc(capacity, sizeof(slot_t));
+    queue->values = (int *)calloc((size_t)capacity * max_points, sizeof(int));
+
+    if (!queue->slots || !queue->values)
+    {
+        scan_queue_free(queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void
+scan_queue_free(
+    scan_queue_t * queue)
+{
+    if (queue)
+    {
+        pthread_cond_destroy(&queue->wait_cond);
+        pthread_mutex_destroy(&queue->wait_mutex);
+        free(queue->slots);
+        free(queue->values);
+        free(queue);
+    }
+}
+
+int
+scan_queue_max_points(
+    scan_queue_t * queue)
+{
+    return queue->max_points;
+}
+
+int *
+scan_queue_acquire(
+    scan_queue_t * queue)
+{
+    uint64_t head = queue->head;
+
+    if (queue->policy == SCAN_QUEUE_BACKPRESSURE &&
+        head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= (uint64_t)queue->capacity)
+    {
+        return NULL;
+    }
+
+    /* mark the slot as being written before touching its values */
+    __atomic_store_n(&_slot(queue, head)->version, 2*head+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return _values(queue, head);
+}
+
+void
+scan_queue_publish(
+    scan_queue_t * queue,
+    int npoints,
+    uint64_t timestamp_usec,
+    uint32_t sensor_timestamp)
+{
+    uint64_t head = queue->head;
+    slot_t * slot = _slot(queue, head);
+
+    slot->npoints = npoints < queue->max_points ? npoints : queue->max_points;
+    slot->timestamp_usec = timestamp_usec;
+    slot->sensor_timestamp = sensor_timestamp;
+    slot->sequence = queue->offered++;
+
+    __atomic_store_n(&slot->version, 2*head+2, __ATOMIC_RELEASE);
+    __atomic_store_n(&queue->head, head+1, __ATOMIC_RELEASE);
+
+    /* pairs with the fence in scan_queue_wait(): either we see the flag or it sees the new head */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&queue->waiting, __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&queue->wait_mutex);
+        pthread_cond_signal(&queue->wait_cond);
+        pthread_mutex_unlock(&queue->wait_mutex);
+    }
+}
+
+void
+scan_queue_drop(
+    scan_queue_t * queue)
+{
+    queue->offered++;
+}
+
+int
+scan_queue_push(
+    scan_queue_t * queue,
+    const int * values,
+    int npoints,
+    uint64_t timestamp_usec,
+    uint32_t sensor_timestamp)
+{
+    int * slot_values = scan_queue_acquire(queue);
+
+    if (!slot_values)
+    {
+        scan_queue_drop(queue);
+        return -1;
+    }
+
+    if (npoints > queue->max_points)
+    {
+        npoints = queue->max_points;
+    }
+
+    memcpy(slot_values, values, npoints*sizeof(int));
+
+    scan_queue_publish(queue, npoints, timestamp_usec, sensor_timestamp);
+
+    return 0;
+}
+
+uint64_t
+scan_queue_now_usec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+int
+scan_queue_pop(
+    scan_queue_t * queue,
+    int * values,
+    scan_queue_info_t * info)
+{
+    while (1)
+    {
+        uint64_t tail = queue->tail;
+        slot_t * slot = _slot(queue, tail);
+
+        uint64_t version = __atomic_load_n(&slot->version, __ATOMIC_ACQUIRE);
+
+        /* not yet published */
+        if (version < 2*tail+2)
+        {
+            return -1;
+        }
+
+        if (version == 2*tail+2)
+        {
+            int npoints = slot->npoints;
+            uint64_t sequence = slot->sequence;
+            uint64_t timestamp_usec = slot->timestamp_usec;
+            uint32_t sensor_timestamp = slot->sensor_timestamp;
+
+            memcpy(values, _values(queue, tail), npoints*sizeof(int));
+
+            /* make sure the producer did not lap us while copying */
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(&slot->version, __ATOMIC_RELAXED) == version)
+            {
+                __atomic_store_n(&queue->tail, tail+1, __ATOMIC_RELEASE);
+
+                if (info)
+                {
+                    info->sequence = sequence;
+                    info->timestamp_usec = timestamp_usec;
+                    info->skipped = sequence - queue->next_sequence;
+                    info->sensor_timestamp = sensor_timestamp;
+                }
+
+                queue->next_sequence = sequence + 1;
+
+                return npoints;
+            }
+        }
+
+        /* overwritten: skip to the oldest slot the producer cannot be writing */
+        uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        uint64_t oldest = head + 1 > (uint64_t)queue->capacity ? head + 1 - queue->capacity : 0;
+
+        __atomic_store_n(&queue->tail, oldest > tail ? oldest : tail+1, __ATOMIC_RELEASE);
+    }
+}
+
+int
+scan_queue_pop_latest(
+    scan_queue_t * queue,
+    int * values,
+    scan_queue_info_t * info)
+{
+    uint64_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+
+    if (head > queue->tail + 1)
+    {
+        __atomic_store_n(&queue->tail, head-1, __ATOMIC_RELEASE);
+    }
+
+    return scan_queue_pop(queue, values, info);
+}
+
+static int _unread(scan_queue_t * queue)
+{
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) > queue->tail;
+}
+
+int
+scan_queue_wait(
+    scan_queue_t * queue,
+    uint64_t timeout_usec)
+{
+    if (_unread(queue))
+    {
+        return 0;
+    }
+
+    uint64_t deadline_usec = scan_queue_now_usec() + timeout_usec;
+
+    struct timespec deadline;
+    deadline.tv_sec = deadline_usec / 1000000;
+    deadline.tv_nsec = (deadline_usec % 1000000) * 1000;
+
+    pthread_mutex_lock(&queue->wait_mutex);
+
+    __atomic_store_n(&queue->waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    int timed_out = 0;
+
+    while (!_unread(queue) && !timed_out)
+    {
+        timed_out = pthread_cond_timedwait(&queue->wait_cond, &queue->wait_mutex, &deadline) != 0;
+    }
+
+    __atomic_store_n(&queue->waiting, 0, __ATOMIC_RELAXED);
+
+    pthread_mutex_unlock(&queue->wait_mutex);
+
+    return _unread(queue) ? 0 : -1;
+}
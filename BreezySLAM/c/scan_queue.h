@@ -0,0 +1,143 @@
+/*
+
+scan_queue.h - Lock-free single-producer/single-consumer queue of Lidar scans
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#ifndef SCAN_QUEUE_H
+#define SCAN_QUEUE_H
+
+#include <stdint.h>
+
+/* When the queue is full, the producer overwrites the oldest unread scan */
+static const int SCAN_QUEUE_OVERWRITE_OLDEST = 0;
+
+/* When the queue is full, the producer is refused a slot until the consumer catches up */
+static const int SCAN_QUEUE_BACKPRESSURE     = 1;
+
+typedef struct scan_queue_t scan_queue_t;
+
+/* Describes a scan removed from the queue */
+typedef struct scan_queue_info_t
+{
+    uint64_t sequence;          /* number of scans offered to the queue before this one */
+    uint64_t timestamp_usec;    /* supplied by the producer when publishing */
+    uint64_t skipped;           /* scans overwritten or dropped since the previous pop */
+    uint32_t sensor_timestamp;  /* the sensor's own clock, if it has one, else 0 */
+
+} scan_queue_info_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Creates a queue of capacity slots, each holding up to max_points values.
+ * Returns NULL on failure.
+ */
+scan_queue_t *
+scan_queue_create(
+    int capacity,
+    int max_points,
+    int policy);
+
+void
+scan_queue_free(
+    scan_queue_t * queue);
+
+int
+scan_queue_max_points(
+    scan_queue_t * queue);
+
+/* Producer side ------------------------------------------------------------ */
+
+/*
+ * Returns the values array of the next slot, to be filled in place and then
+ * published with scan_queue_publish().  Returns NULL if the queue is full under
+ * SCAN_QUEUE_BACKPRESSURE; the producer may retry later, or call
+ * scan_queue_drop() to discard its scan.
+ */
+int *
+scan_queue_acquire(
+    scan_queue_t * queue);
+
+/* 
+ * Makes the slot returned by scan_queue_acquire() visible to the consumer, 
+ * waking it if it is blocked in scan_queue_wait()
+ */
+void
+scan_queue_publish(
+    scan_queue_t * queue,
+    int npoints,
+    uint64_t timestamp_usec,
+    uint32_t sensor_timestamp);
+
+/* Records a scan that the producer could not queue, so the consumer sees the gap */
+void
+scan_queue_drop(
+    scan_queue_t * queue);
+
+/* Copies a scan into the queue; returns 0 on success, -1 if the queue is full */
+int
+scan_queue_push(
+    scan_queue_t * queue,
+    const int * values,
+    int npoints,
+    uint64_t timestamp_usec,
+    uint32_t sensor_timestamp);
+
+/* Microseconds on CLOCK_MONOTONIC, for producers' timestamps */
+uint64_t
+scan_queue_now_usec(void);
+
+/* Consumer side ------------------------------------------------------------ */
+
+/*
+ * Copies the oldest unread scan into values (which must hold max_points ints)
+ * and returns its number of points, or returns -1 if no unread scan is
+ * available.  info may be NULL.
+ */
+int
+scan_queue_pop(
+    scan_queue_t * queue,
+    int * values,
+    scan_queue_info_t * info);
+
+/* As scan_queue_pop(), but skips to the newest unread scan */
+int
+scan_queue_pop_latest(
+    scan_queue_t * queue,
+    int * values,
+    scan_queue_info_t * info);
+
+/*
+ * Blocks until an unread scan is available or timeout_usec has passed on
+ * CLOCK_MONOTONIC.  Returns 0 if a scan is available, -1 on timeout.  The
+ * producer signals a condition variable only while the consumer is waiting, 
+ * so publishing stays lock-free otherwise.
+ */
+int
+scan_queue_wait(
+    scan_queue_t * queue,
+    uint64_t timeout_usec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCAN_QUEUE_H */
@@ -0,0 +1,297 @@
+/*
+
+scanlog.c - Binary, memory-mapped log of Lidar scans and odometry
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "scanlog.h"
+
+/* record layout: timestamp, two odometry values, distances */
+static const int RECORD_ODOMETRY_OFFSET  = 8;
+static const int RECORD_DISTANCES_OFFSET = 16;
+
+struct scanlog_t
+{
+    const uint8_t * base;
+    size_t length;
+    const scanlog_header_t * header;
+    const int64_t * index;
+};
+
+struct scanlog_writer_t
+{
+    FILE * fp;
+    scanlog_header_t header;
+    uint8_t * record;
+    int64_t * index;
+    uint64_t index_capacity;
+};
+
+static uint64_t _record_size(uint32_t scan_size)
+{
+    uint64_t size = RECORD_DISTANCES_OFFSET + (uint64_t)scan_size * sizeof(int32_t);
+
+    /* keep timestamps 8-byte aligned */
+    return (size + 7) & ~(uint64_t)7;
+}
+
+static const uint8_t * _record(scanlog_t * log, uint64_t k)
+{
+    return log->base + log->header->header_size + k * log->header->record_size;
+}
+
+/* Reading ------------------------------------------------------------------ */
+
+scanlog_t *
+scanlog_open(
+    const char * filename)
+{
+    int fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+    {
+        fprintf(stderr, "scanlog_open: unable to open %s\n", filename);
+        return NULL;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(scanlog_header_t))
+    {
+        fprintf(stderr, "scanlog_open: %s is not a scan log\n", filename);
+        close(fd);
+        return NULL;
+    }
+
+    void * base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    /* the mapping keeps the file open */
+    close(fd);
+
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "scanlog_open: unable to map %s\n", filename);
+        return NULL;
+    }
+
+    const scanlog_header_t * header = (const scanlog_header_t *)base;
+
+    uint64_t length = st.st_size;
+
+    /* each size is checked against the file length before it is used, so that none of the sums
+       and products below can overflow */
+    if (memcmp(header->magic, SCANLOG_MAGIC, sizeof(SCANLOG_MAGIC)) ||
+        header->version != (uint32_t)SCANLOG_VERSION ||
+        header->header_size < sizeof(scanlog_header_t) ||
+        header->header_size > length ||
+        header->record_size != _record_size(header->scan_size) ||
+        header->nrecords > length / header->record_size ||
+        header->index_offset > length ||
+        header->index_offset < header->header_size + header->nrecords * header->record_size ||
+        header->nrecords > (length - header->index_offset) / sizeof(int64_t))
+    {
+        fprintf(stderr, "scanlog_open: %s is not a valid scan log\n", filename);
+        munmap(base, st.st_size);
+        return NULL;
+    }
+
+    /* records are normally read front to back */
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    scanlog_t * log = (scanlog_t *)malloc(sizeof(scanlog_t));
+
+    log->base = (const uint8_t *)base;
+    log->length = st.st_size;
+    log->header = header;
+    log->index = (const int64_t *)(log->base + header->index_offset);
+
+    return log;
+}
+
+void
+scanlog_close(
+    scanlog_t * log)
+{
+    if (log)
+    {
+        munmap((void *)log->base, log->length);
+        free(log);
+    }
+}
+
+int
+scanlog_scan_size(
+    scanlog_t * log)
+{
+    return log->header->scan_size;
+}
+
+uint64_t
+scanlog_count(
+    scanlog_t * log)
+{
+    return log->header->nrecords;
+}
+
+const int32_t *
+scanlog_scan(
+    scanlog_t * log,
+    uint64_t k)
+{
+    return (const int32_t *)(_record(log, k) + RECORD_DISTANCES_OFFSET);
+}
+
+const int32_t *
+scanlog_odometry(
+    scanlog_t * log,
+    uint64_t k)
+{
+    return (const int32_t *)(_record(log, k) + RECORD_ODOMETRY_OFFSET);
+}
+
+int64_t
+scanlog_timestamp_usec(
+    scanlog_t * log,
+    uint64_t k)
+{
+    return log->index[k];
+}
+
+uint64_t
+scanlog_seek(
+    scanlog_t * log,
+    int64_t timestamp_usec)
+{
+    uint64_t lo = 0;
+    uint64_t hi = log->header->nrecords;
+
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+
+        if (log->index[mid] < timestamp_usec)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/* Writing ------------------------------------------------------------------ */
+
+scanlog_writer_t *
+scanlog_create(
+    const char * filename,
+    int scan_size)
+{
+    FILE * fp = fopen(filename, "wb");
+
+    if (!fp)
+    {
+        fprintf(stderr, "scanlog_create: unable to create %s\n", filename);
+        return NULL;
+    }
+
+    scanlog_writer_t * writer = (scanlog_writer_t *)calloc(1, sizeof(scanlog_writer_t));
+
+    writer->fp = fp;
+
+    memcpy(writer->header.magic, SCANLOG_MAGIC, sizeof(SCANLOG_MAGIC));
+    writer->header.version = SCANLOG_VERSION;
+    writer->header.header_size = sizeof(scanlog_header_t);
+    writer->header.scan_size = scan_size;
+    writer->header.record_size = _record_size(scan_size);
+
+    writer->record = (uint8_t *)calloc(1, writer->header.record_size);
+
+    /* placeholder header, rewritten by scanlog_finish() */
+    fwrite(&writer->header, sizeof(scanlog_header_t), 1, fp);
+
+    return writer;
+}
+
+int
+scanlog_append(
+    scanlog_writer_t * writer,
+    int64_t timestamp_usec,
+    int32_t odometry0,
+    int32_t odometry1,
+    const int * distances_mm)
+{
+    uint8_t * record = writer->record;
+    int32_t odometry[2] = {odometry0, odometry1};
+
+    memcpy(record, &timestamp_usec, sizeof(int64_t));
+    memcpy(record + RECORD_ODOMETRY_OFFSET, odometry, sizeof(odometry));
+    memcpy(record + RECORD_DISTANCES_OFFSET, distances_mm, writer->header.scan_size * sizeof(int32_t));
+
+    if (fwrite(record, writer->header.record_size, 1, writer->fp) != 1)
+    {
+        return -1;
+    }
+
+    if (writer->header.nrecords == writer->index_capacity)
+    {
+        writer->index_capacity = writer->index_capacity ? 2 * writer->index_capacity : 1024;
+        writer->index = (int64_t *)realloc(writer->index, writer->index_capacity * sizeof(int64_t));
+    }
+
+    writer->index[writer->header.nrecords++] = timestamp_usec;
+
+    return 0;
+}
+
+int
+scanlog_finish(
+    scanlog_writer_t * writer)
+{
+    int result = 0;
+
+    writer->header.index_offset = writer->header.header_size +
+                                  writer->header.nrecords * writer->header.record_size;
+
+    if (fwrite(writer->index, sizeof(int64_t), writer->header.nrecords, writer->fp) != writer->header.nrecords ||
+        fseek(writer->fp, 0, SEEK_SET) ||
+        fwrite(&writer->header, sizeof(scanlog_header_t), 1, writer->fp) != 1)
+    {
+        result = -1;
+    }
+
+    if (fclose(writer->fp))
+    {
+        result = -1;
+    }
+
+    free(writer->record);
+    free(writer->index);
+    free(writer);
+
+    return result;
+}
@@ -0,0 +1,130 @@
+/*
+
+scanlog.h - Binary, memory-mapped log of Lidar scans and odometry
+
+A scan log is a fixed-size header, followed by fixed-size records, followed by
+an index of record timestamps for seeking.  All values are little-endian.
+
+    header  (scanlog_header_t, 64 bytes)
+    records (record_size bytes each):
+        int64_t timestamp_usec
+        int32_t odometry[2]             e.g. left and right wheel ticks
+        int32_t distances_mm[scan_size]
+        padding to a multiple of 8 bytes
+    index   (int64_t timestamp_usec for each record)
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http:#www.gnu.org/licenses/>.
+*/
+
+#ifndef SCANLOG_H
+#define SCANLOG_H
+
+#include <stdint.h>
+
+static const char SCANLOG_MAGIC[8]   = {'B', 'Z', 'S', 'C', 'A', 'N', 'L', 'G'};
+static const int  SCANLOG_VERSION    = 1;
+
+typedef struct scanlog_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t scan_size;             /* distances per record */
+    uint32_t record_size;           /* bytes per record */
+    uint64_t nrecords;
+    uint64_t index_offset;          /* byte offset of the timestamp index */
+    uint8_t reserved[24];
+
+} scanlog_header_t;
+
+typedef struct scanlog_t scanlog_t;
+
+typedef struct scanlog_writer_t scanlog_writer_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Reading ------------------------------------------------------------------ */
+
+/* Maps a scan log read-only; returns NULL and prints a message on failure */
+scanlog_t *
+scanlog_open(
+    const char * filename);
+
+void
+scanlog_close(
+    scanlog_t * log);
+
+int
+scanlog_scan_size(
+    scanlog_t * log);
+
+uint64_t
+scanlog_count(
+    scanlog_t * log);
+
+/* The distances of record k, pointing into the mapped file */
+const int32_t *
+scanlog_scan(
+    scanlog_t * log,
+    uint64_t k);
+
+/* The two odometry values of record k, pointing into the mapped file */
+const int32_t *
+scanlog_odometry(
+    scanlog_t * log,
+    uint64_t k);
+
+int64_t
+scanlog_timestamp_usec(
+    scanlog_t * log,
+    uint64_t k);
+
+/* Returns the first record whose timestamp is at or after timestamp_usec */
+uint64_t
+scanlog_seek(
+    scanlog_t * log,
+    int64_t timestamp_usec);
+
+/* Writing ------------------------------------------------------------------ */
+
+/* Creates a scan log; returns NULL and prints a message on failure */
+scanlog_writer_t *
+scanlog_create(
+    const char * filename,
+    int scan_size);
+
+/* Appends a record; returns 0 on success, -1 on a write error */
+int
+scanlog_append(
+    scanlog_writer_t * writer,
+    int64_t timestamp_usec,
+    int32_t odometry0,
+    int32_t odometry1,
+    const int * distances_mm);
+
+/* Writes the index and final header and closes the file; returns 0 on success */
+int
+scanlog_finish(
+    scanlog_writer_t * writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SCANLOG_H */
@@ -26,6 +26,36 @@
 using namespace std; 
 
 
+/**
+* Output arrays for converting a Lidar scan into scan points; these alias the
+* arrays of the scan_t being updated.
+*/
+struct laser_scan_points
+{
+    double * x_mm;
+    double * y_mm;
+    int * value;
+    float * obst_x_mm;
+    float * obst_y_mm;
+    int npoints;
+    int obst_npoints;
+};
+
+/**
+* A scan conversion routine specialized for one laser model.  Returns false if
+* it does not support the requested span, in which case the generic
+* scan_update() is used.
+*/
+typedef bool (*laser_scan_converter)(
+    laser_scan_points & points,
+    const int * lidar_mm,
+    int span,
+    int detection_margin,
+    double hole_width_mm,
+    double velocities_dxy_mm,
+    double velocities_dtheta_degrees);
+
+
 /**
 * A class for scanning laser rangefinder (Lidar) parameters.
 */
@@ -44,6 +74,8 @@ protected:
     double distance_no_detection_mm;    /* default value when the laser returns 0 */
     int detection_margin;               /* first scan element to consider */
     double offset_mm;                   /* position of the laser wrt center of rotation */
+
+    laser_scan_converter scan_converter; /* specialized scan conversion, or NULL */
     
 public:
     
@@ -74,6 +106,7 @@ public:
         this->distance_no_detection_mm = distance_no_detection_mm;
         this->detection_margin = detection_margin;
         this->offset_mm = offset_mm;
+        this->scan_converter = NULL;
     }
     
     /**
@@ -102,29 +135,249 @@ public:
     }
 };
     
+/**
+* A class for lasers whose geometry is known at compile time.  The angle of
+* every ray is tabulated at compile time, so scan conversion needs no
+* trigonometry for a stationary robot and only a rotation recurrence for a
+* moving one.  Spans of 1 and 3 (as used by CoreSLAM) are specialized; other
+* spans fall back to the generic conversion.
+*/
+template <int SCAN_SIZE, int SCAN_RATE_HZ, int DETECTION_ANGLE_DEGREES, int DISTANCE_NO_DETECTION_MM>
+class FixedLaser : public Laser
+{
+
+public:
+
+    /**
+    * Builds a FixedLaser object.
+    * @param detection_margin           number of rays at edges of scan to ignore
+    * @param offset_mm                  forward/backward offset of laser motor from robot center
+    * @return a new FixedLaser object
+    *
+    */
+    FixedLaser(int detection_margin = 0, float offset_mm = 0) :
+    Laser(SCAN_SIZE, SCAN_RATE_HZ, DETECTION_ANGLE_DEGREES, DISTANCE_NO_DETECTION_MM, detection_margin, offset_mm)
+    {
+        this->scan_converter = FixedLaser::convert;
+    }
+
+private:
+
+    /* Scan values; these must match coreslam_internals.h */
+    static const int NO_OBSTACLE = 65500;
+    static const int OBSTACLE    = 0;
+
+    /* Reduces x to [-pi/4, pi/4] by quadrant, then sums the Taylor series */
+    static constexpr long double taylor(long double x, int first_power)
+    {
+        long double term = first_power ? x : 1;
+        long double sum = term;
+
+        for (int n=first_power+1; n<first_power+40; n+=2)
+        {
+            term *= -x * x / (n * (n + 1));
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    static constexpr long double quadrant_sin(double x, int shift)
+    {
+        const long double half_pi = 1.57079632679489661923132169163975144L;
+
+        long double q = x / half_pi;
+        long long quadrant = (long long)(q < 0 ? q - 0.5L : q + 0.5L);
+        long double r = x - quadrant * half_pi;
+
+        switch ((quadrant + shift) & 3)
+        {
+        case 0:
+            return taylor(r, 1);
+        case 1:
+            return taylor(r, 0);
+        case 2:
+            return -taylor(r, 1);
+        }
+        return -taylor(r, 0);
+    }
+
+    /* Ray angles in radians, computed as in scan_update() so results match */
+    template <int SPAN>
+    struct ray_table
+    {
+        double k[SCAN_SIZE*SPAN];           /* ray position in degrees from first ray */
+        double cos_angle[SCAN_SIZE*SPAN];
+        double sin_angle[SCAN_SIZE*SPAN];
+
+        constexpr ray_table(void) : k(), cos_angle(), sin_angle()
+        {
+            for (int n=0; n<SCAN_SIZE*SPAN; ++n)
+            {
+                this->k[n] = (double)n * DETECTION_ANGLE_DEGREES / (SCAN_SIZE * SPAN - 1);
+
+                double angle = (-(double)DETECTION_ANGLE_DEGREES/2 + this->k[n]) * M_PI / 180;
+
+                this->cos_angle[n] = (double)quadrant_sin(angle, 1);
+                this->sin_angle[n] = (double)quadrant_sin(angle, 0);
+            }
+        }
+    };
+
+    static constexpr ray_table<1> table1 = ray_table<1>();
+    static constexpr ray_table<3> table3 = ray_table<3>();
+
+    template <int SPAN>
+    static void convert_span(
+        const ray_table<SPAN> & table,
+        laser_scan_points & points,
+        const int * lidar_mm,
+        int detection_margin,
+        double hole_width_mm,
+        double velocities_dxy_mm,
+        double velocities_dtheta_degrees)
+    {
+        /* Take velocity into account */
+        const int degrees_per_second = (int)(SCAN_RATE_HZ * 360);
+        double horz_mm = velocities_dxy_mm / degrees_per_second;
+
+        /* Rotation during the scan adds n * dphi to the angle of ray n */
+        bool rotating = velocities_dtheta_degrees != 0;
+        double dphi = (double)DETECTION_ANGLE_DEGREES / (SCAN_SIZE * SPAN - 1) *
+                      velocities_dtheta_degrees / degrees_per_second * M_PI / 180;
+        double cos_dphi = rotating ? cos(dphi) : 1;
+        double sin_dphi = rotating ? sin(dphi) : 0;
+
+        int first = detection_margin + 1;
+        double cos_rot = rotating ? cos(first * SPAN * dphi) : 1;
+        double sin_rot = rotating ? sin(first * SPAN * dphi) : 0;
+
+        points.npoints = 0;
+        points.obst_npoints = 0;
+
+        for (int i=first; i<SCAN_SIZE-detection_margin; ++i)
+        {
+            int lidar_value_mm = lidar_mm[i];
+            int distance = 0;
+            int value = NO_OBSTACLE;
+
+            /* No obstacle */
+            if (lidar_value_mm == 0)
+            {
+                distance = DISTANCE_NO_DETECTION_MM;
+            }
+
+            /* Obstacle */
+            else if (lidar_value_mm > hole_width_mm / 2)
+            {
+                distance = lidar_value_mm;
+                value = OBSTACLE;
+            }
+
+            for (int j=0; j<SPAN; ++j)
+            {
+                int n = i * SPAN + j;
+
+                if (distance)
+                {
+                    double c = table.cos_angle[n];
+                    double s = table.sin_angle[n];
+
+                    if (rotating)
+                    {
+                        double cr = c * cos_rot - s * sin_rot;
+                        s = s * cos_rot + c * sin_rot;
+                        c = cr;
+                    }
+
+                    double x = distance * c - table.k[n] * horz_mm;
+                    double y = distance * s;
+
+                    points.value[points.npoints] = value;
+                    points.x_mm[points.npoints] = x;
+                    points.y_mm[points.npoints] = y;
+                    points.npoints++;
+
+                    /* Store obstacles separately for SSE */
+                    if (value == OBSTACLE)
+                    {
+                        points.obst_x_mm[points.obst_npoints] = (float)x;
+                        points.obst_y_mm[points.obst_npoints] = (float)y;
+                        points.obst_npoints++;
+                    }
+                }
+
+                if (rotating)
+                {
+                    double cr = cos_rot * cos_dphi - sin_rot * sin_dphi;
+                    sin_rot = sin_rot * cos_dphi + cos_rot * sin_dphi;
+                    cos_rot = cr;
+                }
+            }
+        }
+    }
+
+    static bool convert(
+        laser_scan_points & points,
+        const int * lidar_mm,
+        int span,
+        int detection_margin,
+        double hole_width_mm,
+        double velocities_dxy_mm,
+        double velocities_dtheta_degrees)
+    {
+        switch (span)
+        {
+        case 1:
+            convert_span<1>(table1, points, lidar_mm, detection_margin,
+                            hole_width_mm, velocities_dxy_mm, velocities_dtheta_degrees);
+            return true;
+        case 3:
+            convert_span<3>(table3, points, lidar_mm, detection_margin,
+                            hole_width_mm, velocities_dxy_mm, velocities_dtheta_degrees);
+            return true;
+        }
+
+        return false;
+    }
+};
+
 /**
   * A class for the Hokuyo URG-04LX laser.
   */
-class URG04LX : public Laser  
+class URG04LX : public FixedLaser<682, 10, 240, 4000>
 {
-    
+
 public:
-    
+
     /**
     * Builds a URG04LX object.
     * Lidar unit.
     * @param detection_margin           number of rays at edges of scan to ignore
     * @param offset_mm                  forward/backward offset of laser motor from robot center
     * @return a new URG04LX object
-    * 
+    *
     */
-    URG04LX(int detection_margin = 0, float offset_mm = 0) : 
-    Laser(682, 10, 240, 4000, detection_margin, offset_mm) { }
-    
+    URG04LX(int detection_margin = 0, float offset_mm = 0) :
+    FixedLaser<682, 10, 240, 4000>(detection_margin, offset_mm) { }
+};
+
+/**
+  * A class for the SlamTec RP-Lidar A2.
+  */
+class RPLidarA2 : public FixedLaser<360, 10, 360, 6000>
+{
+
+public:
+
     /**
-    * Builds an empty URG04LX object (all parameters zero).
+    * Builds an RPLidarA2 object.
+    * @param detection_margin           number of rays at edges of scan to ignore
+    * @param offset_mm                  forward/backward offset of laser motor from robot center
+    * @return a new RPLidarA2 object
+    *
     */
-    URG04LX(void) : Laser() {} 
-    
+    RPLidarA2(int detection_margin = 0, float offset_mm = 0) :
+    FixedLaser<360, 10, 360, 6000>(detection_margin, offset_mm) { }
 };
 
@@ -39,6 +39,7 @@ class Map
     friend class CoreSLAM;
     friend class SinglePositionSLAM;
     friend class RMHC_SLAM;
+    friend class MapExport;
         
 public:
     
@@ -0,0 +1,86 @@
+/*
+MapExport.cpp - C++ map export
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 of the 
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,     
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License 
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "coreslam.h"
+#include "mapexport.h"
+
+#include "Position.hpp"
+#include "Map.hpp"
+#include "Velocities.hpp"
+#include "algorithms.hpp"
+#include "MapExport.hpp"
+
+MapExport::MapExport(int size_pixels, double size_meters)
+{
+    this->size_pixels = size_pixels;
+    this->mm_per_pixel = size_meters * 1000. / size_pixels;
+}
+
+void MapExport::addPosition(Position & position)
+{
+    int x = (int)(position.x_mm / this->mm_per_pixel);
+    int y = (int)(position.y_mm / this->mm_per_pixel);
+
+    int n = this->trajectory.size();
+
+    // Successive positions often fall on the same pixel
+    if (n && this->trajectory[n-2] == x && this->trajectory[n-1] == y)
+    {
+        return;
+    }
+
+    this->trajectory.push_back(x);
+    this->trajectory.push_back(y);
+}
+
+void MapExport::clearTrajectory(void)
+{
+    this->trajectory.clear();
+}
+
+bool MapExport::save(const char * filename, unsigned char * mapbytes, int format, int tile_size)
+{
+    return this->save(filename, mapbytes, NULL, format, tile_size);
+}
+
+bool MapExport::save(const char * filename, CoreSLAM & slam, int format, int tile_size)
+{
+    slam.waitForMap();
+
+    return this->save(filename, NULL, slam.map->map->pixels, format, tile_size);
+}
+
+bool MapExport::save(const char * filename, unsigned char * mapbytes, unsigned short * pixels, 
+                     int format, int tile_size)
+{
+    mapexport_image_t image;
+
+    image.bytes = mapbytes;
+    image.pixels = pixels;
+    image.width = this->size_pixels;
+    image.height = this->size_pixels;
+    image.trajectory_xy = this->trajectory.empty() ? NULL : &this->trajectory[0];
+    image.trajectory_npoints = this->trajectory.size() / 2;
+
+    int result = tile_size > 0 ?
+        mapexport_save_tiles(filename, &image, format, tile_size) :
+        mapexport_save(filename, &image, format);
+
+    return result == 0;
+}
@@ -0,0 +1,100 @@
+/**
+* 
+* MapExport.hpp - C++ header for MapExport class
+*
+* Copyright (C) 2014 Simon D. Levy
+
+* This code is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as 
+* published by the Free Software Foundation, either version 3 of the 
+* License, or (at your option) any later version.
+* 
+* This code is distributed in the hope that it will be useful,     
+* but WITHOUT ANY WARRANTY without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public License 
+* along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+using namespace std; 
+
+class Position;
+class CoreSLAM;
+
+/**
+* A class for saving maps as image files, with the robot's trajectory drawn in black.  
+* Images are written a row at a time in a single pass over the map, and PNG files are 
+* compressed by a built-in encoder, so a 4096 x 4096 map is exported in tens of milliseconds.
+*/
+class MapExport
+{
+public:
+
+    /**
+    * Binary (P5) PGM format
+    */
+    static const int PGM        = 0;
+
+    /**
+    * Grayscale PNG format, run-length compressed
+    */
+    static const int PNG        = 1;
+
+    /**
+    * Grayscale PNG format, uncompressed
+    */
+    static const int PNG_STORED = 2;
+
+    /**
+    * Builds a MapExport object for maps of a given size.
+    * @param size_pixels size of the (square) map in pixels
+    * @param size_meters size of the map in meters
+    */
+    MapExport(int size_pixels, double size_meters);
+
+    /**
+    * Adds a position to the trajectory.
+    * @param position the position
+    */
+    void addPosition(Position & position);
+
+    /**
+    * Empties the trajectory.
+    */
+    void clearTrajectory(void);
+
+    /**
+    * Saves a map retrieved by CoreSLAM::getmap().
+    * @param filename name of the file to write
+    * @param mapbytes the map pixels
+    * @param format PGM, PNG, or PNG_STORED
+    * @param tile_size if positive, writes the map as tiles of this size, named after filename, 
+    * plus an index file; e.g., map.png becomes map-0-0.png, map-0-1.png, ..., and map.tiles
+    * @return true on success, false on failure
+    */
+    bool save(const char * filename, unsigned char * mapbytes, int format = PNG, int tile_size = 0);
+
+    /**
+    * Saves the current map of a CoreSLAM object directly, without copying it out first.
+    * @param filename name of the file to write
+    * @param slam the CoreSLAM object
+    * @param format PGM, PNG, or PNG_STORED
+    * @param tile_size if positive, writes the map as tiles of this size; see above
+    * @return true on success, false on failure
+    */
+    bool save(const char * filename, CoreSLAM & slam, int format = PNG, int tile_size = 0);
+
+private:
+
+    int size_pixels;
+    double mm_per_pixel;
+
+    // Pixel coordinates x0, y0, x1, y1, ...
+    vector<int> trajectory;
+
+    bool save(const char * filename, unsigned char * mapbytes, unsigned short * pixels, 
+              int format, int tile_size);
+};
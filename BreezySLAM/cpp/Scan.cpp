@@ -63,6 +63,8 @@ void Scan::init(Laser * laser, int span)
             laser->distance_no_detection_mm,    
             laser->detection_margin,               
             laser->offset_mm);
+
+    this->converter = laser->scan_converter;
 }
 
 Scan::~Scan(void)
@@ -78,6 +80,31 @@ Scan::update(
     double hole_width_millimeters,
     Velocities & velocities)
 {
+    if (this->converter)
+    {
+        laser_scan_points points;
+
+        points.x_mm = this->scan->x_mm;
+        points.y_mm = this->scan->y_mm;
+        points.value = this->scan->value;
+        points.obst_x_mm = this->scan->obst_x_mm;
+        points.obst_y_mm = this->scan->obst_y_mm;
+
+        if (this->converter(
+                points, 
+                scanvals_mm, 
+                this->scan->span, 
+                this->scan->detection_margin,
+                hole_width_millimeters,
+                velocities.dxy_mm,
+                velocities.dtheta_degrees))
+        {
+            this->scan->npoints = points.npoints;
+            this->scan->obst_npoints = points.obst_npoints;
+            return;
+        }
+    }
+
     scan_update(
         this->scan,
         scanvals_mm,
@@ -94,6 +121,24 @@ Scan::update(
     this->update(scanvals_mm, hole_width_millimeters, zeroVelocities);
 }
 
+void 
+Scan::update(
+    const double * angles_degrees,
+    const int * scanvals_mm, 
+    int npoints,
+    double hole_width_millimeters,
+    Velocities & velocities)
+{
+    scan_update_angles(
+        this->scan,
+        angles_degrees,
+        scanvals_mm,
+        npoints,
+        hole_width_millimeters,
+        velocities.dxy_mm,
+        velocities.dtheta_degrees);
+}
+
 ostream& operator<< (ostream & out, Scan & scan)
 {
     char str[512];
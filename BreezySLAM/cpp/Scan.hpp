@@ -90,11 +90,38 @@ update(
     double hole_width_millimeters,
     Velocities & velocities);
 
+/**
+* Updates this Scan object with Lidar samples at arbitrary angles, rather than evenly spaced rays.
+* @param angles_degrees angle of each sample in degrees, counterclockwise from straight ahead
+* @param scanvals_mm distance of each sample in millimeters
+* @param npoints number of samples
+* @param hole_width_millimeters hole width in millimeters
+* @param velocities forward velocity and angular velocity of robot at scan time
+* 
+*/
+void 
+update(
+    const double * angles_degrees,
+    const int * scanvals_mm, 
+    int npoints,
+    double hole_width_millimeters,
+    Velocities & velocities);
+
 friend ostream& operator<< (ostream & out, Scan & scan);
 
 private:
     
     struct scan_t * scan;
+
+    /* specialized conversion from the Laser, or NULL for scan_update() */
+    bool (*converter)(
+        struct laser_scan_points & points,
+        const int * lidar_mm,
+        int span,
+        int detection_margin,
+        double hole_width_mm,
+        double velocities_dxy_mm,
+        double velocities_dtheta_degrees);
     
     void init(Laser * laser, int span);
 };
@@ -17,8 +17,13 @@ You should have received a copy of the GNU Lesser General Public License
 along with this code.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
 #include "coreslam.h"
 #include "random.h"
+#include "scan_queue.h"
 
 #include "Position.hpp"
 #include "Map.hpp"
@@ -38,6 +43,136 @@ static void Position2position_t(Position & cpp_pos, struct position_t * c_pos)
     c_pos->theta_degrees = cpp_pos.theta_degrees;
 }
 
+// Instrumentation: compiles to nothing unless BREEZYSLAM_STATS is defined
+
+#ifdef BREEZYSLAM_STATS
+static unsigned long long stats_now_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define STATS_TIMER(t) unsigned long long t = stats_now_nsec()
+#define STATS_ELAPSED(stats, field, t) (stats)->field += stats_now_nsec() - (t)
+#else
+#define STATS_TIMER(t)
+#define STATS_ELAPSED(stats, field, t)
+#endif
+
+// Pipeline mode --------------------------------------------------------------------------------------------------------
+
+struct pipeline_t
+{
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    bool allow_stale_map;
+    bool pending;           // a scan is waiting for or undergoing integration
+    bool done;              // asks the thread to exit
+
+    Map * map;              // the map being integrated into
+    Map * snapshot;         // with allow_stale_map, the map as of the last finished integration
+
+    // With allow_stale_map, the two maps swap at each integration, and the one to be integrated
+    // into first catches up by copying from the other the box of pixels the last integration wrote
+    bool catch_up;
+    map_t * catch_up_from;
+    map_t * catch_up_to;
+    int catch_up_box[4];    // first column, last column, first row, last row
+    int box[4];             // the box of the integration in flight
+    Scan * scan;            // scan being integrated; swapped with scan_for_mapbuild
+    Position position;
+    int map_quality;
+    double hole_width_mm;
+
+    slam_stats_t stats;     // map counters of the last integration, until update() takes them
+};
+
+static void * pipeline_run(void * arg)
+{
+    pipeline_t * pipeline = (pipeline_t *)arg;
+
+    slam_stats_collect(&pipeline->stats);
+
+    pthread_mutex_lock(&pipeline->mutex);
+
+    while (true)
+    {
+        while (!pipeline->pending && !pipeline->done)
+        {
+            pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+        }
+
+        if (!pipeline->pending)
+        {
+            break;
+        }
+
+        // Integrate outside the lock, so update() can run the next search meanwhile
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        STATS_TIMER(start);
+
+        if (pipeline->catch_up)
+        {
+            map_t * from = pipeline->catch_up_from;
+            map_t * to = pipeline->catch_up_to;
+
+            int * box = pipeline->catch_up_box;
+
+            for (int y=box[2]; y<=box[3]; ++y)
+            {
+                int k = y * from->size_pixels + box[0];
+                memcpy(&to->pixels[k], &from->pixels[k], (box[1] - box[0] + 1) * sizeof(pixel_t));
+            }
+        }
+
+        pipeline->map->update(*pipeline->scan, pipeline->position, pipeline->map_quality, pipeline->hole_width_mm);
+
+        STATS_ELAPSED(&pipeline->stats, map_update_nsec, start);
+
+        pthread_mutex_lock(&pipeline->mutex);
+
+        pipeline->pending = false;
+        pthread_cond_broadcast(&pipeline->cond);
+    }
+
+    pthread_mutex_unlock(&pipeline->mutex);
+
+    return NULL;
+}
+
+// Bounds the pixels that integrating a scan at a position can write: no ray ends further than
+// hole_width_mm / 2 beyond its point, or outside the map
+static void pipeline_box(map_t * map, scan_t * scan, Position & position, double hole_width_mm, int box[4])
+{
+    double range_mm = 0;
+
+    for (int i=0; i<scan->npoints; ++i)
+    {
+        double dist = sqrt(scan->x_mm[i] * scan->x_mm[i] + scan->y_mm[i] * scan->y_mm[i]);
+
+        if (dist > range_mm)
+        {
+            range_mm = dist;
+        }
+    }
+
+    range_mm += hole_width_mm / 2;
+
+    double bounds_mm[4] = { position.x_mm - range_mm, position.x_mm + range_mm,
+                            position.y_mm - range_mm, position.y_mm + range_mm };
+
+    for (int k=0; k<4; ++k)
+    {
+        // a pixel either side for rounding
+        int pixel = (int)floor(bounds_mm[k] * map->scale_pixels_per_mm) + ((k & 1) ? 2 : -1);
+
+        box[k] = (pixel < 0) ? 0 : (pixel >= map->size_pixels) ? map->size_pixels - 1 : pixel;
+    }
+}
+
 // CoreSLAM class -------------------------------------------------------------------------------------------------------
 
 int CoreSLAM::distanceScanToMap(
@@ -73,23 +208,96 @@ CoreSLAM::CoreSLAM(
     
     // Initialize the map 
     this->map = new Map(map_size_pixels, map_size_meters);
+
+    // Integrate scans synchronously until enablePipeline() is called
+    this->pipeline = NULL;
+
+    this->stats = new slam_stats_t;
+    memset(this->stats, 0, sizeof(slam_stats_t));
 }
 
 CoreSLAM::~CoreSLAM(void)
 {        
+    pipeline_t * pipeline = this->pipeline;
+
+    // Let the pipeline thread finish any pending integration, then stop it
+    if (pipeline)
+    {
+        pthread_mutex_lock(&pipeline->mutex);
+        pipeline->done = true;
+        pthread_cond_broadcast(&pipeline->cond);
+        pthread_mutex_unlock(&pipeline->mutex);
+
+        pthread_join(pipeline->thread, NULL);
+
+        pthread_cond_destroy(&pipeline->cond);
+        pthread_mutex_destroy(&pipeline->mutex);
+
+        delete pipeline->snapshot;
+        delete pipeline->scan;
+        delete pipeline;
+    }
+
     delete this->map;
     delete this->scan_for_distance;
     delete this->scan_for_mapbuild;
     delete this->velocities;
+    delete this->stats;
 }
 
 
 void CoreSLAM::update(int * scan_mm, Velocities & velocities)
 {             
+#ifdef BREEZYSLAM_STATS
+    memset(this->stats, 0, sizeof(slam_stats_t));
+    slam_stats_collect(this->stats);
+#endif
+
+    STATS_TIMER(start);
+
     // Build a scan for computing distance to map, and one for updating map
     this->scan_update(this->scan_for_mapbuild, scan_mm);
     this->scan_update(this->scan_for_distance, scan_mm);
+
+    STATS_ELAPSED(this->stats, scan_update_nsec, start);
+
+    this->updateVelocitiesAndPointcloud(velocities);
+}   
+
+void CoreSLAM::update(int * scan_mm) 
+{
+    Velocities zero_velocities;   
     
+    this->update(scan_mm, zero_velocities);
+}
+
+void CoreSLAM::update(const double * angles_degrees, const int * scan_mm, int npoints, Velocities & velocities)
+{
+#ifdef BREEZYSLAM_STATS
+    memset(this->stats, 0, sizeof(slam_stats_t));
+    slam_stats_collect(this->stats);
+#endif
+
+    STATS_TIMER(start);
+
+    // Build a scan for computing distance to map, and one for updating map, from the samples as they are
+    this->scan_for_mapbuild->update(angles_degrees, scan_mm, npoints, this->hole_width_mm, *this->velocities);
+    this->scan_for_distance->update(angles_degrees, scan_mm, npoints, this->hole_width_mm, *this->velocities);
+
+    STATS_ELAPSED(this->stats, scan_update_nsec, start);
+
+    this->updateVelocitiesAndPointcloud(velocities);
+}
+
+void CoreSLAM::update(const double * angles_degrees, const int * scan_mm, int npoints)
+{
+    Velocities zero_velocities;   
+    
+    this->update(angles_degrees, scan_mm, npoints, zero_velocities);
+}
+
+void CoreSLAM::updateVelocitiesAndPointcloud(Velocities & velocities)
+{
     // Update velocities
     this->velocities->update(velocities.dxy_mm, 
                              velocities.dtheta_degrees,  
@@ -97,21 +305,218 @@ void CoreSLAM::update(int * scan_mm, Velocities & velocities)
                              
     // Implementing class updates map and pointcloud
     this->updateMapAndPointcloud(velocities);
-}   
 
-void CoreSLAM::update(int * scan_mm) 
+    slam_stats_collect(NULL);
+}
+
+bool CoreSLAM::update(scan_queue_t * queue, Velocities & velocities, scan_queue_info_t * info)
 {
-    Velocities zero_velocities;   
-    
-    this->update(scan_mm, zero_velocities);
+    int size = scan_queue_max_points(queue);
+
+    if (size < this->laser->scan_size)
+    {
+        size = this->laser->scan_size;
+    }
+
+    if ((int)this->queue_scan.size() < size)
+    {
+        this->queue_scan.resize(size);
+    }
+
+    int npoints = scan_queue_pop(queue, &this->queue_scan[0], info);
+
+    if (npoints < 0)
+    {
+        return false;
+    }
+
+    // Pad a short scan with no-detection values
+    for (int k=npoints; k<this->laser->scan_size; ++k)
+    {
+        this->queue_scan[k] = 0;
+    }
+
+    this->update(&this->queue_scan[0], velocities);
+
+    return true;
 }
 
 
+void CoreSLAM::enablePipeline(bool allow_stale_map)
+{
+    if (this->pipeline)
+    {
+        this->pipeline->allow_stale_map = allow_stale_map;
+        return;
+    }
+
+    pipeline_t * pipeline = new pipeline_t;
+
+    pipeline->allow_stale_map = allow_stale_map;
+    pipeline->pending = false;
+    pipeline->done = false;
+    pipeline->map = this->map;
+    pipeline->snapshot = NULL;
+    pipeline->catch_up = false;
+    memset(&pipeline->stats, 0, sizeof(slam_stats_t));
+    pipeline->scan = this->scan_create(3);
+
+    pthread_mutex_init(&pipeline->mutex, NULL);
+    pthread_cond_init(&pipeline->cond, NULL);
+
+    if (pthread_create(&pipeline->thread, NULL, pipeline_run, pipeline))
+    {
+        fprintf(stderr, "Unable to start map pipeline thread; integrating scans synchronously\n");
+
+        pthread_cond_destroy(&pipeline->cond);
+        pthread_mutex_destroy(&pipeline->mutex);
+        delete pipeline->scan;
+        delete pipeline;
+        return;
+    }
+
+    this->pipeline = pipeline;
+}
+
 void CoreSLAM::getmap(unsigned char * mapbytes)
 {
+    this->waitForMap();
+
     this->map->get((char *)mapbytes);
 }
 
+void CoreSLAM::integrateScan(Position & position)
+{
+    pipeline_t * pipeline = this->pipeline;
+
+    if (!pipeline)
+    {
+        STATS_TIMER(start);
+
+        this->map->update(*this->scan_for_mapbuild, position, this->map_quality, this->hole_width_mm);
+
+        STATS_ELAPSED(this->stats, map_update_nsec, start);
+        return;
+    }
+
+    // Only one integration can be in flight
+    this->waitForMap();
+
+    // The next search reads the snapshot, as of the integration just finished, while the thread integrates
+    // into the other map
+    if (pipeline->allow_stale_map)
+    {
+        if (!pipeline->snapshot)
+        {
+            map_t * map = pipeline->map->map;
+
+            pipeline->snapshot = new Map(map->size_pixels, map->size_meters);
+
+            memcpy(pipeline->snapshot->map->pixels, map->pixels, map->size_pixels * map->size_pixels * sizeof(pixel_t));
+        }
+        else
+        {
+            Map * map = pipeline->snapshot;
+            pipeline->snapshot = pipeline->map;
+            pipeline->map = map;
+            this->map = map;
+
+            pipeline->catch_up = true;
+            pipeline->catch_up_from = pipeline->snapshot->map;
+            pipeline->catch_up_to = pipeline->map->map;
+            memcpy(pipeline->catch_up_box, pipeline->box, sizeof(pipeline->box));
+        }
+
+        pipeline_box(pipeline->map->map, this->scan_for_mapbuild->scan, position, this->hole_width_mm, pipeline->box);
+    }
+
+    // The snapshot would miss the integrations made meanwhile, so a later allow_stale_map takes a new one
+    else if (pipeline->snapshot)
+    {
+        delete pipeline->snapshot;
+        pipeline->snapshot = NULL;
+        pipeline->catch_up = false;
+    }
+
+#ifdef BREEZYSLAM_STATS
+    // The thread is idle now, so its counters can be taken
+    this->stats->pixels_written += pipeline->stats.pixels_written;
+    this->stats->map_update_nsec += pipeline->stats.map_update_nsec;
+    memset(&pipeline->stats, 0, sizeof(slam_stats_t));
+#endif
+
+    pthread_mutex_lock(&pipeline->mutex);
+
+    // Hand this scan to the thread, and take back the one it has finished with
+    Scan * scan = pipeline->scan;
+    pipeline->scan = this->scan_for_mapbuild;
+    this->scan_for_mapbuild = scan;
+
+    pipeline->position = position;
+    pipeline->map_quality = this->map_quality;
+    pipeline->hole_width_mm = this->hole_width_mm;
+    pipeline->pending = true;
+
+    pthread_cond_broadcast(&pipeline->cond);
+    pthread_mutex_unlock(&pipeline->mutex);
+}
+
+SLAMStats CoreSLAM::getStats(void)
+{
+    SLAMStats stats;
+
+    stats.candidates_evaluated = this->stats->candidates_evaluated;
+    stats.accepted_moves = this->stats->accepted_moves;
+    stats.sigma_halvings = this->stats->sigma_halvings;
+    stats.points_scored = this->stats->points_scored;
+    stats.points_out_of_map = this->stats->points_out_of_map;
+    stats.pixels_written = this->stats->pixels_written;
+    stats.scan_update_nsec = this->stats->scan_update_nsec;
+    stats.search_nsec = this->stats->search_nsec;
+    stats.map_update_nsec = this->stats->map_update_nsec;
+
+    return stats;
+}
+
+void CoreSLAM::beginSearch(void)
+{
+    pipeline_t * pipeline = this->pipeline;
+
+    if (pipeline && pipeline->allow_stale_map && pipeline->snapshot)
+    {
+        this->map = pipeline->snapshot;
+    }
+    else
+    {
+        this->waitForMap();
+    }
+}
+
+void CoreSLAM::endSearch(void)
+{
+    if (this->pipeline)
+    {
+        this->map = this->pipeline->map;
+    }
+}
+
+void CoreSLAM::waitForMap(void)
+{
+    pipeline_t * pipeline = this->pipeline;
+
+    if (pipeline)
+    {
+        pthread_mutex_lock(&pipeline->mutex);
+
+        while (pipeline->pending)
+        {
+            pthread_cond_wait(&pipeline->cond, &pipeline->mutex);
+        }
+
+        pthread_mutex_unlock(&pipeline->mutex);
+    }
+}
+
 Scan * CoreSLAM::scan_create(int span)
 {
     return new Scan(this->laser, span);
@@ -147,11 +552,19 @@ void SinglePositionSLAM::updateMapAndPointcloud(Velocities & velocities)
     start_pos.x_mm += this->laser->offset_mm * this->costheta();
     start_pos.y_mm += this->laser->offset_mm * this->sintheta();
     
-    // Get new position from implementing class
+    // Get new position from implementing class, once the map it searches is ready
+    this->beginSearch();
+
+    STATS_TIMER(start);
+
     Position new_position = this->getNewPosition(start_pos);
+
+    STATS_ELAPSED(this->stats, search_nsec, start);
+
+    this->endSearch();
          
     // Update the map with this new position
-    this->map->update(*this->scan_for_mapbuild, new_position, this->map_quality, this->hole_width_mm);
+    this->integrateScan(new_position);
    
     // Update the current position with this new position, adjusted by laser offset
     this->position = Position(new_position);
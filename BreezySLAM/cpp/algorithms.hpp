@@ -29,6 +29,45 @@ class Position;
 class Map;
 class Scan;
 class Laser;
+struct pipeline_t;
+struct scan_queue_t;
+struct scan_queue_info_t;
+struct slam_stats_t;
+
+/**
+* Counters and per-stage timings for the most recent update.  These are collected only when
+* the library is built with BREEZYSLAM_STATS defined (make STATS_FLAGS=-DBREEZYSLAM_STATS);
+* otherwise the instrumentation compiles out and every field stays zero.
+*/
+struct SLAMStats
+{
+    /** Poses scored by the position search */
+    unsigned long long candidates_evaluated;
+
+    /** Candidate poses that improved on the best so far */
+    unsigned long long accepted_moves;
+
+    /** Times the search halved its standard deviations */
+    unsigned long long sigma_halvings;
+
+    /** Obstacle points scored against the map, over all candidates */
+    unsigned long long points_scored;
+
+    /** Obstacle points that fell outside the map, over all candidates */
+    unsigned long long points_out_of_map;
+
+    /** Map pixels written when integrating the scan */
+    unsigned long long pixels_written;
+
+    /** Time spent converting the Lidar scan into scan points */
+    unsigned long long scan_update_nsec;
+
+    /** Time spent searching for the new position */
+    unsigned long long search_nsec;
+
+    /** Time spent integrating the scan into the map */
+    unsigned long long map_update_nsec;
+};
 
 /**
 *    CoreSLAM is an abstract class that uses the classes Position, Map, Scan, and Laser
@@ -54,6 +93,8 @@ class Laser;
 */
 class CoreSLAM 
 {
+    friend class MapExport;
+
 
 public:
     
@@ -90,6 +131,62 @@ public:
     * attribute of the Laser object passed to the CoreSlam constructor
     */
     void update(int * scan_mm);
+
+    /**
+    * Updates the scan and odometry from Lidar samples at arbitrary angles, such as those of
+    * a spinning Lidar as they arrive, instead of <tt>scan_size</tt> evenly spaced rays; each
+    * sample keeps its own angle rather than being binned into a ray.  Samples outside the 
+    * Laser's detection angle and margin are ignored.  Otherwise as update(int *, Velocities &).
+    * @param angles_degrees angle of each sample in degrees, counterclockwise from straight ahead
+    * (any multiple of 360 from that), in any order
+    * @param scan_mm distance of each sample in millimeters, 0 for no detection
+    * @param npoints number of samples
+    * @param velocities velocities for odometry
+    */
+    void update(const double * angles_degrees, const int * scan_mm, int npoints, Velocities & velocities);
+
+    /**
+    * As update(const double *, const int *, int, Velocities &), with zero velocities (no odometry).
+    * @param angles_degrees angle of each sample in degrees, counterclockwise from straight ahead
+    * @param scan_mm distance of each sample in millimeters, 0 for no detection
+    * @param npoints number of samples
+    */
+    void update(const double * angles_degrees, const int * scan_mm, int npoints);
+
+    /**
+    * Takes the oldest unread scan from a scan queue, such as the one filled by a Lidar
+    * driver's reader thread, and updates with it as update(int *, Velocities &) does.
+    * Scans shorter than the Laser's <tt>scan_size</tt> are padded with zeros (no detection).
+    * @param queue the scan queue
+    * @param velocities velocities for odometry
+    * @param info if not NULL, receives the scan's sequence number and timestamp, and the 
+    * number of scans skipped since the previous one
+    * @return true if a scan was taken, false if the queue had no unread scan
+    */
+    bool update(struct scan_queue_t * queue, Velocities & velocities, struct scan_queue_info_t * info = NULL);
+
+    /**
+    * Runs map integration on a background thread, so that update() returns as soon as
+    * the new position has been found, while the scan is still being added to the map.
+    * The next position search waits for that integration to finish, unless
+    * allow_stale_map is set.  getmap() always waits.
+    * @param allow_stale_map if true, position search does not wait, but searches the map
+    * as it was before the previous scan was integrated: one scan stale.  This keeps a second
+    * map, which catches up by copying only the pixels near the previous scan
+    */
+    void enablePipeline(bool allow_stale_map = false);
+
+    /**
+    * Deallocates this CoreSLAM object, after any map integration in progress.
+    */
+    virtual ~CoreSLAM(void);
+
+    /**
+    * Returns counters and timings for the most recent update; see SLAMStats.  In pipeline
+    * mode, the map counters and timing of a background integration are reported with the
+    * update that follows it.
+    */
+    SLAMStats getStats(void);
     
     /**
     * The quality of the map (0 through 255); default = 50
@@ -113,11 +210,6 @@ protected:
     */
     CoreSLAM(Laser & laser, int map_size_pixels, double map_size_meters);
 
-    /**
-    * Deallocates this CoreSLAM object.
-    */
-    ~CoreSLAM(void);
-
      /**
      * A pointer to the current map
      */
@@ -149,7 +241,39 @@ protected:
     */
     virtual void updateMapAndPointcloud(Velocities & velocities) = 0;
 
+    /**
+    * Adds scan_for_mapbuild to the map at the specified position; in pipeline mode this
+    * hands the scan to the background thread and returns immediately.
+    * @param position the position of the laser
+    */
+    void integrateScan(Position & position);
+
+    /**
+    * Readies map for a position search: waits for a pending map integration, or if a
+    * stale map is allowed, points map at the copy taken for the search.  Call
+    * endSearch() when done.
+    */
+    void beginSearch(void);
+
+    /**
+    * Points map back at the map being integrated into, after beginSearch().
+    */
+    void endSearch(void);
+
+    /**
+    * Counters for the current update; filled only when built with BREEZYSLAM_STATS
+    */
+    struct slam_stats_t * stats;
+
 private:
+
+    struct pipeline_t * pipeline;
+
+    vector<int> queue_scan;
+
+    void waitForMap(void);
+
+    void updateVelocitiesAndPointcloud(Velocities & velocities);
             
     Scan * scan_create(int span);
     
@@ -0,0 +1,788 @@
+/**
+*
+* coreslam.hpp - header-only templated version of the CoreSLAM map kernels
+*
+* The C core in coreslam.h fixes the map pixel type to unsigned short and the
+* map size to a runtime value.  This header provides the same map_update,
+* distance_scan_to_map, and rmhc_position_search kernels as templates on
+*
+*   - the pixel type (unsigned short, unsigned char, or float evidence), and
+*   - the map size policy (runtime, compile-time, or compile-time power of two),
+*
+* so that the compiler can specialize the pixel arithmetic and fold the map
+* size into the indexing and bounds checks.  The C ABI is the instantiation
+* map<unsigned short, dynamic_size> (classic_map), whose kernels are the C
+* kernels themselves, run on its pixels, so there is one implementation of the
+* original map; examples/kernelcheck checks the other instantiations against
+* it.  A map whose size is fixed by its policy takes no size argument, so a
+* mismatch cannot compile.
+*
+* Copyright (C) 2014 Simon D. Levy
+
+* This code is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as
+* published by the Free Software Foundation, either version 3 of the
+* License, or (at your option) any later version.
+*
+* This code is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COREBREEZYSLAM_HPP
+#define COREBREEZYSLAM_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "coreslam.h"
+#include "random.h"
+
+extern "C"
+{
+#include "coreslam_internals.h"
+}
+
+namespace coreslam
+{
+
+/* Pixel policies ----------------------------------------------------------- */
+
+/*
+ * A pixel policy describes how laser-ray evidence is integrated into a pixel,
+ * how a pixel contributes to the scan-to-map distance (lower is more likely
+ * an obstacle), and how it converts to and from the 8-bit external format.
+ * Ray profiles are always computed in the 16-bit domain [OBSTACLE, NO_OBSTACLE]
+ * of the scan_t::value constants in coreslam_internals.h.
+ */
+template <typename P>
+struct pixel_traits;
+
+/* 16-bit pixels: the original CoreSLAM map */
+template <>
+struct pixel_traits<unsigned short>
+{
+    typedef int64_t sum_type;
+
+    static unsigned short initial(void)
+    {
+        return (OBSTACLE + NO_OBSTACLE) / 2;
+    }
+
+    static void integrate(unsigned short & pixel, int profile, int alpha)
+    {
+        pixel = ((256 - alpha) * pixel + alpha * profile) >> 8;
+    }
+
+    static int score(unsigned short pixel)
+    {
+        return pixel;
+    }
+
+    static unsigned char to_byte(unsigned short pixel)
+    {
+        return pixel >> 8;
+    }
+
+    static unsigned short from_byte(unsigned char byte)
+    {
+        return byte << 8;
+    }
+};
+
+/* 8-bit pixels: half the memory of the original map, coarser integration */
+template <>
+struct pixel_traits<unsigned char>
+{
+    typedef int64_t sum_type;
+
+    static unsigned char initial(void)
+    {
+        return ((OBSTACLE + NO_OBSTACLE) / 2) >> 8;
+    }
+
+    static void integrate(unsigned char & pixel, int profile, int alpha)
+    {
+        /* round to nearest so repeated integration can reach both extremes */
+        pixel = ((256 - alpha) * pixel + alpha * (profile >> 8) + 128) >> 8;
+    }
+
+    static int score(unsigned char pixel)
+    {
+        return pixel;
+    }
+
+    static unsigned char to_byte(unsigned char pixel)
+    {
+        return pixel;
+    }
+
+    static unsigned char from_byte(unsigned char byte)
+    {
+        return byte;
+    }
+};
+
+/* Floating-point pixels holding the evidence that a cell is free, averaged as the C core averages
+   its profiles: each observation moves a pixel alpha / 256 of the way towards it, so that pixels stay
+   within [-clamp, +clamp] and the search keeps a gradient to follow where a hard limit would flatten it */
+template <>
+struct pixel_traits<float>
+{
+    typedef double sum_type;
+
+    /* magnitude of the evidence of one observation, and so of any pixel */
+    static float clamp(void)   { return 8.0f; }
+
+    static float initial(void)
+    {
+        return 0;
+    }
+
+    static void integrate(float & pixel, int profile, int alpha)
+    {
+        /* map profile [0, NO_OBSTACLE] to evidence [-1, +1] */
+        float evidence = (float)(2 * profile - NO_OBSTACLE) / NO_OBSTACLE;
+
+        pixel += alpha * (evidence * clamp() - pixel) / 256;
+    }
+
+    static float score(float pixel)
+    {
+        return pixel;
+    }
+
+    static unsigned char to_byte(float pixel)
+    {
+        return (unsigned char)((pixel + clamp()) * (255 / (2 * clamp())) + 0.5f);
+    }
+
+    static float from_byte(unsigned char byte)
+    {
+        return byte * (2 * clamp() / 255) - clamp();
+    }
+};
+
+/* Size policies ------------------------------------------------------------ */
+
+/* Map size known only at runtime, as in the C core */
+class dynamic_size
+{
+public:
+
+    static const bool is_fixed = false;
+
+    explicit dynamic_size(int size_pixels) : size_pixels(size_pixels) { }
+
+    int size(void) const
+    {
+        return this->size_pixels;
+    }
+
+    int index(int x, int y) const
+    {
+        return y * this->size_pixels + x;
+    }
+
+    bool contains(int x, int y) const
+    {
+        return x >= 0 && x < this->size_pixels && y >= 0 && y < this->size_pixels;
+    }
+
+private:
+
+    int size_pixels;
+};
+
+/* Map size fixed at compile time, so the row stride is a constant */
+template <int SIZE_PIXELS>
+class fixed_size
+{
+    static_assert(SIZE_PIXELS > 0 && SIZE_PIXELS <= 46340, "fixed_size: map pixels must fit an int");
+
+public:
+
+    static const bool is_fixed = true;
+
+    static int size(void)
+    {
+        return SIZE_PIXELS;
+    }
+
+    static int index(int x, int y)
+    {
+        return y * SIZE_PIXELS + x;
+    }
+
+    static bool contains(int x, int y)
+    {
+        return (unsigned)x < (unsigned)SIZE_PIXELS && (unsigned)y < (unsigned)SIZE_PIXELS;
+    }
+};
+
+/* Power-of-two map size: indexing by shift, bounds check by a single mask */
+template <int LOG2_SIZE_PIXELS>
+class pow2_size
+{
+    static_assert(LOG2_SIZE_PIXELS >= 0 && LOG2_SIZE_PIXELS <= 15, "pow2_size: map pixels must fit an int");
+
+public:
+
+    static const bool is_fixed = true;
+
+    static int size(void)
+    {
+        return 1 << LOG2_SIZE_PIXELS;
+    }
+
+    static int index(int x, int y)
+    {
+        return (y << LOG2_SIZE_PIXELS) | x;
+    }
+
+    static bool contains(int x, int y)
+    {
+        return !((unsigned)(x | y) >> LOG2_SIZE_PIXELS);
+    }
+};
+
+/* Map ---------------------------------------------------------------------- */
+
+template <typename P, class S = dynamic_size>
+class map
+{
+public:
+
+    typedef P pixel_type;
+    typedef pixel_traits<P> traits;
+
+    /* A map of a runtime size */
+    map(int size_pixels, double size_meters) : size(size_pixels)
+    {
+        static_assert(!S::is_fixed, "map: a fixed-size map takes only its size in meters");
+
+        this->init_pixels(size_meters);
+    }
+
+    /* A map of the size fixed by its size policy */
+    explicit map(double size_meters)
+    {
+        static_assert(S::is_fixed, "map: a runtime-size map needs its size in pixels");
+
+        this->init_pixels(size_meters);
+    }
+
+    /* Wraps the pixels of a C map_t without copying; the C map keeps ownership */
+    explicit map(map_t & cmap) : size(cmap.size_pixels)
+    {
+        static_assert(!S::is_fixed, "map: only a runtime-size map can wrap a C map_t");
+
+        this->pixels = cmap.pixels;
+        this->owns_pixels = false;
+        this->init_scale(cmap.size_meters);
+    }
+
+    ~map(void)
+    {
+        if (this->owns_pixels)
+        {
+            free(this->pixels);
+        }
+    }
+
+    int size_pixels(void) const
+    {
+        return this->size.size();
+    }
+
+    void get(unsigned char * bytes) const
+    {
+        int npix = this->size.size() * this->size.size();
+
+        for (int k=0; k<npix; ++k)
+        {
+            bytes[k] = traits::to_byte(this->pixels[k]);
+        }
+    }
+
+    void set(const unsigned char * bytes)
+    {
+        int npix = this->size.size() * this->size.size();
+
+        for (int k=0; k<npix; ++k)
+        {
+            this->pixels[k] = traits::from_byte(bytes[k]);
+        }
+    }
+
+    P * pixels;
+    S size;
+    double size_meters;
+    double scale_pixels_per_mm;
+
+private:
+
+    bool owns_pixels;
+
+    void init_pixels(double size_meters)
+    {
+        int npix = this->size.size() * this->size.size();
+
+        this->pixels = (P *)malloc(npix * sizeof(P));
+
+        if (!this->pixels)
+        {
+            fprintf(stderr, "Unable to allocate %lu bytes\n", (unsigned long)(npix * sizeof(P)));
+            exit(1);
+        }
+
+        for (int k=0; k<npix; ++k)
+        {
+            this->pixels[k] = traits::initial();
+        }
+
+        this->owns_pixels = true;
+        this->init_scale(size_meters);
+    }
+
+    void init_scale(double size_meters)
+    {
+        this->size_meters = size_meters;
+
+        /* precompute scale for efficiency */
+        this->scale_pixels_per_mm = this->size.size() / (size_meters * 1000);
+    }
+
+    /* not copyable: owns its pixels */
+    map(const map &);
+    map & operator=(const map &);
+};
+
+/* Kernels ------------------------------------------------------------------ */
+
+namespace detail
+{
+    static inline int roundup(double x)
+    {
+        return (int)floor(x + 0.5);
+    }
+
+    static inline void swap(int & a, int & b)
+    {
+        int tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    static inline bool clip(int & xyc, int & yxc, int xy, int yx, int map_size)
+    {
+        if (xyc < 0)
+        {
+            if (xyc == xy)
+            {
+                return true;
+            }
+            yxc += (yxc - yx) * (- xyc) / (xyc - xy);
+            xyc = 0;
+        }
+
+        if (xyc >= map_size)
+        {
+            if (xyc == xy)
+            {
+                return true;
+            }
+            yxc += (yxc - yx) * (map_size - 1 - xyc) / (xyc - xy);
+            xyc = map_size - 1;
+        }
+
+        return false;
+    }
+
+} // detail
+
+template <typename P, class S>
+void
+map_laser_ray(
+    map<P, S> & m,
+    int x1,
+    int y1,
+    int x2,
+    int y2,
+    int xp,
+    int yp,
+    int value,
+    int alpha)
+{
+    typedef pixel_traits<P> traits;
+
+    const int map_size = m.size.size();
+
+    if (!m.size.contains(x1, y1))
+    {
+        return;
+    }
+
+    int x2c = x2;
+    int y2c = y2;
+
+    if (detail::clip(x2c, y2c, x1, y1, map_size) || detail::clip(y2c, x2c, y1, x1, map_size))
+    {
+        return;
+    }
+
+    int dx = abs(x2 - x1);
+    int dy = abs(y2 - y1);
+    int dxc = abs(x2c - x1);
+    int dyc = abs(y2c - y1);
+    int incptrx = (x2 > x1) ? 1 : -1;
+    int incptry = (y2 > y1) ? map_size : -map_size;
+    int sincv = (value > NO_OBSTACLE) ? 1 : -1;
+
+    int derrorv = 0;
+
+    if (dx > dy)
+    {
+        derrorv = abs(xp - x2);
+    }
+    else
+    {
+        detail::swap(dx, dy);
+        detail::swap(dxc, dyc);
+        detail::swap(incptrx, incptry);
+        derrorv = abs(yp - y2);
+    }
+
+    if (!derrorv)
+    {
+        fprintf(stderr, "map_update: No error gradient: try increasing hole width\n");
+        exit(1);
+    }
+
+    int error = 2 * dyc - dxc;
+    int horiz = 2 * dyc;
+    int diago = 2 * (dyc - dxc);
+    int errorv = derrorv / 2;
+
+    int incv = (value - NO_OBSTACLE) / derrorv;
+
+    int incerrorv = value - NO_OBSTACLE - derrorv * incv;
+
+    P * ptr = m.pixels + m.size.index(x1, y1);
+    int pixval = NO_OBSTACLE;
+
+    for (int x = 0; x <= dxc; x++, ptr += incptrx)
+    {
+        if (x > dx - 2 * derrorv)
+        {
+            if (x <= dx - derrorv)
+            {
+                pixval += incv;
+                errorv += incerrorv;
+                if (errorv > derrorv)
+                {
+                    pixval += sincv;
+                    errorv -= derrorv;
+                }
+            }
+            else
+            {
+                pixval -= incv;
+                errorv -= incerrorv;
+                if (errorv < 0)
+                {
+                    pixval -= sincv;
+                    errorv += derrorv;
+                }
+            }
+        }
+
+        /* Integration into the map */
+        traits::integrate(*ptr, pixval, alpha);
+
+        if (error > 0)
+        {
+            ptr += incptry;
+            error += diago;
+        }
+        else
+        {
+            error += horiz;
+        }
+    }
+
+    SLAM_STATS_ADD(pixels_written, dxc + 1);
+}
+
+template <typename P, class S>
+void
+map_update(
+    map<P, S> & m,
+    const scan_t & scan,
+    position_t position,
+    int map_quality,
+    double hole_width_mm)
+{
+    double position_theta_radians = radians(position.theta_degrees);
+    double costheta = cos(position_theta_radians);
+    double sintheta = sin(position_theta_radians);
+
+    int x1 = detail::roundup(position.x_mm * m.scale_pixels_per_mm);
+    int y1 = detail::roundup(position.y_mm * m.scale_pixels_per_mm);
+
+    for (int i = 0; i != scan.npoints; i++)
+    {
+        double x2p = costheta * scan.x_mm[i] - sintheta * scan.y_mm[i];
+        double y2p = sintheta * scan.x_mm[i] + costheta * scan.y_mm[i];
+
+        int xp = detail::roundup((position.x_mm + x2p) * m.scale_pixels_per_mm);
+        int yp = detail::roundup((position.y_mm + y2p) * m.scale_pixels_per_mm);
+
+        double dist = sqrt(x2p * x2p + y2p * y2p);
+        double add = hole_width_mm / 2 / dist;
+
+        x2p *= m.scale_pixels_per_mm * (1 + add);
+        y2p *= m.scale_pixels_per_mm * (1 + add);
+
+        int x2 = detail::roundup(position.x_mm * m.scale_pixels_per_mm + x2p);
+        int y2 = detail::roundup(position.y_mm * m.scale_pixels_per_mm + y2p);
+
+        int value = OBSTACLE;
+        int q = map_quality;
+
+        if (scan.value[i] == NO_OBSTACLE)
+        {
+            q = map_quality / 4;
+            value = NO_OBSTACLE;
+        }
+
+        map_laser_ray(m, x1, y1, x2, y2, xp, yp, value, q);
+    }
+}
+
+/*
+ * Computes the distance between a scan and a map at a hypothetical position.
+ * Returns false for infinity (no scan point fell inside the map); otherwise
+ * sets distance to the mean pixel score scaled by 1024, as in the C core.
+ */
+template <typename P, class S>
+bool
+distance_scan_to_map(
+    const map<P, S> & m,
+    const scan_t & scan,
+    position_t position,
+    typename pixel_traits<P>::sum_type & distance)
+{
+    typedef pixel_traits<P> traits;
+
+    /* Pre-compute sine and cosine of angle for rotation */
+    double position_theta_radians = radians(position.theta_degrees);
+    double costheta = cos(position_theta_radians) * m.scale_pixels_per_mm;
+    double sintheta = sin(position_theta_radians) * m.scale_pixels_per_mm;
+
+    /* Pre-compute pixel offset for translation */
+    double pos_x_pix = position.x_mm * m.scale_pixels_per_mm;
+    double pos_y_pix = position.y_mm * m.scale_pixels_per_mm;
+
+    typename traits::sum_type sum = 0; /* sum of map values at those points */
+    int npoints = 0;                   /* number of points where scan matches map */
+
+    for (int i=0; i<scan.npoints; i++)
+    {
+        /* Consider only scan points representing obstacles */
+        if (scan.value[i] == OBSTACLE)
+        {
+            /* Translate and rotate scan point to robot position */
+            int x = (int)floor(pos_x_pix + costheta * scan.x_mm[i] - sintheta * scan.y_mm[i] + 0.5);
+            int y = (int)floor(pos_y_pix + sintheta * scan.x_mm[i] + costheta * scan.y_mm[i] + 0.5);
+
+            /* Add point if in map bounds */
+            if (m.size.contains(x, y))
+            {
+                sum += traits::score(m.pixels[m.size.index(x, y)]);
+                npoints++;
+            }
+            else
+            {
+                SLAM_STATS_ADD(points_out_of_map, 1);
+            }
+        }
+    }
+
+    SLAM_STATS_ADD(points_scored, npoints);
+
+    if (!npoints)
+    {
+        return false;
+    }
+
+    distance = sum * 1024 / npoints;
+
+    return true;
+}
+
+/* The distance_scan_to_map() template as a function object, for rmhc_position_search() */
+template <typename P, class S>
+struct scan_distance
+{
+    bool operator()(
+        const map<P, S> & m,
+        const scan_t & scan,
+        position_t position,
+        typename pixel_traits<P>::sum_type & distance) const
+    {
+        return distance_scan_to_map(m, scan, position, distance);
+    }
+};
+
+/*
+ * Random-Mutation Hill-Climbing search, as in the C core.  Candidates are scored
+ * by distance, a function object called as distance_scan_to_map() is.
+ */
+template <typename P, class S, class D = scan_distance<P, S> >
+position_t
+rmhc_position_search(
+    position_t start_pos,
+    const map<P, S> & m,
+    const scan_t & scan,
+    double sigma_xy_mm,
+    double sigma_theta_degrees,
+    int max_search_iter,
+    void * randomizer,
+    D distance = D())
+{
+    typedef typename pixel_traits<P>::sum_type sum_type;
+
+    position_t currentpos = start_pos;
+    position_t bestpos = start_pos;
+    position_t lastbestpos = start_pos;
+
+    /* an infinite starting distance is never improved upon, as in the C core */
+    sum_type current_distance = 0;
+    bool start_is_finite = distance(m, scan, currentpos, current_distance);
+
+    SLAM_STATS_ADD(candidates_evaluated, 1);
+
+    sum_type lowest_distance = current_distance;
+    sum_type last_lowest_distance = current_distance;
+
+    int counter = 0;
+
+    while (counter < max_search_iter)
+    {
+        currentpos = lastbestpos;
+
+        currentpos.x_mm = random_normal(randomizer, currentpos.x_mm, sigma_xy_mm);
+        currentpos.y_mm = random_normal(randomizer, currentpos.y_mm, sigma_xy_mm);
+        currentpos.theta_degrees = random_normal(randomizer, currentpos.theta_degrees, sigma_theta_degrees);
+
+        bool is_finite = distance(m, scan, currentpos, current_distance);
+
+        SLAM_STATS_ADD(candidates_evaluated, 1);
+
+        if (start_is_finite && is_finite && current_distance < lowest_distance)
+        {
+            lowest_distance = current_distance;
+            bestpos = currentpos;
+            SLAM_STATS_ADD(accepted_moves, 1);
+        }
+        else
+        {
+            counter++;
+        }
+
+        if (counter > max_search_iter / 3)
+        {
+            if (lowest_distance < last_lowest_distance)
+            {
+                lastbestpos = bestpos;
+                last_lowest_distance = lowest_distance;
+                counter = 0;
+                sigma_xy_mm *= 0.5;
+                sigma_theta_degrees *= 0.5;
+                SLAM_STATS_ADD(sigma_halvings, 1);
+            }
+        }
+    }
+
+    return bestpos;
+}
+
+/* The C ABI ---------------------------------------------------------------- */
+
+/* The instantiation that matches the C ABI in coreslam.h */
+typedef map<unsigned short, dynamic_size> classic_map;
+
+namespace detail
+{
+    /* A C map_t on the pixels of a classic_map, for the C kernels */
+    static inline map_t c_map(const classic_map & m)
+    {
+        map_t cmap;
+
+        cmap.pixels = m.pixels;
+        cmap.size_pixels = m.size_pixels();
+        cmap.size_meters = m.size_meters;
+        cmap.scale_pixels_per_mm = m.scale_pixels_per_mm;
+
+        return cmap;
+    }
+
+} // detail
+
+/* These overloads take the place of the templates for classic_map */
+
+inline void
+map_update(
+    classic_map & m,
+    const scan_t & scan,
+    position_t position,
+    int map_quality,
+    double hole_width_mm)
+{
+    map_t cmap = detail::c_map(m);
+
+    ::map_update(&cmap, (scan_t *)&scan, position, map_quality, hole_width_mm);
+}
+
+inline bool
+distance_scan_to_map(
+    const classic_map & m,
+    const scan_t & scan,
+    position_t position,
+    pixel_traits<unsigned short>::sum_type & distance)
+{
+    map_t cmap = detail::c_map(m);
+
+    int d = ::distance_scan_to_map(&cmap, (scan_t *)&scan, position);
+
+    distance = d;
+
+    return d > -1;
+}
+
+inline position_t
+rmhc_position_search(
+    position_t start_pos,
+    const classic_map & m,
+    const scan_t & scan,
+    double sigma_xy_mm,
+    double sigma_theta_degrees,
+    int max_search_iter,
+    void * randomizer)
+{
+    map_t cmap = detail::c_map(m);
+
+    return ::rmhc_position_search(start_pos, &cmap, (scan_t *)&scan, sigma_xy_mm, sigma_theta_degrees,
+                                  max_search_iter, randomizer);
+}
+
+} // coreslam
+
+#endif // COREBREEZYSLAM_HPP
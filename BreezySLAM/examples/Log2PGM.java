@@ -55,6 +55,7 @@ public class Log2PGM
     private static int    MAP_SIZE_PIXELS = 800;
     private static double MAP_SIZE_METERS = 32;
     private static int    SCAN_SIZE       = 682;
+    private static int    BATCH_SIZE      = 32;     // scans per call to updateMany()
 
     private SinglePositionSLAM slam;
 
@@ -218,32 +219,44 @@ public class Log2PGM
 
         Vector<double []> trajectory = new Vector<double []>();
 
-        for (int scanno=0; scanno<nscans; ++scanno)
+        for (int scanno=0; scanno<nscans; scanno+=BATCH_SIZE)
         {
-            int [] scan = scans.elementAt(scanno);
+            int nbatch = Math.min(BATCH_SIZE, nscans-scanno);
 
-            // Update with/out odometry
-            if (this.use_odometry)
+            // Pack the batch's scans one after another
+            int [] batch = new int [nbatch*SCAN_SIZE];
+            for (int k=0; k<nbatch; ++k)
             {
-                long [] odometry = odometries.elementAt(scanno);
-                Velocities velocities = this.robot.computeVelocities(odometry[0], odometry[1], odometry[2]);
-                slam.update(scan, velocities);            
+                System.arraycopy(scans.elementAt(scanno+k), 0, batch, k*SCAN_SIZE, SCAN_SIZE);
             }
-            else
+
+            // Update with/out odometry
+            double [] velocities = null;
+            if (this.use_odometry)
             {
-                slam.update(scan);  
+                velocities = new double [3*nbatch];
+                for (int k=0; k<nbatch; ++k)
+                {
+                    long [] odometry = odometries.elementAt(scanno+k);
+                    Velocities v = this.robot.computeVelocities(odometry[0], odometry[1], odometry[2]);
+                    velocities[3*k]   = v.getDxyMm();
+                    velocities[3*k+1] = v.getDthetaDegrees();
+                    velocities[3*k+2] = v.getDtSeconds();
+                }
             }
 
-            Position position = slam.getpos();
+            double [] positions = slam.updateMany(batch, velocities);
 
             // Add new coordinates to trajectory
-            double [] v = new double[2];
-            v[0] = position.x_mm;
-            v[1] = position.y_mm;
-            trajectory.add(v);     
-
+            for (int k=0; k<nbatch; ++k)
+            {
+                double [] v = new double[2];
+                v[0] = positions[3*k];
+                v[1] = positions[3*k+1];
+                trajectory.add(v);     
+            }
  
-            progbar.updateAmount(scanno);
+            progbar.updateAmount(scanno+nbatch-1);
             System.out.printf("\r%s", progbar.str());
         } 
 
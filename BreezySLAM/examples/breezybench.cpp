@@ -0,0 +1,382 @@
+/*
+breezybench.cpp : BreezySLAM replay benchmark.  Replays a logfile in the Paris
+Mines Tech format (e.g. exp1.dat, exp2.dat, or a .scanlog made from one by
+log2scanlog) through RMHC_SLAM or Deterministic_SLAM, times each stage of
+every update with a monotonic clock, and reports latency percentiles and
+throughput as JSON on standard output.
+
+The stages are:
+
+  scan_update  converting the Lidar scan into scan points
+  search       searching for the new position
+  map_update   integrating the scan into the map (in pipeline mode, the time
+               update() spends waiting for and handing off the integration)
+  getmap       copying the map out of the SLAM object
+
+Search and map counters (see SLAMStats) are summed over all updates; they are
+zero unless libbreezyslam was built with STATS_FLAGS=-DBREEZYSLAM_STATS.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Same map as log2pgm
+static const int MAP_SIZE_PIXELS        = 800;
+static const double MAP_SIZE_METERS     =  32;
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "Position.hpp"
+#include "Laser.hpp"
+#include "WheeledRobot.hpp"
+#include "Velocities.hpp"
+#include "algorithms.hpp"
+
+#include "mines.hpp"
+
+// Helpers ---------------------------------------------------------------------
+
+static double now_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void sleep_until_usec(double usec)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(usec / 1e6);
+    ts.tv_nsec = (long)((usec - ts.tv_sec * 1e6) * 1e3);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// Latency samples for one stage ------------------------------------------------
+
+class Stage
+{
+public:
+
+    Stage(const char * name)
+    {
+        this->name = name;
+    }
+
+    void add(double usec)
+    {
+        this->samples.push_back(usec);
+    }
+
+    void report(FILE * out, bool last)
+    {
+        vector<double> sorted = this->samples;
+        sort(sorted.begin(), sorted.end());
+
+        int n = sorted.size();
+        double sum = 0;
+        for (int k=0; k<n; ++k)
+        {
+            sum += sorted[k];
+        }
+
+        fprintf(out, "    \"%s\": {\"count\": %d, \"mean_usec\": %.1f, \"p50_usec\": %.1f, "
+                     "\"p99_usec\": %.1f, \"max_usec\": %.1f}%s\n",
+                this->name, n,
+                n ? sum / n : 0,
+                percentile(sorted, 0.50),
+                percentile(sorted, 0.99),
+                n ? sorted[n-1] : 0,
+                last ? "" : ",");
+    }
+
+private:
+
+    const char * name;
+    vector<double> samples;
+
+    // Nearest-rank percentile of sorted samples
+    static double percentile(vector<double> & sorted, double p)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+
+        int rank = (int)ceil(p * sorted.size());
+
+        return sorted[rank > 0 ? rank-1 : 0];
+    }
+};
+
+static Stage scan_update_stage("scan_update");
+static Stage search_stage("search");
+static Stage map_update_stage("map_update");
+static Stage getmap_stage("getmap");
+
+// Search counters summed over all updates; zero unless the library was built with BREEZYSLAM_STATS
+static SLAMStats counters;
+
+// SLAM wrapper that times the stages of each update ----------------------------
+
+template <class SLAM>
+class TimedSLAM : public SLAM
+{
+public:
+
+    template <typename... Args>
+    TimedSLAM(Args... args) : SLAM(args...)
+    {
+        this->search_usec = 0;
+        this->pointcloud_usec = 0;
+    }
+
+    void timedUpdate(int * scan_mm, Velocities & velocities)
+    {
+        double start_usec = now_usec();
+
+        this->update(scan_mm, velocities);
+
+        double total_usec = now_usec() - start_usec;
+
+        scan_update_stage.add(total_usec - this->pointcloud_usec);
+        search_stage.add(this->search_usec);
+        map_update_stage.add(this->pointcloud_usec - this->search_usec);
+
+        SLAMStats stats = this->getStats();
+        counters.candidates_evaluated += stats.candidates_evaluated;
+        counters.accepted_moves += stats.accepted_moves;
+        counters.sigma_halvings += stats.sigma_halvings;
+        counters.points_scored += stats.points_scored;
+        counters.points_out_of_map += stats.points_out_of_map;
+        counters.pixels_written += stats.pixels_written;
+    }
+
+protected:
+
+    void updateMapAndPointcloud(Velocities & velocities)
+    {
+        double start_usec = now_usec();
+
+        SLAM::updateMapAndPointcloud(velocities);
+
+        this->pointcloud_usec = now_usec() - start_usec;
+    }
+
+    Position getNewPosition(Position & start_position)
+    {
+        double start_usec = now_usec();
+
+        Position position = SLAM::getNewPosition(start_position);
+
+        this->search_usec = now_usec() - start_usec;
+
+        return position;
+    }
+
+private:
+
+    double search_usec;
+    double pointcloud_usec;
+};
+
+// Replay loop -----------------------------------------------------------------
+
+struct Options
+{
+    bool use_odometry;
+    int random_seed;
+    bool realtime;
+    bool pipeline;
+    bool stale_map;
+    int getmap_every;
+    int repeat;
+};
+
+template <class SLAM>
+static void replay(SLAM & slam, MinesLog & log, Options & options)
+{
+    Rover robot;
+
+    unsigned char * mapbytes = new unsigned char[MAP_SIZE_PIXELS * MAP_SIZE_PIXELS];
+
+    if (options.pipeline)
+    {
+        slam.enablePipeline(options.stale_map);
+    }
+
+    double start_usec = now_usec();
+
+    for (int scanno=0; scanno<log.size(); ++scanno)
+    {
+        // Wait for the scan's time in the log, relative to the first scan
+        if (options.realtime)
+        {
+            sleep_until_usec(start_usec + (log.odometry(scanno)[0] - log.odometry(0)[0]));
+        }
+
+        Velocities velocities;
+
+        if (options.use_odometry)
+        {
+            velocities = robot.computeVelocities(log.odometry(scanno));
+        }
+
+        slam.timedUpdate(log.scan(scanno), velocities);
+
+        if (options.getmap_every && !((scanno+1) % options.getmap_every))
+        {
+            double getmap_usec = now_usec();
+            slam.getmap(mapbytes);
+            getmap_stage.add(now_usec() - getmap_usec);
+        }
+    }
+
+    delete[] mapbytes;
+}
+
+static void usage(const char * name)
+{
+    fprintf(stderr, "Usage:   %s [options] <logfile>\n", name);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -o, --odometry          use odometry\n");
+    fprintf(stderr, "  -s, --seed SEED         random seed for RMHC_SLAM; 0 for Deterministic_SLAM (default 9999)\n");
+    fprintf(stderr, "  -r, --realtime          pace playback at the log's timestamps\n");
+    fprintf(stderr, "  -p, --pipeline          integrate maps on a background thread\n");
+    fprintf(stderr, "  -a, --allow-stale-map   with -p, search the map without waiting for the last scan\n");
+    fprintf(stderr, "  -g, --getmap-every N    call getmap every N scans; 0 for never (default 1)\n");
+    fprintf(stderr, "  -n, --repeat N          replay the log N times (default 1)\n");
+    fprintf(stderr, "Example: %s -o exp2.scanlog\n", name);
+    exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+    Options options;
+    options.use_odometry = false;
+    options.random_seed = 9999;
+    options.realtime = false;
+    options.pipeline = false;
+    options.stale_map = false;
+    options.getmap_every = 1;
+    options.repeat = 1;
+
+    static struct option long_options[] =
+    {
+        {"odometry",        no_argument,        NULL, 'o'},
+        {"seed",            required_argument,  NULL, 's'},
+        {"realtime",        no_argument,        NULL, 'r'},
+        {"pipeline",        no_argument,        NULL, 'p'},
+        {"allow-stale-map", no_argument,        NULL, 'a'},
+        {"getmap-every",    required_argument,  NULL, 'g'},
+        {"repeat",          required_argument,  NULL, 'n'},
+        {NULL,              0,                  NULL,  0 }
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "os:rpag:n:", long_options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'o':
+            options.use_odometry = true;
+            break;
+        case 's':
+            options.random_seed = atoi(optarg);
+            break;
+        case 'r':
+            options.realtime = true;
+            break;
+        case 'p':
+            options.pipeline = true;
+            break;
+        case 'a':
+            options.stale_map = true;
+            break;
+        case 'g':
+            options.getmap_every = atoi(optarg);
+            break;
+        case 'n':
+            options.repeat = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind != argc-1 || options.repeat < 1)
+    {
+        usage(argv[0]);
+    }
+
+    const char * filename = argv[optind];
+
+    MinesLog log(filename, false);
+
+    MinesURG04LX laser;
+
+    double start_usec = now_usec();
+
+    for (int k=0; k<options.repeat; ++k)
+    {
+        if (options.random_seed)
+        {
+            TimedSLAM<RMHC_SLAM> slam(laser, MAP_SIZE_PIXELS, MAP_SIZE_METERS, (unsigned)options.random_seed);
+            replay(slam, log, options);
+        }
+        else
+        {
+            TimedSLAM<Deterministic_SLAM> slam(laser, MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+            replay(slam, log, options);
+        }
+    }
+
+    double elapsed_sec = (now_usec() - start_usec) / 1e6;
+    int nscans = log.size() * options.repeat;
+
+    printf("{\n");
+    printf("  \"logfile\": \"%s\",\n", filename);
+    printf("  \"scans\": %d,\n", nscans);
+    printf("  \"odometry\": %s,\n", options.use_odometry ? "true" : "false");
+    printf("  \"random_seed\": %d,\n", options.random_seed);
+    printf("  \"realtime\": %s,\n", options.realtime ? "true" : "false");
+    printf("  \"pipeline\": %s,\n", options.pipeline ? "true" : "false");
+    printf("  \"map_size_pixels\": %d,\n", MAP_SIZE_PIXELS);
+    printf("  \"elapsed_sec\": %.3f,\n", elapsed_sec);
+    printf("  \"scans_per_sec\": %.1f,\n", nscans / elapsed_sec);
+    printf("  \"stages\": {\n");
+    scan_update_stage.report(stdout, false);
+    search_stage.report(stdout, false);
+    map_update_stage.report(stdout, false);
+    getmap_stage.report(stdout, true);
+    printf("  },\n");
+    printf("  \"counters\": {\"candidates_evaluated\": %llu, \"accepted_moves\": %llu, "
+           "\"sigma_halvings\": %llu, \"points_scored\": %llu, \"points_out_of_map\": %llu, "
+           "\"pixels_written\": %llu}\n",
+           counters.candidates_evaluated, counters.accepted_moves, counters.sigma_halvings,
+           counters.points_scored, counters.points_out_of_map, counters.pixels_written);
+    printf("}\n");
+
+    return 0;
+}
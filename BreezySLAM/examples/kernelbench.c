@@ -0,0 +1,449 @@
+/*
+kernelbench.c : BreezySLAM kernel microbenchmarks.  Times each CoreSLAM inner
+loop on synthetic maps and scans, so that the distance_scan_to_map() kernels
+(see kernels.h) can be compared with each other and any new kernel can be
+measured against them before it is adopted.
+
+The benchmarks are:
+
+  distance    distance_scan_to_map() for every compiled kernel, on maps of
+              256 to 8192 pixels square and scans of 100 to 10000 obstacles
+  map_update  map_update(), whose time goes to map_laser_ray(), with short
+              rays (0.4 to 1 m) and long rays (a quarter to half the map)
+  scan_update scan_update() on scans of 100 to 10000 points
+  random      random_normal(), as called by the RMHC position search
+
+Poses are either random (near the middle of the map, any heading) or
+adversarial (at a corner of the map, so that most points fall outside it and
+most rays are clipped).  Each case runs for at least the minimum time and
+reports nanoseconds per point and the effective bandwidth, counting the scan
+data read and the map pixels read or written.
+
+Usage: kernelbench [-t MILLISECONDS] [FILTER]
+
+runs only the cases whose benchmark, kernel, or pose name contains FILTER.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "coreslam.h"
+#include "random.h"
+#include "kernels.h"
+
+static const int    MAP_SIZES[]         = {256, 1024, 4096, 8192};
+static const int    OBSTACLE_COUNTS[]   = {100, 1000, 10000};
+static const double MM_PER_PIXEL        = 25;
+static const int    NPOSES              = 64;
+static const int    RAY_COUNT           = 1000;
+static const int    RANDOM_BATCH        = 10000;
+static const int    DEFAULT_MIN_MSEC    = 50;
+
+#define NELEMS(a) (int)(sizeof(a) / sizeof(a[0]))
+
+/* Keeps results live so that the compiler cannot drop the work */
+static volatile long long sink;
+
+static long long min_nsec;
+static const char * filter;
+
+/* Helpers ------------------------------------------------------------------- */
+
+static long long now_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Small deterministic generator for the synthetic data */
+static unsigned int xorshift(unsigned int * state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static double uniform(unsigned int * state, double lo, double hi)
+{
+    return lo + (hi - lo) * (xorshift(state) / 4294967296.);
+}
+
+static int selected(const char * bench, const char * variant, const char * pose)
+{
+    return !filter || strstr(bench, filter) || strstr(variant, filter) || strstr(pose, filter);
+}
+
+static void report(const char * bench, const char * variant, int map_size, int npoints, const char * pose,
+                   long long nsec, double points, double bytes)
+{
+    printf("%-12s %-7s %6d %6d  %-12s %10.2f", bench, variant, map_size, npoints, pose, nsec / points);
+
+    if (bytes > 0)
+    {
+        printf(" %8.2f\n", bytes / nsec);
+    }
+    else
+    {
+        printf(" %8s\n", "-");
+    }
+
+    fflush(stdout);
+}
+
+/* Synthetic data ------------------------------------------------------------ */
+
+static void make_map(map_t * map, int size_pixels, unsigned int seed)
+{
+    map_init(map, size_pixels, size_pixels * MM_PER_PIXEL / 1000);
+
+    int k;
+    for (k=0; k<size_pixels*size_pixels; ++k)
+    {
+        map->pixels[k] = xorshift(&seed) % 65536;
+    }
+}
+
+/* Builds a 360-degree scan of npoints obstacles at distances between lo_mm and hi_mm */
+static void make_scan(scan_t * scan, int npoints, double lo_mm, double hi_mm, unsigned int seed)
+{
+    int * lidar_mm = int_alloc(npoints+1);
+
+    int k;
+    for (k=0; k<=npoints; ++k)
+    {
+        lidar_mm[k] = (int)uniform(&seed, lo_mm, hi_mm);
+    }
+
+    /* scan_update() skips the first ray when the detection margin is zero */
+    scan_init(scan, 1, npoints+1, 10, 360, 0, 0, 0);
+    scan_update(scan, lidar_mm, DEFAULT_HOLE_WIDTH_MM, 0, 0);
+
+    free(lidar_mm);
+}
+
+static void make_poses(position_t * poses, map_t * map, int adversarial, unsigned int seed)
+{
+    double size_mm = map->size_meters * 1000;
+
+    int k;
+    for (k=0; k<NPOSES; ++k)
+    {
+        if (adversarial)
+        {
+            /* Corners of the map, half a pixel in */
+            poses[k].x_mm = (k & 1) ? size_mm - MM_PER_PIXEL/2 : MM_PER_PIXEL/2;
+            poses[k].y_mm = (k & 2) ? size_mm - MM_PER_PIXEL/2 : MM_PER_PIXEL/2;
+        }
+        else
+        {
+            poses[k].x_mm = uniform(&seed, 0.4 * size_mm, 0.6 * size_mm);
+            poses[k].y_mm = uniform(&seed, 0.4 * size_mm, 0.6 * size_mm);
+        }
+
+        poses[k].theta_degrees = uniform(&seed, 0, 360);
+    }
+}
+
+/* Number of pixels on the part of the ray from (x1,y1) to (x2,y2) inside the map */
+static double ray_pixels(double x1, double y1, double x2, double y2, int size)
+{
+    double t0 = 0, t1 = 1;
+    double d[2] = {x2 - x1, y2 - y1};
+    double p[2] = {x1, y1};
+
+    int k;
+    for (k=0; k<2; ++k)
+    {
+        if (d[k] != 0)
+        {
+            double ta = (0 - p[k]) / d[k];
+            double tb = (size - p[k]) / d[k];
+
+            if (ta > tb)
+            {
+                double tmp = ta;
+                ta = tb;
+                tb = tmp;
+            }
+
+            t0 = ta > t0 ? ta : t0;
+            t1 = tb < t1 ? tb : t1;
+        }
+    }
+
+    return t1 > t0 ? (t1 - t0) * fmax(fabs(d[0]), fabs(d[1])) + 1 : 0;
+}
+
+/* Benchmarks ---------------------------------------------------------------- */
+
+static void bench_distance(map_t * map, int nobstacles, int adversarial)
+{
+    const char * pose_name = adversarial ? "adversarial" : "random";
+
+    scan_t scan;
+    double size_mm = map->size_meters * 1000;
+    make_scan(&scan, nobstacles, 500, size_mm / 4, 1);
+
+    position_t poses[NPOSES];
+    make_poses(poses, map, adversarial, 2);
+
+    int k;
+    for (k=0; k<NKERNELS; ++k)
+    {
+        const kernel_t * kernel = &KERNELS[k];
+
+        if (!selected("distance", kernel->name, pose_name))
+        {
+            continue;
+        }
+
+        long long count = 0;
+        long long start = now_nsec();
+        long long elapsed = 0;
+
+        do
+        {
+            int j;
+            for (j=0; j<NPOSES; ++j)
+            {
+                sink += kernel->distance_scan_to_map(map, &scan, poses[j]);
+            }
+
+            count += NPOSES;
+            elapsed = now_nsec() - start;
+        }
+        while (elapsed < min_nsec);
+
+        double points = (double)count * scan.obst_npoints;
+
+        report("distance", kernel->name, map->size_pixels, scan.obst_npoints, pose_name, elapsed, points,
+               points * (kernel->scan_bytes_per_point + sizeof(pixel_t)));
+    }
+
+    scan_free(&scan);
+}
+
+static void bench_map_update(map_t * map, int long_rays, int adversarial)
+{
+    const char * variant = long_rays ? "long" : "short";
+    const char * pose_name = adversarial ? "adversarial" : "random";
+
+    if (!selected("map_update", variant, pose_name))
+    {
+        return;
+    }
+
+    scan_t scan;
+    double size_mm = map->size_meters * 1000;
+    if (long_rays)
+    {
+        make_scan(&scan, RAY_COUNT, size_mm / 4, size_mm / 2, 3);
+    }
+    else
+    {
+        make_scan(&scan, RAY_COUNT, 400, 1000, 3);
+    }
+
+    position_t poses[NPOSES];
+    make_poses(poses, map, adversarial, 4);
+
+    /* Pixels touched per pass over the poses, extending each ray by half the hole width as map_update() does */
+    double pixels = 0;
+    int j, i;
+    for (j=0; j<NPOSES; ++j)
+    {
+        double c = cos(poses[j].theta_degrees * M_PI / 180);
+        double s = sin(poses[j].theta_degrees * M_PI / 180);
+        double x1 = poses[j].x_mm / MM_PER_PIXEL;
+        double y1 = poses[j].y_mm / MM_PER_PIXEL;
+
+        for (i=0; i<scan.npoints; ++i)
+        {
+            double dx = c * scan.x_mm[i] - s * scan.y_mm[i];
+            double dy = s * scan.x_mm[i] + c * scan.y_mm[i];
+            double scale = (1 + DEFAULT_HOLE_WIDTH_MM / 2 / sqrt(dx*dx + dy*dy)) / MM_PER_PIXEL;
+
+            pixels += ray_pixels(x1, y1, x1 + dx * scale, y1 + dy * scale, map->size_pixels);
+        }
+    }
+
+    long long count = 0;
+    long long start = now_nsec();
+    long long elapsed = 0;
+
+    do
+    {
+        for (j=0; j<NPOSES; ++j)
+        {
+            map_update(map, &scan, poses[j], DEFAULT_MAP_QUALITY, DEFAULT_HOLE_WIDTH_MM);
+        }
+
+        count++;
+        elapsed = now_nsec() - start;
+    }
+    while (elapsed < min_nsec);
+
+    /* Each pixel on a ray is read and written */
+    report("map_update", variant, map->size_pixels, scan.npoints, pose_name, elapsed,
+           (double)count * NPOSES * scan.npoints, count * pixels * 2 * sizeof(pixel_t));
+
+    scan_free(&scan);
+}
+
+static void bench_scan_update(int npoints)
+{
+    if (!selected("scan_update", "-", "-"))
+    {
+        return;
+    }
+
+    unsigned int seed = 5;
+    int * lidar_mm = int_alloc(npoints+1);
+
+    int k;
+    for (k=0; k<=npoints; ++k)
+    {
+        lidar_mm[k] = (int)uniform(&seed, 500, 10000);
+    }
+
+    scan_t scan;
+    scan_init(&scan, 1, npoints+1, 10, 360, 0, 0, 0);
+
+    long long count = 0;
+    long long start = now_nsec();
+    long long elapsed = 0;
+
+    do
+    {
+        scan_update(&scan, lidar_mm, DEFAULT_HOLE_WIDTH_MM, 100, 10);
+        sink += scan.obst_npoints;
+
+        count++;
+        elapsed = now_nsec() - start;
+    }
+    while (elapsed < min_nsec);
+
+    /* Reads one distance; writes x_mm, y_mm, value, obst_x_mm, obst_y_mm */
+    double points = (double)count * scan.npoints;
+    report("scan_update", "-", 0, scan.npoints, "-", elapsed, points, points * (sizeof(int) + 20 + 8));
+
+    scan_free(&scan);
+    free(lidar_mm);
+}
+
+static void bench_random(void)
+{
+    if (!selected("random", "-", "-"))
+    {
+        return;
+    }
+
+    void * randomizer = random_new(9999);
+
+    long long count = 0;
+    long long start = now_nsec();
+    long long elapsed = 0;
+    double sum = 0;
+
+    do
+    {
+        int k;
+        for (k=0; k<RANDOM_BATCH; ++k)
+        {
+            sum += random_normal(randomizer, 0, DEFAULT_SIGMA_XY_MM);
+        }
+
+        count += RANDOM_BATCH;
+        elapsed = now_nsec() - start;
+    }
+    while (elapsed < min_nsec);
+
+    sink += (long long)sum;
+
+    report("random", "-", 0, 1, "-", elapsed, (double)count, 0);
+
+    random_free(randomizer);
+}
+
+/* Main ---------------------------------------------------------------------- */
+
+int main(int argc, char ** argv)
+{
+    int min_msec = DEFAULT_MIN_MSEC;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:")) != -1)
+    {
+        switch (c)
+        {
+            case 't':
+                min_msec = atoi(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-t MILLISECONDS] [FILTER]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    filter = optind < argc ? argv[optind] : NULL;
+    min_nsec = min_msec * 1000000LL;
+
+    printf("%-12s %-7s %6s %6s  %-12s %10s %8s\n", "bench", "variant", "map", "points", "pose", "ns/point", "GB/s");
+
+    int m, k, adversarial;
+    for (m=0; m<NELEMS(MAP_SIZES); ++m)
+    {
+        map_t map;
+        make_map(&map, MAP_SIZES[m], 7);
+
+        for (k=0; k<NELEMS(OBSTACLE_COUNTS); ++k)
+        {
+            for (adversarial=0; adversarial<2; ++adversarial)
+            {
+                bench_distance(&map, OBSTACLE_COUNTS[k], adversarial);
+            }
+        }
+
+        for (k=0; k<2; ++k)
+        {
+            for (adversarial=0; adversarial<2; ++adversarial)
+            {
+                bench_map_update(&map, k, adversarial);
+            }
+        }
+
+        map_free(&map);
+    }
+
+    for (k=0; k<NELEMS(OBSTACLE_COUNTS); ++k)
+    {
+        bench_scan_update(OBSTACLE_COUNTS[k]);
+    }
+
+    bench_random();
+
+    return 0;
+}
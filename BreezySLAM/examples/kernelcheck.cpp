@@ -0,0 +1,748 @@
+/*
+kernelcheck.cpp : BreezySLAM kernel equivalence and determinism checks, run
+by 'make check'.
+
+The distance_scan_to_map() kernels do not round alike: the scalar kernel
+rounds doubles with floor(x + 0.5), while the SSE and NEON kernels convert
+floats, so a scan point near a pixel boundary can land on a different pixel.
+These checks bound how far that lets the kernels drift apart, and check that
+what is meant to be exact is:
+
+  kernels     every compiled kernel (see kernels.h) scores the same synthetic
+              maps, scans and poses as the scalar kernel, to within the value
+              of one pixel in a hundred moving
+  steps       on each logfile, every other kernel finds each scan within a
+              fixed distance of where the scalar kernel finds it, given the
+              same map and the same seed for that scan
+  pipeline    with the scalar kernel, pipelined map integration gives exactly
+              the same trajectory and map as integrating in update()
+  threads     with the scalar kernel, SLAM objects with the same seed running
+              on 1, 2 and 4 threads at once all give exactly the same
+              trajectory and map
+  templates   the coreslam.hpp kernels on classic_map, which runs the C
+              kernels on its pixels, and on 16-bit maps of compile-time and
+              power-of-two sizes, give exactly the same poses, distances and
+              maps as the C kernels; on 8-bit and float maps they find each
+              scan as near as another kernel must
+
+Comparing whole trajectories would say little: the search is chaotic, and one
+differing score sends it down another path, so that the scalar kernel's own
+trajectory moves by metres when only the seed changes.  The steps checks
+therefore replay each logfile open loop, building the map at the scalar
+kernel's poses and reseeding the search for every scan, so that each pose
+found depends only on the kernel scoring one scan against one map.
+
+The kernels are swapped into libbreezyslam by defining distance_scan_to_map()
+here, which takes the place of the library's own; the checks fail if it does
+not.  Prints one line per check and exits with the number of failures.
+
+Usage: kernelcheck [-t TOLERANCE_MM] DATASET ...
+
+where each DATASET (e.g. exp2) is read from DATASET.scanlog if present, or
+else DATASET.dat.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Same map as log2pgm
+static const int MAP_SIZE_PIXELS        = 800;
+static const double MAP_SIZE_METERS     =  32;
+
+// The power-of-two map of the template checks, at the same scale
+static const int MAP_LOG2_SIZE_PIXELS   = 10;
+static const double MAP_POW2_SIZE_METERS = MAP_SIZE_METERS * (1 << MAP_LOG2_SIZE_PIXELS) / MAP_SIZE_PIXELS;
+
+static const int RANDOM_SEED            = 9999;
+
+// How far a scan's pose may move from the scalar kernel's in the steps checks.  With the scalar kernel
+// itself, changing the seed moves poses by up to 114 mm on exp1 and exp2 (99% of them by under 45 mm),
+// where the other kernels and 8-bit and float maps move them by under 35 mm.
+static const double DEFAULT_TOLERANCE_MM = 120;
+
+// Scans replayed by the thread check, enough for shared state to show up
+static const int THREAD_CHECK_SCANS     = 100;
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "Position.hpp"
+#include "Laser.hpp"
+#include "WheeledRobot.hpp"
+#include "Velocities.hpp"
+#include "algorithms.hpp"
+#include "coreslam.hpp"
+
+#include "mines.hpp"
+#include "kernels.h"
+
+// Kernel selection ------------------------------------------------------------
+
+static distance_kernel_t current_kernel = distance_scan_to_map_sisd;
+static bool kernel_dispatched;
+
+// Replaces the library's kernel, so that SLAM runs with current_kernel
+extern "C" int distance_scan_to_map(map_t * map, scan_t * scan, position_t position)
+{
+    __atomic_store_n(&kernel_dispatched, true, __ATOMIC_RELAXED);
+
+    return current_kernel(map, scan, position);
+}
+
+// Reporting -------------------------------------------------------------------
+
+static int failures;
+
+static void report(bool passed, const char * check, const char * details)
+{
+    printf("%-4s %-32s %s\n", passed ? "PASS" : "FAIL", check, details);
+    fflush(stdout);
+
+    failures += !passed;
+}
+
+// Small deterministic generator for the synthetic data
+static unsigned int xorshift(unsigned int * state)
+{
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static double uniform(unsigned int * state, double lo, double hi)
+{
+    return lo + (hi - lo) * (xorshift(state) / 4294967296.);
+}
+
+// Synthetic kernel check ------------------------------------------------------
+
+static void check_kernels_synthetic(void)
+{
+    static const int MAP_SIZES[]        = {256, 1024};
+    static const int OBSTACLE_COUNTS[]  = {100, 1000};
+    static const int NPOSES             = 500;
+
+    unsigned int seed = 1;
+
+    for (int k=1; k<NKERNELS; ++k)
+    {
+        int ncases = 0;
+        int ndiffering = 0;
+        double worst = 0;   // largest difference as a fraction of the allowance
+
+        for (int m=0; m<2; ++m)
+        {
+            map_t map;
+            map_init(&map, MAP_SIZES[m], MAP_SIZES[m] * 25 / 1000.);
+
+            for (int p=0; p<MAP_SIZES[m]*MAP_SIZES[m]; ++p)
+            {
+                map.pixels[p] = xorshift(&seed) % 65536;
+            }
+
+            double size_mm = map.size_meters * 1000;
+
+            for (int n=0; n<2; ++n)
+            {
+                int npoints = OBSTACLE_COUNTS[n];
+                int * lidar_mm = int_alloc(npoints+1);
+
+                for (int j=0; j<=npoints; ++j)
+                {
+                    lidar_mm[j] = (int)uniform(&seed, 500, size_mm / 4);
+                }
+
+                scan_t scan;
+                scan_init(&scan, 1, npoints+1, 10, 360, 0, 0, 0);
+                scan_update(&scan, lidar_mm, DEFAULT_HOLE_WIDTH_MM, 0, 0);
+
+                // Up to one point in a hundred may move to a pixel of any value
+                double allowance = ceil(scan.obst_npoints / 100.) * 65535 * 1024 / scan.obst_npoints;
+
+                for (int j=0; j<NPOSES; ++j)
+                {
+                    position_t position;
+                    position.x_mm = uniform(&seed, 0.4 * size_mm, 0.6 * size_mm);
+                    position.y_mm = uniform(&seed, 0.4 * size_mm, 0.6 * size_mm);
+                    position.theta_degrees = uniform(&seed, 0, 360);
+
+                    int expected = distance_scan_to_map_sisd(&map, &scan, position);
+                    int actual = KERNELS[k].distance_scan_to_map(&map, &scan, position);
+
+                    ncases++;
+
+                    if (actual != expected)
+                    {
+                        ndiffering++;
+
+                        double diff = fabs((double)actual - expected) / allowance;
+                        worst = diff > worst ? diff : worst;
+                    }
+                }
+
+                scan_free(&scan);
+                free(lidar_mm);
+            }
+
+            map_free(&map);
+        }
+
+        char check[100];
+        sprintf(check, "kernels sisd/%s", KERNELS[k].name);
+
+        char details[200];
+        sprintf(details, "%d of %d scores differ; worst %.0f%% of allowance",
+                ndiffering, ncases, 100 * worst);
+
+        report(worst <= 1, check, details);
+    }
+}
+
+// SLAM runs -------------------------------------------------------------------
+
+// A logfile held in memory, so that several threads can replay it at once
+struct Dataset
+{
+    const char * name;
+    vector<int *> scans;
+    vector<long> odometries;
+};
+
+struct Run
+{
+    const Dataset * dataset;
+    int nscans;
+    bool pipeline;
+    int seed;
+
+    // Replayed open loop, as the steps checks do
+    bool stepwise;
+
+    vector<Position> trajectory;
+    vector<position_t> poses;   // as the search found them, before the laser offset is taken off
+    vector<unsigned char> mapbytes;
+};
+
+static void * replay(void * arg)
+{
+    Run * run = (Run *)arg;
+
+    MinesURG04LX laser;
+    Rover robot;
+    RMHC_SLAM slam(laser, MAP_SIZE_PIXELS, MAP_SIZE_METERS, run->seed);
+
+    if (run->pipeline)
+    {
+        slam.enablePipeline();
+    }
+
+    for (int k=0; k<run->nscans; ++k)
+    {
+        long odometry[3];
+        memcpy(odometry, &run->dataset->odometries[3*k], sizeof(odometry));
+
+        Velocities velocities = robot.computeVelocities(odometry);
+
+        slam.update(run->dataset->scans[k], velocities);
+
+        run->trajectory.push_back(slam.getpos());
+    }
+
+    run->mapbytes.resize(MAP_SIZE_PIXELS * MAP_SIZE_PIXELS);
+    slam.getmap(&run->mapbytes[0]);
+
+    return NULL;
+}
+
+static Run make_run(const Dataset & dataset, int nscans = 0, bool pipeline = false, int seed = RANDOM_SEED)
+{
+    Run run;
+
+    run.dataset = &dataset;
+    run.nscans = nscans ? nscans : (int)dataset.scans.size();
+    run.pipeline = pipeline;
+    run.seed = seed;
+    run.stepwise = false;
+
+    return run;
+}
+
+// Largest distance in millimeters between corresponding positions
+static double max_deviation_mm(const Run & a, const Run & b)
+{
+    double worst = 0;
+
+    for (int k=0; k<(int)a.trajectory.size(); ++k)
+    {
+        double dx = a.trajectory[k].x_mm - b.trajectory[k].x_mm;
+        double dy = a.trajectory[k].y_mm - b.trajectory[k].y_mm;
+        double d = sqrt(dx*dx + dy*dy);
+
+        worst = d > worst ? d : worst;
+    }
+
+    return worst;
+}
+
+static bool identical(const Run & a, const Run & b)
+{
+    if (a.trajectory.size() != b.trajectory.size() || a.mapbytes != b.mapbytes)
+    {
+        return false;
+    }
+
+    for (int k=0; k<(int)a.trajectory.size(); ++k)
+    {
+        if (a.trajectory[k].x_mm != b.trajectory[k].x_mm ||
+            a.trajectory[k].y_mm != b.trajectory[k].y_mm ||
+            a.trajectory[k].theta_degrees != b.trajectory[k].theta_degrees)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Dataset checks --------------------------------------------------------------
+
+// Returns whether SLAM ran with this program's kernels, for the steps checks to mean anything
+static bool check_dataset(const Dataset & dataset)
+{
+    char check[100];
+    char details[200];
+
+    // Reference run with the scalar kernel
+    current_kernel = distance_scan_to_map_sisd;
+    kernel_dispatched = false;
+
+    Run reference = make_run(dataset);
+    replay(&reference);
+
+    if (!kernel_dispatched)
+    {
+        sprintf(check, "dispatch %s", dataset.name);
+        report(false, check, "libbreezyslam did not call this program's distance_scan_to_map()");
+        return false;
+    }
+
+    // Pipelining the map integration should not change anything
+    Run pipelined = make_run(dataset, 0, true);
+    replay(&pipelined);
+
+    sprintf(check, "pipeline %s", dataset.name);
+    sprintf(details, "max deviation %.1f mm; maps %s", max_deviation_mm(reference, pipelined),
+            reference.mapbytes == pipelined.mapbytes ? "identical" : "differ");
+    report(identical(reference, pipelined), check, details);
+
+    // Nor should running several SLAM objects at once
+    int nscans = min(THREAD_CHECK_SCANS, (int)dataset.scans.size());
+
+    Run single = make_run(dataset, nscans);
+    replay(&single);
+
+    for (int nthreads=1; nthreads<=4; nthreads*=2)
+    {
+        vector<Run> runs(nthreads, make_run(dataset, nscans));
+        vector<pthread_t> threads(nthreads);
+
+        for (int k=0; k<nthreads; ++k)
+        {
+            pthread_create(&threads[k], NULL, replay, &runs[k]);
+        }
+
+        int nsame = 0;
+
+        for (int k=0; k<nthreads; ++k)
+        {
+            pthread_join(threads[k], NULL);
+
+            nsame += identical(single, runs[k]);
+        }
+
+        sprintf(check, "threads %s x%d", dataset.name, nthreads);
+        sprintf(details, "%d of %d runs identical over %d scans", nsame, nthreads, nscans);
+        report(nsame == nthreads, check, details);
+    }
+
+    return true;
+}
+
+// Template kernel checks ------------------------------------------------------
+
+// The Mines laser, able to set up the C scans that the template checks build by hand
+class ScanLaser : public MinesURG04LX
+{
+public:
+
+    void initScan(scan_t * scan, int span)
+    {
+        scan_init(scan, span, this->scan_size, this->scan_rate_hz, this->detection_angle_degrees,
+                  this->distance_no_detection_mm, this->detection_margin, this->offset_mm);
+    }
+
+    double offsetMillimeters(void)
+    {
+        return this->offset_mm;
+    }
+};
+
+// The C kernels on a C map
+struct CKernels
+{
+    map_t map;
+
+    CKernels(int size_pixels, double size_meters)
+    {
+        map_init(&this->map, size_pixels, size_meters);
+    }
+
+    ~CKernels(void)
+    {
+        map_free(&this->map);
+    }
+
+    position_t search(position_t start, scan_t & scan, void * randomizer)
+    {
+        return rmhc_position_search(start, &this->map, &scan, DEFAULT_SIGMA_XY_MM, DEFAULT_SIGMA_THETA_DEGREES,
+                                    DEFAULT_MAX_SEARCH_ITER, randomizer);
+    }
+
+    long long distance(scan_t & scan, position_t position)
+    {
+        return distance_scan_to_map(&this->map, &scan, position);
+    }
+
+    void update(scan_t & scan, position_t position)
+    {
+        map_update(&this->map, &scan, position, DEFAULT_MAP_QUALITY, DEFAULT_HOLE_WIDTH_MM);
+    }
+
+    void get(unsigned char * bytes)
+    {
+        map_get(&this->map, (char *)bytes);
+    }
+};
+
+// The coreslam.hpp kernels on a map of type M
+template <class M>
+struct TemplateKernels
+{
+    M & map;
+
+    TemplateKernels(M & map) : map(map) { }
+
+    position_t search(position_t start, scan_t & scan, void * randomizer)
+    {
+        return coreslam::rmhc_position_search(start, this->map, scan, DEFAULT_SIGMA_XY_MM, DEFAULT_SIGMA_THETA_DEGREES,
+                                              DEFAULT_MAX_SEARCH_ITER, randomizer);
+    }
+
+    long long distance(scan_t & scan, position_t position)
+    {
+        typename M::traits::sum_type distance = 0;
+        return coreslam::distance_scan_to_map(this->map, scan, position, distance) ? (long long)distance : -1;
+    }
+
+    void update(scan_t & scan, position_t position)
+    {
+        coreslam::map_update(this->map, scan, position, DEFAULT_MAP_QUALITY, DEFAULT_HOLE_WIDTH_MM);
+    }
+
+    void get(unsigned char * bytes)
+    {
+        this->map.get(bytes);
+    }
+};
+
+// Runs RMHC SLAM on a dataset as SinglePositionSLAM does, with the given kernels, adding to
+// distances the score of each scan at its new pose before it is integrated.  A stepwise run
+// reseeds the search for each scan, and given a reference run, integrates each scan at the
+// reference's pose for it rather than its own.
+template <class K>
+static void replay_kernels(Run & run, K & kernels, int map_size_pixels, vector<long long> & distances,
+                           const Run * reference = NULL)
+{
+    ScanLaser laser;
+    Rover robot;
+
+    scan_t scan_for_mapbuild;
+    scan_t scan_for_distance;
+    laser.initScan(&scan_for_mapbuild, 3);
+    laser.initScan(&scan_for_distance, 1);
+
+    void * randomizer = random_new(run.seed);
+
+    Velocities velocities;
+    double dxy_mm = 0;
+    double dtheta_degrees = 0;
+
+    position_t position;
+    position.x_mm = position.y_mm = 500 * MAP_SIZE_METERS * map_size_pixels / MAP_SIZE_PIXELS;
+    position.theta_degrees = 0;
+
+    for (int k=0; k<run.nscans; ++k)
+    {
+        long odometry[3];
+        memcpy(odometry, &run.dataset->odometries[3*k], sizeof(odometry));
+
+        velocities = robot.computeVelocities(odometry);
+
+        scan_update(&scan_for_mapbuild, run.dataset->scans[k], DEFAULT_HOLE_WIDTH_MM, dxy_mm, dtheta_degrees);
+        scan_update(&scan_for_distance, run.dataset->scans[k], DEFAULT_HOLE_WIDTH_MM, dxy_mm, dtheta_degrees);
+
+        double velocity_factor = (velocities.dt_seconds > 0) ? (1 / velocities.dt_seconds) : 0;
+        dxy_mm = velocities.dxy_mm * velocity_factor;
+        dtheta_degrees = velocities.dtheta_degrees * velocity_factor;
+
+        double theta_radians = position.theta_degrees * M_PI / 180;
+        double forward_mm = velocities.dxy_mm + laser.offsetMillimeters();
+
+        position_t start = position;
+        start.x_mm += forward_mm * cos(theta_radians);
+        start.y_mm += forward_mm * sin(theta_radians);
+        start.theta_degrees += velocities.dtheta_degrees;
+
+        if (run.stepwise)
+        {
+            random_free(randomizer);
+            randomizer = random_new(run.seed + k);
+        }
+
+        position_t new_position = kernels.search(start, scan_for_distance, randomizer);
+
+        distances.push_back(kernels.distance(scan_for_distance, new_position));
+
+        run.poses.push_back(new_position);
+        run.trajectory.push_back(Position(new_position.x_mm - laser.offsetMillimeters() * cos(theta_radians),
+                                          new_position.y_mm - laser.offsetMillimeters() * sin(theta_radians),
+                                          new_position.theta_degrees));
+
+        if (reference)
+        {
+            new_position = reference->poses[k];
+        }
+
+        kernels.update(scan_for_mapbuild, new_position);
+
+        position = new_position;
+        position.x_mm -= laser.offsetMillimeters() * cos(theta_radians);
+        position.y_mm -= laser.offsetMillimeters() * sin(theta_radians);
+    }
+
+    run.mapbytes.resize(map_size_pixels * map_size_pixels);
+    kernels.get(&run.mapbytes[0]);
+
+    random_free(randomizer);
+    scan_free(&scan_for_distance);
+    scan_free(&scan_for_mapbuild);
+}
+
+// Replays a dataset stepwise with the given kernels, building the map at the poses of a stepwise
+// reference run, and reports whether every scan is found within tolerance_mm of the reference
+template <class K>
+static void check_steps(const char * check, const Run & reference, K & kernels, int map_size_pixels,
+                        double tolerance_mm)
+{
+    Run run = make_run(*reference.dataset);
+    run.stepwise = true;
+
+    vector<long long> distances;
+    replay_kernels(run, kernels, map_size_pixels, distances, &reference);
+
+    double deviation = max_deviation_mm(reference, run);
+
+    char details[200];
+    sprintf(details, "max deviation %.1f mm over %d scans (allowed %.1f mm)", deviation,
+            (int)run.trajectory.size(), tolerance_mm);
+    report(deviation <= tolerance_mm, check, details);
+}
+
+// Replays a dataset stepwise with the scalar kernel, as the reference for the steps checks
+static Run replay_reference_steps(const Dataset & dataset)
+{
+    current_kernel = distance_scan_to_map_sisd;
+
+    Run reference = make_run(dataset);
+    reference.stepwise = true;
+
+    vector<long long> distances;
+    CKernels kernels(MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+    replay_kernels(reference, kernels, MAP_SIZE_PIXELS, distances);
+
+    return reference;
+}
+
+static void check_kernel_steps(const Run & reference, double tolerance_mm)
+{
+    for (int k=1; k<NKERNELS; ++k)
+    {
+        current_kernel = KERNELS[k].distance_scan_to_map;
+
+        char check[100];
+        sprintf(check, "steps %s sisd/%s", reference.dataset->name, KERNELS[k].name);
+
+        CKernels kernels(MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+        check_steps(check, reference, kernels, MAP_SIZE_PIXELS, tolerance_mm);
+    }
+
+    current_kernel = distance_scan_to_map_sisd;
+}
+
+// Replays a dataset with the C kernels and with the template kernels on a map of type M, and
+// reports whether they agree exactly
+template <class M>
+static void check_template(const Dataset & dataset, const char * name, M & map, int map_size_pixels,
+                           double map_size_meters)
+{
+    Run c_run = make_run(dataset);
+    vector<long long> c_distances;
+    CKernels c_kernels(map_size_pixels, map_size_meters);
+    replay_kernels(c_run, c_kernels, map_size_pixels, c_distances);
+
+    Run template_run = make_run(dataset);
+    vector<long long> template_distances;
+    TemplateKernels<M> template_kernels(map);
+    replay_kernels(template_run, template_kernels, map_size_pixels, template_distances);
+
+    double deviation = max_deviation_mm(c_run, template_run);
+
+    char check[100];
+    sprintf(check, "templates %s %s", dataset.name, name);
+
+    char details[200];
+    sprintf(details, "max deviation %.1f mm over %d scans; distances %s; maps %s", deviation,
+            (int)c_run.trajectory.size(), c_distances == template_distances ? "identical" : "differ",
+            c_run.mapbytes == template_run.mapbytes ? "identical" : "differ");
+
+    bool same = identical(c_run, template_run) && c_distances == template_distances;
+    report(same, check, details);
+}
+
+static void check_templates(const Dataset & dataset, const Run & reference, double tolerance_mm)
+{
+    // The C ABI's instantiation, wrapping the pixels of a C map
+    map_t cmap;
+    map_init(&cmap, MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+    coreslam::classic_map classic(cmap);
+    check_template(dataset, "classic_map", classic, MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+    map_free(&cmap);
+
+    // Sizes known at compile time index the same pixels
+    coreslam::map<unsigned short, coreslam::fixed_size<MAP_SIZE_PIXELS> > fixed(MAP_SIZE_METERS);
+    check_template(dataset, "fixed_size", fixed, MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+
+    coreslam::map<unsigned short, coreslam::pow2_size<MAP_LOG2_SIZE_PIXELS> > pow2(MAP_POW2_SIZE_METERS);
+    check_template(dataset, "pow2_size", pow2, 1 << MAP_LOG2_SIZE_PIXELS, MAP_POW2_SIZE_METERS);
+
+    // 8-bit pixels integrate more coarsely, so they need only find scans as near as another kernel
+    coreslam::map<unsigned char> uint8(MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+    TemplateKernels<coreslam::map<unsigned char> > uint8_kernels(uint8);
+
+    char check[100];
+    sprintf(check, "templates %s uint8", dataset.name);
+    check_steps(check, reference, uint8_kernels, MAP_SIZE_PIXELS, tolerance_mm);
+
+    // Float pixels average the same profiles on another scale, so they should find scans as near
+    coreslam::map<float> evidence(MAP_SIZE_PIXELS, MAP_SIZE_METERS);
+    TemplateKernels<coreslam::map<float> > float_kernels(evidence);
+
+    sprintf(check, "templates %s float", dataset.name);
+    check_steps(check, reference, float_kernels, MAP_SIZE_PIXELS, tolerance_mm);
+}
+
+static void load_dataset(const char * name, Dataset & dataset)
+{
+    char filename[256];
+    sprintf(filename, "%s.scanlog", name);
+    if (access(filename, R_OK))
+    {
+        sprintf(filename, "%s.dat", name);
+    }
+
+    MinesLog * log = new MinesLog(filename, false);
+
+    dataset.name = name;
+
+    for (int k=0; k<log->size(); ++k)
+    {
+        int * scan = new int [SCAN_SIZE];
+        memcpy(scan, log->scan(k), SCAN_SIZE*sizeof(int));
+        dataset.scans.push_back(scan);
+
+        long * odometry = log->odometry(k);
+        dataset.odometries.insert(dataset.odometries.end(), odometry, odometry+3);
+    }
+
+    delete log;
+}
+
+int main(int argc, char ** argv)
+{
+    double tolerance_mm = DEFAULT_TOLERANCE_MM;
+
+    int c;
+    while ((c = getopt(argc, argv, "t:")) != -1)
+    {
+        switch (c)
+        {
+            case 't':
+                tolerance_mm = atof(optarg);
+                break;
+
+            default:
+                fprintf(stderr, "Usage: %s [-t TOLERANCE_MM] DATASET ...\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    check_kernels_synthetic();
+
+    for (int k=optind; k<argc; ++k)
+    {
+        Dataset dataset;
+        load_dataset(argv[k], dataset);
+
+        bool dispatched = check_dataset(dataset);
+
+        Run reference = replay_reference_steps(dataset);
+
+        if (dispatched)
+        {
+            check_kernel_steps(reference, tolerance_mm);
+        }
+
+        check_templates(dataset, reference, tolerance_mm);
+
+        for (int j=0; j<(int)dataset.scans.size(); ++j)
+        {
+            delete[] dataset.scans[j];
+        }
+    }
+
+    printf("%d failure%s\n", failures, failures == 1 ? "" : "s");
+
+    return failures;
+}
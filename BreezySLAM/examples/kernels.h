@@ -0,0 +1,73 @@
+/*
+kernels.h : Table of the distance_scan_to_map() kernels compiled for this
+machine, for comparing them against each other in one program.
+
+libbreezyslam contains only the kernel for its build architecture, so the
+examples Makefile compiles each kernel source again with distance_scan_to_map
+renamed to distance_scan_to_map_<kernel>, and defines HAVE_KERNEL_<KERNEL> for
+each SIMD kernel it could build.  The scalar kernel is always present.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include "coreslam.h"
+
+typedef int (*distance_kernel_t)(map_t * map, scan_t * scan, position_t position);
+
+typedef struct kernel_t
+{
+    const char * name;
+    distance_kernel_t distance_scan_to_map;
+    int scan_bytes_per_point;   /* scan data read per obstacle point, not counting the map */
+
+} kernel_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+int distance_scan_to_map_sisd(map_t * map, scan_t * scan, position_t position);
+
+#ifdef HAVE_KERNEL_I686
+int distance_scan_to_map_i686(map_t * map, scan_t * scan, position_t position);
+#endif
+
+#ifdef HAVE_KERNEL_ARMV7L
+int distance_scan_to_map_armv7l(map_t * map, scan_t * scan, position_t position);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+static const kernel_t KERNELS[] =
+{
+    { "sisd",   distance_scan_to_map_sisd,   20 },   /* x_mm, y_mm, value */
+#ifdef HAVE_KERNEL_I686
+    { "i686",   distance_scan_to_map_i686,   20 },
+#endif
+#ifdef HAVE_KERNEL_ARMV7L
+    { "armv7l", distance_scan_to_map_armv7l,  8 },   /* obst_x_mm, obst_y_mm */
+#endif
+};
+
+static const int NKERNELS = sizeof(KERNELS) / sizeof(kernel_t);
+
+#endif /* KERNELS_H */
@@ -40,11 +40,6 @@ Change log:
 static const int MAP_SIZE_PIXELS        = 800;
 static const double MAP_SIZE_METERS     =  32;
 
-static const int SCAN_SIZE 		        = 682;
-
-// Arbitrary maximum length of line in input logfile
-#define MAXLINE 10000
-
 #include <iostream>
 #include <vector>
 using namespace std;
@@ -54,151 +49,17 @@ using namespace std;
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "Position.hpp"
 #include "Laser.hpp"
 #include "WheeledRobot.hpp"
 #include "Velocities.hpp"
 #include "algorithms.hpp"
+#include "MapExport.hpp"
 
+#include "mines.hpp"
 
-// Methods to load all data from file ------------------------------------------
-// Each line in the file has the format:
-//
-//  TIMESTAMP  ... Q1  Q1 ... Distances
-//  (usec)                    (mm)
-//  0          ... 2   3  ... 24 ... 
-//  
-//where Q1, Q2 are odometry values
-
-static void skiptok(char ** cpp)
-{
-    *cpp = strtok(NULL, " ");
-}
-
-static int nextint(char ** cpp)
-{
-    skiptok(cpp);
-    
-    return atoi(*cpp);
-}
-
-static void load_data(
-    const char * dataset, 
-    vector<int *> & scans,
-    vector<long *> & odometries)
-{
-    char filename[256];
-    
-    sprintf(filename, "%s.dat", dataset);
-    printf("Loading data from %s ... \n", filename);
-    
-    FILE * fp = fopen(filename, "rt");
-    
-    if (!fp)
-    {
-        fprintf(stderr, "Failed to open file\n");
-        exit(1);
-    }
-    
-    char s[MAXLINE];
-    
-    while (fgets(s, MAXLINE, fp))
-    {
-        char * cp = strtok(s, " ");
-               
-        long * odometry = new long [3];
-        odometry[0] = atol(cp);
-        skiptok(&cp);        
-        odometry[1] = nextint(&cp);
-        odometry[2] = nextint(&cp);
-        
-        odometries.push_back(odometry);
-        
-        // Skip unused fields
-        for (int k=0; k<20; ++k)
-        {
-            skiptok(&cp);
-        }
-        
-        int * scanvals = new int [SCAN_SIZE];
-        
-        for (int k=0; k<SCAN_SIZE; ++k)
-        {
-            scanvals[k] = nextint(&cp);
-        }
-        
-        scans.push_back(scanvals);
-    }
-    
-    fclose(fp);    
-}
-
-// Class for Mines verison of URG-04LX Lidar -----------------------------------
-
-class MinesURG04LX : public URG04LX
-{
-    
-public:
-    
-    MinesURG04LX(void): URG04LX(
-        70,          // detectionMargin
-        145)         // offsetMillimeters
-    {
-    }
-};
-
-// Class for MinesRover custom robot -------------------------------------------
-
-class Rover : WheeledRobot
-{
-    
-public:
-    
-    Rover() : WheeledRobot(
-         77,     // wheelRadiusMillimeters
-        165)     // halfAxleLengthMillimeters
-    {
-    }
-    
-    Velocities computeVelocities(long * odometry, Velocities & velocities)
-    {  
-        return WheeledRobot::computeVelocities(
-            odometry[0], 
-            odometry[1], 
-            odometry[2]);
-    }
-
-protected:    
-    
-    void extractOdometry(
-        double timestamp, 
-        double leftWheelOdometry, 
-        double rightWheelOdometry, 
-        double & timestampSeconds, 
-        double & leftWheelDegrees, 
-        double & rightWheelDegrees)
-    {        
-        // Convert microseconds to seconds, ticks to angles        
-        timestampSeconds = timestamp / 1e6;
-        leftWheelDegrees = ticksToDegrees(leftWheelOdometry);
-        rightWheelDegrees = ticksToDegrees(rightWheelOdometry);
-    }
-    
-    void descriptorString(char * str)
-    {
-        sprintf(str, "ticks_per_cycle=%d", this->TICKS_PER_CYCLE);
-    }
-        
-private:
-    
-    double ticksToDegrees(double ticks)
-    {
-        return ticks * (180. / this->TICKS_PER_CYCLE);
-    }
-    
-    static const int TICKS_PER_CYCLE = 2000;
-};
 
 // Progress-bar class
 // Adapted from http://code.activestate.com/recipes/168639-progress-bar-class/
@@ -253,7 +114,7 @@ public:
 		sprintf(percentString, "%d%%", percentDone);
 				
 		// Put it there
-		for (int k=0; k<strlen(percentString); ++k)
+		for (int k=0; k<(int)strlen(percentString); ++k)
 		{
 		    this->progBar[percentPlace+k] = percentString[k];
 		}
@@ -283,19 +144,6 @@ private:
     }
 };
 
-// Helpers ----------------------------------------------------------------
-
-int coords2index(double x,  double y)
-{    
-    return y * MAP_SIZE_PIXELS + x;
-}
-
-
-int mm2pix(double mm)
-{
-    return (int)(mm / (MAP_SIZE_METERS * 1000. / MAP_SIZE_PIXELS));  
-}
-
 int main( int argc, const char** argv )
 {    
     // Bozo filter for input args
@@ -313,17 +161,19 @@ int main( int argc, const char** argv )
     bool use_odometry    =  atoi(argv[2]) ? true : false;
     int random_seed =  argc > 3 ? atoi(argv[3]) : 0;
     
-    // Load the Lidar and odometry data from the file   
-    vector<int *> scans;
-    vector<long *> odometries;
-    load_data(dataset, scans, odometries);
+    // Stream the Lidar and odometry data from the file, preferring a binary scan log
+    char filename[256];
+    sprintf(filename, "%s.scanlog", dataset);
+    if (access(filename, R_OK))
+    {
+        sprintf(filename, "%s.dat", dataset);
+    }
+    printf("Streaming data from %s ... \n", filename);
+    MinesStream log(filename);
        
     // Build a robot model in case we want odometry
     Rover robot = Rover();
     
-    // Create a byte array to receive the computed maps
-    unsigned char * mapbytes = new unsigned char[MAP_SIZE_PIXELS * MAP_SIZE_PIXELS];
-        
     // Create SLAM object
     MinesURG04LX laser;
     SinglePositionSLAM * slam = random_seed ?
@@ -331,26 +181,26 @@ int main( int argc, const char** argv )
     (SinglePositionSLAM*)new Deterministic_SLAM(laser, MAP_SIZE_PIXELS, MAP_SIZE_METERS);
 	    
     // Report what we're doing
-    int nscans = scans.size();
-    printf("Processing %d scans with%s odometry / with%s particle filter...\n",
-        nscans, use_odometry ? "" : "out", random_seed ? "" : "out");
-    ProgressBar * progbar = new ProgressBar(0, nscans, 80); 
+    printf("Processing scans with%s odometry / with%s particle filter...\n",
+        use_odometry ? "" : "out", random_seed ? "" : "out");
+    ProgressBar * progbar = new ProgressBar(0, 1000, 80); 
         
-    // Start with an empty trajectory of positions
-    vector<double *> trajectory;
+    // Start with an empty trajectory, kept by the map exporter
+    MapExport mapexport(MAP_SIZE_PIXELS, MAP_SIZE_METERS);
     
     // Start timing
     time_t start_sec = time(NULL);
 
     // Loop over scans
-    for (int scanno=0; scanno<nscans; ++scanno)
+    int nscans = 0;
+    while (log.next())
     {                         
-        int * lidar = scans[scanno];
+        int * lidar = log.scan();
         
         // Update with/out odometry
         if (use_odometry)
         {
-            Velocities velocities = robot.computeVelocities(odometries[scanno], velocities);
+            Velocities velocities = robot.computeVelocities(log.odometry());
             slam->update(lidar, velocities);            
         }
         else
@@ -361,13 +211,11 @@ int main( int argc, const char** argv )
         Position position = slam->getpos();
 
         // Add new coordinates to trajectory
-        double * v = new double[2];
-        v[0] = position.x_mm;
-        v[1] = position.y_mm;
-        trajectory.push_back(v);     
+        mapexport.addPosition(position);
+        nscans++;
         
         // Tame impatience
-        progbar->updateAmount(scanno);
+        progbar->updateAmount(log.permille());
         printf("\r%s", progbar->str());
         fflush(stdout);
     }
@@ -377,62 +225,21 @@ int main( int argc, const char** argv )
     printf("\n%d scans in %ld seconds = %f scans / sec\n", 
            nscans, elapsed_sec, (float)nscans/elapsed_sec);
               
-    // Get final map
-    slam->getmap(mapbytes);
-
-    // Put trajectory into map as black pixels
-    for (int k=0; k<(int)trajectory.size(); ++k)
-    {        
-        double * v = trajectory[k];
-                        
-        int x = mm2pix(v[0]);
-        int y = mm2pix(v[1]);
-        
-        delete v;
-                        
-        mapbytes[coords2index(x, y)] = 0;
-    }
-            
-    // Save map and trajectory as PGM file    
-    
-    char filename[100];
+    // Save final map and trajectory as PGM file    
     sprintf(filename, "%s.pgm", dataset);
     printf("\nSaving map to file %s\n", filename);
     
-    FILE * output = fopen(filename, "wt");
-    
-    fprintf(output, "P2\n%d %d 255\n", MAP_SIZE_PIXELS, MAP_SIZE_PIXELS);
-    
-    for (int y=0; y<MAP_SIZE_PIXELS; y++)
+    if (!mapexport.save(filename, *slam, MapExport::PGM))
     {
-        for (int x=0; x<MAP_SIZE_PIXELS; x++)
-        {
-            fprintf(output, "%d ", mapbytes[coords2index(x, y)]);
-        }
-        fprintf(output, "\n");
+        fprintf(stderr, "Failed to save map to file %s\n", filename);
     }
     
     printf("\n");
     
     // Clean up
-    for (int scanno=0; scanno<(int)scans.size(); ++scanno)
-    {                                       
-        delete scans[scanno];
-        delete odometries[scanno];
-    }
-    
-    if (random_seed)
-    {
-        delete ((RMHC_SLAM *)slam);
-    }
-    else
-    {
-        delete ((Deterministic_SLAM *)slam);
-    }
+    delete slam;
 
     delete progbar;
-    delete mapbytes;
-    fclose(output);
 
     
     return 0;
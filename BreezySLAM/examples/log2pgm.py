@@ -43,6 +43,9 @@ Change log:
 MAP_SIZE_PIXELS          = 800
 MAP_SIZE_METERS          =  32
 
+# Scans per call to update_many()
+BATCH_SIZE               =  32
+
 from breezyslam.algorithms import Deterministic_SLAM, RMHC_SLAM
 
 from mines import MinesLaser, Rover, load_data
@@ -51,6 +54,7 @@ from pgm_utils import pgm_save
 
 from sys import argv, exit, stdout
 from time import time
+from array import array
 
 def main():
 	    
@@ -89,30 +93,37 @@ def main():
     # Start timing
     start_sec = time()
     
-    # Loop over scans    
-    for scanno in range(nscans):
+    # Loop over batches of scans, which run natively with the GIL released
+    for scanno in range(0, nscans, BATCH_SIZE):
+    
+        batch = range(scanno, min(scanno+BATCH_SIZE, nscans))
+        
+        # Pack the batch's scans one after another
+        scans = array('i')
+        for k in batch:
+            scans.extend(lidars[k])
     
         if use_odometry:
                   
             # Convert odometry to velocities
-            velocities = robot.computeVelocities(odometries[scanno])
+            velocities = array('d')
+            for k in batch:
+                velocities.extend(robot.computeVelocities(odometries[k]))
                                  
             # Update SLAM with lidar and velocities
-            slam.update(lidars[scanno], velocities)
+            positions = slam.update_many(scans, velocities)
             
         else:
         
             # Update SLAM with lidar alone
-            slam.update(lidars[scanno])
+            positions = slam.update_many(scans)
 
-        # Get new position
-        x_mm, y_mm, theta_degrees = slam.getpos()    
-        
-        # Add new position to trajectory
-        trajectory.append((x_mm, y_mm))
+        # Add new positions to trajectory
+        for k in range(0, len(positions), 3):
+            trajectory.append((positions[k], positions[k+1]))
         
         # Tame impatience
-        progbar.updateAmount(scanno)
+        progbar.updateAmount(batch[-1])
         stdout.write('\r%s' % str(progbar))
         stdout.flush()
 
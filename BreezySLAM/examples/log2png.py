@@ -51,7 +51,6 @@ from progressbar import ProgressBar
 from sys import argv, exit, stdout
 from time import time
 
-import Image
 
 def main():
 	    
@@ -122,32 +121,8 @@ def main():
     print('\n%d scans in %f sec = %f scans / sec' % (nscans, elapsed_sec, nscans/elapsed_sec))
                     
                                 
-    # Create a byte array to receive the computed maps
-    mapbytes = bytearray(MAP_SIZE_PIXELS * MAP_SIZE_PIXELS)
-    
-    # Get final map    
-    slam.getmap(mapbytes)
-    
-    # Put trajectory into map as black pixels
-    for coords in trajectory:
-                
-        x_mm, y_mm = coords
-                               
-        x_pix = mm2pix(x_mm)
-        y_pix = mm2pix(y_mm)
-                                                                                              
-        mapbytes[y_pix * MAP_SIZE_PIXELS + x_pix] = 0;
-                    
     # Save map and trajectory as PNG file
-    image = Image.frombuffer('L', (MAP_SIZE_PIXELS, MAP_SIZE_PIXELS), mapbytes, 'raw', 'L', 0, 1)
-    image.save('%s.png' % dataset)
+    slam.savemap('%s.png' % dataset, trajectory)
 
             
-# Helpers ---------------------------------------------------------        
-
-def mm2pix(mm):
-        
-    return int(mm / (MAP_SIZE_METERS * 1000. / MAP_SIZE_PIXELS))  
-    
-                    
 main()
@@ -0,0 +1,187 @@
+/*
+log2scanlog.cpp : Converts a text logfile into a binary scan log (see
+scanlog.h), which log2pgm and breezybench map into memory instead of parsing.
+
+Two text formats are supported, chosen by file extension:
+
+  .dat  Paris Mines Tech:  TIMESTAMP(usec) ... Q1 Q2 ... (20 fields) ... distances(mm)
+  .log  RPLidar SLAMbot:   LEFT(ticks) RIGHT(ticks) TIMESTAMP(msec) distances(mm)
+
+The scan size is taken from the first line.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3 of the
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "scanlog.h"
+
+// Number of leading non-distance fields in each format
+static const int DAT_HEADER_FIELDS = 24;
+static const int LOG_HEADER_FIELDS = 3;
+
+// Parses whitespace-separated numbers from a line; some unused .dat fields are not integers
+static int parse_line(char * line, vector<double> & fields)
+{
+    fields.clear();
+
+    char * cp = line;
+
+    while (true)
+    {
+        char * end = NULL;
+        double value = strtod(cp, &end);
+
+        if (end == cp)
+        {
+            break;
+        }
+
+        fields.push_back(value);
+        cp = end;
+    }
+
+    return fields.size();
+}
+
+static bool has_extension(const char * filename, const char * extension)
+{
+    int n = strlen(filename);
+    int m = strlen(extension);
+
+    return n > m && !strcmp(filename + n - m, extension);
+}
+
+int main(int argc, char ** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage:   %s <logfile.dat|logfile.log> <output.scanlog>\n", argv[0]);
+        fprintf(stderr, "Example: %s exp2.dat exp2.scanlog\n", argv[0]);
+        exit(1);
+    }
+
+    const char * infile = argv[1];
+    const char * outfile = argv[2];
+
+    bool is_dat = has_extension(infile, ".dat");
+
+    if (!is_dat && !has_extension(infile, ".log"))
+    {
+        fprintf(stderr, "%s: unrecognized format; expected .dat or .log\n", infile);
+        exit(1);
+    }
+
+    int header_fields = is_dat ? DAT_HEADER_FIELDS : LOG_HEADER_FIELDS;
+
+    FILE * fp = fopen(infile, "rt");
+
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open file %s\n", infile);
+        exit(1);
+    }
+
+    scanlog_writer_t * writer = NULL;
+    int scan_size = 0;
+    int lineno = 0;
+    int nscans = 0;
+
+    char * line = NULL;
+    size_t line_capacity = 0;
+    vector<double> fields;
+    vector<int> distances;
+
+    while (getline(&line, &line_capacity, fp) > 0)
+    {
+        lineno++;
+
+        int nfields = parse_line(line, fields);
+
+        if (!nfields)
+        {
+            continue;
+        }
+
+        if (!writer)
+        {
+            scan_size = nfields - header_fields;
+
+            if (scan_size < 1)
+            {
+                fprintf(stderr, "%s:%d: no distances\n", infile, lineno);
+                exit(1);
+            }
+
+            writer = scanlog_create(outfile, scan_size);
+
+            if (!writer)
+            {
+                exit(1);
+            }
+
+            distances.resize(scan_size);
+        }
+
+        if (nfields != header_fields + scan_size)
+        {
+            fprintf(stderr, "%s:%d: expected %d fields, found %d\n", infile, lineno, header_fields + scan_size, nfields);
+            exit(1);
+        }
+
+        for (int k=0; k<scan_size; ++k)
+        {
+            distances[k] = (int)fields[header_fields+k];
+        }
+
+        int result = is_dat ?
+            scanlog_append(writer, (int64_t)fields[0], (int32_t)fields[2], (int32_t)fields[3], &distances[0]) :
+            scanlog_append(writer, (int64_t)(fields[2] * 1000), (int32_t)fields[0], (int32_t)fields[1], &distances[0]);
+
+        if (result)
+        {
+            fprintf(stderr, "Failed to write %s\n", outfile);
+            exit(1);
+        }
+
+        nscans++;
+    }
+
+    free(line);
+    fclose(fp);
+
+    if (!writer)
+    {
+        fprintf(stderr, "%s: no scans\n", infile);
+        exit(1);
+    }
+
+    if (scanlog_finish(writer))
+    {
+        fprintf(stderr, "Failed to write %s\n", outfile);
+        exit(1);
+    }
+
+    printf("Wrote %d scans of %d points to %s\n", nscans, scan_size, outfile);
+
+    return 0;
+}
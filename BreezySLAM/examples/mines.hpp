@@ -0,0 +1,486 @@
+/*
+mines.hpp : Lidar and robot models, and a logfile loader, for the Paris Mines 
+Tech datasets (exp1.dat, exp2.dat) used by the BreezySLAM C++ examples.
+
+Copyright (C) 2014 Simon D. Levy
+
+This code is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 of the 
+License, or (at your option) any later version.
+
+This code is distributed in the hope that it will be useful,     
+but WITHOUT ANY WARRANTY without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License 
+along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "scanlog.h"
+#include "scan_queue.h"
+
+static const int SCAN_SIZE 		        = 682;
+
+// Arbitrary maximum length of line in input logfile
+#define MAXLINE 10000
+
+// Methods to load all data from file ------------------------------------------
+// Each line in the file has the format:
+//
+//  TIMESTAMP  ... Q1  Q1 ... Distances
+//  (usec)                    (mm)
+//  0          ... 2   3  ... 24 ... 
+//  
+//where Q1, Q2 are odometry values
+
+static void skiptok(char ** cpp, char ** savepp)
+{
+    *cpp = strtok_r(NULL, " ", savepp);
+}
+
+static int nextint(char ** cpp, char ** savepp)
+{
+    skiptok(cpp, savepp);
+    
+    return atoi(*cpp);
+}
+
+// Parses one line of the file into the timestamp, the two odometry values, 
+// and SCAN_SIZE distances.  Safe to call from a reader thread.
+static void parse_line(char * s, int * scanvals, long * odometry)
+{
+    char * savep = NULL;
+    char * cp = strtok_r(s, " ", &savep);
+    
+    odometry[0] = atol(cp);
+    skiptok(&cp, &savep);        
+    odometry[1] = nextint(&cp, &savep);
+    odometry[2] = nextint(&cp, &savep);
+    
+    // Skip unused fields
+    for (int k=0; k<20; ++k)
+    {
+        skiptok(&cp, &savep);
+    }
+    
+    for (int k=0; k<SCAN_SIZE; ++k)
+    {
+        scanvals[k] = nextint(&cp, &savep);
+    }
+}
+
+static void load_data(
+    const char * filename, 
+    vector<int *> & scans,
+    vector<long *> & odometries,
+    bool verbose = true)
+{
+    if (verbose)
+    {
+        printf("Loading data from %s ... \n", filename);
+    }
+    
+    FILE * fp = fopen(filename, "rt");
+    
+    if (!fp)
+    {
+        fprintf(stderr, "Failed to open file\n");
+        exit(1);
+    }
+    
+    char s[MAXLINE];
+    
+    while (fgets(s, MAXLINE, fp))
+    {
+        long * odometry = new long [3];
+        int * scanvals = new int [SCAN_SIZE];
+        
+        parse_line(s, scanvals, odometry);
+        
+        odometries.push_back(odometry);
+        scans.push_back(scanvals);
+    }
+    
+    fclose(fp);    
+}
+
+// Class for logfiles: a text .dat file is loaded into memory, while a binary
+// .scanlog file (see log2scanlog) is memory-mapped with no per-scan allocation
+
+class MinesLog
+{
+public:
+
+    MinesLog(const char * filename, bool verbose = true)
+    {
+        int n = strlen(filename);
+
+        this->scanlog = NULL;
+
+        if (n > 8 && !strcmp(filename + n - 8, ".scanlog"))
+        {
+            this->scanlog = scanlog_open(filename);
+
+            if (!this->scanlog)
+            {
+                exit(1);
+            }
+
+            // Like load_data(), use the first SCAN_SIZE distances of each scan
+            if (scanlog_scan_size(this->scanlog) < SCAN_SIZE)
+            {
+                fprintf(stderr, "%s has %d points per scan; expected at least %d\n", 
+                        filename, scanlog_scan_size(this->scanlog), SCAN_SIZE);
+                exit(1);
+            }
+        }
+        else
+        {
+            load_data(filename, this->scans, this->odometries, verbose);
+        }
+    }
+
+    ~MinesLog(void)
+    {
+        scanlog_close(this->scanlog);
+
+        for (int k=0; k<(int)this->scans.size(); ++k)
+        {
+            delete[] this->scans[k];
+            delete[] this->odometries[k];
+        }
+    }
+
+    int size(void)
+    {
+        return this->scanlog ? (int)scanlog_count(this->scanlog) : (int)this->scans.size();
+    }
+
+    int * scan(int k)
+    {
+        // SLAM does not modify scans, so the read-only mapping can be passed directly
+        return this->scanlog ? (int *)scanlog_scan(this->scanlog, k) : this->scans[k];
+    }
+
+    // Returns timestamp and odometry as loaded by load_data(); valid until the next call
+    long * odometry(int k)
+    {
+        if (!this->scanlog)
+        {
+            return this->odometries[k];
+        }
+
+        const int32_t * odometry = scanlog_odometry(this->scanlog, k);
+
+        this->current_odometry[0] = scanlog_timestamp_usec(this->scanlog, k);
+        this->current_odometry[1] = odometry[0];
+        this->current_odometry[2] = odometry[1];
+
+        return this->current_odometry;
+    }
+
+private:
+
+    scanlog_t * scanlog;
+
+    vector<int *> scans;
+    vector<long *> odometries;
+
+    long current_odometry[3];
+};
+
+// Class for streaming a logfile: a reader thread parses scans ahead of the 
+// caller into a bounded queue of preallocated buffers, so memory stays flat 
+// however long the log is and the first scan is available as soon as it has 
+// been read.  Reads a text .dat file or a binary .scanlog file.
+
+class MinesStream
+{
+public:
+
+    MinesStream(const char * filename, int capacity = STREAM_CAPACITY)
+    {
+        int n = strlen(filename);
+
+        this->fp = NULL;
+        this->scanlog = NULL;
+        this->file_size = 1;
+
+        if (n > 8 && !strcmp(filename + n - 8, ".scanlog"))
+        {
+            this->scanlog = scanlog_open(filename);
+
+            if (!this->scanlog)
+            {
+                exit(1);
+            }
+
+            if (scanlog_scan_size(this->scanlog) < SCAN_SIZE)
+            {
+                fprintf(stderr, "%s has %d points per scan; expected at least %d\n", 
+                        filename, scanlog_scan_size(this->scanlog), SCAN_SIZE);
+                exit(1);
+            }
+        }
+        else
+        {
+            this->fp = fopen(filename, "rt");
+
+            if (!this->fp)
+            {
+                fprintf(stderr, "Failed to open file %s\n", filename);
+                exit(1);
+            }
+
+            fseek(this->fp, 0, SEEK_END);
+            this->file_size = ftell(this->fp);
+            fseek(this->fp, 0, SEEK_SET);
+        }
+
+        // Each slot holds the distances followed by the odometry and the per-mille progress
+        this->queue = scan_queue_create(capacity, SCAN_SIZE+3, SCAN_QUEUE_BACKPRESSURE);
+        this->values = new int [SCAN_SIZE+3];
+
+        this->finished = false;
+        this->stopping = false;
+
+        pthread_create(&this->thread, NULL, run, this);
+    }
+
+    ~MinesStream(void)
+    {
+        __atomic_store_n(&this->stopping, true, __ATOMIC_RELEASE);
+
+        pthread_join(this->thread, NULL);
+
+        scan_queue_free(this->queue);
+        scanlog_close(this->scanlog);
+
+        if (this->fp)
+        {
+            fclose(this->fp);
+        }
+
+        delete[] this->values;
+    }
+
+    // Waits for the next scan; returns false at the end of the log
+    bool next(void)
+    {
+        while (true)
+        {
+            // Check for the end before popping, so that no scan published before it is missed
+            bool finished = __atomic_load_n(&this->finished, __ATOMIC_ACQUIRE);
+
+            scan_queue_info_t info;
+
+            if (scan_queue_pop(this->queue, this->values, &info) >= 0)
+            {
+                this->current_odometry[0] = info.timestamp_usec;
+                this->current_odometry[1] = this->values[SCAN_SIZE];
+                this->current_odometry[2] = this->values[SCAN_SIZE+1];
+
+                return true;
+            }
+
+            if (finished)
+            {
+                return false;
+            }
+
+            scan_queue_wait(this->queue, EMPTY_WAIT_USEC);
+        }
+    }
+
+    // The current scan and its timestamp and odometry; valid until the next call to next()
+    int * scan(void)
+    {
+        return this->values;
+    }
+
+    long * odometry(void)
+    {
+        return this->current_odometry;
+    }
+
+    // How far through the file the current scan is, in tenths of a percent
+    int permille(void)
+    {
+        return this->values[SCAN_SIZE+2];
+    }
+
+private:
+
+    static const int STREAM_CAPACITY  = 32;
+    static const int EMPTY_WAIT_USEC  = 100;
+    static const int FULL_WAIT_USEC   = 1000;
+
+    FILE * fp;
+    long file_size;
+    scanlog_t * scanlog;
+
+    scan_queue_t * queue;
+    int * values;
+    long current_odometry[3];
+
+    pthread_t thread;
+    bool finished;
+    bool stopping;
+
+    // Waits for a free slot; returns NULL if the caller is going away
+    int * acquire(void)
+    {
+        int * slot = NULL;
+
+        while (!(slot = scan_queue_acquire(this->queue)))
+        {
+            if (__atomic_load_n(&this->stopping, __ATOMIC_ACQUIRE))
+            {
+                return NULL;
+            }
+
+            usleep(FULL_WAIT_USEC);
+        }
+
+        return slot;
+    }
+
+    static void * run(void * arg)
+    {
+        MinesStream * stream = (MinesStream *)arg;
+
+        if (stream->scanlog)
+        {
+            stream->read_scanlog();
+        }
+        else
+        {
+            stream->read_dat();
+        }
+
+        __atomic_store_n(&stream->finished, true, __ATOMIC_RELEASE);
+
+        return NULL;
+    }
+
+    void read_dat(void)
+    {
+        char s[MAXLINE];
+        long odometry[3];
+
+        while (fgets(s, MAXLINE, this->fp))
+        {
+            int * slot = this->acquire();
+
+            if (!slot)
+            {
+                return;
+            }
+
+            parse_line(s, slot, odometry);
+
+            slot[SCAN_SIZE]   = odometry[1];
+            slot[SCAN_SIZE+1] = odometry[2];
+            slot[SCAN_SIZE+2] = (int)(1000. * ftell(this->fp) / this->file_size);
+
+            scan_queue_publish(this->queue, SCAN_SIZE+3, odometry[0], 0);
+        }
+    }
+
+    // Copying out of the mapping also pages the file in ahead of the caller
+    void read_scanlog(void)
+    {
+        int count = scanlog_count(this->scanlog);
+
+        for (int k=0; k<count; ++k)
+        {
+            int * slot = this->acquire();
+
+            if (!slot)
+            {
+                return;
+            }
+
+            const int32_t * odometry = scanlog_odometry(this->scanlog, k);
+
+            memcpy(slot, scanlog_scan(this->scanlog, k), SCAN_SIZE*sizeof(int));
+
+            slot[SCAN_SIZE]   = odometry[0];
+            slot[SCAN_SIZE+1] = odometry[1];
+            slot[SCAN_SIZE+2] = (int)(1000. * (k+1) / count);
+
+            scan_queue_publish(this->queue, SCAN_SIZE+3, scanlog_timestamp_usec(this->scanlog, k), 0);
+        }
+    }
+};
+
+// Class for Mines verison of URG-04LX Lidar -----------------------------------
+
+class MinesURG04LX : public URG04LX
+{
+    
+public:
+    
+    MinesURG04LX(void): URG04LX(
+        70,          // detectionMargin
+        145)         // offsetMillimeters
+    {
+    }
+};
+
+// Class for MinesRover custom robot -------------------------------------------
+
+class Rover : WheeledRobot
+{
+    
+public:
+    
+    Rover() : WheeledRobot(
+         77,     // wheelRadiusMillimeters
+        165)     // halfAxleLengthMillimeters
+    {
+    }
+    
+    Velocities computeVelocities(long * odometry)
+    {  
+        return WheeledRobot::computeVelocities(
+            odometry[0], 
+            odometry[1], 
+            odometry[2]);
+    }
+
+protected:    
+    
+    void extractOdometry(
+        double timestamp, 
+        double leftWheelOdometry, 
+        double rightWheelOdometry, 
+        double & timestampSeconds, 
+        double & leftWheelDegrees, 
+        double & rightWheelDegrees)
+    {        
+        // Convert microseconds to seconds, ticks to angles        
+        timestampSeconds = timestamp / 1e6;
+        leftWheelDegrees = ticksToDegrees(leftWheelOdometry);
+        rightWheelDegrees = ticksToDegrees(rightWheelOdometry);
+    }
+    
+    void descriptorString(char * str)
+    {
+        sprintf(str, "ticks_per_cycle=%d", this->TICKS_PER_CYCLE);
+    }
+        
+private:
+    
+    double ticksToDegrees(double ticks)
+    {
+        return ticks * (180. / this->TICKS_PER_CYCLE);
+    }
+    
+    static const int TICKS_PER_CYCLE = 2000;
+};
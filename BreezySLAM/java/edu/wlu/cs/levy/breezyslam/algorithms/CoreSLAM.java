@@ -26,6 +26,9 @@ import edu.wlu.cs.levy.breezyslam.components.Velocities;
 import edu.wlu.cs.levy.breezyslam.components.Map;
 import edu.wlu.cs.levy.breezyslam.components.Scan;
 
+import java.nio.ByteBuffer;
+import java.nio.ShortBuffer;
+
 /**
 *    CoreSLAM is an abstract class that uses the classes Position, Map, Scan, and Laser
 *    to run variants of the simple CoreSLAM (tinySLAM) algorithm described in 
@@ -69,6 +72,8 @@ public abstract class CoreSLAM {
     protected Scan scan_for_mapbuild;
     protected Scan scan_for_distance;
 
+    protected SLAMStats stats = new SLAMStats();
+
     public CoreSLAM(Laser laser, int map_size_pixels, double map_size_meters)
     {
         // Set default params
@@ -98,9 +103,15 @@ public abstract class CoreSLAM {
 
     public void update(int [] scan_mm, Velocities velocities)
     {             
+        // Start a fresh set of counters for getStats()
+        this.stats.reset();
+        long start_nsec = System.nanoTime();
+
         // Build a scan for computing distance to map, and one for updating map
         this.scan_update(this.scan_for_mapbuild, scan_mm);
         this.scan_update(this.scan_for_distance, scan_mm);
+
+        this.stats.scan_update_nsec = System.nanoTime() - start_nsec;
         
         // Update velocities
         this.velocities.update(velocities.getDxyMm(), velocities.getDthetaDegrees(),  velocities.getDtSeconds());
@@ -125,9 +136,36 @@ public abstract class CoreSLAM {
 
     protected abstract void updateMapAndPointcloud(Velocities velocities);
 
+    /**
+    * Returns the counters for the most recent update.  The object is reused by the next update.
+    * @return a SLAMStats object
+    */
+    public SLAMStats getStats()
+    {
+        return this.stats;
+    }
+
     public void getmap(byte [] mapbytes)
     {
         this.map.get(mapbytes);
     }
 
+    /**
+    * Puts the current map into a direct ByteBuffer of at least map_size_pixels ^ 2 bytes, which 
+    * can be reused from one call to the next without any Java-heap copy.
+    * @param mapbytes direct byte buffer that gets the map values
+    */
+    public void getmap(ByteBuffer mapbytes)
+    {
+        this.map.get(mapbytes);
+    }
+
+    /**
+    * Returns a read-only view of the current map's 16-bit pixels without copying; see Map.getPixels().
+    */
+    public ShortBuffer getmapview()
+    {
+        return this.map.getPixels();
+    }
+
 }
@@ -44,7 +44,8 @@ public class RMHCSLAM extends SinglePositionSLAM
         Scan scan,
         double sigma_xy_mm,
         double sigma_theta_degrees,
-        int max_search_iter);
+        int max_search_iter,
+        SLAMStats stats);
 
 
     private long native_ptr;
@@ -95,7 +96,8 @@ public class RMHCSLAM extends SinglePositionSLAM
             this.scan_for_distance,
             this.sigma_xy_mm,
             this.sigma_theta_degrees,
-            this.max_search_iter);    
+            this.max_search_iter,
+            this.stats);    
 
         return newpos;
     }
@@ -0,0 +1,81 @@
+/**
+*
+* SLAMStats.java Java class for search and map-update counters in BreezySLAM
+*
+* Copyright (C) 2014 Simon D. Levy
+
+* This code is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as 
+* published by the Free Software Foundation, either version 3 of the 
+* License, or (at your option) any later version.
+* 
+* This code is distributed in the hope that it will be useful,     
+* but WITHOUT ANY WARRANTY without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU Lesser General Public License 
+* along with this code.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+package edu.wlu.cs.levy.breezyslam.algorithms;
+
+/**
+*    SLAMStats holds counters for the most recent call to CoreSLAM.update().  The stage
+*    timings are always kept; the search counters are filled in only when the native
+*    library was built with STATS_FLAGS=-DBREEZYSLAM_STATS, and are zero otherwise.
+*/
+public class SLAMStats {
+
+    /**
+    * Candidate positions scored against the map during position search
+    */
+    public long candidates_evaluated;
+
+    /**
+    * Candidates that improved on the best position so far
+    */
+    public long accepted_moves;
+
+    /**
+    * Times the search halved its standard deviations after repeated failures
+    */
+    public long sigma_halvings;
+
+    /**
+    * Scan points looked up in the map while scoring candidates
+    */
+    public long points_scored;
+
+    /**
+    * Scan points that fell outside the map and were skipped
+    */
+    public long points_out_of_map;
+
+    /**
+    * Nanoseconds spent building the scans
+    */
+    public long scan_update_nsec;
+
+    /**
+    * Nanoseconds spent searching for the new position
+    */
+    public long search_nsec;
+
+    /**
+    * Nanoseconds spent integrating the scan into the map
+    */
+    public long map_update_nsec;
+
+    void reset()
+    {
+        this.candidates_evaluated = 0;
+        this.accepted_moves = 0;
+        this.sigma_halvings = 0;
+        this.points_scored = 0;
+        this.points_out_of_map = 0;
+        this.scan_update_nsec = 0;
+        this.search_nsec = 0;
+        this.map_update_nsec = 0;
+    }
+}
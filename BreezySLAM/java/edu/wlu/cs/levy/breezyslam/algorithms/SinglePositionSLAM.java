@@ -31,6 +31,13 @@ import edu.wlu.cs.levy.breezyslam.components.Laser;
 
 public abstract class SinglePositionSLAM extends CoreSLAM
 {
+	static 
+    {
+		System.loadLibrary("jnibreezyslam_algorithms");
+	}
+
+    private native void updateMany(int [] scans_mm, double [] velocities, double [] state, double [] trajectory);
+
     /**
     * Returns the current position.
     * @return the current position as a Position object.
@@ -55,6 +62,44 @@ public abstract class SinglePositionSLAM extends CoreSLAM
     }
     
     
+    /**
+    * Updates with a batch of scans at once, with the same result as calling update() on each in turn,
+    * but running natively, with one scan at a time copied in from scans_mm.
+    * @param scans_mm Lidar scans one after another, each with the <tt>scan_size</tt> of the Laser
+    * object passed to the constructor
+    * @param velocities (dxy_mm, dtheta_degrees, dt_seconds) for each scan one after another, or null 
+    * for no odometry
+    * @return x_mm, y_mm, theta_degrees after each scan one after another
+    * @throws IllegalStateException if getNewPosition() comes from a class other than RMHCSLAM or 
+    * DeterministicSLAM, since the native search could not match it
+    */
+    public double [] updateMany(int [] scans_mm, double [] velocities)
+    {
+        // The native search stands in for getNewPosition(), so only works for the classes it copies
+        Class<?> searchClass = this.getNewPositionClass();
+        if (searchClass != RMHCSLAM.class && searchClass != DeterministicSLAM.class)
+        {
+            throw new IllegalStateException(this.getClass().getName() + 
+                " overrides getNewPosition(), so updateMany() cannot run its search natively");
+        }
+
+        // Start a fresh set of counters for getStats()
+        this.stats.reset();
+
+        double [] state = {this.position.x_mm, this.position.y_mm, this.position.theta_degrees, 
+                           this.velocities.getDxyMm(), this.velocities.getDthetaDegrees()};
+
+        double [] trajectory = new double [3 * (scans_mm.length / this.laser.getScanSize())];
+
+        this.updateMany(scans_mm, velocities, state, trajectory);
+
+        this.position = new Position(state[0], state[1], state[2]);
+
+        this.velocities.update(state[3], state[4], 1);
+
+        return trajectory;
+    }
+    
     /**
     * Updates the map and point-cloud (particle cloud). Called automatically by CoreSLAM::update()
     * @param velocities velocities for odometry
@@ -74,10 +119,14 @@ public abstract class SinglePositionSLAM extends CoreSLAM
         start_pos.y_mm += this.laser.getOffsetMm() * this.sintheta();
         
         // Get new position from implementing class
+        long start_nsec = System.nanoTime();
         Position new_position = this.getNewPosition(start_pos);
+        this.stats.search_nsec = System.nanoTime() - start_nsec;
              
         // Update the map with this new position
+        start_nsec = System.nanoTime();
         this.map.update(this.scan_for_mapbuild, new_position, this.map_quality, this.hole_width_mm);
+        this.stats.map_update_nsec = System.nanoTime() - start_nsec;
        
         // Update the current position with this new position, adjusted by laser offset
         this.position = new Position(new_position);
@@ -91,7 +140,25 @@ public abstract class SinglePositionSLAM extends CoreSLAM
     * @param start_pos the starting position
     */
 
-    protected abstract Position getNewPosition(Position start_pos);    
+    protected abstract Position getNewPosition(Position start_pos);
+
+    // Returns the class whose getNewPosition() this object runs
+    private Class<?> getNewPositionClass()
+    {
+        for (Class<?> c = this.getClass(); c != null; c = c.getSuperclass())
+        {
+            try
+            {
+                c.getDeclaredMethod("getNewPosition", Position.class);
+                return c;
+            }
+            catch (NoSuchMethodException e)
+            {
+            }
+        }
+
+        return null;
+    }    
     
     private Position position;
        
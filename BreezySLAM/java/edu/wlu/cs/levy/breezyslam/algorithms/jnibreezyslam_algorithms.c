@@ -22,6 +22,15 @@
 #include "../jni_utils.h"
 
 #include <jni.h>
+#include <string.h>
+#include <math.h>
+
+static void add_long_field(JNIEnv *env, jobject object, const char * fieldname, unsigned long long value)
+{
+    jfieldID fid = get_fid(env, object, fieldname, "J");
+
+    (*env)->SetLongField(env, object, fid, (*env)->GetLongField(env, object, fid) + value);
+}
 
 
 // RMHC_SLAM methods -----------------------------------------------------------------------------------------
@@ -37,7 +46,8 @@ JNIEXPORT jobject JNICALL Java_edu_wlu_cs_levy_breezyslam_algorithms_RMHCSLAM_po
         jobject scan_object,
         jdouble sigma_xy_mm,
         jdouble sigma_theta_degrees,
-        jint max_search_iter)
+        jint max_search_iter,
+        jobject stats_object)
 {
     position_t startpos;
 
@@ -47,6 +57,10 @@ JNIEXPORT jobject JNICALL Java_edu_wlu_cs_levy_breezyslam_algorithms_RMHCSLAM_po
 
     void * random = ptr_from_obj(env, thisobject);
 
+    slam_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    slam_stats_collect(&stats);
+
     position_t newpos =  
     rmhc_position_search(
             startpos,
@@ -57,6 +71,17 @@ JNIEXPORT jobject JNICALL Java_edu_wlu_cs_levy_breezyslam_algorithms_RMHCSLAM_po
             max_search_iter, 
             random);
 
+    slam_stats_collect(NULL);
+
+    if (slam_stats_enabled())
+    {
+        add_long_field(env, stats_object, "candidates_evaluated", stats.candidates_evaluated);
+        add_long_field(env, stats_object, "accepted_moves",       stats.accepted_moves);
+        add_long_field(env, stats_object, "sigma_halvings",       stats.sigma_halvings);
+        add_long_field(env, stats_object, "points_scored",        stats.points_scored);
+        add_long_field(env, stats_object, "points_out_of_map",    stats.points_out_of_map);
+    }
+
     jclass cls = (*env)->FindClass(env, "edu/wlu/cs/levy/breezyslam/components/Position");
 
     jmethodID constructor = (*env)->GetMethodID(env, cls, "<init>", "(DDD)V");
@@ -65,3 +90,191 @@ JNIEXPORT jobject JNICALL Java_edu_wlu_cs_levy_breezyslam_algorithms_RMHCSLAM_po
 
     return newpos_object;
 } 
+
+// SinglePositionSLAM methods --------------------------------------------------------------------------------
+
+static jobject get_object_field(JNIEnv *env, jobject object, const char * fieldname, const char * fieldsig)
+{
+    return (*env)->GetObjectField(env, object, get_fid(env, object, fieldname, fieldsig));
+}
+
+// java.lang.Math, so that updateMany() computes the same poses as update() does in Java
+typedef struct java_math_t
+{
+    JNIEnv * env;
+    jclass cls;
+    jmethodID toRadians;
+    jmethodID cos;
+    jmethodID sin;
+
+} java_math_t;
+
+static void java_math_init(JNIEnv *env, java_math_t * math)
+{
+    math->env = env;
+    math->cls = (*env)->FindClass(env, "java/lang/Math");
+    math->toRadians = (*env)->GetStaticMethodID(env, math->cls, "toRadians", "(D)D");
+    math->cos = (*env)->GetStaticMethodID(env, math->cls, "cos", "(D)D");
+    math->sin = (*env)->GetStaticMethodID(env, math->cls, "sin", "(D)D");
+}
+
+static double java_math_call(java_math_t * math, jmethodID method, double x)
+{
+    return (*math->env)->CallStaticDoubleMethod(math->env, math->cls, method, x);
+}
+
+static double java_costheta(java_math_t * math, double theta_degrees)
+{
+    return java_math_call(math, math->cos, java_math_call(math, math->toRadians, theta_degrees));
+}
+
+static double java_sintheta(java_math_t * math, double theta_degrees)
+{
+    return java_math_call(math, math->sin, java_math_call(math, math->toRadians, theta_degrees));
+}
+
+JNIEXPORT void JNICALL Java_edu_wlu_cs_levy_breezyslam_algorithms_SinglePositionSLAM_updateMany (JNIEnv *env, jobject thisobject, 
+        jintArray scans_mm,
+        jdoubleArray velocities,
+        jdoubleArray state,
+        jdoubleArray trajectory)
+{
+    // Get everything we need from the object before starting the batch
+    map_t * map = cmap_from_jmap(env, 
+        get_object_field(env, thisobject, "map", "Ledu/wlu/cs/levy/breezyslam/components/Map;"));
+    scan_t * scan_for_mapbuild = cscan_from_jscan(env, 
+        get_object_field(env, thisobject, "scan_for_mapbuild", "Ledu/wlu/cs/levy/breezyslam/components/Scan;"));
+    scan_t * scan_for_distance = cscan_from_jscan(env, 
+        get_object_field(env, thisobject, "scan_for_distance", "Ledu/wlu/cs/levy/breezyslam/components/Scan;"));
+    double offset_mm = get_double_field(env, 
+        get_object_field(env, thisobject, "laser", "Ledu/wlu/cs/levy/breezyslam/components/Laser;"), "offset_mm");
+    double hole_width_mm = get_double_field(env, thisobject, "hole_width_mm");
+    int map_quality = (*env)->GetIntField(env, thisobject, get_fid(env, thisobject, "map_quality", "I"));
+
+    // RMHC search if this is an RMHCSLAM object; otherwise keep the search-start position, as
+    // DeterministicSLAM does (updateMany() in Java refuses any other getNewPosition())
+    void * random = NULL;
+    double sigma_xy_mm = 0;
+    double sigma_theta_degrees = 0;
+    int max_search_iter = 0;
+
+    if ((*env)->IsInstanceOf(env, thisobject, (*env)->FindClass(env, "edu/wlu/cs/levy/breezyslam/algorithms/RMHCSLAM")))
+    {
+        random = ptr_from_obj(env, thisobject);
+        sigma_xy_mm = get_double_field(env, thisobject, "sigma_xy_mm");
+        sigma_theta_degrees = get_double_field(env, thisobject, "sigma_theta_degrees");
+        max_search_iter = (*env)->GetIntField(env, thisobject, get_fid(env, thisobject, "max_search_iter", "I"));
+    }
+
+    int scan_size = scan_for_distance->size;
+    int nscans = (*env)->GetArrayLength(env, scans_mm) / scan_size;
+
+    if ((*env)->GetArrayLength(env, scans_mm) % scan_size ||
+        (velocities && (*env)->GetArrayLength(env, velocities) != 3 * nscans) ||
+        (*env)->GetArrayLength(env, state) != 5 ||
+        (*env)->GetArrayLength(env, trajectory) != 3 * nscans)
+    {
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/IllegalArgumentException"), 
+            "updateMany: array sizes do not match scan size");
+        return;
+    }
+
+    // Copy each scan in and its pose out, rather than pinning the arrays for the whole batch:
+    // the searches take seconds on a long log, and a critical section would hold off GC throughout
+    jint * lidar_mm = malloc(scan_size * sizeof(jint));
+    if (!lidar_mm)
+    {
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/OutOfMemoryError"), 
+            "updateMany: cannot allocate scan buffer");
+        return;
+    }
+
+    java_math_t math;
+    java_math_init(env, &math);
+
+    double state_c[5];
+    (*env)->GetDoubleArrayRegion(env, state, 0, 5, state_c);
+
+    slam_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    slam_stats_collect(&stats);
+
+    position_t position;
+    position.x_mm          = state_c[0];
+    position.y_mm          = state_c[1];
+    position.theta_degrees = state_c[2];
+    double dxy_mm          = state_c[3];
+    double dtheta_degrees  = state_c[4];
+
+    int k;
+    for (k=0; k<nscans; ++k)
+    {
+        (*env)->GetIntArrayRegion(env, scans_mm, k * scan_size, scan_size, lidar_mm);
+
+        // Build a scan for computing distance to map, and one for updating map, with the previous velocities
+        scan_update(scan_for_mapbuild, lidar_mm, hole_width_mm, dxy_mm, dtheta_degrees);
+        scan_update(scan_for_distance, lidar_mm, hole_width_mm, dxy_mm, dtheta_degrees);
+
+        // Odometry for this scan, as passed to CoreSLAM.update()
+        double odometry[3] = {0, 0, 0};
+        if (velocities)
+        {
+            (*env)->GetDoubleArrayRegion(env, velocities, 3*k, 3, odometry);
+        }
+
+        // Update velocities as Velocities.update() does
+        double velocity_factor = (odometry[2] > 0) ? (1 / odometry[2]) : 0;
+        dxy_mm = odometry[0] * velocity_factor;
+        dtheta_degrees = odometry[1] * velocity_factor;
+
+        // Start at current position, adding effect of odometry and offset from laser
+        double costheta = java_costheta(&math, position.theta_degrees);
+        double sintheta = java_sintheta(&math, position.theta_degrees);
+
+        position_t start_pos = position;
+        start_pos.x_mm += odometry[0] * costheta;
+        start_pos.y_mm += odometry[0] * sintheta;
+        start_pos.theta_degrees += odometry[1];
+        start_pos.x_mm += offset_mm * costheta;
+        start_pos.y_mm += offset_mm * sintheta;
+
+        // Get new position
+        position_t new_position = random ?
+            rmhc_position_search(start_pos, map, scan_for_distance, 
+                sigma_xy_mm, sigma_theta_degrees, max_search_iter, random) :
+            start_pos;
+
+        // Update the map with this new position
+        map_update(map, scan_for_mapbuild, new_position, map_quality, hole_width_mm);
+
+        // Update the current position with this new position, adjusted by laser offset
+        position = new_position;
+        position.x_mm -= offset_mm * java_costheta(&math, position.theta_degrees);
+        position.y_mm -= offset_mm * java_sintheta(&math, position.theta_degrees);
+
+        double pose[3] = {position.x_mm, position.y_mm, position.theta_degrees};
+        (*env)->SetDoubleArrayRegion(env, trajectory, 3*k, 3, pose);
+    }
+
+    slam_stats_collect(NULL);
+
+    free(lidar_mm);
+
+    state_c[0] = position.x_mm;
+    state_c[1] = position.y_mm;
+    state_c[2] = position.theta_degrees;
+    state_c[3] = dxy_mm;
+    state_c[4] = dtheta_degrees;
+    (*env)->SetDoubleArrayRegion(env, state, 0, 5, state_c);
+
+    if (slam_stats_enabled())
+    {
+        jobject stats_object = get_object_field(env, thisobject, "stats", "Ledu/wlu/cs/levy/breezyslam/algorithms/SLAMStats;");
+
+        add_long_field(env, stats_object, "candidates_evaluated", stats.candidates_evaluated);
+        add_long_field(env, stats_object, "accepted_moves",       stats.accepted_moves);
+        add_long_field(env, stats_object, "sigma_halvings",       stats.sigma_halvings);
+        add_long_field(env, stats_object, "points_scored",        stats.points_scored);
+        add_long_field(env, stats_object, "points_out_of_map",    stats.points_out_of_map);
+    }
+}
@@ -105,4 +105,13 @@ public class Laser
      {
          return this.offset_mm;
      }
+
+    /**
+     * Returns the number of rays per scan.
+     *
+     */
+     public int getScanSize()
+     {
+         return this.scan_size;
+     }
 }
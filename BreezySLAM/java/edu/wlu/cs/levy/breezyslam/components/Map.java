@@ -22,6 +22,10 @@
 
 package edu.wlu.cs.levy.breezyslam.components;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.ShortBuffer;
+
 /**
 * A class for maps used in SLAM.
 */
@@ -44,8 +48,14 @@ public class Map
             int quality, 
             double hole_width_mm);
         
+    private native void getBuffer(ByteBuffer bytes);
+
+    private native ByteBuffer pixels();
+
     private long native_ptr;
 
+    private ShortBuffer pixels_view;
+
     /**
      * Returns a string representation of this Map object.
      */
@@ -61,6 +71,9 @@ public class Map
     {
         this.init(size_pixels, size_meters);
 
+        // View of the native pixels, which live as long as this object
+        this.pixels_view = this.pixels().order(ByteOrder.nativeOrder()).asShortBuffer().asReadOnlyBuffer();
+
         // for public accessor
         this.size_meters = size_meters;
     }
@@ -72,6 +85,31 @@ public class Map
      */
     public native void get(byte [] bytes);
 
+    /**
+     * Puts current map values into a direct ByteBuffer of at least map_size_pixels ^ 2 bytes, 
+     * without going through a Java array.  
+     * @param bytes direct byte buffer that gets the map values
+     */
+    public void get(ByteBuffer bytes)
+    {
+        if (!bytes.isDirect() || bytes.capacity() < this.pixels_view.capacity())
+        {
+            throw new IllegalArgumentException("Map.get() needs a direct buffer of map_size_pixels ^ 2 bytes");
+        }
+
+        this.getBuffer(bytes);
+    }
+
+    /**
+     * Returns a read-only view of the current map's 16-bit pixels, row by row, without copying.
+     * The high byte of each pixel is what get() copies out; the view follows the map as it is
+     * updated.  Read pixels as unsigned: <tt>getPixels().get(k) &amp; 0xFFFF</tt>.
+     */
+    public ShortBuffer getPixels()
+    {
+        return this.pixels_view.duplicate();
+    }
+
     /**
      * Updates this map object based on new data.
      * @param scan a new scan
@@ -22,6 +22,11 @@
 
 package edu.wlu.cs.levy.breezyslam.components;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.DoubleBuffer;
+import java.nio.IntBuffer;
+
 /**
 * A class for Lidar scans.
 */
@@ -41,8 +46,18 @@ public class Scan
             int detection_margin,
             double offset_mm);
  
+    private native void updateBuffer(
+            IntBuffer lidar_mm,
+            double hole_width_mm,
+            double velocities_dxy_mm,
+            double velocities_dtheta_degrees);
+
+    private native ByteBuffer points(int which);
+
     private long native_ptr;
 
+    private int scan_size;
+
     public native String toString();
 
     /**
@@ -70,6 +85,8 @@ public class Scan
             laser.distance_no_detection_mm,    
             laser.detection_margin,               
             laser.offset_mm);
+
+        this.scan_size = laser.scan_size;
     }
 
     /**
@@ -93,5 +110,55 @@ public class Scan
     {
         this.update(scanvals_mm, hole_width_millimeters, velocities.dxy_mm, velocities.dtheta_degrees);
     }
+
+    /**
+    * Updates this Scan object with new values from a Lidar scan held in a direct buffer, e.g. from
+    * <tt>ByteBuffer.allocateDirect(4*scan_size).order(ByteOrder.nativeOrder()).asIntBuffer()</tt>,
+    * which is read in place.
+    * @param scanvals_mm scanned Lidar distance values in millimeters
+    * @param hole_width_millimeters hole width in millimeters
+    * @param velocities forward velocity and angular velocity of robot at scan time
+    * 
+    */
+    public void update(IntBuffer scanvals_mm, double hole_width_millimeters, Velocities velocities) 
+    {
+        if (!scanvals_mm.isDirect() || scanvals_mm.order() != ByteOrder.nativeOrder() || 
+             scanvals_mm.capacity() < this.scan_size)
+        {
+            throw new IllegalArgumentException("Scan.update() needs a direct native-order buffer of scan_size ints");
+        }
+
+        this.updateBuffer(scanvals_mm, hole_width_millimeters, velocities.dxy_mm, velocities.dtheta_degrees);
+    }
+
+    /**
+    * Returns the number of points in this scan after the most recent update; the first npoints()
+    * elements of getXMm(), getYMm(), and getValues() are valid.
+    */
+    public native int npoints();
+
+    /**
+    * Returns a read-only view of the X coordinates in millimeters of this scan's points, without copying.
+    */
+    public DoubleBuffer getXMm()
+    {
+        return this.points(0).order(ByteOrder.nativeOrder()).asDoubleBuffer().asReadOnlyBuffer();
+    }
+
+    /**
+    * Returns a read-only view of the Y coordinates in millimeters of this scan's points, without copying.
+    */
+    public DoubleBuffer getYMm()
+    {
+        return this.points(1).order(ByteOrder.nativeOrder()).asDoubleBuffer().asReadOnlyBuffer();
+    }
+
+    /**
+    * Returns a read-only view of this scan's point values (obstacle or free), without copying.
+    */
+    public IntBuffer getValues()
+    {
+        return this.points(2).order(ByteOrder.nativeOrder()).asIntBuffer().asReadOnlyBuffer();
+    }
 }
 
@@ -51,11 +51,27 @@ JNIEXPORT void JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Map_get (JNIEn
 {
     map_t * map = cmap_from_jmap(env, thisobject);
 
-    jbyte * ptr = (*env)->GetByteArrayElements(env, bytes, NULL);
+    // Write straight into the Java array rather than into a copy of it
+    jbyte * ptr = (*env)->GetPrimitiveArrayCritical(env, bytes, NULL);
 
-    map_get(map, ptr);
+    map_get(map, (char *)ptr);
 
-    (*env)->ReleaseByteArrayElements(env, bytes, ptr, 0);
+    (*env)->ReleasePrimitiveArrayCritical(env, bytes, ptr, 0);
+}
+
+JNIEXPORT void JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Map_getBuffer (JNIEnv *env, jobject thisobject, jobject bytes)
+{
+    map_t * map = cmap_from_jmap(env, thisobject);
+
+    map_get(map, (char *)(*env)->GetDirectBufferAddress(env, bytes));
+}
+
+JNIEXPORT jobject JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Map_pixels (JNIEnv *env, jobject thisobject)
+{
+    map_t * map = cmap_from_jmap(env, thisobject);
+
+    return (*env)->NewDirectByteBuffer(env, map->pixels, 
+            (jlong)map->size_pixels * map->size_pixels * sizeof(pixel_t));
 }
 
 JNIEXPORT void JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Map_update (JNIEnv *env, jobject thisobject, 
@@ -124,9 +140,45 @@ JNIEXPORT void JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Scan_update (J
 {
     scan_t * scan = cscan_from_jscan(env, thisobject);
 
-    jint * lidar_mm_c = (*env)->GetIntArrayElements(env, lidar_mm, 0);
+    // Read the Java array in place; scan_update() makes no JNI calls
+    jint * lidar_mm_c = (*env)->GetPrimitiveArrayCritical(env, lidar_mm, 0);
 
     scan_update(scan, lidar_mm_c, hole_width_mm, velocities_dxy_mm, velocities_dtheta_degrees);
 
-    (*env)->ReleaseIntArrayElements(env, lidar_mm, lidar_mm_c, 0);
+    (*env)->ReleasePrimitiveArrayCritical(env, lidar_mm, lidar_mm_c, JNI_ABORT);
+}
+
+JNIEXPORT void JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Scan_updateBuffer (JNIEnv *env, jobject thisobject, 
+                            jobject lidar_mm,
+                            jdouble hole_width_mm,
+                            jdouble velocities_dxy_mm,
+                            jdouble velocities_dtheta_degrees)
+{
+    scan_t * scan = cscan_from_jscan(env, thisobject);
+
+    scan_update(scan, (int *)(*env)->GetDirectBufferAddress(env, lidar_mm), 
+            hole_width_mm, velocities_dxy_mm, velocities_dtheta_degrees);
+}
+
+JNIEXPORT jobject JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Scan_points (JNIEnv *env, jobject thisobject, jint which)
+{
+    scan_t * scan = cscan_from_jscan(env, thisobject);
+
+    // The point arrays as allocated, which scan_update_angles() may have grown past size * span
+    jlong capacity = scan->capacity;
+
+    switch (which)
+    {
+        case 0:
+            return (*env)->NewDirectByteBuffer(env, scan->x_mm, capacity * sizeof(double));
+        case 1:
+            return (*env)->NewDirectByteBuffer(env, scan->y_mm, capacity * sizeof(double));
+        default:
+            return (*env)->NewDirectByteBuffer(env, scan->value, capacity * sizeof(int));
+    }
+}
+
+JNIEXPORT jint JNICALL Java_edu_wlu_cs_levy_breezyslam_components_Scan_npoints (JNIEnv *env, jobject thisobject)
+{
+    return cscan_from_jscan(env, thisobject)->npoints;
 }
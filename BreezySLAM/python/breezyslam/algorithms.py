@@ -26,6 +26,7 @@ import pybreezyslam
 
 import math
 import time
+from array import array
 
 # Basic params
 _DEFAULT_MAP_QUALITY         = 50 # out of 255
@@ -36,6 +37,12 @@ _DEFAULT_SIGMA_XY_MM         = 100
 _DEFAULT_SIGMA_THETA_DEGREES = 20
 _DEFAULT_MAX_SEARCH_ITER     = 1000
 
+def _defining_class(obj, name):
+    '''
+    Returns the class in obj's method resolution order that defines attribute name, or object if none does
+    '''
+    return next((cls for cls in type(obj).__mro__ if name in cls.__dict__), object)
+
 # CoreSLAM class ------------------------------------------------------------------------------------------------------
 
 class CoreSLAM(object):
@@ -90,20 +97,27 @@ class CoreSLAM(object):
         # Initialize the map 
         self.map = pybreezyslam.Map(map_size_pixels, map_size_meters)
                 
-    def update(self, scans_mm, velocities, should_update_map=True):
+    def update(self, scans_mm, velocities, should_update_map=True, scan_angles_degrees=None):
         '''
         Updates the scan and odometry, and calls the the implementing class's _updateMapAndPointcloud method with
         the specified velocities.
          
         scan_mm is a list of Lidar scan values, whose count is specified in the scan_size 
-        attribute of the Laser object passed to the CoreSlam constructor
+        attribute of the Laser object passed to the CoreSlam constructor; an array.array('i') or
+        other buffer of C ints is used without copying, and the GIL is released while SLAM runs
         velocities is a tuple of velocities (dxy_mm, dtheta_degrees, dt_seconds) for odometry
         should_update_map flags for whether you want to update the map
+        scan_angles_degrees is an optional list or buffer of the angle of each of scans_mm, counterclockwise 
+        from straight ahead, for Lidars whose samples are not evenly spaced; scans_mm may then have any
+        count, and is used at these angles rather than binned into scan_size rays
         '''
 
+        # Start a fresh set of counters for getStats()
+        pybreezyslam.resetStats()
+
         # Build a scan for computing distance to map, and one for updating map 
-        self._scan_update(self.scan_for_mapbuild, scans_mm)
-        self._scan_update(self.scan_for_distance, scans_mm)
+        self._scan_update(self.scan_for_mapbuild, scans_mm, scan_angles_degrees)
+        self._scan_update(self.scan_for_distance, scans_mm, scan_angles_degrees)
 
         # Update velocities
         velocity_factor = (1 / velocities[2])  if (velocities[2] > 0) else 0
@@ -114,13 +128,38 @@ class CoreSLAM(object):
         # Implementing class updates map and pointcloud
         self._updateMapAndPointcloud(self.velocities, should_update_map)
         
+    def getStats(self):
+        '''
+        Returns a dictionary of counters for the most recent update: candidate positions evaluated,
+        accepted moves, sigma halvings, scan points scored and out of map, map pixels written, and
+        nanoseconds spent in scan update, position search, and map update.  The counters are all zero 
+        unless the extension was built with BREEZYSLAM_STATS set in the environment.
+        '''
+        return pybreezyslam.getStats()
+        
     def getmap(self, mapbytes):
         '''
         Fills bytearray mapbytes with current map pixels, where bytearray length is square of map size passed
-        to CoreSLAM.__init__().
+        to CoreSLAM.__init__().  Any writable buffer of that length will do.
         '''
         self.map.get(mapbytes)
         
+    def getmapview(self):
+        '''
+        Returns a read-only memoryview of the current map's 16-bit pixels, rows by columns, without copying; 
+        the high byte of each is what getmap() copies out.  The view follows the map as it is updated.
+        '''
+        return memoryview(self.map)
+        
+        
+    def savemap(self, filename, trajectory=None, tile_size=0):
+        '''
+        Saves current map as a PNG file, or a binary PGM file if filename ends in .pgm, without copying
+        it out first.  trajectory is an optional list of (x_mm, y_mm) positions to draw in black.  If
+        tile_size is positive, saves the map as tiles of that size plus an index file; e.g., map.png
+        becomes map-0-0.png, map-0-1.png, ..., and map.tiles.
+        '''
+        self.map.save(filename, trajectory, tile_size)
         
     def setmap(self, mapbytes):
         '''
@@ -139,9 +178,10 @@ class CoreSLAM(object):
          return self.__str__()
 
         
-    def _scan_update(self, scan, lidar):
+    def _scan_update(self, scan, lidar, scan_angles_degrees=None):
         
-        scan.update(scans_mm=lidar, hole_width_mm=self.hole_width_mm, velocities=self.velocities)
+        scan.update(scans_mm=lidar, hole_width_mm=self.hole_width_mm, velocities=self.velocities, 
+                    scan_angles_degrees=scan_angles_degrees)
         
         
 # SinglePositionSLAM class ---------------------------------------------------------------------------------------------
@@ -201,6 +241,56 @@ class SinglePositionSLAM(CoreSLAM):
         Returns current position as a tuple (x_mm, y_mm, theta_degrees)
         '''
         return (self.position.x_mm, self.position.y_mm, self.position.theta_degrees)
+        
+    def update_many(self, scans_mm, velocities=None, should_update_map=True):
+        '''
+        Updates with a batch of scans at once, with the same result as calling update() on each in turn,
+        but running natively with the GIL released for the whole batch.
+        
+        scans_mm is a contiguous buffer of N scans one after another, each with the scan_size of the Laser
+        object passed to the constructor; e.g., an array.array('i') or a 2-D numpy array of int32.  
+        velocities is None, or a contiguous buffer of N (dxy_mm, dtheta_degrees, dt_seconds) tuples as 
+        doubles; e.g., an array.array('d').
+        Returns the trajectory as an array.array('d') of x_mm, y_mm, theta_degrees after each scan.
+        Raises NotImplementedError if the class overrides _getNewPosition() without also overriding
+        _search_args(), since the native search could not match it.
+        '''
+        
+        # The native search stands in for _getNewPosition(), so must come from a class that overrides it
+        if not issubclass(_defining_class(self, '_search_args'), _defining_class(self, '_getNewPosition')):
+            raise NotImplementedError('%s overrides _getNewPosition() but not _search_args(), so update_many() '
+                                      'cannot run its search natively' % type(self).__name__)
+
+        # Start a fresh set of counters for getStats()
+        pybreezyslam.resetStats()
+        
+        search = self._search_args() or (None, 0, 0, 0)
+        
+        trajectory, dxy_dtheta = pybreezyslam.updateMany(
+            self.position, 
+            self.map, 
+            self.scan_for_distance, 
+            self.scan_for_mapbuild,
+            scans_mm,
+            velocities,
+            self.laser.offset_mm,
+            self.hole_width_mm,
+            self.map_quality,
+            should_update_map,
+            self.velocities[:2],
+            *search)
+            
+        self.velocities = (dxy_dtheta[0], dxy_dtheta[1], 0)
+        
+        return array('d', bytes(trajectory))
+        
+    def _search_args(self):
+        '''
+        Returns (randomizer, sigma_xy_mm, sigma_theta_degrees, max_search_iter) for the native position search
+        run by update_many(), or None to keep the search-start position.  Classes whose _getNewPosition() 
+        neither search can match leave this unimplemented.
+        '''
+        raise NotImplementedError('%s has no native position search for update_many()' % type(self).__name__)
                 
         
     def _costheta(self):
@@ -254,13 +344,13 @@ class RMHC_SLAM(SinglePositionSLAM):
         self.sigma_theta_degrees = sigma_theta_degrees
         self.max_search_iter = max_search_iter
         
-    def update(self, scan_mm, velocities=None, should_update_map=True):
+    def update(self, scan_mm, velocities=None, should_update_map=True, scan_angles_degrees=None):
 
         if not velocities:
         
             velocities = (0, 0, 0)
     
-        CoreSLAM.update(self, scan_mm, velocities, should_update_map)   
+        CoreSLAM.update(self, scan_mm, velocities, should_update_map, scan_angles_degrees)   
     
     def _getNewPosition(self, start_position):
         '''
@@ -279,6 +369,10 @@ class RMHC_SLAM(SinglePositionSLAM):
             self.max_search_iter,
             self.randomizer)
                              
+    def _search_args(self):
+        
+        return (self.randomizer, self.sigma_xy_mm, self.sigma_theta_degrees, self.max_search_iter)
+                             
     def _random_normal(self, mu, sigma):
         
         return mu + self.randomizer.rnor() * sigma
@@ -312,4 +406,8 @@ class Deterministic_SLAM(SinglePositionSLAM):
         
         return start_position.copy()
         
+    def _search_args(self):
+        
+        return None
+        
   
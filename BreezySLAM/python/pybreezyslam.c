@@ -41,12 +41,167 @@ Change log:
 */
 
 #include <Python.h>
+#include <string.h>
+#include <math.h>
 #include <structmember.h>
 
 #include "../c/coreslam.h"
 #include "../c/random.h"
+#include "../c/mapexport.h"
 #include "pyextension_utils.h"
 
+// Instrumentation -------------------------------------------------------------
+
+// Counters for the current update, collected only when built with BREEZYSLAM_STATS.
+// Updates run with the GIL released, so each thread keeps its own.
+
+#ifdef BREEZYSLAM_STATS
+#include <time.h>
+#ifdef _MSC_VER
+static __declspec(thread) slam_stats_t stats;
+#else
+static __thread slam_stats_t stats;
+#endif
+static unsigned long long stats_now_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define STATS_BEGIN(t) unsigned long long t = stats_now_nsec(); slam_stats_collect(&stats)
+#define STATS_END(field, t) slam_stats_collect(NULL); stats.field += stats_now_nsec() - (t)
+#else
+static slam_stats_t stats;
+#define STATS_BEGIN(t)
+#define STATS_END(field, t)
+#endif
+
+// Buffer-protocol input --------------------------------------------------------
+
+// Returns the struct-module type code of a buffer holding native-order numbers, or 0
+static char buffer_typecode(Py_buffer * view)
+{
+    const char * format = view->format ? view->format : "B";
+
+    if (*format == '@' || *format == '=')
+    {
+        format++;
+    }
+
+    return (strlen(format) == 1 && strchr("bBhHiIlLqQfd", *format)) ? *format : 0;
+}
+
+// Copies n numbers of the given type code from a buffer to ints; safe without the GIL
+static void ints_from_buffer(const void * buf, char typecode, int * values, int n)
+{
+    int k;
+
+#define INTS_FROM(type) for (k=0; k<n; ++k) values[k] = (int)((const type *)buf)[k]; break
+
+    switch (typecode)
+    {
+        case 'b': INTS_FROM(signed char);
+        case 'B': INTS_FROM(unsigned char);
+        case 'h': INTS_FROM(short);
+        case 'H': INTS_FROM(unsigned short);
+        case 'i': INTS_FROM(int);
+        case 'I': INTS_FROM(unsigned int);
+        case 'l': INTS_FROM(long);
+        case 'L': INTS_FROM(unsigned long);
+        case 'q': INTS_FROM(long long);
+        case 'Q': INTS_FROM(unsigned long long);
+        case 'f': INTS_FROM(float);
+        case 'd': INTS_FROM(double);
+    }
+
+#undef INTS_FROM
+}
+
+// Copies n numbers of the given type code from a buffer to doubles; safe without the GIL
+static void doubles_from_buffer(const void * buf, char typecode, double * values, int n)
+{
+    int k;
+
+#define DOUBLES_FROM(type) for (k=0; k<n; ++k) values[k] = (double)((const type *)buf)[k]; break
+
+    switch (typecode)
+    {
+        case 'b': DOUBLES_FROM(signed char);
+        case 'B': DOUBLES_FROM(unsigned char);
+        case 'h': DOUBLES_FROM(short);
+        case 'H': DOUBLES_FROM(unsigned short);
+        case 'i': DOUBLES_FROM(int);
+        case 'I': DOUBLES_FROM(unsigned int);
+        case 'l': DOUBLES_FROM(long);
+        case 'L': DOUBLES_FROM(unsigned long);
+        case 'q': DOUBLES_FROM(long long);
+        case 'Q': DOUBLES_FROM(unsigned long long);
+        case 'f': DOUBLES_FROM(float);
+        case 'd': DOUBLES_FROM(double);
+    }
+
+#undef DOUBLES_FROM
+}
+
+// Gets a list's size, or a C-contiguous buffer of numbers and its type code.
+// Returns the number of values on success; otherwise raises an exception and returns -1.
+static Py_ssize_t get_numbers(PyObject * obj, Py_buffer * view, char * typecode, 
+    const char * classname, const char * methodname, const char * argname)
+{
+    char details[100];
+
+    *typecode = 0;
+
+    if (PyList_Check(obj))
+    {
+        return PyList_Size(obj);
+    }
+
+    if (!PyObject_CheckBuffer(obj) ||
+        PyObject_GetBuffer(obj, view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS))
+    {
+        PyErr_Clear();
+
+        sprintf(details, "%s must be a list or a contiguous buffer", argname);
+        return error_on_raise_argument_exception_with_details(classname, methodname, details);
+    }
+
+    if (!(*typecode = buffer_typecode(view)))
+    {
+        PyBuffer_Release(view);
+
+        sprintf(details, "%s buffer must hold native integers or floats", argname);
+        return error_on_raise_argument_exception_with_details(classname, methodname, details);
+    }
+
+    return view->len / view->itemsize;
+}
+
+// Gets a C-contiguous buffer of exactly nbytes bytes for reading, or writing if writable.
+// Returns 0 on success; otherwise raises an exception and returns -1.
+static int get_bytes_buffer(PyObject * obj, Py_buffer * view, Py_ssize_t nbytes, int writable,
+    const char * classname, const char * methodname)
+{
+    if (!PyObject_CheckBuffer(obj) || 
+        PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | (writable ? PyBUF_WRITABLE : 0)))
+    {
+        PyErr_Clear();
+
+        return error_on_raise_argument_exception_with_details(classname, methodname, 
+            writable ? "argument is not a writable buffer" : "argument is not a buffer");        
+    }
+
+    if (view->len != nbytes)
+    {        
+        PyBuffer_Release(view);
+
+        return error_on_raise_argument_exception_with_details(classname, methodname, 
+            "mapbytes are wrong size");
+    }
+
+    return 0;
+}
+
 // Position class  -------------------------------------------------------------
 
 typedef struct 
@@ -199,10 +354,29 @@ typedef struct
     PyObject_HEAD
     
     scan_t scan;
+
+    // Scan values copied from Python, and the angles they were taken at if given
     int * lidar_mm;
+    double * angles_degrees;
+    int capacity;
+
+    // Held while the scan is updated or read with the GIL released
+    PyThread_type_lock lock;
     
 } Scan;
 
+// Takes a Scan's, Map's or Randomizer's lock, releasing the GIL while waiting for it.  Functions 
+// that take more than one take them in the order Scan(s), Map, Randomizer.
+static void lock_acquire(PyThread_type_lock lock)
+{
+    if (!PyThread_acquire_lock(lock, NOWAIT_LOCK))
+    {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
 
 static void
 Scan_dealloc(Scan* self)
@@ -210,6 +384,12 @@ Scan_dealloc(Scan* self)
     scan_free(&self->scan);
     
     free(self->lidar_mm);
+    free(self->angles_degrees);
+
+    if (self->lock)
+    {
+        PyThread_free_lock(self->lock);
+    }
     
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
@@ -220,6 +400,12 @@ Scan_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     Scan *self;
     
     self = (Scan *)type->tp_alloc(type, 0);
+
+    if (self && !(self->lock = PyThread_allocate_lock()))
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
     
     return (PyObject *)self;
 }
@@ -267,6 +453,7 @@ Scan_init(Scan *self, PyObject *args, PyObject *kwds)
             offset_mm);
  
     self->lidar_mm = int_alloc(self->scan.size);
+    self->capacity = self->scan.size;
     
     return 0;
 }
@@ -291,68 +478,205 @@ Scan_update(Scan *self, PyObject *args, PyObject *kwds)
     PyObject * py_lidar = NULL;
     double hole_width_mm = 0;
     PyObject * py_velocities = NULL;
+    PyObject * py_angles = NULL;
 
-    static char* argnames[] = {"scans_mm", "hole_width_mm", "velocities", NULL};
+    static char* argnames[] = {"scans_mm", "hole_width_mm", "velocities", "scan_angles_degrees", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds,"Od|O", argnames,
+    if (!PyArg_ParseTupleAndKeywords(args, kwds,"Od|OO", argnames,
         &py_lidar, 
         &hole_width_mm,
-        &py_velocities))
+        &py_velocities,
+        &py_angles))
     {
         return null_on_raise_argument_exception("Scan", "update");
     }
 
-    // Bozo filter on LIDAR argument
-    if (!PyList_Check(py_lidar))
+    if (py_angles == Py_None)
+    {
+        py_angles = NULL;
+    }
+
+    // Bozo filter on LIDAR argument: a list, or a buffer of numbers such as an array
+    Py_buffer view;
+    char typecode = 0;
+
+    Py_ssize_t npoints = get_numbers(py_lidar, &view, &typecode, "Scan", "update", "lidar");
+
+    if (npoints < 0)
     {
-        return null_on_raise_argument_exception_with_details("Scan", "update", 
-            "lidar must be a list");
+        return NULL;
     }
+
+    // Bozo filter on angles argument, which must match the LIDAR argument in size
+    Py_buffer angles_view;
+    char angles_typecode = 0;
     
-    // Bozo filter on LIDAR argument list size
-    if (PyList_Size(py_lidar) != self->scan.size)
-    {        
-        return null_on_raise_argument_exception_with_details("Scan", "update", 
-            "lidar size mismatch");
+    Py_ssize_t nangles = py_angles ? 
+        get_numbers(py_angles, &angles_view, &angles_typecode, "Scan", "update", "scan angles") : 
+        self->scan.size;
+
+    if (nangles < 0)
+    {
+        if (typecode)
+        {
+            PyBuffer_Release(&view);
+        }
+
+        return NULL;
     }
+
+    const char * details = (npoints == nangles) ? NULL : 
+        py_angles ? "lidar and scan angles size mismatch" : "lidar size mismatch";
     
     // Default to no velocities
     double dxy_mm = 0;
     double dtheta_degrees = 0;
           
     // Bozo filter on velocities tuple
-    if (py_velocities)
+    if (!details && py_velocities)
     {
-        if (!PyTuple_Check(py_velocities))
+        if (!PyTuple_Check(py_velocities) ||
+            !double_from_tuple(py_velocities, 0, &dxy_mm) ||
+            !double_from_tuple(py_velocities, 1, &dtheta_degrees))
         {
-           return null_on_raise_argument_exception_with_details("Scan", "update", 
-                "velocities must be a tuple");    
+            details = PyTuple_Check(py_velocities) ? 
+                "velocities tuple must contain at least two numbers" : "velocities must be a tuple";
         }
-        
-        if (!double_from_tuple(py_velocities, 0, &dxy_mm) ||
-            !double_from_tuple(py_velocities, 1, &dtheta_degrees))
+    }
+
+    if (details)
+    {
+        if (typecode)
+        {
+            PyBuffer_Release(&view);
+        }
+
+        if (angles_typecode)
+        {
+            PyBuffer_Release(&angles_view);
+        }
+
+        return null_on_raise_argument_exception_with_details("Scan", "update", details);
+    }
+    
+    lock_acquire(self->lock);
+
+    // Make room for irregular scans of any size
+    if (npoints > self->capacity || (py_angles && !self->angles_degrees))
+    {
+        int capacity = npoints > self->capacity ? (int)npoints : self->capacity;
+
+        int * lidar_mm = (int *)realloc(self->lidar_mm, capacity * sizeof(int));
+        double * angles_degrees = lidar_mm ? 
+            (double *)realloc(self->angles_degrees, capacity * sizeof(double)) : NULL;
+
+        if (lidar_mm)
+        {
+            self->lidar_mm = lidar_mm;
+        }
+
+        if (!angles_degrees)
+        {
+            PyThread_release_lock(self->lock);
+
+            if (typecode)
             {
-                return null_on_raise_argument_exception_with_details("Scan", "update", 
-                    "velocities tuple must contain at least two numbers");    
-               
+                PyBuffer_Release(&view);
             }
+
+            if (angles_typecode)
+            {
+                PyBuffer_Release(&angles_view);
+            }
+
+            return PyErr_NoMemory();
+        }
+
+        self->angles_degrees = angles_degrees;
+        self->capacity = capacity;
     }
-    
 
-    // Extract LIDAR values from argument
+    // Extract LIDAR values and angles from lists; a buffer of ints or doubles is used in place
+    int * lidar_mm = self->lidar_mm;
+    double * angles_degrees = self->angles_degrees;
+
     int k = 0;
-    for (k=0; k<self->scan.size; ++k)
+
+    if (!typecode)
     {
-        self->lidar_mm[k] = PyFloat_AsDouble(PyList_GetItem(py_lidar, k));
+        for (k=0; k<npoints; ++k)
+        {
+            self->lidar_mm[k] = PyFloat_AsDouble(PyList_GetItem(py_lidar, k));
+        }
     }
-    
+    else if ((typecode == 'i' || (typecode == 'l' && sizeof(long) == sizeof(int))) && view.itemsize == sizeof(int))
+    {
+        lidar_mm = (int *)view.buf;
+    }
+
+    if (py_angles && !angles_typecode)
+    {
+        for (k=0; k<npoints; ++k)
+        {
+            self->angles_degrees[k] = PyFloat_AsDouble(PyList_GetItem(py_angles, k));
+        }
+    }
+    else if (angles_typecode == 'd')
+    {
+        angles_degrees = (double *)angles_view.buf;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+
+    if (lidar_mm == self->lidar_mm && typecode)
+    {
+        ints_from_buffer(view.buf, typecode, lidar_mm, (int)npoints);
+    }
+
+    if (angles_degrees == self->angles_degrees && angles_typecode)
+    {
+        doubles_from_buffer(angles_view.buf, angles_typecode, angles_degrees, (int)npoints);
+    }
+
     // Update the scan
-    scan_update(
-        &self->scan, 
-        self->lidar_mm, 
-        hole_width_mm,
-        dxy_mm,
-        dtheta_degrees);
+    STATS_BEGIN(start);
+
+    if (py_angles)
+    {
+        scan_update_angles(
+            &self->scan, 
+            angles_degrees,
+            lidar_mm, 
+            (int)npoints,
+            hole_width_mm,
+            dxy_mm,
+            dtheta_degrees);
+    }
+    else
+    {
+        scan_update(
+            &self->scan, 
+            lidar_mm, 
+            hole_width_mm,
+            dxy_mm,
+            dtheta_degrees);
+    }
+
+    STATS_END(scan_update_nsec, start);
+
+    Py_END_ALLOW_THREADS
+
+    PyThread_release_lock(self->lock);
+
+    if (typecode)
+    {
+        PyBuffer_Release(&view);
+    }
+
+    if (angles_typecode)
+    {
+        PyBuffer_Release(&angles_view);
+    }
                
     Py_RETURN_NONE;
 }
@@ -361,11 +685,14 @@ Scan_update(Scan *self, PyObject *args, PyObject *kwds)
 static PyMethodDef Scan_methods[] = 
 {
     {"update", (PyCFunction)Scan_update, METH_VARARGS | METH_KEYWORDS, 
-    "Scan.update(scans_mm, hole_width_mm, velocities=None) updates scan.\n"\
-    "scans_mm is a list of integers representing scanned distances in mm.\n"\
+    "Scan.update(scans_mm, hole_width_mm, velocities=None, scan_angles_degrees=None) updates scan.\n"\
+    "scans_mm is a list of integers representing scanned distances in mm, or any buffer of numbers\n"\
+    "such as an array or numpy array; a buffer of C ints (array('i'), numpy.intc) is used without copying.\n"\
     "hole_width_mm is the width of holes (obstacles, walls) in millimeters.\n"\
     "velocities is an optional tuple containing at least dxy_mm, dtheta_degrees;\n"\
-    "i.e., robot's (forward, rotational velocity) for improving the quality of the scan."
+    "i.e., robot's (forward, rotational velocity) for improving the quality of the scan.\n"\
+    "scan_angles_degrees is an optional list or buffer of the angle of each of scans_mm, counterclockwise\n"\
+    "from straight ahead; scans_mm may then have any size, and its distances are used at these angles."
     },
     {NULL}  // Sentinel 
 };
@@ -432,24 +759,37 @@ typedef struct
     PyObject_HEAD
     
     map_t map;
+
+    // For exporting the pixels through the buffer protocol
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+
+    // Held while the map is updated or read with the GIL released, or while another thread may be
+    PyThread_type_lock lock;
     
 } Map;
 
-// Helper for Map.__init__(), Map.set()
-static int bad_mapbytes(PyObject * py_mapbytes, int size_pixels, const char * methodname)
+// Helper for Map.__init__(), Map.set(): copies any buffer of size_pixels^2 bytes into the map
+static int set_mapbytes(Map * self, PyObject * py_mapbytes, const char * methodname)
 {    
-    if (!PyByteArray_Check(py_mapbytes))
+    Py_buffer view;
+
+    if (get_bytes_buffer(py_mapbytes, &view, 
+        (Py_ssize_t)self->map.size_pixels * self->map.size_pixels, 0, "Map", methodname))
     {
-        return error_on_raise_argument_exception_with_details("Map", methodname, 
-            "argument is not a byte array");        
-    }
-    
-    if (PyByteArray_GET_SIZE(py_mapbytes) != (size_pixels * size_pixels))
-    {        
-        return error_on_raise_argument_exception_with_details("Map", methodname, 
-            "mapbytes are wrong size");
+        return -1;
     }
 
+    lock_acquire(self->lock);
+
+    Py_BEGIN_ALLOW_THREADS
+    map_set(&self->map, (char *)view.buf);
+    Py_END_ALLOW_THREADS
+
+    PyThread_release_lock(self->lock);
+
+    PyBuffer_Release(&view);
+
     return 0;
 }
 
@@ -457,6 +797,11 @@ static void
 Map_dealloc(Map* self)
 {            
     map_free(&self->map);
+
+    if (self->lock)
+    {
+        PyThread_free_lock(self->lock);
+    }
     
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
@@ -467,6 +812,12 @@ Map_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     Map *self;
     
     self = (Map *)type->tp_alloc(type, 0);
+
+    if (self && !(self->lock = PyThread_allocate_lock()))
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
     
     return (PyObject *)self;
 }
@@ -489,10 +840,14 @@ Map_init(Map *self, PyObject *args, PyObject *kwds)
     }
            
     map_init(&self->map, size_pixels, size_meters);
+
+    self->shape[0] = self->shape[1] = size_pixels;
+    self->strides[0] = size_pixels * sizeof(pixel_t);
+    self->strides[1] = sizeof(pixel_t);
     
-    if (py_bytes && !bad_mapbytes(py_bytes, size_pixels, "__init__"))
+    if (py_bytes && set_mapbytes(self, py_bytes, "__init__"))
     {    
-        map_set(&self->map, PyByteArray_AsString(py_bytes));
+        return -1;
     }
     
     return 0;
@@ -520,12 +875,41 @@ Map_get(Map * self, PyObject * args, PyObject * kwds)
         return null_on_raise_argument_exception("Map", "get");
     }
     
-    if (bad_mapbytes(py_mapbytes, self->map.size_pixels, "get"))
+    Py_buffer view;
+
+    if (get_bytes_buffer(py_mapbytes, &view, 
+        (Py_ssize_t)self->map.size_pixels * self->map.size_pixels, 1, "Map", "get"))
     {
-        Py_RETURN_NONE;
+        return NULL;
     }
     
-    map_get(&self->map, PyByteArray_AsString(py_mapbytes));
+    lock_acquire(self->lock);
+
+    Py_BEGIN_ALLOW_THREADS
+    map_get(&self->map, (char *)view.buf);
+    Py_END_ALLOW_THREADS
+
+    PyThread_release_lock(self->lock);
+
+    PyBuffer_Release(&view);
+    
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+Map_set(Map * self, PyObject * args, PyObject * kwds)
+{        
+    PyObject * py_mapbytes = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &py_mapbytes))
+    {
+        return null_on_raise_argument_exception("Map", "set");
+    }
+    
+    if (set_mapbytes(self, py_mapbytes, "set"))
+    {
+        return NULL;
+    }
     
     Py_RETURN_NONE;
 }
@@ -556,7 +940,14 @@ Map_update(Map *self, PyObject *args, PyObject *kwds)
     }
             
     position_t position = pypos2cpos(py_position);
+
+    lock_acquire(py_scan->lock);
+    lock_acquire(self->lock);
     
+    Py_BEGIN_ALLOW_THREADS
+
+    STATS_BEGIN(start);
+
     map_update(
         &self->map, 
         &py_scan->scan, 
@@ -564,6 +955,119 @@ Map_update(Map *self, PyObject *args, PyObject *kwds)
         map_quality, 
         hole_width_mm);
 
+    STATS_END(map_update_nsec, start);
+
+    Py_END_ALLOW_THREADS
+
+    PyThread_release_lock(self->lock);
+    PyThread_release_lock(py_scan->lock);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+Map_save(Map * self, PyObject * args, PyObject * kwds)
+{
+    char * filename = NULL;
+    PyObject * py_trajectory = NULL;
+    int tile_size = 0;
+
+    static char * argnames[] = {"filename", "trajectory", "tile_size", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "s|Oi", argnames,
+        &filename,
+        &py_trajectory,
+        &tile_size))
+    {
+        return null_on_raise_argument_exception("Map", "save");
+    }
+
+    // Format comes from filename extension
+    int length = strlen(filename);
+    int format = (length > 4 && !strcmp(filename + length - 4, ".pgm")) ? MAPEXPORT_PGM : MAPEXPORT_PNG;
+
+    // Convert trajectory of (x_mm, y_mm) pairs to pixel coordinates
+    int * trajectory_xy = NULL;
+    int trajectory_npoints = 0;
+
+    if (py_trajectory && py_trajectory != Py_None)
+    {
+        PyObject * py_sequence = PySequence_Fast(py_trajectory, "trajectory must be a sequence");
+
+        if (!py_sequence)
+        {
+            return NULL;
+        }
+
+        trajectory_npoints = PySequence_Fast_GET_SIZE(py_sequence);
+        trajectory_xy = (int *)malloc((2*trajectory_npoints+1) * sizeof(int));
+
+        if (!trajectory_xy)
+        {
+            Py_DECREF(py_sequence);
+            return PyErr_NoMemory();
+        }
+
+        double mm_per_pixel = self->map.size_meters * 1000. / self->map.size_pixels;
+        int k;
+
+        for (k=0; k<trajectory_npoints; ++k)
+        {
+            double x_mm = 0, y_mm = 0;
+
+            PyObject * py_point = PySequence_Fast_GET_ITEM(py_sequence, k);
+            PyObject * py_x = PySequence_GetItem(py_point, 0);
+            PyObject * py_y = py_x ? PySequence_GetItem(py_point, 1) : NULL;
+
+            if (py_y)
+            {
+                x_mm = PyFloat_AsDouble(py_x);
+                y_mm = PyFloat_AsDouble(py_y);
+            }
+
+            Py_XDECREF(py_x);
+            Py_XDECREF(py_y);
+
+            if (PyErr_Occurred())
+            {
+                Py_DECREF(py_sequence);
+                free(trajectory_xy);
+                return null_on_raise_argument_exception_with_details("Map", "save", 
+                    "trajectory must hold (x_mm, y_mm) pairs");
+            }
+
+            trajectory_xy[2*k]   = (int)(x_mm / mm_per_pixel);
+            trajectory_xy[2*k+1] = (int)(y_mm / mm_per_pixel);
+        }
+
+        Py_DECREF(py_sequence);
+    }
+
+    mapexport_image_t image;
+    image.bytes = NULL;
+    image.pixels = self->map.pixels;
+    image.width = self->map.size_pixels;
+    image.height = self->map.size_pixels;
+    image.trajectory_xy = trajectory_xy;
+    image.trajectory_npoints = trajectory_npoints;
+
+    // Keep other threads from updating the map while it is written out
+    lock_acquire(self->lock);
+
+    int result = tile_size > 0 ? 
+        mapexport_save_tiles(filename, &image, format, tile_size) :
+        mapexport_save(filename, &image, format);
+
+    PyThread_release_lock(self->lock);
+
+    free(trajectory_xy);
+
+    if (result)
+    {
+        PyErr_Format(PyExc_IOError, "unable to save map to %s", filename);
+        return NULL;
+    }
+
     Py_RETURN_NONE;
 }
 
@@ -575,14 +1079,74 @@ static PyMethodDef Map_methods[] =
     "Hole width determines width of obstacles (walls)."
     },
     {"get", (PyCFunction)Map_get, METH_VARARGS,
-    "Map.get(bytearray) fills byte array with map pixels, where bytearray length is square of size of map."
+    "Map.get(bytearray) fills byte array with map pixels, where bytearray length is square of size of map.\n"\
+    "Any writable buffer of that many bytes will do, such as a numpy.uint8 array."
+    },
+    {"set", (PyCFunction)Map_set, METH_VARARGS,
+    "Map.set(bytearray) sets map pixels from byte array, where bytearray length is square of size of map.\n"\
+    "Any buffer of that many bytes will do."
+    },
+    {"save", (PyCFunction)Map_save, METH_VARARGS | METH_KEYWORDS,
+    "Map.save(filename, trajectory=None, tile_size=0) saves map as a PNG file, or a binary PGM file\n"\
+    "if filename ends in .pgm, without copying the map out first.\n"\
+    "trajectory is an optional sequence of (x_mm, y_mm) positions to draw in black.\n"\
+    "If tile_size is positive, the map is saved as tiles of that size, plus an index file;\n"\
+    "e.g., map.png becomes map-0-0.png, map-0-1.png, ..., and map.tiles."
     },
     {NULL}  // Sentinel 
 };
 
+// Exports the map's 16-bit pixels in place, read-only, as a size_pixels x size_pixels array
+static int
+Map_getbuffer(Map * self, Py_buffer * view, int flags)
+{
+    if (flags & PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "map pixels are read-only");
+        view->obj = NULL;
+        return -1;
+    }
+
+    view->buf = self->map.pixels;
+    view->obj = (PyObject *)self;
+    view->len = (Py_ssize_t)self->map.size_pixels * self->map.size_pixels * sizeof(pixel_t);
+    view->readonly = 1;
+    view->itemsize = sizeof(pixel_t);
+    view->format = (flags & PyBUF_FORMAT) ? "H" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    Py_INCREF(self);
+
+    return 0;
+}
+
+static PyBufferProcs Map_as_buffer = 
+{
+    #if PY_MAJOR_VERSION < 3
+    0,                                          // bf_getreadbuffer
+    0,                                          // bf_getwritebuffer
+    0,                                          // bf_getsegcount
+    0,                                          // bf_getcharbuffer
+    #endif
+    (getbufferproc)Map_getbuffer,               // bf_getbuffer
+    0,                                          // bf_releasebuffer
+};
+
+#if PY_MAJOR_VERSION < 3
+#define MAP_TPFLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_NEWBUFFER)
+#else
+#define MAP_TPFLAGS (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE)
+#endif
+
 #define TP_DOC_MAP \
 "A class for maps used in SLAM.\n"\
-"Map.__init__(size_pixels, size_meters, bytes=None)"
+"Map.__init__(size_pixels, size_meters, bytes=None)\n"\
+"Supports the buffer protocol: memoryview(map) or numpy.asarray(map) gives the map's 16-bit pixels\n"\
+"in place, read-only, without copying; Map.get() copies out their high bytes."
 
 
 static PyTypeObject pybreezyslam_MapType = 
@@ -610,8 +1174,8 @@ static PyTypeObject pybreezyslam_MapType =
     (reprfunc)Map_str,                          // tp_str
     0,                                          // tp_getattro
     0,                                          // tp_setattro
-    0,                                          // tp_as_buffer
-    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,   // tp_flags
+    &Map_as_buffer,                             // tp_as_buffer
+    MAP_TPFLAGS,                                // tp_flags
     TP_DOC_MAP,                                 // tp_doc 
     0,                                          // tp_traverse 
     0,                                          // tp_clear 
@@ -639,6 +1203,9 @@ typedef struct
     PyObject_HEAD
     
     void * randomizer;
+
+    // Held while a search draws from the randomizer with the GIL released
+    PyThread_type_lock lock;
     
 } Randomizer;
 
@@ -647,6 +1214,11 @@ static void
 Randomizer_dealloc(Randomizer* self)
 {            
     random_free(self->randomizer);
+
+    if (self->lock)
+    {
+        PyThread_free_lock(self->lock);
+    }
     
     Py_TYPE(self)->tp_free((PyObject*)self);
 }
@@ -657,6 +1229,12 @@ Randomizer_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
     Randomizer *self;
     
     self = (Randomizer *)type->tp_alloc(type, 0);
+
+    if (self && !(self->lock = PyThread_allocate_lock()))
+    {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
     
     return (PyObject *)self;
 }
@@ -759,7 +1337,266 @@ distanceScanToMap(PyObject *self, PyObject *args)
     position_t c_position = pypos2cpos(py_position);
     
     // Run C version and return Python integer
-    return PyLong_FromLong(distance_scan_to_map(&py_map->map, &py_scan->scan, c_position));
+    lock_acquire(py_scan->lock);
+    lock_acquire(py_map->lock);
+
+    int distance = distance_scan_to_map(&py_map->map, &py_scan->scan, c_position);
+
+    PyThread_release_lock(py_map->lock);
+    PyThread_release_lock(py_scan->lock);
+
+    return PyLong_FromLong(distance);
+}
+
+// Called internally, so minimal type-checking on arguments.  Runs SinglePositionSLAM.update()
+// over a batch of scans with the GIL released; see breezyslam.algorithms for the steps.
+static PyObject *
+updateMany(PyObject *self, PyObject *args)
+{
+    Position * py_position = NULL;
+    Map * py_map = NULL;
+    Scan * py_scan_for_distance = NULL;
+    Scan * py_scan_for_mapbuild = NULL;
+    PyObject * py_scans = NULL;
+    PyObject * py_velocities = NULL;
+    double offset_mm = 0;
+    double hole_width_mm = 0;
+    int map_quality = 0;
+    int should_update_map = 0;
+    double dxy_mm = 0;
+    double dtheta_degrees = 0;
+    PyObject * py_randomizer = NULL;
+    double sigma_xy_mm = 0;
+    double sigma_theta_degrees = 0;
+    int max_search_iter = 0;
+
+    if (!PyArg_ParseTuple(args, "OOOOOOddii(dd)Oddi",
+        &py_position,
+        &py_map,
+        &py_scan_for_distance,
+        &py_scan_for_mapbuild,
+        &py_scans,
+        &py_velocities,
+        &offset_mm,
+        &hole_width_mm,
+        &map_quality,
+        &should_update_map,
+        &dxy_mm,
+        &dtheta_degrees,
+        &py_randomizer,
+        &sigma_xy_mm,
+        &sigma_theta_degrees,
+        &max_search_iter))
+    {
+        return null_on_raise_argument_exception("breezyslam.algorithms", "updateMany");
+    }
+
+    int scan_size = py_scan_for_distance->scan.size;
+
+    // Scans: a contiguous buffer of nscans x scan_size numbers
+    Py_buffer scans_view;
+    char typecode = 0;
+
+    if (!PyObject_CheckBuffer(py_scans) ||
+        PyObject_GetBuffer(py_scans, &scans_view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS))
+    {
+        PyErr_Clear();
+
+        return null_on_raise_argument_exception_with_details("breezyslam.algorithms", "update_many", 
+            "scans must be a contiguous buffer");
+    }
+
+    Py_ssize_t nvalues = scans_view.len / scans_view.itemsize;
+
+    if (!(typecode = buffer_typecode(&scans_view)) || nvalues % scan_size)
+    {
+        PyBuffer_Release(&scans_view);
+
+        return null_on_raise_argument_exception_with_details("breezyslam.algorithms", "update_many", 
+            typecode ? "scans size is not a multiple of scan size" : 
+                       "scans buffer must hold native integers or floats");
+    }
+
+    int nscans = (int)(nvalues / scan_size);
+
+    // Velocities: None, or a contiguous buffer of nscans x 3 doubles
+    Py_buffer velocities_view;
+    const double * velocities = NULL;
+
+    if (py_velocities != Py_None)
+    {
+        if (!PyObject_CheckBuffer(py_velocities) ||
+            PyObject_GetBuffer(py_velocities, &velocities_view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS))
+        {
+            PyErr_Clear();
+            PyBuffer_Release(&scans_view);
+
+            return null_on_raise_argument_exception_with_details("breezyslam.algorithms", "update_many", 
+                "velocities must be None or a contiguous buffer");
+        }
+
+        if (buffer_typecode(&velocities_view) != 'd' || velocities_view.len != nscans * 3 * (Py_ssize_t)sizeof(double))
+        {
+            PyBuffer_Release(&velocities_view);
+            PyBuffer_Release(&scans_view);
+
+            return null_on_raise_argument_exception_with_details("breezyslam.algorithms", "update_many", 
+                "velocities must hold three doubles per scan");
+        }
+
+        velocities = (const double *)velocities_view.buf;
+    }
+
+    // Trajectory: x_mm, y_mm, theta_degrees after each scan
+    PyObject * py_trajectory = PyByteArray_FromStringAndSize(NULL, nscans * 3 * sizeof(double));
+
+    if (!py_trajectory)
+    {
+        if (velocities)
+        {
+            PyBuffer_Release(&velocities_view);
+        }
+        PyBuffer_Release(&scans_view);
+
+        return NULL;
+    }
+
+    double * trajectory = (double *)PyByteArray_AS_STRING(py_trajectory);
+    void * randomizer = py_randomizer == Py_None ? NULL : ((Randomizer *)py_randomizer)->randomizer;
+    int zero_copy = (typecode == 'i' || (typecode == 'l' && sizeof(long) == sizeof(int))) && 
+                    scans_view.itemsize == sizeof(int);
+
+    // Take the scans' locks in a fixed order, then the map's and the randomizer's
+    Scan * first = py_scan_for_distance < py_scan_for_mapbuild ? py_scan_for_distance : py_scan_for_mapbuild;
+    Scan * second = first == py_scan_for_distance ? py_scan_for_mapbuild : py_scan_for_distance;
+
+    lock_acquire(first->lock);
+    if (second != first)
+    {
+        lock_acquire(second->lock);
+    }
+    lock_acquire(py_map->lock);
+    if (randomizer)
+    {
+        lock_acquire(((Randomizer *)py_randomizer)->lock);
+    }
+
+    position_t position = pypos2cpos(py_position);
+
+    Py_BEGIN_ALLOW_THREADS
+
+    int k;
+    for (k=0; k<nscans; ++k)
+    {
+        int * lidar_mm = py_scan_for_mapbuild->lidar_mm;
+
+        if (zero_copy)
+        {
+            lidar_mm = (int *)scans_view.buf + (Py_ssize_t)k * scan_size;
+        }
+        else
+        {
+            ints_from_buffer((const char *)scans_view.buf + (Py_ssize_t)k * scan_size * scans_view.itemsize, 
+                             typecode, lidar_mm, scan_size);
+        }
+
+        // Build a scan for computing distance to map, and one for updating map, with the previous velocities
+        STATS_BEGIN(scan_start);
+        scan_update(&py_scan_for_mapbuild->scan, lidar_mm, hole_width_mm, dxy_mm, dtheta_degrees);
+        scan_update(&py_scan_for_distance->scan, lidar_mm, hole_width_mm, dxy_mm, dtheta_degrees);
+        STATS_END(scan_update_nsec, scan_start);
+
+        // Update velocities
+        dxy_mm = 0;
+        dtheta_degrees = 0;
+
+        if (velocities)
+        {
+            const double * v = velocities + 3*k;
+            double velocity_factor = (v[2] > 0) ? (1 / v[2]) : 0;
+            dxy_mm = v[0] * velocity_factor;
+            dtheta_degrees = v[1] * velocity_factor;
+        }
+
+        // Start at current position, adding effect of velocities and offset from laser,
+        // in the same order and with the same conversions as the Python code
+        double theta_radians = position.theta_degrees * (M_PI / 180.0);
+        double costheta = cos(theta_radians);
+        double sintheta = sin(theta_radians);
+
+        position_t start_pos = position;
+        start_pos.x_mm += dxy_mm * costheta;
+        start_pos.y_mm += dxy_mm * sintheta;
+        start_pos.theta_degrees = start_pos.theta_degrees + dtheta_degrees;
+        start_pos.x_mm += offset_mm * costheta;
+        start_pos.y_mm += offset_mm * sintheta;
+
+        // Get new position
+        position_t new_position = start_pos;
+
+        if (randomizer)
+        {
+            STATS_BEGIN(search_start);
+
+            new_position = rmhc_position_search(
+                start_pos,
+                &py_map->map,
+                &py_scan_for_distance->scan,
+                sigma_xy_mm,
+                sigma_theta_degrees,
+                max_search_iter,
+                randomizer);
+
+            STATS_END(search_nsec, search_start);
+        }
+
+        // Update the current position with this new position, adjusted by laser offset
+        theta_radians = new_position.theta_degrees * (M_PI / 180.0);
+        position = new_position;
+        position.x_mm -= offset_mm * cos(theta_radians);
+        position.y_mm -= offset_mm * sin(theta_radians);
+
+        // Update the map with this new position if indicated
+        if (should_update_map)
+        {
+            STATS_BEGIN(map_start);
+            map_update(&py_map->map, &py_scan_for_mapbuild->scan, new_position, map_quality, hole_width_mm);
+            STATS_END(map_update_nsec, map_start);
+        }
+
+        trajectory[3*k]   = position.x_mm;
+        trajectory[3*k+1] = position.y_mm;
+        trajectory[3*k+2] = position.theta_degrees;
+    }
+
+    Py_END_ALLOW_THREADS
+
+    if (randomizer)
+    {
+        PyThread_release_lock(((Randomizer *)py_randomizer)->lock);
+    }
+    PyThread_release_lock(py_map->lock);
+    PyThread_release_lock(first->lock);
+    if (second != first)
+    {
+        PyThread_release_lock(second->lock);
+    }
+
+    py_position->x_mm = position.x_mm;
+    py_position->y_mm = position.y_mm;
+    py_position->theta_degrees = position.theta_degrees;
+
+    if (velocities)
+    {
+        PyBuffer_Release(&velocities_view);
+    }
+    PyBuffer_Release(&scans_view);
+
+    // Return trajectory and final velocities
+    PyObject * py_result = Py_BuildValue("O(dd)", py_trajectory, dxy_mm, dtheta_degrees);
+    Py_DECREF(py_trajectory);
+
+    return py_result;
 }
 
 // Called internally, so minimal type-checking on arguments
@@ -791,8 +1628,17 @@ rmhcPositionSearch(PyObject *self, PyObject *args)
     
     // Convert Python objects to C structures
     position_t start_pos = pypos2cpos(py_start_pos);
+	position_t likeliest_position;
+
+    lock_acquire(py_scan->lock);
+    lock_acquire(py_map->lock);
+    lock_acquire(py_randomizer->lock);
+
+    Py_BEGIN_ALLOW_THREADS
 
-	position_t likeliest_position = 
+    STATS_BEGIN(start);
+
+	likeliest_position = 
     rmhc_position_search(
         start_pos,
         &py_map->map,
@@ -801,6 +1647,14 @@ rmhcPositionSearch(PyObject *self, PyObject *args)
         sigma_theta_degrees,
         max_search_iter,
         py_randomizer->randomizer);    
+
+    STATS_END(search_nsec, start);
+
+    Py_END_ALLOW_THREADS
+
+    PyThread_release_lock(py_randomizer->lock);
+    PyThread_release_lock(py_map->lock);
+    PyThread_release_lock(py_scan->lock);
     
     
     // Convert C position back to Python object
@@ -817,6 +1671,29 @@ rmhcPositionSearch(PyObject *self, PyObject *args)
 }
 
 
+static PyObject *
+getStats(PyObject *self, PyObject *args)
+{
+    return Py_BuildValue("{sKsKsKsKsKsKsKsKsK}",
+        "candidates_evaluated", stats.candidates_evaluated,
+        "accepted_moves", stats.accepted_moves,
+        "sigma_halvings", stats.sigma_halvings,
+        "points_scored", stats.points_scored,
+        "points_out_of_map", stats.points_out_of_map,
+        "pixels_written", stats.pixels_written,
+        "scan_update_nsec", stats.scan_update_nsec,
+        "search_nsec", stats.search_nsec,
+        "map_update_nsec", stats.map_update_nsec);
+}
+
+static PyObject *
+resetStats(PyObject *self, PyObject *args)
+{
+    memset(&stats, 0, sizeof(stats));
+
+    Py_RETURN_NONE;
+}
+
 static PyMethodDef module_methods[] = 
 {
     {"distanceScanToMap", distanceScanToMap, METH_VARARGS,
@@ -831,6 +1708,21 @@ static PyMethodDef module_methods[] =
         "rmhcPositionSearch(startpos, map, scan, laser, sigma_xy_mm, max_iter, randomizer)\n"
     "Internal use only."
     },
+    {"updateMany", updateMany, METH_VARARGS,
+        "updateMany(position, map, scan_for_distance, scan_for_mapbuild, scans, velocities, offset_mm,\n"
+    "hole_width_mm, map_quality, should_update_map, (dxy_mm, dtheta_degrees), randomizer, sigma_xy_mm,\n"
+    "sigma_theta_degrees, max_search_iter)\n"
+    "Internal use only."
+    },
+    {"getStats", getStats, METH_NOARGS,
+        "getStats()\n"
+    "Returns a dictionary of search and map-update counters and per-stage nanoseconds since\n"\
+    "the last call to resetStats().  All zero unless built with BREEZYSLAM_STATS defined."
+    },
+    {"resetStats", resetStats, METH_NOARGS,
+        "resetStats()\n"
+    "Zeroes the counters returned by getStats()."
+    },
     {NULL, NULL, 0, NULL}        /* Sentinel */
 };
 
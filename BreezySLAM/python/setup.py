@@ -44,12 +44,20 @@ SOURCES = [
     '../c/coreslam.c', 
     '../c/coreslam_' + arch + '.c',
     '../c/random.c',
-    '../c/ziggurat.c']
+    '../c/ziggurat.c',
+    '../c/mapexport.c']
+
+# Set BREEZYSLAM_STATS in the environment to collect search counters (see CoreSLAM.getStats())
+
+from os import environ
+
+STATS_MACROS = [('BREEZYSLAM_STATS', None)] if 'BREEZYSLAM_STATS' in environ else []
 
 from distutils.core import setup, Extension
 
 module = Extension('pybreezyslam', 
     sources = SOURCES, 
+    define_macros = STATS_MACROS,
     extra_compile_args = SIMD_FLAGS + OPT_FLAGS
     )
 
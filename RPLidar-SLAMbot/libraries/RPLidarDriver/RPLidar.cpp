@@ -31,6 +31,9 @@
 
 RPLidar::RPLidar()
     : _bined_serialdev(NULL)
+    , _express(false)
+    , _capsuleReady(false)
+    , _expressPos(RPLIDAR_CAPSULE_SAMPLES)
 {
     _currentMeasurement.distance = 0;
     _currentMeasurement.angle = 0;
@@ -198,6 +201,45 @@ u_result RPLidar::startScan(bool force, _u32 timeout)
             return RESULT_INVALID_DATA;
         }
     }
+    _express = false;
+    return RESULT_OK;
+}
+
+// start the express measurement operation
+u_result RPLidar::startExpressScan(_u32 timeout)
+{
+    u_result ans;
+
+    if (!isOpen()) return RESULT_OPERATION_FAIL;
+
+    stop(); //force the previous operation to stop
+
+    {
+        rplidar_payload_express_scan_t payload;
+        memset(&payload, 0, sizeof(payload));
+        payload.working_mode = RPLIDAR_EXPRESS_SCAN_MODE_NORMAL;
+
+        ans = _sendCommand(RPLIDAR_CMD_EXPRESS_SCAN, &payload, sizeof(payload));
+        if (IS_FAIL(ans)) return ans;
+
+        // waiting for confirmation
+        rplidar_ans_header_t response_header;
+        if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+            return ans;
+        }
+
+        // verify whether we got a correct header
+        if (response_header.type != RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED) {
+            return RESULT_INVALID_DATA;
+        }
+
+        if (response_header.size < sizeof(rplidar_response_capsule_measurement_nodes_t)) {
+            return RESULT_INVALID_DATA;
+        }
+    }
+    _express = true;
+    _capsuleReady = false;
+    _expressPos = RPLIDAR_CAPSULE_SAMPLES;
     return RESULT_OK;
 }
 
@@ -211,6 +253,10 @@ u_result RPLidar::waitPoint(_u32 timeout)
 
    _u8 recvPos = 0;
 
+   if (_express) {
+       return _waitCapsulePoint(timeout);
+   }
+
    while ((remainingtime=millis() - currentTs) <= timeout) {
         int currentbyte = _bined_serialdev->read();
         if (currentbyte<0) continue;
@@ -241,11 +287,7 @@ u_result RPLidar::waitPoint(_u32 timeout)
           nodebuf[recvPos++] = currentbyte;
 
           if (recvPos == sizeof(rplidar_response_measurement_node_t)) {
-              // store the data ...
-              _currentMeasurement.distance = node.distance_q2/4.0f;
-              _currentMeasurement.angle = (node.angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f;
-              _currentMeasurement.quality = (node.sync_quality>>RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
-              _currentMeasurement.startBit = (node.sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT);
+              _storeNode(node);
               return RESULT_OK;
           }
         
@@ -254,6 +296,72 @@ u_result RPLidar::waitPoint(_u32 timeout)
    return RESULT_OPERATION_TIMEOUT;
 }
 
+// hand out the next sample of the last decoded capsule, receiving capsules until there is one
+u_result RPLidar::_waitCapsulePoint(_u32 timeout)
+{
+   _u32 currentTs = millis();
+   _u32 remainingtime;
+   rplidar_response_capsule_measurement_nodes_t capsule;
+   _u8 *capsulebuf = (_u8*)&capsule;
+
+   _u8 recvPos = 0;
+
+   while ((remainingtime=millis() - currentTs) <= timeout) {
+        if (_expressPos < RPLIDAR_CAPSULE_SAMPLES) {
+            _storeNode(_expressNodes[_expressPos++]);
+            return RESULT_OK;
+        }
+
+        int currentbyte = _bined_serialdev->read();
+        if (currentbyte<0) continue;
+
+        switch (recvPos) {
+            case 0: // expect the first sync nibble
+                if ((currentbyte >> 4) != RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1) {
+                    continue;
+                }
+                break;
+            case 1: // expect the second sync nibble
+                if ((currentbyte >> 4) != RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2) {
+                    recvPos = 0;
+                    continue;
+                }
+                break;
+        }
+        capsulebuf[recvPos++] = currentbyte;
+
+        if (recvPos == sizeof(capsule)) {
+            recvPos = 0;
+
+            // without a good capsule, the last one's samples have no end angle
+            if (!rplidar_capsule_valid(capsule)) {
+                _capsuleReady = false;
+                continue;
+            }
+
+            // the first capsule of a scan has the sync bit, and follows no capsule of it
+            if (_capsuleReady && !(capsule.start_angle_sync_q6 & RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT)) {
+                rplidar_capsule_decode(_capsule, capsule, _expressNodes);
+                _expressPos = 0;
+            }
+
+            memcpy(&_capsule, &capsule, sizeof(capsule));
+            _capsuleReady = true;
+        }
+   }
+
+   return RESULT_OPERATION_TIMEOUT;
+}
+
+void RPLidar::_storeNode(const rplidar_response_measurement_node_t & node)
+{
+    // store the data ...
+    _currentMeasurement.distance = node.distance_q2/4.0f;
+    _currentMeasurement.angle = (node.angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT)/64.0f;
+    _currentMeasurement.quality = (node.sync_quality>>RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+    _currentMeasurement.startBit = (node.sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT);
+}
+
 
 
 u_result RPLidar::_sendCommand(_u8 cmd, const void * payload, size_t payloadsize)
@@ -288,7 +396,7 @@ u_result RPLidar::_sendCommand(_u8 cmd, const void * payload, size_t payloadsize
         _bined_serialdev->write((uint8_t *)&sizebyte, 1);
 
         // send payload
-        _bined_serialdev->write((uint8_t *)&payload, sizebyte);
+        _bined_serialdev->write((const uint8_t *)payload, sizebyte);
 
         // send checksum
         _bined_serialdev->write((uint8_t *)&checksum, 1);
@@ -32,6 +32,7 @@
 #include "Arduino.h"
 #include "inc/rptypes.h"
 #include "inc/rplidar_cmd.h"
+#include "rplidar_capsule.h"
 
 struct RPLidarMeasurement
 {
@@ -73,6 +74,10 @@ public:
     // start the measurement operation
     u_result startScan(bool force = false, _u32 timeout = RPLIDAR_DEFAULT_TIMEOUT*2);
 
+    // start the express measurement operation, which packs twice the samples into the
+    // same baud rate (firmware 1.17 and later)
+    u_result startExpressScan(_u32 timeout = RPLIDAR_DEFAULT_TIMEOUT*2);
+
     // wait for one sample point to arrive
     u_result waitPoint(_u32 timeout = RPLIDAR_DEFAULT_TIMEOUT);
     
@@ -86,8 +91,18 @@ public:
 protected:
     u_result _sendCommand(_u8 cmd, const void * payload, size_t payloadsize);
     u_result _waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout);
+    u_result _waitCapsulePoint(_u32 timeout);
+    void     _storeNode(const rplidar_response_measurement_node_t & node);
 
 protected:
     HardwareSerial * _bined_serialdev;  
     RPLidarMeasurement _currentMeasurement;
+
+    // express scan: the last capsule received, waiting for the next one's start angle,
+    // and the samples decoded from the one before, handed out by waitPoint()
+    bool _express;
+    bool _capsuleReady;
+    rplidar_response_capsule_measurement_nodes_t _capsule;
+    rplidar_response_measurement_node_t _expressNodes[RPLIDAR_CAPSULE_SAMPLES];
+    _u8 _expressPos;
 };
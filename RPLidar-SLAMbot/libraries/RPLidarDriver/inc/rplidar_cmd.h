@@ -53,14 +53,27 @@
 #define RPLIDAR_CMD_GET_DEVICE_INFO      0x50
 #define RPLIDAR_CMD_GET_DEVICE_HEALTH    0x52
 
+// Commands with payload and have response
+#define RPLIDAR_CMD_EXPRESS_SCAN         0x82
+
 #if defined(_WIN32)
 #pragma pack(1)
 #endif
 
+// Payloads
+// ------------------------------------------
+#define RPLIDAR_EXPRESS_SCAN_MODE_NORMAL      0
+
+typedef struct _rplidar_payload_express_scan_t {
+    _u8   working_mode;
+    _u32  reserved;
+} __attribute__((packed)) rplidar_payload_express_scan_t;
+
 
 // Response
 // ------------------------------------------
 #define RPLIDAR_ANS_TYPE_MEASUREMENT      0x81
+#define RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED   0x82
 
 #define RPLIDAR_ANS_TYPE_DEVINFO          0x4
 #define RPLIDAR_ANS_TYPE_DEVHEALTH        0x6
@@ -81,6 +94,32 @@ typedef struct _rplidar_response_measurement_node_t {
 	_u16   distance_q2;
 } __attribute__((packed)) rplidar_response_measurement_node_t;
 
+// [distance_angle flags]
+#define RPLIDAR_RESP_MEASUREMENT_EXP_ANGLE_MASK           (0x3)
+#define RPLIDAR_RESP_MEASUREMENT_EXP_DISTANCE_MASK        (0xFFFC)
+
+typedef struct _rplidar_response_cabin_nodes_t {
+    _u16   distance_angle_1; // distance_q2 with angle offset bits 4..5 in bits 0..1
+    _u16   distance_angle_2;
+    _u8    offset_angles_q3; // angle offset bits 0..3 of sample 2 in the high nibble, sample 1 in the low
+} __attribute__((packed)) rplidar_response_cabin_nodes_t;
+
+// [s_checksum flags]
+#define RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1               0xA
+#define RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2               0x5
+
+// [start_angle_sync flags]
+#define RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT              (0x1<<15)
+
+#define RPLIDAR_RESP_MEASUREMENT_EXP_CABINS               16
+
+typedef struct _rplidar_response_capsule_measurement_nodes_t {
+    _u8                             s_checksum_1; // sync_1:4 in the high nibble, checksum bits 0..3 in the low
+    _u8                             s_checksum_2; // sync_2:4 in the high nibble, checksum bits 4..7 in the low
+    _u16                            start_angle_sync_q6; // start_angle_q6:15;syncbit:1;
+    rplidar_response_cabin_nodes_t  cabins[RPLIDAR_RESP_MEASUREMENT_EXP_CABINS];
+} __attribute__((packed)) rplidar_response_capsule_measurement_nodes_t;
+
 typedef struct _rplidar_response_device_info_t {
     _u8   model;
     _u16  firmware_version;
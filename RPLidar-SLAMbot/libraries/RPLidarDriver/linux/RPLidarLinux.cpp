@@ -0,0 +1,609 @@
+/*
+ * RoboPeak RPLIDAR Driver for Linux
+ * RoboPeak.com
+ *
+ * Copyright (c) 2014, RoboPeak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "RPLidarLinux.h"
+
+// milliseconds on CLOCK_MONOTONIC, standing in for Arduino's millis()
+static _u32 millis()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (_u32)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+RPLidarLinux::RPLidarLinux(int scan_size)
+    : _serial_fd(-1)
+    , _scan_size(scan_size)
+    , _rxlen(0)
+    , _synced(false)
+    , _last_angle_q6(0)
+    , _filling_nodes(0)
+    , _published_nodes(0)
+    , _published_count(0)
+    , _grabbed_count(0)
+    , _express(false)
+    , _capsule_ready(false)
+    , _reader_running(false)
+    , _reader_stopping(false)
+{
+    _filling_scan = (int *)calloc(scan_size, sizeof(int));
+    _published_scan = (int *)calloc(scan_size, sizeof(int));
+
+    pthread_mutex_init(&_scan_mutex, NULL);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&_scan_cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+
+RPLidarLinux::~RPLidarLinux()
+{
+    end();
+
+    pthread_cond_destroy(&_scan_cond);
+    pthread_mutex_destroy(&_scan_mutex);
+
+    free(_filling_scan);
+    free(_published_scan);
+}
+
+// open the given serial device and try to connect to the RPLIDAR
+bool RPLidarLinux::begin(const char * device)
+{
+    if (isOpen()) {
+      end();
+    }
+
+    _serial_fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (_serial_fd < 0) {
+        return false;
+    }
+
+    struct termios options;
+    if (tcgetattr(_serial_fd, &options)) {
+        end();
+        return false;
+    }
+
+    cfmakeraw(&options);
+    cfsetispeed(&options, B115200);
+    cfsetospeed(&options, B115200);
+    options.c_cflag |= CLOCAL | CREAD;
+
+    if (tcsetattr(_serial_fd, TCSANOW, &options)) {
+        end();
+        return false;
+    }
+
+    tcflush(_serial_fd, TCIOFLUSH);
+    _rxlen = 0;
+
+    return true;
+}
+
+// close the currently opened serial device
+void RPLidarLinux::end()
+{
+    if (isOpen()) {
+       stop();
+       close(_serial_fd);
+       _serial_fd = -1;
+    }
+}
+
+
+// check whether the serial device is opened
+bool RPLidarLinux::isOpen()
+{
+    return _serial_fd >= 0;
+}
+
+// ask the RPLIDAR for its health info
+u_result RPLidarLinux::getHealth(rplidar_response_device_health_t & healthinfo, _u32 timeout)
+{
+    _u32 currentTs = millis();
+    rplidar_ans_header_t response_header;
+    u_result  ans;
+
+    if (!isOpen() || _reader_running) return RESULT_OPERATION_FAIL;
+
+    if (IS_FAIL(ans = _sendCommand(RPLIDAR_CMD_GET_DEVICE_HEALTH, NULL, 0))) {
+        return ans;
+    }
+
+    if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+        return ans;
+    }
+
+    // verify whether we got a correct header
+    if (response_header.type != RPLIDAR_ANS_TYPE_DEVHEALTH) {
+        return RESULT_INVALID_DATA;
+    }
+
+    if ((response_header.size) < sizeof(rplidar_response_device_health_t)) {
+        return RESULT_INVALID_DATA;
+    }
+
+    _u32 elapsed = millis() - currentTs;
+    return _waitResponse(&healthinfo, sizeof(healthinfo), elapsed < timeout ? timeout - elapsed : 0);
+}
+
+// ask the RPLIDAR for its device info like the serial number
+u_result RPLidarLinux::getDeviceInfo(rplidar_response_device_info_t & info, _u32 timeout)
+{
+    _u32 currentTs = millis();
+    rplidar_ans_header_t response_header;
+    u_result  ans;
+
+    if (!isOpen() || _reader_running) return RESULT_OPERATION_FAIL;
+
+    if (IS_FAIL(ans = _sendCommand(RPLIDAR_CMD_GET_DEVICE_INFO,NULL,0))) {
+        return ans;
+    }
+
+    if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+        return ans;
+    }
+
+    // verify whether we got a correct header
+    if (response_header.type != RPLIDAR_ANS_TYPE_DEVINFO) {
+        return RESULT_INVALID_DATA;
+    }
+
+    if (response_header.size < sizeof(rplidar_response_device_info_t)) {
+        return RESULT_INVALID_DATA;
+    }
+
+    _u32 elapsed = millis() - currentTs;
+    return _waitResponse(&info, sizeof(info), elapsed < timeout ? timeout - elapsed : 0);
+}
+
+// stop the measurement operation and the reader thread
+u_result RPLidarLinux::stop()
+{
+    if (!isOpen()) return RESULT_OPERATION_FAIL;
+
+    if (_reader_running) {
+        __atomic_store_n(&_reader_stopping, true, __ATOMIC_RELEASE);
+        pthread_join(_reader, NULL);
+        _reader_running = false;
+    }
+
+    u_result ans = _sendCommand(RPLIDAR_CMD_STOP,NULL,0);
+
+    // nodes still on their way are of no use to the next request
+    tcflush(_serial_fd, TCIFLUSH);
+    _rxlen = 0;
+
+    return ans;
+}
+
+// start the measurement operation, and the reader thread that assembles the revolutions
+u_result RPLidarLinux::startScan(bool force, _u32 timeout)
+{
+    u_result ans;
+
+    if (!isOpen()) return RESULT_OPERATION_FAIL;
+
+    stop(); //force the previous operation to stop
+
+    {
+        ans = _sendCommand(force?RPLIDAR_CMD_FORCE_SCAN:RPLIDAR_CMD_SCAN, NULL, 0);
+        if (IS_FAIL(ans)) return ans;
+
+        // waiting for confirmation
+        rplidar_ans_header_t response_header;
+        if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+            return ans;
+        }
+
+        // verify whether we got a correct header
+        if (response_header.type != RPLIDAR_ANS_TYPE_MEASUREMENT) {
+            return RESULT_INVALID_DATA;
+        }
+
+        if (response_header.size < sizeof(rplidar_response_measurement_node_t)) {
+            return RESULT_INVALID_DATA;
+        }
+    }
+
+    _express = false;
+    return _startReader();
+}
+
+// start the express measurement operation, and the reader thread that decodes its capsules
+u_result RPLidarLinux::startExpressScan(_u32 timeout)
+{
+    u_result ans;
+
+    if (!isOpen()) return RESULT_OPERATION_FAIL;
+
+    stop(); //force the previous operation to stop
+
+    {
+        rplidar_payload_express_scan_t payload;
+        memset(&payload, 0, sizeof(payload));
+        payload.working_mode = RPLIDAR_EXPRESS_SCAN_MODE_NORMAL;
+
+        ans = _sendCommand(RPLIDAR_CMD_EXPRESS_SCAN, &payload, sizeof(payload));
+        if (IS_FAIL(ans)) return ans;
+
+        // waiting for confirmation
+        rplidar_ans_header_t response_header;
+        if (IS_FAIL(ans = _waitResponseHeader(&response_header, timeout))) {
+            return ans;
+        }
+
+        // verify whether we got a correct header
+        if (response_header.type != RPLIDAR_ANS_TYPE_MEASUREMENT_CAPSULED) {
+            return RESULT_INVALID_DATA;
+        }
+
+        if (response_header.size < sizeof(rplidar_response_capsule_measurement_nodes_t)) {
+            return RESULT_INVALID_DATA;
+        }
+    }
+
+    _express = true;
+    _capsule_ready = false;
+    return _startReader();
+}
+
+// wait for a revolution newer than the last one grabbed, and copy it into scan_mm
+u_result RPLidarLinux::grabScan(int * scan_mm, _u32 timeout, _u32 * skipped)
+{
+    if (!_reader_running) return RESULT_OPERATION_FAIL;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&_scan_mutex);
+
+    while (_published_count == _grabbed_count) {
+        if (pthread_cond_timedwait(&_scan_cond, &_scan_mutex, &deadline)) {
+            pthread_mutex_unlock(&_scan_mutex);
+            return RESULT_OPERATION_TIMEOUT;
+        }
+    }
+
+    memcpy(scan_mm, _published_scan, _scan_size * sizeof(int));
+
+    if (skipped) {
+        *skipped = _published_count - _grabbed_count - 1;
+    }
+    _grabbed_count = _published_count;
+
+    pthread_mutex_unlock(&_scan_mutex);
+
+    return RESULT_OK;
+}
+
+
+
+u_result RPLidarLinux::_sendCommand(_u8 cmd, const void * payload, size_t payloadsize)
+{
+    _u8 pkt[3 + 255 + 1];
+    size_t pktsize = 2;
+    _u8 checksum = 0;
+
+    if (payloadsize > 255) return RESULT_INVALID_DATA;
+
+    if (payloadsize && payload) {
+        cmd |= RPLIDAR_CMDFLAG_HAS_PAYLOAD;
+    }
+
+    pkt[0] = RPLIDAR_CMD_SYNC_BYTE;
+    pkt[1] = cmd;
+
+    if (cmd & RPLIDAR_CMDFLAG_HAS_PAYLOAD) {
+        checksum ^= RPLIDAR_CMD_SYNC_BYTE;
+        checksum ^= cmd;
+        checksum ^= (payloadsize & 0xFF);
+
+        // calc checksum
+        for (size_t pos = 0; pos < payloadsize; ++pos) {
+            checksum ^= ((_u8 *)payload)[pos];
+        }
+
+        // size, payload and checksum follow the header
+        pkt[pktsize++] = (_u8)payloadsize;
+        memcpy(pkt + pktsize, payload, payloadsize);
+        pktsize += payloadsize;
+        pkt[pktsize++] = checksum;
+    }
+
+    // the whole packet in one write
+    size_t sent = 0;
+    while (sent < pktsize) {
+        ssize_t n = write(_serial_fd, pkt + sent, pktsize - sent);
+        if (n > 0) {
+            sent += n;
+        } else {
+            struct pollfd pfd = { _serial_fd, POLLOUT, 0 };
+            if (poll(&pfd, 1, RPLIDAR_DEFAULT_TIMEOUT) < 1) {
+                return RESULT_OPERATION_TIMEOUT;
+            }
+        }
+    }
+
+    return RESULT_OK;
+}
+
+u_result RPLidarLinux::_startReader()
+{
+    // the first revolution is partial, so scans start at the first start bit
+    _synced = false;
+    _published_nodes = 0;
+    memset(_filling_scan, 0, _scan_size * sizeof(int));
+
+    __atomic_store_n(&_reader_stopping, false, __ATOMIC_RELAXED);
+    if (pthread_create(&_reader, NULL, _readScans, this)) {
+        return RESULT_OPERATION_FAIL;
+    }
+    _reader_running = true;
+
+    return RESULT_OK;
+}
+
+// wait up to timeout ms for the port to have data, and append what it has to the receive buffer;
+// returns the number of bytes read
+int RPLidarLinux::_fill(_u32 timeout)
+{
+    if (_rxlen == sizeof(_rxbuf)) return 0;
+
+    struct pollfd pfd = { _serial_fd, POLLIN, 0 };
+    if (poll(&pfd, 1, timeout) < 1) {
+        return 0;
+    }
+
+    ssize_t n = read(_serial_fd, _rxbuf + _rxlen, sizeof(_rxbuf) - _rxlen);
+    if (n <= 0) {
+        return 0;
+    }
+
+    _rxlen += n;
+    return (int)n;
+}
+
+// drop count bytes from the front of the receive buffer
+void RPLidarLinux::_consume(size_t count)
+{
+    memmove(_rxbuf, _rxbuf + count, _rxlen - count);
+    _rxlen -= count;
+}
+
+u_result RPLidarLinux::_waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout)
+{
+    _u32 currentTs = millis();
+    _u32 remainingtime;
+
+    while ((remainingtime=millis() - currentTs) <= timeout) {
+
+        // skip to the sync bytes, keeping a last byte that may be the first of them
+        size_t pos = 0;
+        while (pos + 1 < _rxlen &&
+               !(_rxbuf[pos] == RPLIDAR_ANS_SYNC_BYTE1 && _rxbuf[pos+1] == RPLIDAR_ANS_SYNC_BYTE2)) {
+            ++pos;
+        }
+        if (pos && pos + 1 >= _rxlen && _rxbuf[pos] != RPLIDAR_ANS_SYNC_BYTE1) {
+            ++pos;
+        }
+        _consume(pos);
+
+        if (_rxlen >= sizeof(rplidar_ans_header_t)) {
+            memcpy(header, _rxbuf, sizeof(rplidar_ans_header_t));
+            _consume(sizeof(rplidar_ans_header_t));
+            return RESULT_OK;
+        }
+
+        _fill(timeout - remainingtime);
+    }
+
+    return RESULT_OPERATION_TIMEOUT;
+}
+
+// wait for exactly size bytes of response
+u_result RPLidarLinux::_waitResponse(void * response, size_t size, _u32 timeout)
+{
+    _u32 currentTs = millis();
+    _u32 remainingtime;
+
+    while ((remainingtime=millis() - currentTs) <= timeout) {
+
+        if (_rxlen >= size) {
+            memcpy(response, _rxbuf, size);
+            _consume(size);
+            return RESULT_OK;
+        }
+
+        _fill(timeout - remainingtime);
+    }
+
+    return RESULT_OPERATION_TIMEOUT;
+}
+
+// put a node into the frame being filled, publishing the frame when a new revolution starts
+void RPLidarLinux::_addNode(const rplidar_response_measurement_node_t & node)
+{
+    _u32 angle_q6 = node.angle_q6_checkbit >> RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT;
+
+    // a start bit that does not come with the angle wrapping around from the last node, or that
+    // would end a revolution with under a third of the nodes of the last one, is a misread node
+    if ((node.sync_quality & RPLIDAR_RESP_MEASUREMENT_SYNCBIT) &&
+        (!_synced || (angle_q6 + 180*64 < _last_angle_q6 && _filling_nodes*3 >= _published_nodes))) {
+        if (_synced) {
+            _publishScan();
+            _published_nodes = _filling_nodes;
+        }
+        _filling_nodes = 0;
+        _synced = true;
+    }
+
+    _last_angle_q6 = angle_q6;
+    _filling_nodes++;
+
+    if (!_synced || !node.distance_q2) {
+        return;
+    }
+
+    // the RPLIDAR measures clockwise from its front; the frame runs counterclockwise from -180 to +180
+    _u32 ccw_q6 = (180*64 + 360*64 - angle_q6 % (360*64)) % (360*64);
+    int index = (int)((ccw_q6 * (_scan_size - 1) + 180*64) / (360*64));
+
+    int distance_mm = node.distance_q2 / 4;
+
+    // keep the nearest return in each sector
+    int & ray = _filling_scan[index];
+    if (!ray || distance_mm < ray) {
+        ray = distance_mm;
+    }
+}
+
+// hand the completed frame to grabScan() and start filling the other one
+void RPLidarLinux::_publishScan()
+{
+    pthread_mutex_lock(&_scan_mutex);
+
+    int * scan = _published_scan;
+    _published_scan = _filling_scan;
+    _filling_scan = scan;
+    _published_count++;
+
+    pthread_cond_broadcast(&_scan_cond);
+    pthread_mutex_unlock(&_scan_mutex);
+
+    memset(_filling_scan, 0, _scan_size * sizeof(int));
+}
+
+// parse every complete node in the receive buffer, returning the number of bytes used
+size_t RPLidarLinux::_parseNodes()
+{
+    const size_t nodesize = sizeof(rplidar_response_measurement_node_t);
+
+    size_t pos = 0;
+
+    while (pos + nodesize <= _rxlen) {
+
+        const _u8 * p = _rxbuf + pos;
+
+        // the sync bit and its inverse, then the check bit, mark where a node starts
+        if (!(((p[0] >> 1) ^ p[0]) & 0x1) || !(p[1] & RPLIDAR_RESP_MEASUREMENT_CHECKBIT)) {
+            ++pos;
+            continue;
+        }
+
+        rplidar_response_measurement_node_t node;
+        memcpy(&node, p, nodesize);
+        _addNode(node);
+
+        pos += nodesize;
+    }
+
+    return pos;
+}
+
+// parse every complete capsule in the receive buffer, decoding the one before each,
+// and returning the number of bytes used
+size_t RPLidarLinux::_parseCapsules()
+{
+    const size_t capsulesize = sizeof(rplidar_response_capsule_measurement_nodes_t);
+
+    size_t pos = 0;
+
+    while (pos + capsulesize <= _rxlen) {
+
+        const _u8 * p = _rxbuf + pos;
+
+        // the sync nibbles mark where a capsule starts
+        if ((p[0] >> 4) != RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1 || (p[1] >> 4) != RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2) {
+            ++pos;
+            continue;
+        }
+
+        rplidar_response_capsule_measurement_nodes_t capsule;
+        memcpy(&capsule, p, capsulesize);
+
+        // a bad checksum may just be a misplaced sync, and leaves the last capsule without an end angle
+        if (!rplidar_capsule_valid(capsule)) {
+            _capsule_ready = false;
+            ++pos;
+            continue;
+        }
+
+        // the first capsule of a scan has the sync bit, and follows no capsule of it
+        if (_capsule_ready && !(capsule.start_angle_sync_q6 & RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT)) {
+            rplidar_response_measurement_node_t nodes[RPLIDAR_CAPSULE_SAMPLES];
+            rplidar_capsule_decode(_capsule, capsule, nodes);
+            for (int k = 0; k < RPLIDAR_CAPSULE_SAMPLES; ++k) {
+                _addNode(nodes[k]);
+            }
+        }
+
+        memcpy(&_capsule, &capsule, capsulesize);
+        _capsule_ready = true;
+
+        pos += capsulesize;
+    }
+
+    return pos;
+}
+
+// reader thread: read the port in bulk and parse everything complete in what has arrived
+void * RPLidarLinux::_readScans(void * lidar)
+{
+    RPLidarLinux * self = (RPLidarLinux *)lidar;
+
+    while (!__atomic_load_n(&self->_reader_stopping, __ATOMIC_ACQUIRE)) {
+
+        if (!self->_fill(RPLIDAR_DEFAULT_TIMEOUT / 5)) {
+            continue;
+        }
+
+        self->_consume(self->_express ? self->_parseCapsules() : self->_parseNodes());
+    }
+
+    return NULL;
+}
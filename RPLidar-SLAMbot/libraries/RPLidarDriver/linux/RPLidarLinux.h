@@ -0,0 +1,136 @@
+/*
+ * RoboPeak RPLIDAR Driver for Linux
+ * RoboPeak.com
+ *
+ * Copyright (c) 2014, RoboPeak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "inc/rptypes.h"
+#include "inc/rplidar_cmd.h"
+#include "rplidar_capsule.h"
+
+// The Arduino driver's RPLidar class for a Linux host: the port is read in bulk,
+// and a reader thread assembles whole revolutions into preallocated scan frames
+// of evenly spaced distances, ready for BreezySLAM's CoreSLAM::update().
+class RPLidarLinux
+{
+public:
+    enum {
+        RPLIDAR_SERIAL_BAUDRATE = 115200,
+        RPLIDAR_DEFAULT_TIMEOUT = 500,
+        RPLIDAR_DEFAULT_SCAN_SIZE = 360,
+        RPLIDAR_RX_BUFFER_SIZE = 4096,
+    };
+
+    // scan frames have scan_size distances over the full revolution
+    RPLidarLinux(int scan_size = RPLIDAR_DEFAULT_SCAN_SIZE);
+    ~RPLidarLinux();
+
+    // open the given serial device and try to connect to the RPLIDAR
+    bool begin(const char * device);
+
+    // close the currently opened serial device
+    void end();
+
+    // check whether the serial device is opened
+    bool isOpen();
+
+    // ask the RPLIDAR for its health info
+    u_result getHealth(rplidar_response_device_health_t & healthinfo, _u32 timeout = RPLIDAR_DEFAULT_TIMEOUT);
+
+    // ask the RPLIDAR for its device info like the serial number
+    u_result getDeviceInfo(rplidar_response_device_info_t & info, _u32 timeout = RPLIDAR_DEFAULT_TIMEOUT);
+
+    // stop the measurement operation and the reader thread
+    u_result stop();
+
+    // start the measurement operation, and the reader thread that assembles the revolutions
+    u_result startScan(bool force = false, _u32 timeout = RPLIDAR_DEFAULT_TIMEOUT*2);
+
+    // start the express measurement operation, which packs twice the samples into the
+    // same baud rate (firmware 1.17 and later), and the reader thread that decodes them
+    u_result startExpressScan(_u32 timeout = RPLIDAR_DEFAULT_TIMEOUT*2);
+
+    // wait for a revolution newer than the last one grabbed, and copy its scan_size distances
+    // in mm (0 for no return) into scan_mm.  As CoreSLAM::update() expects for a Laser with
+    // this scan size and a 360-degree detection angle, they run counterclockwise from behind
+    // the sensor; each is the nearest return in its sector.  If skipped is not NULL, it gets
+    // the number of revolutions completed since the last grab and not grabbed.
+    u_result grabScan(int * scan_mm, _u32 timeout = RPLIDAR_DEFAULT_TIMEOUT*2, _u32 * skipped = NULL);
+
+    // number of rays in each scan frame
+    int getScanSize()
+    {
+        return _scan_size;
+    }
+
+protected:
+    u_result _sendCommand(_u8 cmd, const void * payload, size_t payloadsize);
+    u_result _waitResponseHeader(rplidar_ans_header_t * header, _u32 timeout);
+    u_result _waitResponse(void * response, size_t size, _u32 timeout);
+    int      _fill(_u32 timeout);
+    void     _consume(size_t count);
+    void     _addNode(const rplidar_response_measurement_node_t & node);
+    void     _publishScan();
+    size_t   _parseNodes();
+    size_t   _parseCapsules();
+    u_result _startReader();
+
+    static void * _readScans(void * lidar);
+
+protected:
+    int _serial_fd;
+    int _scan_size;
+
+    // bytes read from the port and not yet parsed
+    _u8 _rxbuf[RPLIDAR_RX_BUFFER_SIZE];
+    size_t _rxlen;
+
+    // the frame being filled by the reader thread, and the last one it completed
+    int * _filling_scan;
+    int * _published_scan;
+    bool _synced;
+    _u32 _last_angle_q6;
+    _u32 _filling_nodes;
+    _u32 _published_nodes;
+    _u32 _published_count;
+    _u32 _grabbed_count;
+
+    // express scan: the last capsule received, waiting for the next one's start angle
+    bool _express;
+    bool _capsule_ready;
+    rplidar_response_capsule_measurement_nodes_t _capsule;
+
+    pthread_t _reader;
+    bool _reader_running;
+    bool _reader_stopping;              // set by stop() while the reader runs: use __atomic builtins
+    pthread_mutex_t _scan_mutex;
+    pthread_cond_t _scan_cond;
+};
@@ -0,0 +1,93 @@
+/*
+rplidartest.cpp : test program for the Linux RPLIDAR driver
+
+Copyright (c) 2014, RoboPeak
+All rights reserved.
+
+See RPLidarLinux.h for the license.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "RPLidarLinux.h"
+
+static const char * DEVICE = "/dev/ttyUSB0";
+
+static const int    NITER  = 20;
+
+int main(int argc, char ** argv)
+{
+    const char * device = argc > 1 ? argv[1] : DEVICE;
+
+    RPLidarLinux lidar;
+
+    if (!lidar.begin(device))
+    {
+        fprintf(stderr, "Unable to open %s\n", device);
+        return 1;
+    }
+
+    rplidar_response_device_info_t info;
+    if (IS_OK(lidar.getDeviceInfo(info)))
+    {
+        printf("Model: %d  Firmware: %d.%02d  Hardware: %d  Serial: ",
+                info.model, info.firmware_version >> 8, info.firmware_version & 0xFF, info.hardware_version);
+        for (int k=0; k<16; ++k)
+        {
+            printf("%02X", info.serialnum[k]);
+        }
+        printf("\n");
+    }
+    else
+    {
+        printf("=== NO DEVICE INFO ===\n");
+    }
+
+    rplidar_response_device_health_t health;
+    if (IS_OK(lidar.getHealth(health)))
+    {
+        printf("Health: %d  Error code: %d\n", health.status, health.error_code);
+    }
+    else
+    {
+        printf("=== NO HEALTH INFO ===\n");
+    }
+
+    // "express" as a second argument asks for express scans
+    bool express = argc > 2 && !strcmp(argv[2], "express");
+
+    if (IS_FAIL(express ? lidar.startExpressScan() : lidar.startScan()))
+    {
+        fprintf(stderr, "Unable to start scanning\n");
+        return 1;
+    }
+
+    int scan[RPLidarLinux::RPLIDAR_DEFAULT_SCAN_SIZE];
+
+    for (int i=1; i<=NITER; i++)
+    {
+        _u32 skipped = 0;
+
+        printf("Iteration: %3d: ", i);
+
+        if (IS_OK(lidar.grabScan(scan, RPLidarLinux::RPLIDAR_DEFAULT_TIMEOUT*2, &skipped)))
+        {
+            int ndata = 0;
+            for (int k=0; k<lidar.getScanSize(); ++k)
+            {
+                ndata += scan[k] != 0;
+            }
+
+            printf("got %3d data points, skipped %u revolutions\n", ndata, skipped);
+        }
+        else
+        {
+            printf("=== SCAN FAILED ===\n");
+        }
+    }
+
+    lidar.end();
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * RoboPeak RPLIDAR Driver
+ * Express scan capsule decoding, shared by the Arduino and Linux drivers
+ *
+ * Copyright (c) 2014, RoboPeak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "rplidar_capsule.h"
+
+// angles in q6 and q16, as 32 bits even where int is 16
+static const _s32 REVOLUTION_Q6  = (_s32)360 << 6;
+static const _s32 REVOLUTION_Q16 = (_s32)360 << 16;
+
+static const _u8 CAPSULE_QUALITY = 0x2F;
+
+// check the sync nibbles and the checksum of a received capsule
+bool rplidar_capsule_valid(const rplidar_response_capsule_measurement_nodes_t & capsule)
+{
+    const _u8 * capsulebuf = (const _u8 *)&capsule;
+
+    if ((capsule.s_checksum_1 >> 4) != RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_1 ||
+        (capsule.s_checksum_2 >> 4) != RPLIDAR_RESP_MEASUREMENT_EXP_SYNC_2) {
+        return false;
+    }
+
+    // the checksum covers everything after the two sync bytes
+    _u8 checksum = 0;
+    for (size_t pos = 2; pos < sizeof(capsule); ++pos) {
+        checksum ^= capsulebuf[pos];
+    }
+
+    return checksum == ((capsule.s_checksum_1 & 0xF) | ((capsule.s_checksum_2 & 0xF) << 4));
+}
+
+// decode the samples of a capsule into the nodes a normal scan would have sent,
+// given the capsule that followed it
+void rplidar_capsule_decode(const rplidar_response_capsule_measurement_nodes_t & capsule,
+                            const rplidar_response_capsule_measurement_nodes_t & next,
+                            rplidar_response_measurement_node_t * nodes)
+{
+    // the samples are evenly spaced from this capsule's start angle to the next one's
+    _s32 start_q8 = (_s32)(capsule.start_angle_sync_q6 & ~RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) << 2;
+    _s32 next_q8  = (_s32)(next.start_angle_sync_q6 & ~RPLIDAR_RESP_MEASUREMENT_EXP_SYNCBIT) << 2;
+
+    _s32 delta_q8 = next_q8 - start_q8;
+    if (delta_q8 < 0) {
+        delta_q8 += REVOLUTION_Q6 << 2;
+    }
+
+    // delta_q8 << 8 / RPLIDAR_CAPSULE_SAMPLES
+    _s32 increment_q16 = delta_q8 << 3;
+    _s32 start_q16 = start_q8 << 8;
+
+    // Unpack the cabins, then work on the samples as flat arrays, without branches,
+    // so that a vectorizing compiler can take them several at a time
+    _u16 distance_q2[RPLIDAR_CAPSULE_SAMPLES];
+    _u8  offset_q3[RPLIDAR_CAPSULE_SAMPLES];
+
+    for (int k = 0; k < RPLIDAR_RESP_MEASUREMENT_EXP_CABINS; ++k) {
+        const rplidar_response_cabin_nodes_t & cabin = capsule.cabins[k];
+
+        distance_q2[2*k]   = cabin.distance_angle_1 & RPLIDAR_RESP_MEASUREMENT_EXP_DISTANCE_MASK;
+        distance_q2[2*k+1] = cabin.distance_angle_2 & RPLIDAR_RESP_MEASUREMENT_EXP_DISTANCE_MASK;
+
+        offset_q3[2*k]   = (cabin.offset_angles_q3 & 0xF) | ((cabin.distance_angle_1 & RPLIDAR_RESP_MEASUREMENT_EXP_ANGLE_MASK) << 4);
+        offset_q3[2*k+1] = (cabin.offset_angles_q3 >> 4)  | ((cabin.distance_angle_2 & RPLIDAR_RESP_MEASUREMENT_EXP_ANGLE_MASK) << 4);
+    }
+
+    _u16 angle_q6[RPLIDAR_CAPSULE_SAMPLES];
+    _u8  sync[RPLIDAR_CAPSULE_SAMPLES];
+
+    for (int k = 0; k < RPLIDAR_CAPSULE_SAMPLES; ++k) {
+        _s32 raw_q16 = start_q16 + k * increment_q16;
+
+        // each sample has its own offset back from its share of the angle
+        _s32 angle = (raw_q16 - ((_s32)offset_q3[k] << 13)) >> 10;
+        angle += (angle < 0) * REVOLUTION_Q6;
+        angle -= (angle >= REVOLUTION_Q6) * REVOLUTION_Q6;
+        angle_q6[k] = (_u16)angle;
+
+        // a new revolution starts with the first sample past zero
+        _s32 wrapped_q16 = raw_q16 - (raw_q16 >= REVOLUTION_Q16) * REVOLUTION_Q16;
+        sync[k] = wrapped_q16 < increment_q16;
+    }
+
+    for (int k = 0; k < RPLIDAR_CAPSULE_SAMPLES; ++k) {
+        nodes[k].sync_quality = sync[k] | ((!sync[k]) << 1) |
+            ((distance_q2[k] ? CAPSULE_QUALITY : 0) << RPLIDAR_RESP_MEASUREMENT_QUALITY_SHIFT);
+        nodes[k].angle_q6_checkbit = (angle_q6[k] << RPLIDAR_RESP_MEASUREMENT_ANGLE_SHIFT) | RPLIDAR_RESP_MEASUREMENT_CHECKBIT;
+        nodes[k].distance_q2 = distance_q2[k];
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * RoboPeak RPLIDAR Driver
+ * Express scan capsule decoding, shared by the Arduino and Linux drivers
+ *
+ * Copyright (c) 2014, RoboPeak
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include "inc/rptypes.h"
+#include "inc/rplidar_cmd.h"
+
+// An express scan capsule carries two samples in each of its cabins.  Their angles
+// run from the capsule's start angle to the next capsule's, so a capsule can only be
+// decoded once the one after it has arrived.
+#define RPLIDAR_CAPSULE_SAMPLES (RPLIDAR_RESP_MEASUREMENT_EXP_CABINS*2)
+
+// check the sync nibbles and the checksum of a received capsule
+bool rplidar_capsule_valid(const rplidar_response_capsule_measurement_nodes_t & capsule);
+
+// decode the samples of a capsule into the nodes a normal scan would have sent,
+// given the capsule that followed it
+void rplidar_capsule_decode(const rplidar_response_capsule_measurement_nodes_t & capsule,
+                            const rplidar_response_capsule_measurement_nodes_t & next,
+                            rplidar_response_measurement_node_t * nodes);
@@ -18,6 +18,8 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
+from array import array
+
 from tools import coerceToRange
 from breezyslam.algorithms import RMHC_SLAM
 
@@ -54,18 +56,20 @@ class Slam(RMHC_SLAM):
     return self.breezyMap
 
   def updateSlam(self, points): # 15ms
-    distVec = [0 for i in range(self.scanSize)]
-
-    for point in points: # create breezySLAM-compatible data from raw scan data
-      dist = point[0]
-      index = int(point[1])
-      if not 0 <= index < self.scanSize: continue
-      distVec[index] = int(dist)
+    # each point is used at its own angle rather than binned into scanSize rays; point angles are degrees
+    # from straight ahead, as breezySLAM's are, so they need no rotation (360 and up wrap around)
+    dists = array('i', (int(point[0]) for point in points)) # C ints and doubles, passed to BreezySLAM without conversion
+    angles = array('d', (point[1] for point in points))
 
     # note that breezySLAM switches the x- and y- axes (their x is forward, 0deg; y is right, +90deg)
-    if self.logFile: self.logFile.write(' '.join((str(el) for el in list(self.currEncPos)+distVec)) + '\n')
-    distVec = [distVec[i-180] for i in range(self.scanSize)] # rotate scan data so middle of vector is straight ahead, 0deg
-    self.update(distVec, self.getVelocities() if self.USE_ODOMETRY else None) # 10ms
+    if self.logFile:
+      distVec = [0] * self.scanSize # the log keeps its one-distance-per-degree format
+      for point in points:
+        index = int(point[1])
+        if 0 <= index < self.scanSize: distVec[index] = int(point[0])
+      self.logFile.write(' '.join((str(el) for el in list(self.currEncPos)+distVec)) + '\n')
+
+    self.update(dists, self.getVelocities() if self.USE_ODOMETRY else None, scan_angles_degrees=angles) # 10ms
     x, y, theta = self.getpos()
 
     self.getmap(self.breezyMap) # write internal map to breezyMap